@@ -0,0 +1,227 @@
+#include "bench.h"
+#include "../src/interface/progress.h"
+#include <chrono>
+#include <map>
+#include <algorithm>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+
+/*
+ * Microbenchmarks of the kernels of the library.
+ *
+ * Usage: dypc_bench [--repeats N] [--output FILE] [--baseline FILE] [--tolerance T] [FILTER...]
+ *
+ * Runs each benchmark whose name contains one of the filters (all when none given) once to warm up, and then N times
+ * (default 5). Writes one line of JSON per benchmark to standard output, and to the output file if given. The time per
+ * item of the fastest run is the measured value, as it is the least affected by other load on the machine.
+ * When a baseline file (the output of a previous run) is given, each benchmark whose time per item got slower by more
+ * than the tolerance (default 0.1, i.e. 10%) is reported on standard error, and the exit status is 1.
+ */
+
+namespace dypc {
+namespace bench {
+
+namespace {
+
+struct benchmark {
+	std::string name;
+	benchmark_body_t body;
+};
+
+struct result {
+	std::string name;
+	std::size_t items = 0;
+	std::size_t repeats = 0;
+	double min_ns_per_item = 0;
+	double median_ns_per_item = 0;
+};
+
+std::vector<void (*)()>& groups_() {
+	static std::vector<void (*)()> groups;
+	return groups;
+}
+
+std::vector<benchmark>& benchmarks_() {
+	static std::vector<benchmark> benchmarks;
+	return benchmarks;
+}
+
+volatile std::size_t size_sink_;
+volatile float float_sink_;
+
+
+/// Progress callbacks that output nothing, so that standard output remains machine-readable.
+const dypc_progress_callbacks silent_progress_callbacks_ = {
+	[](const char*, unsigned, dypc_progress) -> dypc_progress { return nullptr; },
+	[](dypc_progress) { },
+	[](dypc_progress, unsigned) { },
+	[](dypc_progress) { },
+	[](dypc_progress, const char*) { }
+};
+
+
+result run_(const benchmark& bm, std::size_t repeats) {
+	using clock = std::chrono::steady_clock;
+
+	result res;
+	res.name = bm.name;
+	res.repeats = repeats;
+	res.items = bm.body(); // Warm up caches and allocator
+	if(res.items == 0) throw std::logic_error("Benchmark " + bm.name + " processed no items");
+
+	std::vector<double> ns_per_item;
+	for(std::size_t i = 0; i < repeats; ++i) {
+		clock::time_point start = clock::now();
+		std::size_t items = bm.body();
+		double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+		ns_per_item.push_back(ns / items);
+	}
+
+	std::sort(ns_per_item.begin(), ns_per_item.end());
+	res.min_ns_per_item = ns_per_item.front();
+	res.median_ns_per_item = ns_per_item[ns_per_item.size() / 2];
+	return res;
+}
+
+
+std::string to_json_(const result& res) {
+	std::ostringstream str;
+	str << std::setprecision(6);
+	str << "{\"name\":\"" << res.name << "\""
+		<< ",\"items\":" << res.items
+		<< ",\"repeats\":" << res.repeats
+		<< ",\"min_ns_per_item\":" << res.min_ns_per_item
+		<< ",\"median_ns_per_item\":" << res.median_ns_per_item << "}";
+	return str.str();
+}
+
+
+/// Read name and min_ns_per_item of each line of a previous output. Only needs to understand what to_json_ writes.
+std::map<std::string, double> read_baseline_(const std::string& filename) {
+	std::ifstream file(filename);
+	if(! file) throw std::runtime_error("Could not open baseline file " + filename);
+
+	std::map<std::string, double> baseline;
+	std::string line;
+	while(std::getline(file, line)) {
+		static const std::string name_key = "\"name\":\"", time_key = "\"min_ns_per_item\":";
+		auto name_pos = line.find(name_key);
+		auto time_pos = line.find(time_key);
+		if(name_pos == std::string::npos || time_pos == std::string::npos) continue;
+		name_pos += name_key.size();
+		std::string name = line.substr(name_pos, line.find('"', name_pos) - name_pos);
+		baseline[name] = std::strtod(line.c_str() + time_pos + time_key.size(), nullptr);
+	}
+	return baseline;
+}
+
+
+bool matches_filters_(const std::string& name, const std::vector<std::string>& filters) {
+	if(filters.empty()) return true;
+	for(const std::string& filter : filters) if(name.find(filter) != std::string::npos) return true;
+	return false;
+}
+
+}
+
+
+void register_benchmark(const std::string& name, const benchmark_body_t& body) {
+	benchmarks_().push_back(benchmark { name, body });
+}
+
+
+benchmark_group::benchmark_group(void (*registration)()) {
+	groups_().push_back(registration);
+}
+
+
+void do_not_optimize(std::size_t value) {
+	size_sink_ = value;
+}
+
+
+void do_not_optimize(float value) {
+	float_sink_ = value;
+}
+
+
+std::vector<point> synthetic_points(std::size_t n, random_generator_t::result_type seed, float side) {
+	random_generator_t random_generator(seed);
+	std::uniform_real_distribution<float> coordinate(0.0, side);
+	std::uniform_int_distribution<int> color(0, 255);
+
+	std::vector<point> points;
+	points.reserve(n);
+	for(std::size_t i = 0; i < n; ++i) {
+		float x = coordinate(random_generator), y = coordinate(random_generator), z = coordinate(random_generator);
+		points.emplace_back(x, y, z, color(random_generator), color(random_generator), color(random_generator));
+	}
+	return points;
+}
+
+}
+}
+
+
+int main(int argc, const char* argv[]) {
+	using namespace dypc::bench;
+
+	std::size_t repeats = 5;
+	std::string output_filename, baseline_filename;
+	double tolerance = 0.1;
+	std::vector<std::string> filters;
+
+	for(int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		bool has_value = (i + 1 < argc);
+		if(arg == "--repeats" && has_value) repeats = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+		else if(arg == "--output" && has_value) output_filename = argv[++i];
+		else if(arg == "--baseline" && has_value) baseline_filename = argv[++i];
+		else if(arg == "--tolerance" && has_value) tolerance = std::strtod(argv[++i], nullptr);
+		else if(arg.substr(0, 2) == "--") {
+			std::cerr << "Usage: " << argv[0] << " [--repeats N] [--output FILE] [--baseline FILE] [--tolerance T] [FILTER...]" << std::endl;
+			return 2;
+		} else filters.push_back(arg);
+	}
+
+	try {
+		std::map<std::string, double> baseline;
+		if(! baseline_filename.empty()) baseline = read_baseline_(baseline_filename);
+
+		std::ofstream output;
+		if(! output_filename.empty()) {
+			output.open(output_filename);
+			if(! output) throw std::runtime_error("Could not open output file " + output_filename);
+		}
+
+		dypc_current_progress_callbacks = silent_progress_callbacks_;
+		for(auto registration : groups_()) registration();
+
+		std::size_t regressions = 0;
+		for(const benchmark& bm : benchmarks_()) {
+			if(! matches_filters_(bm.name, filters)) continue;
+
+			result res = run_(bm, repeats);
+			std::string line = to_json_(res);
+			std::cout << line << std::endl;
+			if(output.is_open()) output << line << std::endl;
+
+			auto it = baseline.find(bm.name);
+			if(it != baseline.end() && res.min_ns_per_item > it->second * (1.0 + tolerance)) {
+				std::cerr << "Regression: " << bm.name << " takes " << res.min_ns_per_item << " ns per item, baseline " << it->second << std::endl;
+				++regressions;
+			}
+		}
+
+		return (regressions == 0 ? 0 : 1);
+	} catch(const std::exception& ex) {
+		std::cerr << ex.what() << std::endl;
+		return 2;
+	}
+}
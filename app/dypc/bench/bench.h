@@ -0,0 +1,55 @@
+#ifndef DYPC_BENCH_H_
+#define DYPC_BENCH_H_
+
+#include "../src/point.h"
+#include "../src/util.h"
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace dypc {
+namespace bench {
+
+/**
+ * Body of a benchmark.
+ * Runs the measured kernel once over its whole input, and returns the number of items it processed. Inputs are
+ * prepared before the benchmark gets registered, or in the setup of its body before the measured part.
+ */
+using benchmark_body_t = std::function<std::size_t()>;
+
+/**
+ * Register benchmark.
+ * @param name Unique name, used to match results with the baseline.
+ * @param body Body of the benchmark.
+ */
+void register_benchmark(const std::string& name, const benchmark_body_t& body);
+
+/**
+ * Registers a group of benchmarks at static initialization.
+ * The function gets called by main, so that the synthetic inputs are generated after startup rather than during static
+ * initialization.
+ */
+struct benchmark_group {
+	explicit benchmark_group(void (*registration)());
+};
+
+/**
+ * Consume value so that the compiler cannot drop the computation that produced it.
+ */
+void do_not_optimize(std::size_t value);
+void do_not_optimize(float value);
+
+/**
+ * Generate random point set.
+ * Always generates the same points for the same arguments.
+ * @param n Number of points.
+ * @param seed Seed of random generator.
+ * @param side Points lie in cube from origin with this side length.
+ */
+std::vector<point> synthetic_points(std::size_t n, random_generator_t::result_type seed = 1, float side = 1.0);
+
+}
+}
+
+#endif
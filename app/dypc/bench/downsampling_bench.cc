@@ -0,0 +1,52 @@
+#include "bench.h"
+#include "../src/downsampling.h"
+#include "../src/geometry/cuboid.h"
+#include <memory>
+#include <iterator>
+
+namespace dypc {
+namespace bench {
+
+namespace {
+
+constexpr std::size_t number_of_points_ = 1 << 20;
+constexpr std::size_t expected_number_of_points_ = number_of_points_ / 16;
+
+
+void register_() {
+	auto points = std::make_shared<std::vector<point>>(synthetic_points(number_of_points_, 5));
+	cuboid bounding_cuboid(glm::vec3(0, 0, 0), 1.0);
+
+	// Per input point: the bisection makes several passes over the whole input.
+	register_benchmark("uniform_downsampling", [points, bounding_cuboid]() -> std::size_t {
+		std::vector<point> output;
+		uniform_downsampling(points->begin(), points->end(), expected_number_of_points_, bounding_cuboid, std::back_inserter(output));
+		do_not_optimize(output.size());
+		return points->size();
+	});
+
+	// Single pass of the bisection, so that changes of the pass and of the number of passes can be told apart.
+	register_benchmark("uniform_downsampling_with_side_length", [points]() -> std::size_t {
+		std::vector<point> output;
+		auto inserter = std::back_inserter(output);
+		uniform_downsampling_with_side_length(points->begin(), points->end(), 1.0f / 40.0f, inserter);
+		do_not_optimize(output.size());
+		return points->size();
+	});
+
+	// Per output point: skips directly between the chosen points.
+	register_benchmark("random_downsampling", [points]() -> std::size_t {
+		std::vector<point> output;
+		output.reserve(expected_number_of_points_);
+		random_downsampling(points->begin(), points->end(), expected_number_of_points_, std::back_inserter(output));
+		do_not_optimize(output.size());
+		return output.size();
+	});
+}
+
+benchmark_group group_(&register_);
+
+}
+
+}
+}
@@ -0,0 +1,81 @@
+#include "bench.h"
+#include "../src/geometry/cuboid.h"
+#include "../src/geometry/frustum.h"
+#include <random>
+#include <memory>
+
+namespace dypc {
+namespace bench {
+
+namespace {
+
+constexpr std::size_t number_of_cuboids_ = 1 << 20;
+constexpr std::size_t number_of_positions_ = 1 << 10;
+
+/// Cuboids scattered around the camera, so that all three intersection types occur.
+std::shared_ptr<std::vector<cuboid>> make_cuboids_() {
+	random_generator_t random_generator(2);
+	std::uniform_real_distribution<float> coordinate(-100.0, 100.0);
+	std::uniform_real_distribution<float> side(0.5, 20.0);
+
+	auto cuboids = std::make_shared<std::vector<cuboid>>();
+	cuboids->reserve(number_of_cuboids_);
+	for(std::size_t i = 0; i < number_of_cuboids_; ++i) {
+		glm::vec3 origin(coordinate(random_generator), coordinate(random_generator), coordinate(random_generator));
+		glm::vec3 sides(side(random_generator), side(random_generator), side(random_generator));
+		cuboids->emplace_back(origin, sides);
+	}
+	return cuboids;
+}
+
+
+std::shared_ptr<std::vector<glm::vec3>> make_positions_() {
+	random_generator_t random_generator(3);
+	std::uniform_real_distribution<float> coordinate(-100.0, 100.0);
+
+	auto positions = std::make_shared<std::vector<glm::vec3>>();
+	for(std::size_t i = 0; i < number_of_positions_; ++i)
+		positions->emplace_back(coordinate(random_generator), coordinate(random_generator), coordinate(random_generator));
+	return positions;
+}
+
+
+/// Distance from each position to a different cuboid each time, as a loader does when it visits the nodes of a tree.
+template<float (cuboid::*Distance)(glm::vec3) const>
+benchmark_body_t distance_benchmark_(std::shared_ptr<std::vector<cuboid>> cuboids, std::shared_ptr<std::vector<glm::vec3>> positions) {
+	return [cuboids, positions]() -> std::size_t {
+		float sum = 0;
+		std::size_t n = cuboids->size();
+		for(std::size_t i = 0; i < n; ++i) sum += ((*cuboids)[i].*Distance)((*positions)[i % number_of_positions_]);
+		do_not_optimize(sum);
+		return n;
+	};
+}
+
+
+void register_() {
+	auto cuboids = make_cuboids_();
+	auto positions = make_positions_();
+
+	glm::mat4 view_projection_matrix =
+		glm::perspective(60.0f, 4.0f/3.0f, 0.1f, 1000.0f) *
+		glm::lookAt(glm::vec3(0, 0, -50), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+	frustum fr(view_projection_matrix);
+
+	register_benchmark("frustum::contains_cuboid", [cuboids, fr]() -> std::size_t {
+		std::size_t counts[3] = { 0, 0, 0 };
+		for(const cuboid& cub : *cuboids) ++counts[fr.contains_cuboid(cub)];
+		do_not_optimize(counts[frustum::inside_frustum] + counts[frustum::partially_inside_frustum]);
+		return cuboids->size();
+	});
+
+	register_benchmark("cuboid::minimal_distance", distance_benchmark_<&cuboid::minimal_distance>(cuboids, positions));
+	register_benchmark("cuboid::maximal_distance", distance_benchmark_<&cuboid::maximal_distance>(cuboids, positions));
+}
+
+benchmark_group group_(&register_);
+
+}
+
+}
+}
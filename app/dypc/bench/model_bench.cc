@@ -0,0 +1,158 @@
+#include "bench.h"
+#include "../src/model/model.h"
+#include "../src/model/ply_model.h"
+#include <memory>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+
+namespace dypc {
+namespace bench {
+
+namespace {
+
+constexpr std::size_t number_of_points_ = 1 << 20;
+
+
+/**
+ * Model whose points are held in memory.
+ * Its handle only copies points, so that iterating over it measures the overhead of model::iterator.
+ */
+class memory_model : public model {
+private:
+	class handle : public model::handle {
+	private:
+		const memory_model& model_;
+		std::size_t position_ = 0;
+
+	public:
+		explicit handle(const memory_model& mod) : model_(mod) { }
+
+		std::size_t read(point* buffer, std::size_t n) override {
+			n = std::min(n, model_.points_.size() - position_);
+			std::copy_n(model_.points_.begin() + position_, n, buffer);
+			position_ += n;
+			return n;
+		}
+
+		bool eof() override {
+			return (position_ == model_.points_.size());
+		}
+
+		std::unique_ptr<model::handle> clone() override {
+			handle* h = new handle(model_);
+			h->position_ = position_;
+			return std::unique_ptr<model::handle>(h);
+		}
+	};
+
+	std::vector<point> points_;
+
+protected:
+	std::unique_ptr<model::handle> make_handle_() override {
+		return std::unique_ptr<model::handle>(new handle(*this));
+	}
+
+public:
+	explicit memory_model(std::vector<point>&& points) : points_(std::move(points)) {
+		number_of_points_ = points_.size();
+	}
+};
+
+
+/**
+ * Temporary PLY file holding points, in given byte order.
+ * Has an additional property that the reader must skip, as files from scanners usually do.
+ */
+class ply_file {
+private:
+	std::string filename_;
+
+public:
+	ply_file(const std::vector<point>& points, bool little_endian) {
+		char filename[] = "/tmp/dypc_bench_XXXXXX";
+		int fd = mkstemp(filename);
+		if(fd == -1) throw std::runtime_error("Could not create temporary PLY file");
+		close(fd);
+		filename_ = filename;
+
+		std::ofstream file(filename_, std::ios_base::binary);
+		file << "ply\n"
+			<< "format " << (little_endian ? "binary_little_endian" : "binary_big_endian") << " 1.0\n"
+			<< "element vertex " << points.size() << "\n"
+			<< "property float x\n" << "property float y\n" << "property float z\n"
+			<< "property float confidence\n"
+			<< "property uchar red\n" << "property uchar green\n" << "property uchar blue\n"
+			<< "end_header\n";
+
+		const std::uint16_t byte_order_test = 1;
+		bool host_is_little_endian = (*reinterpret_cast<const std::uint8_t*>(&byte_order_test) == 1);
+		auto write_float = [&](float f) {
+			char buf[4];
+			std::memcpy(buf, &f, 4);
+			if(host_is_little_endian != little_endian) std::reverse(buf, buf + 4);
+			file.write(buf, 4);
+		};
+		for(const point& pt : points) {
+			write_float(pt.x);
+			write_float(pt.y);
+			write_float(pt.z);
+			write_float(1.0);
+			file.put(pt.r).put(pt.g).put(pt.b);
+		}
+		if(! file) throw std::runtime_error("Could not write temporary PLY file");
+	}
+
+	ply_file(const ply_file&) = delete;
+
+	~ply_file() {
+		std::remove(filename_.c_str());
+	}
+
+	const std::string& filename() const { return filename_; }
+};
+
+
+std::size_t iterate_(model& mod) {
+	std::size_t n = 0;
+	float sum = 0;
+	for(const point& pt : mod) {
+		sum += pt.x;
+		++n;
+	}
+	do_not_optimize(sum);
+	return n;
+}
+
+
+void register_() {
+	std::vector<point> points = synthetic_points(number_of_points_, 6);
+	auto little_endian_file = std::make_shared<ply_file>(points, true);
+	auto big_endian_file = std::make_shared<ply_file>(points, false);
+	auto mod = std::make_shared<memory_model>(std::move(points));
+
+	// Includes reading the file. It stays in the page cache after the warm up run, so that decoding dominates.
+	register_benchmark("ply_model little endian", [little_endian_file]() -> std::size_t {
+		ply_model ply(little_endian_file->filename(), 1.0);
+		return iterate_(ply);
+	});
+	register_benchmark("ply_model big endian", [big_endian_file]() -> std::size_t {
+		ply_model ply(big_endian_file->filename(), 1.0);
+		return iterate_(ply);
+	});
+
+	register_benchmark("model::iterator", [mod]() -> std::size_t {
+		return iterate_(*mod);
+	});
+}
+
+benchmark_group group_(&register_);
+
+}
+
+}
+}
@@ -0,0 +1,86 @@
+#include "bench.h"
+#include "../src/structure/tree/octree/octree_structure_splitter.h"
+#include "../src/structure/tree/kdtree/kdtree_structure_splitter.h"
+#include "../src/structure/tree/kdtree_half/kdtree_half_structure_splitter.h"
+#include "../src/geometry/cuboid.h"
+#include <memory>
+#include <type_traits>
+#include <cstdint>
+
+namespace dypc {
+namespace bench {
+
+namespace {
+
+constexpr std::size_t number_of_points_ = 1 << 20;
+constexpr unsigned number_of_depths_ = 3; ///< Depths 0, 1, 2 cover the three split axes of the k-d trees.
+
+
+/// Same points as coordinate arrays, as taken by node_children_for_points.
+struct coordinates {
+	std::vector<float> x, y, z;
+};
+
+
+template<class Splitter>
+void register_splitter_(const std::string& name, std::shared_ptr<std::vector<point>> points, std::shared_ptr<coordinates> coords) {
+	using node_points_information = typename Splitter::node_points_information;
+	cuboid root_cuboid = Splitter::adjust_root_cuboid(cuboid(glm::vec3(0, 0, 0), 1.0));
+
+	auto infos = std::make_shared<std::vector<node_points_information>>();
+	for(unsigned depth = 0; depth < number_of_depths_; ++depth)
+		infos->push_back(Splitter::compute_node_points_information(points->begin(), points->end(), root_cuboid, depth));
+
+	// Splitters that store no information with the nodes inherit a compute_node_points_information that does nothing.
+	if(! std::is_same<node_points_information, tree_structure_splitter::node_points_information>::value)
+	register_benchmark(name + "::compute_node_points_information", [points, root_cuboid]() -> std::size_t {
+		node_points_information info = Splitter::compute_node_points_information(points->begin(), points->end(), root_cuboid, 0);
+		do_not_optimize(sizeof(info));
+		return points->size();
+	});
+
+	register_benchmark(name + "::node_child_for_point", [points, infos, root_cuboid]() -> std::size_t {
+		std::size_t sum = 0;
+		std::size_t n = points->size();
+		for(std::size_t i = 0; i < n; ++i) {
+			unsigned depth = i % number_of_depths_;
+			sum += Splitter::node_child_for_point((*points)[i], root_cuboid, (*infos)[depth], depth);
+		}
+		do_not_optimize(sum);
+		return n;
+	});
+
+	register_benchmark(name + "::node_children_for_points", [coords, infos, root_cuboid]() -> std::size_t {
+		std::size_t n = coords->x.size();
+		std::vector<std::uint8_t> children(n);
+		std::size_t sum = 0;
+		for(unsigned depth = 0; depth < number_of_depths_; ++depth) {
+			Splitter::node_children_for_points(coords->x.data(), coords->y.data(), coords->z.data(), n, root_cuboid, (*infos)[depth], depth, children.data());
+			sum += children[n / 2];
+		}
+		do_not_optimize(sum);
+		return n * number_of_depths_;
+	});
+}
+
+
+void register_() {
+	auto points = std::make_shared<std::vector<point>>(synthetic_points(number_of_points_, 4));
+	auto coords = std::make_shared<coordinates>();
+	for(const point& pt : *points) {
+		coords->x.push_back(pt.x);
+		coords->y.push_back(pt.y);
+		coords->z.push_back(pt.z);
+	}
+
+	register_splitter_<octree_structure_splitter>("octree_structure_splitter", points, coords);
+	register_splitter_<kdtree_structure_splitter>("kdtree_structure_splitter", points, coords);
+	register_splitter_<kdtree_half_structure_splitter>("kdtree_half_structure_splitter", points, coords);
+}
+
+benchmark_group group_(&register_);
+
+}
+
+}
+}
@@ -0,0 +1,252 @@
+#include "build_report.h"
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <exception>
+#include <cstdio>
+#include <ctime>
+
+namespace dypc {
+
+/// Values of stages with the same label and parent, summed over all times they were open.
+struct build_stage_record {
+	std::string label;
+	std::size_t calls = 0;
+	double wall_seconds = 0;
+	double cpu_seconds = 0;
+	double thread_cpu_seconds = 0;
+	std::uint64_t bytes_read = 0;
+	std::uint64_t bytes_written = 0;
+	std::uint64_t peak_rss = 0;
+	std::map<std::string, double> counters;
+	std::vector<std::unique_ptr<build_stage_record>> children; ///< In order in which they were first opened.
+};
+
+
+static std::mutex report_mutex_; ///< Held while modifying records, or the following state.
+static std::string report_file_;
+static std::vector<build_stage*> open_stages_; ///< Stages of the reports that are open, in any thread.
+
+
+build_stage_record*& current_build_stage_() {
+	static thread_local build_stage_record* current = nullptr;
+	return current;
+}
+
+
+static double clock_seconds_(clockid_t clk) {
+	timespec ts;
+	if(clock_gettime(clk, &ts) != 0) return 0;
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/// Bytes read and written by the process, including reads served from the page cache.
+static void io_bytes_(std::uint64_t& read, std::uint64_t& written) {
+	read = written = 0;
+	std::FILE* file = std::fopen("/proc/self/io", "r");
+	if(! file) return;
+	char key[32];
+	unsigned long long value;
+	while(std::fscanf(file, "%31[^:]: %llu\n", key, &value) == 2) {
+		if(std::string(key) == "rchar") read = value;
+		else if(std::string(key) == "wchar") written = value;
+	}
+	std::fclose(file);
+}
+
+
+/// Peak resident memory of the process in bytes, since it started or since the last reset.
+static std::uint64_t read_peak_rss_() {
+	std::FILE* file = std::fopen("/proc/self/status", "r");
+	if(! file) return 0;
+	char line[256];
+	unsigned long long kb = 0;
+	while(std::fgets(line, sizeof(line), file))
+		if(std::sscanf(line, "VmHWM: %llu kB", &kb) == 1) break;
+	std::fclose(file);
+	return kb * 1024;
+}
+
+
+/// Reset the peak resident memory to the current one. Not possible on all systems, then the peak stays monotonic.
+static void reset_peak_rss_() {
+	std::FILE* file = std::fopen("/proc/self/clear_refs", "w");
+	if(! file) return;
+	std::fputs("5", file);
+	std::fclose(file);
+}
+
+
+/// Key under which stages get merged: label without details after the last ellipsis.
+static std::string stage_key_(const std::string& label) {
+	auto pos = label.rfind("...");
+	if(pos == std::string::npos) return label;
+	else return label.substr(0, pos + 3);
+}
+
+
+static void write_json_string_(std::ostream& str, const std::string& s) {
+	str << '"';
+	for(char c : s) {
+		if(c == '"' || c == '\\') str << '\\' << c;
+		else if((unsigned char)c < 0x20) str << ' ';
+		else str << c;
+	}
+	str << '"';
+}
+
+
+static void write_stage_json_(std::ostream& str, const build_stage_record& rec) {
+	str << "\"label\":";
+	write_json_string_(str, rec.label);
+	str << ",\"calls\":" << rec.calls
+		<< ",\"wall_seconds\":" << rec.wall_seconds
+		<< ",\"cpu_seconds\":" << rec.cpu_seconds
+		<< ",\"thread_cpu_seconds\":" << rec.thread_cpu_seconds
+		<< ",\"bytes_read\":" << rec.bytes_read
+		<< ",\"bytes_written\":" << rec.bytes_written
+		<< ",\"peak_rss\":" << rec.peak_rss;
+
+	str << ",\"counters\":{";
+	for(auto it = rec.counters.begin(); it != rec.counters.end(); ++it) {
+		if(it != rec.counters.begin()) str << ',';
+		write_json_string_(str, it->first);
+		str << ':' << it->second;
+	}
+	str << "},\"stages\":[";
+	for(auto it = rec.children.begin(); it != rec.children.end(); ++it) {
+		if(it != rec.children.begin()) str << ',';
+		str << '{';
+		write_stage_json_(str, **it);
+		str << '}';
+	}
+	str << ']';
+}
+
+
+void set_build_report_file(const std::string& path) {
+	std::lock_guard<std::mutex> lock(report_mutex_);
+	report_file_ = path;
+}
+
+
+void add_build_counter(const std::string& name, double value) {
+	build_stage_record* rec = current_build_stage_();
+	if(! rec) return;
+	std::lock_guard<std::mutex> lock(report_mutex_);
+	rec->counters[name] += value;
+}
+
+
+void build_stage::sample_peak_rss_() {
+	// Every open stage gets the peak since the previous sample, and sampling happens whenever a stage opens or
+	// closes, so each stage gets the peak of the time it was open.
+	std::uint64_t peak = read_peak_rss_();
+	for(build_stage* st : open_stages_) st->peak_rss_ = std::max(st->peak_rss_, peak);
+	reset_peak_rss_();
+}
+
+
+build_stage::build_stage(const std::string& label) {
+	// Only recorded below the current stage of the thread, so that each thread stays in the report of its own build
+	build_stage_record* parent = current_build_stage_();
+	if(! parent) return;
+
+	std::lock_guard<std::mutex> lock(report_mutex_);
+	std::string key = stage_key_(label);
+	auto it = std::find_if(parent->children.begin(), parent->children.end(), [&](const std::unique_ptr<build_stage_record>& child) {
+		return (child->label == key);
+	});
+	if(it == parent->children.end()) {
+		parent->children.emplace_back(new build_stage_record);
+		parent->children.back()->label = key;
+		it = parent->children.end() - 1;
+	}
+	open_(it->get());
+}
+
+
+void build_stage::open_(build_stage_record* rec) {
+	sample_peak_rss_();
+	record_ = rec;
+	previous_ = current_build_stage_();
+	current_build_stage_() = rec;
+	open_stages_.push_back(this);
+
+	start_time_ = clock::now();
+	start_cpu_seconds_ = clock_seconds_(CLOCK_PROCESS_CPUTIME_ID);
+	start_thread_cpu_seconds_ = clock_seconds_(CLOCK_THREAD_CPUTIME_ID);
+	io_bytes_(start_bytes_read_, start_bytes_written_);
+}
+
+
+build_stage::~build_stage() {
+	if(! record_) return;
+
+	double wall_seconds = std::chrono::duration<double>(clock::now() - start_time_).count();
+	double cpu_seconds = clock_seconds_(CLOCK_PROCESS_CPUTIME_ID) - start_cpu_seconds_;
+	double thread_cpu_seconds = clock_seconds_(CLOCK_THREAD_CPUTIME_ID) - start_thread_cpu_seconds_;
+	std::uint64_t bytes_read, bytes_written;
+	io_bytes_(bytes_read, bytes_written);
+
+	std::lock_guard<std::mutex> lock(report_mutex_);
+	sample_peak_rss_();
+	open_stages_.erase(std::find(open_stages_.begin(), open_stages_.end(), this));
+	current_build_stage_() = previous_;
+
+	record_->calls++;
+	record_->wall_seconds += wall_seconds;
+	record_->cpu_seconds += cpu_seconds;
+	record_->thread_cpu_seconds += thread_cpu_seconds;
+	record_->bytes_read += bytes_read - start_bytes_read_;
+	record_->bytes_written += bytes_written - start_bytes_written_;
+	record_->peak_rss = std::max(record_->peak_rss, peak_rss_);
+}
+
+
+build_report::build_report(const std::string& builder, const std::string& output) : output_(output) {
+	if(current_build_stage_()) {
+		stage_.reset(new build_stage(builder));
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(report_mutex_);
+	if(report_file_.empty()) return;
+	file_ = report_file_;
+	root_.reset(new build_stage_record);
+	root_->label = builder;
+	stage_.reset(new build_stage);
+	stage_->open_(root_.get());
+}
+
+
+build_report::~build_report() {
+	bool completed = ! std::uncaught_exception();
+	stage_.reset();
+	if(! root_) return;
+
+	try {
+		std::ostringstream str;
+		str << "{\"output\":";
+		write_json_string_(str, output_);
+		str << ",\"time\":" << std::time(nullptr)
+			<< ",\"completed\":" << (completed ? "true" : "false")
+			<< ",\"hardware_threads\":" << std::thread::hardware_concurrency() << ',';
+		write_stage_json_(str, *root_);
+		str << "}\n";
+
+		// Concurrent builds append whole lines
+		std::lock_guard<std::mutex> lock(report_mutex_);
+		std::ofstream file(file_, std::ios_base::app);
+		file << str.str();
+	} catch(...) {
+		// Report is not essential to the build
+	}
+}
+
+}
@@ -0,0 +1,97 @@
+#ifndef DYPC_BUILD_REPORT_H_
+#define DYPC_BUILD_REPORT_H_
+
+#include <string>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+
+namespace dypc {
+
+struct build_stage_record;
+
+/**
+ * Set file into which build reports get written.
+ * Each build appends its report to the file, as one line of JSON. @see build_report
+ * @param path Path of the file, or empty string to disable build reports.
+ */
+void set_build_report_file(const std::string& path);
+
+/**
+ * Add value to a counter of the innermost stage open in this thread.
+ * Does nothing when no build report is being recorded.
+ * @param name Name of the counter.
+ * @param value Value to add.
+ */
+void add_build_counter(const std::string& name, double value = 1);
+
+/**
+ * Innermost stage open in this thread.
+ * Worker threads of shared_progress inherit it from the thread that runs them, so that their stages nest below it.
+ */
+build_stage_record*& current_build_stage_();
+
+
+/**
+ * Scope of one stage of a build.
+ * While open, measures wall time, CPU time of the process and of this thread, bytes read and written by the process,
+ * and peak resident memory of the process. The values get added to the stage in the build report that this thread
+ * is recording, if any. Stages nest, and every progress indicator opens one with its label. Stages of the same parent
+ * with the same label get merged, and their values summed. Text after the last "..." of a label, which holds
+ * details of a single call, is ignored, so that the stages have the same names across builds.
+ * Values other than thread CPU time are for the whole process, and so include stages of other threads that run at
+ * the same time.
+ */
+class build_stage {
+	friend class build_report;
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	build_stage_record* record_ = nullptr; ///< Record the values get added to. Null when not recording.
+	build_stage_record* previous_ = nullptr; ///< Stage that was current in this thread before.
+	clock::time_point start_time_;
+	double start_cpu_seconds_ = 0;
+	double start_thread_cpu_seconds_ = 0;
+	std::uint64_t start_bytes_read_ = 0;
+	std::uint64_t start_bytes_written_ = 0;
+	std::uint64_t peak_rss_ = 0; ///< Peak resident memory sampled while stage was open.
+
+	build_stage() = default;
+	void open_(build_stage_record* rec);
+	static void sample_peak_rss_();
+
+public:
+	explicit build_stage(const std::string& label);
+	build_stage(const build_stage&) = delete;
+	~build_stage();
+};
+
+
+/**
+ * Scope of a whole build, which writes the build report when it ends.
+ * Opened by the functions that write structure files, with their name. Records a report only when a report file was
+ * set using set_build_report_file. When this thread is already recording a build, the new one becomes a stage of it.
+ * Builds started on other threads record their own reports.
+ */
+class build_report {
+private:
+	std::unique_ptr<build_stage_record> root_;
+	std::unique_ptr<build_stage> stage_;
+	std::string file_;
+	std::string output_;
+
+public:
+	/**
+	 * Start recording build.
+	 * @param builder Name of the build function.
+	 * @param output Path of the file being written.
+	 */
+	build_report(const std::string& builder, const std::string& output);
+	build_report(const build_report&) = delete;
+	~build_report(); ///< Finish recording, and append report to report file.
+};
+
+}
+
+#endif
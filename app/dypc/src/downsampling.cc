@@ -39,4 +39,152 @@ downsampling_ratios_t determine_downsampling_ratios(std::size_t levels, std::siz
 	return result;
 }
 
+
+
+random_skip_sampler::random_skip_sampler(std::size_t total, std::size_t choices, random_generator_t& random_generator) :
+random_generator_(random_generator), remaining_items_(total), remaining_choices_(choices) {
+	assert(choices <= total);
+}
+
+
+double random_skip_sampler::uniform_() {
+	// Uniform in open interval (0, 1), with 53 bits, so that its logarithm is defined
+	std::uint64_t a = random_generator_() >> 5, b = random_generator_() >> 6;
+	return ((a << 26) + b + 0.5) / 9007199254740992.0;
+}
+
+
+std::size_t random_skip_sampler::skip_a_() {
+	const std::size_t n = remaining_choices_;
+	double top = remaining_items_ - n;
+	double items = remaining_items_;
+	double quotient = top / items;
+	double v = uniform_();
+	std::size_t s = 0;
+	while(quotient > v) {
+		++s;
+		top -= 1.0;
+		items -= 1.0;
+		quotient *= top / items;
+	}
+	return s;
+}
+
+
+std::size_t random_skip_sampler::skip_d_() {
+	// Vitter, "An efficient algorithm for sequential random sampling", ACM TOMS 13(1), 1987
+	const std::size_t n = remaining_choices_;
+	const std::size_t N = remaining_items_;
+	const double n_real = n, N_real = N;
+	const double n_inv = 1.0 / n_real, n_min1_inv = 1.0 / (n_real - 1.0);
+	const std::size_t qu1 = N - n + 1;
+	const double qu1_real = qu1;
+	
+	double v_prime = std::exp(std::log(uniform_()) * n_inv);
+	for(;;) {
+		// Generate candidate skip S from envelope distribution
+		double x;
+		std::size_t s;
+		for(;;) {
+			x = N_real * (1.0 - v_prime);
+			s = x;
+			if(s < qu1) break;
+			v_prime = std::exp(std::log(uniform_()) * n_inv);
+		}
+		double u = uniform_();
+		double neg_s_real = -(double)s;
+		
+		// Fast acceptance test with squeeze function
+		double y1 = std::exp(std::log(u * N_real / qu1_real) * n_min1_inv);
+		v_prime = y1 * (1.0 - x/N_real) * (qu1_real / (neg_s_real + qu1_real));
+		if(v_prime <= 1.0) return s;
+		
+		// Exact acceptance test
+		double y2 = 1.0, top = N_real - 1.0, bottom;
+		std::size_t limit;
+		if(n - 1 > s) {
+			bottom = N_real - n_real;
+			limit = N - s;
+		} else {
+			bottom = neg_s_real + N_real - 1.0;
+			limit = qu1;
+		}
+		for(std::size_t t = N - 1; t >= limit; --t) {
+			y2 = (y2 * top) / bottom;
+			top -= 1.0;
+			bottom -= 1.0;
+		}
+		if(N_real / (N_real - x) >= y1 * std::exp(std::log(y2) * n_min1_inv)) return s;
+		
+		v_prime = std::exp(std::log(uniform_()) * n_inv);
+	}
+}
+
+
+std::size_t random_skip_sampler::next_skip() {
+	assert(remaining_choices_ > 0);
+	const std::size_t alpha_inverse = 13; // Use algorithm A when more than 1/alpha of items get chosen
+	
+	std::size_t s;
+	if(remaining_choices_ == 1) {
+		s = remaining_items_ * uniform_();
+		if(s >= remaining_items_) s = remaining_items_ - 1;
+	} else if(alpha_inverse * remaining_choices_ >= remaining_items_) {
+		s = skip_a_();
+	} else {
+		s = skip_d_();
+	}
+	
+	remaining_items_ -= s + 1;
+	--remaining_choices_;
+	return s;
+}
+
+
+static double log_binomial_coefficient_(double n, double k) {
+	return std::lgamma(n + 1.0) - std::lgamma(k + 1.0) - std::lgamma(n - k + 1.0);
+}
+
+
+std::size_t random_hypergeometric(std::size_t total, std::size_t choices, std::size_t count, random_generator_t& random_generator) {
+	assert(choices <= total && count <= total);
+	const std::size_t minimum = (count + choices > total ? count + choices - total : 0);
+	const std::size_t maximum = (count < choices ? count : choices);
+	if(minimum == maximum) return minimum;
+	
+	// Probability of mode
+	std::size_t mode = (double)(count + 1) * (double)(choices + 1) / (double)(total + 2);
+	if(mode < minimum) mode = minimum;
+	else if(mode > maximum) mode = maximum;
+	const double N = total, K = choices, n = count;
+	const double mode_probability = std::exp(
+		log_binomial_coefficient_(K, mode) + log_binomial_coefficient_(N - K, n - mode) - log_binomial_coefficient_(N, n)
+	);
+	
+	// Subtract probabilities of values around the mode, in alternating order, until u is reached
+	double u = std::uniform_real_distribution<double>(0.0, 1.0)(random_generator);
+	u -= mode_probability;
+	if(u <= 0.0) return mode;
+	
+	std::size_t lower = mode, upper = mode;
+	double lower_probability = mode_probability, upper_probability = mode_probability;
+	while(lower > minimum || upper < maximum) {
+		if(upper < maximum) {
+			double k = upper;
+			upper_probability *= ((K - k) * (n - k)) / ((k + 1.0) * (N - K - n + k + 1.0));
+			++upper;
+			u -= upper_probability;
+			if(u <= 0.0) return upper;
+		}
+		if(lower > minimum) {
+			double k = lower;
+			lower_probability *= (k * (N - K - n + k)) / ((K - k + 1.0) * (n - k + 1.0));
+			--lower;
+			u -= lower_probability;
+			if(u <= 0.0) return lower;
+		}
+	}
+	return mode; // Only reached through rounding errors
+}
+
 }
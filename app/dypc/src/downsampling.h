@@ -8,6 +8,7 @@
 #include "geometry/cuboid.h"
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <tuple>
 #include <glm/glm.hpp>
 #include <cmath>
@@ -16,6 +17,7 @@
 #include <cstdint>
 #include <stdexcept>
 #include <iterator>
+#include <thread>
 
 namespace dypc {
 
@@ -95,11 +97,63 @@ inline float choose_downsampling_level_ratio_continuous(std::size_t levels, floa
 downsampling_ratios_t determine_downsampling_ratios(std::size_t levels, std::size_t total_points, std::size_t minimum, float amount);
 
 
+/**
+ * Sequential random sampler which jumps directly from one chosen item to the next.
+ * Chooses \a choices out of \a total items, in their order, such that every subset of that size is equally likely.
+ * Uses Vitter's Algorithm D, so the number of random numbers drawn and the running time are proportional to the
+ * number of choices instead of the number of items. When more than 1/13 of the items are chosen, the simpler
+ * Algorithm A is used for the following skips, as it is faster for dense samples.
+ */
+class random_skip_sampler {
+private:
+	random_generator_t& random_generator_;
+	std::size_t remaining_items_;
+	std::size_t remaining_choices_;
+	
+	double uniform_();
+	std::size_t skip_a_();
+	std::size_t skip_d_();
+	
+public:
+	/**
+	 * Create sampler.
+	 * @param total Number of items.
+	 * @param choices Number of items to choose. Must not be greater than \a total.
+	 * @param random_generator Random number generator to draw from.
+	 */
+	random_skip_sampler(std::size_t total, std::size_t choices, random_generator_t& random_generator);
+	
+	/**
+	 * Number of items that still need to be chosen.
+	 */
+	std::size_t remaining_choices() const { return remaining_choices_; }
+	
+	/**
+	 * Get number of items to skip before the next chosen item.
+	 * Must only be called while remaining_choices() is not zero.
+	 */
+	std::size_t next_skip();
+};
+
+
+/**
+ * Draw number from hypergeometric distribution.
+ * Gives the number of chosen items that are among the first \a count items, when \a choices out of \a total items
+ * are chosen uniformly at random. Searches the inverse of the distribution function outwards from its mode, so the cost
+ * is proportional to the standard deviation of the distribution.
+ * @param total Number of items.
+ * @param choices Number of chosen items.
+ * @param count Number of items in first part.
+ * @param random_generator Random number generator to draw from.
+ */
+std::size_t random_hypergeometric(std::size_t total, std::size_t choices, std::size_t count, random_generator_t& random_generator);
+
+
 /**
  * Apply random downsampling.
  * Randomly chooses exactly \a expected_number_of_points points from the input point set.
- * It iterates through the point set only once.
- * @tparam Iterator Iterator to point set.
+ * Skips directly between the chosen points, so the cost is proportional to the number of output points.
+ * @tparam Iterator Random access iterator to point set.
  * @tparam OutputContainer Container type for output.
  * @param pt_begin Begin iterator of points.
  * @param pt_end End iterator of points.
@@ -110,15 +164,100 @@ template<class Iterator, class Inserter>
 void random_downsampling(Iterator pt_begin, Iterator pt_end, std::size_t expected_number_of_points, Inserter output) {
 	random_generator_t random_generator;
 	const std::size_t total_number_of_points = pt_end - pt_begin;
-	std::size_t picked = 0, left = total_number_of_points, needed = expected_number_of_points;
-	for(Iterator pt = pt_begin; (pt != pt_end) && (needed > 0); ++pt) {
-		std::uniform_int_distribution<std::size_t> distribution(0, left - 1);
-		if(distribution(random_generator) < needed) {
-			*output = *pt;
-			--needed;
+	if(expected_number_of_points > total_number_of_points) expected_number_of_points = total_number_of_points;
+	random_skip_sampler sampler(total_number_of_points, expected_number_of_points, random_generator);
+	Iterator pt = pt_begin;
+	while(sampler.remaining_choices() > 0) {
+		pt += sampler.next_skip();
+		*output = *pt;
+		++pt;
+	}
+}
+
+/**
+ * Apply random downsampling on multiple threads.
+ * Splits the point set into one part per thread, and draws how many of the chosen points fall into each part from
+ * the hypergeometric distribution. The parts are then sampled independently, giving the same distribution as
+ * random_downsampling. Each thread collects its chosen points in a buffer, and the buffers are then passed to the
+ * inserter in input order, so that any output container can be used.
+ * @tparam Iterator Random access iterator to point set.
+ * @tparam Inserter Output iterator that receives the chosen points.
+ * @param pt_begin Begin iterator of points.
+ * @param pt_end End iterator of points.
+ * @param expected_number_of_points Number of points to output.
+ * @param output Inserter to receive output points.
+ * @param number_of_threads Number of threads.
+ */
+template<class Iterator, class Inserter>
+void random_downsampling_parallel(Iterator pt_begin, Iterator pt_end, std::size_t expected_number_of_points, Inserter output, std::size_t number_of_threads) {
+	random_generator_t random_generator;
+	const std::size_t total_number_of_points = pt_end - pt_begin;
+	if(expected_number_of_points > total_number_of_points) expected_number_of_points = total_number_of_points;
+	if(number_of_threads == 0) number_of_threads = 1;
+	
+	struct part {
+		std::size_t begin;
+		std::size_t end;
+		std::size_t choices;
+		random_generator_t::result_type seed;
+		std::vector<point> chosen;
+	};
+	std::vector<part> parts(number_of_threads);
+	std::size_t remaining_points = total_number_of_points, remaining_choices = expected_number_of_points;
+	for(std::size_t i = 0; i < number_of_threads; ++i) {
+		part& p = parts[i];
+		p.begin = (i * total_number_of_points) / number_of_threads;
+		p.end = ((i + 1) * total_number_of_points) / number_of_threads;
+		if(i + 1 == number_of_threads) p.choices = remaining_choices;
+		else p.choices = random_hypergeometric(remaining_points, remaining_choices, p.end - p.begin, random_generator);
+		p.seed = random_generator();
+		remaining_points -= p.end - p.begin;
+		remaining_choices -= p.choices;
+	}
+	
+	std::vector<std::thread> threads;
+	for(part& p : parts) threads.emplace_back([&pt_begin, &p]() {
+		random_generator_t part_random_generator(p.seed);
+		random_skip_sampler sampler(p.end - p.begin, p.choices, part_random_generator);
+		p.chosen.reserve(p.choices);
+		Iterator pt = pt_begin + p.begin;
+		while(sampler.remaining_choices() > 0) {
+			pt += sampler.next_skip();
+			p.chosen.push_back(*(pt++));
 		}
-		--left;
-	}	
+	});
+	for(std::thread& thr : threads) thr.join();
+	
+	for(part& p : parts) {
+		for(const point& pt : p.chosen) *output = pt;
+		std::vector<point>().swap(p.chosen);
+	}
+}
+
+/**
+ * Apply random downsampling, and keep the points that were not chosen.
+ * Same selection as random_downsampling, but the points that are not chosen are written into \a rest instead
+ * of being dropped. Used for additive downsampling, where each level is a subset of the previous one.
+ * @param pt_begin Begin iterator of points.
+ * @param pt_end End iterator of points.
+ * @param expected_number_of_points Number of points to output.
+ * @param output Inserter to receive chosen points.
+ * @param rest Inserter to receive remaining points.
+ */
+template<class Iterator, class Inserter, class RestInserter>
+void random_downsampling_partition(Iterator pt_begin, Iterator pt_end, std::size_t expected_number_of_points, Inserter output, RestInserter rest) {
+	random_generator_t random_generator;
+	const std::size_t total_number_of_points = pt_end - pt_begin;
+	if(expected_number_of_points > total_number_of_points) expected_number_of_points = total_number_of_points;
+	random_skip_sampler sampler(total_number_of_points, expected_number_of_points, random_generator);
+	Iterator pt = pt_begin;
+	while(sampler.remaining_choices() > 0) {
+		Iterator chosen = pt + sampler.next_skip();
+		for(; pt != chosen; ++pt) *rest = *pt;
+		*output = *pt;
+		++pt;
+	}
+	for(; pt != pt_end; ++pt) *rest = *pt;
 }
 
 /**
@@ -196,6 +335,7 @@ float uniform_downsampling_side_length(Iterator pt_begin, Iterator pt_end, std::
 	progress("Finding uniform downsampling cube size...", [&](progress_handle& pr) {
 		do {			
 			attempt.number_of_points = uniform_downsampling_number_of_points_for_side_length(pt_begin, pt_end, attempt.side_length, maximal_increment);
+			add_build_counter("bisection_iterations");
 
 			pr.pulse();
 			pr.message("expected: " + std::to_string(expected_number_of_points) + "; got: " + std::to_string(attempt.number_of_points) + "; side: " + std::to_string(attempt.side_length));
@@ -225,18 +365,13 @@ inline void uniform_downsampling(Iterator pt_begin, Iterator pt_end, std::size_t
 
 
 /**
- * 
+ * Apply uniform downsampling with given cube side length.
+ * Outputs one point per cube of side length \a side that contains input points.
+ * @param output Inserter to receive output points. Taken by reference, so that the caller can continue inserting with it.
+ * @return Number of output points.
  */
 template<class Iterator, class Inserter>
-void uniform_downsampling(Iterator pt_begin, Iterator pt_end, std::size_t expected_number_of_points, const cuboid& bounding_cuboid, Inserter output, uniform_downsampling_previous_results_t& previous_results) {
-	std::size_t total_number_of_points = pt_end - pt_begin;
-	if(expected_number_of_points == 0) return;
-	else if(expected_number_of_points >= total_number_of_points) {
-		for(Iterator pt = pt_begin; pt != pt_end; ++pt) *output = *pt;
-	}
-	
-	float side = uniform_downsampling_side_length(pt_begin, pt_end, expected_number_of_points, bounding_cuboid, previous_results);
-	
+std::size_t uniform_downsampling_with_side_length(Iterator pt_begin, Iterator pt_end, float side, Inserter& output) {
 	using cube_index_t = std::tuple<long, long, long>;
 	
 	class cube {
@@ -293,12 +428,154 @@ void uniform_downsampling(Iterator pt_begin, Iterator pt_end, std::size_t expect
 		it->second.add_point(pt);
 	});
 	
-	assert(cubes.size() <= expected_number_of_points);
-	
 	progress_foreach(cubes, "Computing uniform downsampling points..."+std::to_string(cubes.size()), [&](const typename cubes_t::value_type& p) {
 		const auto& cube = p.second;
 		*output = cube.make_point();
 	});
+	
+	return cubes.size();
+}
+
+
+/**
+ * Apply uniform downsampling.
+ * Outputs at most \a expected_number_of_points points, one per cube. The cube side length is estimated so that the
+ * number of cubes approaches \a expected_number_of_points.
+ */
+template<class Iterator, class Inserter>
+void uniform_downsampling(Iterator pt_begin, Iterator pt_end, std::size_t expected_number_of_points, const cuboid& bounding_cuboid, Inserter output, uniform_downsampling_previous_results_t& previous_results) {
+	std::size_t total_number_of_points = pt_end - pt_begin;
+	if(expected_number_of_points == 0) return;
+	else if(expected_number_of_points >= total_number_of_points) {
+		for(Iterator pt = pt_begin; pt != pt_end; ++pt) *output = *pt;
+		return;
+	}
+	
+	float side = uniform_downsampling_side_length(pt_begin, pt_end, expected_number_of_points, bounding_cuboid, previous_results);
+	std::size_t number_of_cubes = uniform_downsampling_with_side_length(pt_begin, pt_end, side, output);
+	assert(number_of_cubes <= expected_number_of_points);
+	(void)number_of_cubes;
+}
+
+
+/**
+ * Apply uniform downsampling, and output exactly \a expected_number_of_points points.
+ * uniform_downsampling outputs one point per cube, which can be fewer than requested. The missing points are taken
+ * from the input points of cubes that contained several: their input points are ordered by distance to the cube
+ * center, and the second nearest point of each such cube is added, then the third nearest, and so on, until the
+ * count is reached. So all output points are distinct, and the added ones are spread over the densest cubes.
+ * @param pt_begin Begin iterator of points.
+ * @param pt_end End iterator of points.
+ * @param expected_number_of_points Number of points to output.
+ * @param bounding_cuboid Cuboid enclosing the points.
+ * @param output Inserter to receive output points.
+ * @param previous_results Previous results data to use during downsampling.
+ */
+template<class Iterator, class Inserter>
+void uniform_downsampling_exact(Iterator pt_begin, Iterator pt_end, std::size_t expected_number_of_points, const cuboid& bounding_cuboid, Inserter output, uniform_downsampling_previous_results_t& previous_results) {
+	std::size_t total_number_of_points = pt_end - pt_begin;
+	if(expected_number_of_points == 0) return;
+	else if(expected_number_of_points >= total_number_of_points) {
+		for(Iterator pt = pt_begin; pt != pt_end; ++pt) *output = *pt;
+		return;
+	}
+	
+	float side = uniform_downsampling_side_length(pt_begin, pt_end, expected_number_of_points, bounding_cuboid, previous_results);
+	std::size_t number_of_cubes = uniform_downsampling_with_side_length(pt_begin, pt_end, side, output);
+	if(number_of_cubes >= expected_number_of_points) return;
+	std::size_t missing = expected_number_of_points - number_of_cubes;
+	
+	// Input points of each cube, with squared distance to cube center
+	using cube_index_t = std::tuple<long, long, long>;
+	using cube_points_t = std::vector<std::pair<float, std::ptrdiff_t>>;
+	std::map<cube_index_t, cube_points_t> cubes;
+	for(std::ptrdiff_t i = 0; i < total_number_of_points; ++i) {
+		const point& pt = *(pt_begin + i);
+		cube_index_t idx(pt.x / side, pt.y / side, pt.z / side);
+		glm::vec3 center(std::get<0>(idx) * side, std::get<1>(idx) * side, std::get<2>(idx) * side);
+		float sqdistance = sq(pt.x - center.x) + sq(pt.y - center.y) + sq(pt.z - center.z);
+		cubes[idx].emplace_back(sqdistance, i);
+	}
+	
+	std::vector<cube_points_t*> over_full_cubes;
+	for(auto& p : cubes) {
+		if(p.second.size() < 2) continue;
+		std::sort(p.second.begin(), p.second.end());
+		over_full_cubes.push_back(&p.second);
+	}
+	
+	// Take the rank-th nearest point of each over-full cube, until enough were added.
+	// There are always enough: the input has more points than expected_number_of_points.
+	for(std::size_t rank = 1; missing > 0; ++rank) {
+		auto end = std::remove_if(over_full_cubes.begin(), over_full_cubes.end(), [rank](const cube_points_t* c) { return c->size() <= rank; });
+		over_full_cubes.erase(end, over_full_cubes.end());
+		assert(! over_full_cubes.empty());
+		for(auto it = over_full_cubes.begin(); it != over_full_cubes.end() && missing > 0; ++it, --missing)
+			*output = *(pt_begin + (**it)[rank].second);
+	}
+}
+
+/**
+ * Apply uniform downsampling, choosing points from the input set instead of generating new ones.
+ * Uses the same cubes as uniform_downsampling, but for each cube the input point closest to the cube center is
+ * kept as-is. All other points are written into \a rest. Used for additive downsampling, where each level is a subset of the previous one.
+ * @param pt_begin Begin iterator of points.
+ * @param pt_end End iterator of points.
+ * @param expected_number_of_points Upper bound of number of points to output.
+ * @param bounding_cuboid Cuboid enclosing the points.
+ * @param output Inserter to receive chosen points.
+ * @param rest Inserter to receive remaining points.
+ */
+template<class Iterator, class Inserter, class RestInserter>
+void uniform_downsampling_partition(Iterator pt_begin, Iterator pt_end, std::size_t expected_number_of_points, const cuboid& bounding_cuboid, Inserter output, RestInserter rest) {
+	std::size_t total_number_of_points = pt_end - pt_begin;
+	if(expected_number_of_points >= total_number_of_points) {
+		for(Iterator pt = pt_begin; pt != pt_end; ++pt) *output = *pt;
+		return;
+	} else if(expected_number_of_points == 0) {
+		for(Iterator pt = pt_begin; pt != pt_end; ++pt) *rest = *pt;
+		return;
+	}
+	
+	uniform_downsampling_previous_results_t previous_results;
+	float side = uniform_downsampling_side_length(pt_begin, pt_end, expected_number_of_points, bounding_cuboid, previous_results);
+	
+	using cube_index_t = std::tuple<long, long, long>;
+	struct representative {
+		float sqdistance = INFINITY; ///< Squared distance of current representative to cube center.
+		std::ptrdiff_t index = -1; ///< Index of current representative in input.
+	};
+	std::map<cube_index_t, representative> cubes;
+
+	progress(100, "Choosing uniform downsampling points...", [&](progress_handle& pr) {
+		pr.message("side: " + std::to_string(side));
+		std::size_t update_step = total_number_of_points/100;
+		std::size_t counter = 0;
+		for(std::size_t i = 0; i < total_number_of_points; ++i, ++counter) {
+			const point& pt = *(pt_begin + i);
+			cube_index_t idx(pt.x / side, pt.y / side, pt.z / side);
+			glm::vec3 center(std::get<0>(idx) * side, std::get<1>(idx) * side, std::get<2>(idx) * side);
+			float sqdistance = sq(pt.x - center.x) + sq(pt.y - center.y) + sq(pt.z - center.z);
+			representative& rep = cubes[idx];
+			if(sqdistance < rep.sqdistance) {
+				rep.sqdistance = sqdistance;
+				rep.index = i;
+			}
+			if(counter == update_step) {
+				pr.increment();
+				counter = 0;
+			}
+		}
+	});
+	
+	assert(cubes.size() <= expected_number_of_points);
+	
+	std::vector<bool> chosen(total_number_of_points, false);
+	for(const auto& p : cubes) chosen[p.second.index] = true;
+	for(std::ptrdiff_t i = 0; i < total_number_of_points; ++i) {
+		if(chosen[i]) *output = *(pt_begin + i);
+		else *rest = *(pt_begin + i);
+	}
 }
 
 }
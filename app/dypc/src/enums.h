@@ -24,7 +24,8 @@ enum class loader_type {
 	direct = dypc_direct_loader_type, ///< Direct model loader. @see direct_model_loader
 	cubes = dypc_cubes_loader_type, ///< Cubes structure loader. @see cubes_structure_loader
 	cubes_mipmap = dypc_cubes_mipmap_loader_type, ///< Cubes mipmap structure loader. @see cubes_mipmap_structure_loader
-	tree = dypc_tree_loader_type ///< Tree structure loader. @see tree_structure_loader
+	tree = dypc_tree_loader_type, ///< Tree structure loader. @see tree_structure_loader
+	scene = dypc_scene_loader_type ///< Scene loader over multiple structure files. @see scene_loader
 };
 
 
@@ -33,7 +34,8 @@ enum class loader_type {
  */
 enum class tree_structure_loader_type {
 	simple = dypc_simple_tree_structure_loader_type, ///< Simple tree structure loader. @see tree_structure_simple_loader
-	ordered = dypc_ordered_tree_structure_loader_type ///< Ordered tree structure loader. Loads cuboids closer to camera first. @see tree_structure_ordered_loader
+	ordered = dypc_ordered_tree_structure_loader_type, ///< Ordered tree structure loader. Loads cuboids closer to camera first. @see tree_structure_ordered_loader
+	prioritized = dypc_prioritized_tree_structure_loader_type ///< Prioritized tree structure loader. Loads nodes with largest projected size first. @see tree_structure_prioritized_loader
 };
 
 /**
@@ -55,6 +57,39 @@ enum class cuboid_distance_mode {
 	center = dypc_center_cuboid_distance_mode ///< Distance to center of cuboid.
 };
 
+
+/**
+ * Ways to choose the downsampling level of a region.
+ */
+enum class lod_selection_mode {
+	distance = dypc_distance_lod_selection_mode, ///< Level from distance to camera. @see choose_downsampling_level
+	screen_space_error = dypc_screen_space_error_lod_selection_mode ///< Coarsest level whose projected point spacing is below a pixel threshold.
+};
+
+
+/**
+ * Memory layouts in which loaders can output points.
+ * @see output_layout.h
+ */
+enum class output_layout {
+	point = dypc_point_output_layout, ///< Array of point, as computed by the loader.
+	intensity = dypc_intensity_output_layout, ///< Like point, with intensity stored in the padding byte.
+	split = dypc_split_output_layout, ///< Array of positions, followed by array of RGBA colors starting at  capacity.
+	relative_half = dypc_relative_half_output_layout ///< Half float positions relative to camera, with RGBA colors.
+};
+
+
+/**
+ * Compression codecs for point sets in HDF files.
+ * LZ4 and Zstandard are not built into HDF, and need the corresponding filter plugin to be installed.
+ */
+enum class hdf_compression {
+	none = dypc_no_hdf_compression, ///< No compression.
+	deflate = dypc_deflate_hdf_compression, ///< Deflate (zlib), built into HDF.
+	lz4 = dypc_lz4_hdf_compression, ///< LZ4, using registered HDF filter 32004.
+	zstd = dypc_zstd_hdf_compression ///< Zstandard, using registered HDF filter 32015.
+};
+
 }
 
 #endif
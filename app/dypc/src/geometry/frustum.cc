@@ -1,5 +1,8 @@
 #include "frustum.h"
 #include "cuboid.h"
+#include "../point.h"
+#include <algorithm>
+#include <cstdint>
 
 // see http://www.crownandcutlass.com/features/technicaldetails/frustum.html
 //     http://voxelengine.googlecode.com/svn/branches/0_base/Frustum.cpp (wrong)
@@ -42,4 +45,35 @@ frustum::intersection_t frustum::contains_cuboid(const cuboid& cub) const {
 	return (c2 == 6) ? inside_frustum : partially_inside_frustum;
 }
 
+
+
+std::size_t frustum::filter_points(point* points, std::size_t n) const {
+	// Plane coefficients are copied into arrays, and the inside test of a block of points is computed without branches,
+	// so that it can get vectorized. Compaction is done in a second pass over the block.
+	float a[6], b[6], c[6], d[6];
+	for(std::ptrdiff_t i = 0; i < 6; ++i) {
+		a[i] = planes[i].normal[0]; b[i] = planes[i].normal[1]; c[i] = planes[i].normal[2]; d[i] = planes[i].d;
+	}
+	
+	const std::size_t block_size = 256;
+	std::uint8_t inside[block_size];
+	std::size_t count = 0;
+	for(std::size_t block_begin = 0; block_begin < n; block_begin += block_size) {
+		std::size_t block_end = std::min(block_begin + block_size, n);
+		
+		for(std::size_t i = block_begin; i < block_end; ++i) {
+			const point& pt = points[i];
+			bool in = true;
+			for(std::ptrdiff_t p = 0; p < 6; ++p) in &= (a[p]*pt.x + b[p]*pt.y + c[p]*pt.z + d[p] >= 0);
+			inside[i - block_begin] = in;
+		}
+		
+		for(std::size_t i = block_begin; i < block_end; ++i) {
+			points[count] = points[i];
+			count += inside[i - block_begin];
+		}
+	}
+	return count;
+}
+
 }
@@ -6,10 +6,12 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "plane.h"
+#include <cstddef>
 
 namespace dypc {
 
 class cuboid;
+class point;
 
 /**
  * Viewing frustum formed by clipped pyramid in three-dimensional space.
@@ -60,6 +62,15 @@ public:
 	 * However, can return incorrect results in a small region behind the frustum due to omission of an additional test.
 	 */
 	intersection_t contains_cuboid(const cuboid&) const;
+	
+	/**
+	 * Remove points outside the frustum from buffer.
+	 * The points inside are moved to the front of the buffer, keeping their order.
+	 * @param points Buffer of points.
+	 * @param n Number of points in buffer.
+	 * @return Number of points inside the frustum.
+	 */
+	std::size_t filter_points(point* points, std::size_t n) const;
 };
 
 }
@@ -29,13 +29,15 @@ typedef enum {
 	dypc_direct_loader_type = 0,
 	dypc_cubes_loader_type,
 	dypc_cubes_mipmap_loader_type,
-	dypc_tree_loader_type
+	dypc_tree_loader_type,
+	dypc_scene_loader_type
 } dypc_loader_type;
 
 
 typedef enum {
 	dypc_simple_tree_structure_loader_type = 0,
-	dypc_ordered_tree_structure_loader_type
+	dypc_ordered_tree_structure_loader_type,
+	dypc_prioritized_tree_structure_loader_type
 } dypc_tree_structure_loader_type;
 
 
@@ -53,6 +55,28 @@ typedef enum {
 } dypc_cuboid_distance_mode;
 
 
+typedef enum {
+	dypc_distance_lod_selection_mode = 0,
+	dypc_screen_space_error_lod_selection_mode
+} dypc_lod_selection_mode;
+
+
+typedef enum {
+	dypc_point_output_layout = 0,
+	dypc_intensity_output_layout,
+	dypc_split_output_layout,
+	dypc_relative_half_output_layout
+} dypc_output_layout;
+
+
+typedef enum {
+	dypc_no_hdf_compression = 0,
+	dypc_deflate_hdf_compression,
+	dypc_lz4_hdf_compression,
+	dypc_zstd_hdf_compression
+} dypc_hdf_compression;
+
+
 typedef float dypc_vector3[3];
 typedef float dypc_quaternion[4];
 typedef float dypc_matrix4[16];
@@ -62,6 +86,7 @@ typedef struct {
 	dypc_vector3 velocity;
 	dypc_quaternion orientation;
 	dypc_matrix4 view_projection_matrix;
+	float viewport_height;
 } dypc_loader_request;
 
 typedef struct {
@@ -71,8 +96,26 @@ typedef struct {
 
 typedef dypc_point* dypc_points_buffer;
 
+typedef struct {
+	float x, y, z;
+	unsigned char r, g, b, intensity;
+} dypc_intensity_point;
+
+typedef struct {
+	unsigned short x, y, z, w;
+	unsigned char r, g, b, a;
+} dypc_relative_half_point;
+
 typedef size_t dypc_size;
 typedef int dypc_bool;
 typedef unsigned dypc_milliseconds;
 
+typedef struct {
+	dypc_size chunk_size;
+	dypc_bool shuffle;
+	dypc_hdf_compression compression;
+	unsigned compression_level;
+	dypc_size chunk_cache_size;
+} dypc_hdf_file_options;
+
 #endif
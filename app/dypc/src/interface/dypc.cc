@@ -3,9 +3,13 @@
 #include <string>
 #include <iostream>
 
-int dypc_error = 0;
+static thread_local int error_ = 0; ///< Per thread, like error_message_.
+static thread_local std::string error_message_ = std::string(""); ///< Per thread, so that concurrent loader sessions keep their own message.
 
-static std::string error_message_ = std::string("");
+
+int* dypc_error_location() {
+	return &error_;
+}
 
 
 const char* dypc_error_message() {
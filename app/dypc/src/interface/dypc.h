@@ -10,7 +10,13 @@
 extern "C" {
 #endif
 
-extern int dypc_error DYPC_INTERFACE_DEC;
+/**
+ * Location of error flag of calling thread.
+ * Concurrent loader sessions on different threads each keep their own flag, like errno.
+ */
+int* dypc_error_location() DYPC_INTERFACE_DEC;
+
+#define dypc_error (*dypc_error_location()) ///< Error flag of calling thread. Assignable, so existing uses of the former global keep working.
 
 const char* dypc_error_message() DYPC_INTERFACE_DEC;
 
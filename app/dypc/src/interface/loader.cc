@@ -3,10 +3,14 @@
 #include "../enums.h"
 #include "../point.h"
 #include "../util.h"
+#include "../build_report.h"
 #include "../model/model.h"
 #include "../loader/loader.h"
 #include "../loader/direct_model_loader.h"
+#include "../loader/output_layout.h"
+#include "../loader/scene_loader.h"
 #include "../structure/structure_loader_factory.h"
+#include "../remote/structure_server.h"
 #include "../structure/cubes/cubes_structure_memory_loader.h"
 #include "../structure/cubes/cubes_structure_hdf_loader.h"
 #include "../structure/cubes/cubes_structure_sqlite_loader.h"
@@ -26,7 +30,8 @@ static dypc::loader::request_t convert_loader_request_(const dypc_loader_request
 		glm::make_vec3(req.position),
 		glm::make_vec3(req.velocity),
 		glm::quat(req.orientation[0], req.orientation[1], req.orientation[2], req.orientation[3]),
-		glm::make_mat4(req.view_projection_matrix)
+		glm::make_mat4(req.view_projection_matrix),
+		req.viewport_height
 	);
 }
 
@@ -43,6 +48,44 @@ dypc_loader dypc_create_file_structure_loader(const char* filename, dypc_tree_st
 	DYPC_INTERFACE_END_RETURN((dypc_loader)ld, nullptr);
 }
 
+dypc_loader dypc_create_paged_file_structure_loader(const char* filename, dypc_tree_structure_loader_type ltype, dypc_size node_memory_budget) {
+	DYPC_INTERFACE_BEGIN;
+	dypc::loader* ld = dypc::create_structure_file_loader(filename, (dypc::tree_structure_loader_type)(ltype), node_memory_budget);
+	DYPC_INTERFACE_END_RETURN((dypc_loader)ld, nullptr);
+}
+
+dypc_loader dypc_create_tiered_file_structure_loader(const char* filename, dypc_tree_structure_loader_type ltype, dypc_size node_memory_budget, dypc_size point_memory_budget) {
+	DYPC_INTERFACE_BEGIN;
+	dypc::loader* ld = dypc::create_structure_file_loader(filename, (dypc::tree_structure_loader_type)(ltype), node_memory_budget, point_memory_budget);
+	DYPC_INTERFACE_END_RETURN((dypc_loader)ld, nullptr);
+}
+
+dypc_loader dypc_create_scene_loader(const char* manifest, dypc_tree_structure_loader_type ltype, dypc_size maximal_open_tiles, dypc_size memory_budget) {
+	DYPC_INTERFACE_BEGIN;
+	auto tiles = dypc::scene_loader::read_manifest(manifest);
+	dypc::loader* ld = new dypc::scene_loader(tiles, (dypc::tree_structure_loader_type)(ltype), maximal_open_tiles, memory_budget);
+	DYPC_INTERFACE_END_RETURN((dypc_loader)ld, nullptr);
+}
+
+dypc_loader dypc_create_loader_session(dypc_loader l) {
+	DYPC_INTERFACE_BEGIN;
+	dypc::loader* ld = (dypc::loader*)l;
+	DYPC_INTERFACE_END_RETURN((dypc_loader)ld->create_session(), nullptr);
+}
+
+dypc_loader dypc_create_remote_structure_loader(const char* address, dypc_tree_structure_loader_type ltype) {
+	DYPC_INTERFACE_BEGIN;
+	dypc::loader* ld = dypc::create_remote_structure_loader(address, (dypc::tree_structure_loader_type)(ltype));
+	DYPC_INTERFACE_END_RETURN((dypc_loader)ld, nullptr);
+}
+
+void dypc_serve_structure_file(const char* filename, dypc_tree_structure_loader_type ltype, dypc_size point_memory_budget, const char* address) {
+	DYPC_INTERFACE_BEGIN;
+	dypc::structure_server server(dypc::create_structure_file_loader(filename, (dypc::tree_structure_loader_type)(ltype), 0, point_memory_budget));
+	server.serve(address);
+	DYPC_INTERFACE_END;
+}
+
 void dypc_delete_loader(dypc_loader ld) {
 	DYPC_INTERFACE_BEGIN;
 	delete (dypc::loader*)ld;
@@ -66,7 +109,7 @@ dypc_loader dypc_create_mipmap_cubes_structure_loader(dypc_model m, float side,
 }
 
 
-dypc_loader dypc_create_tree_structure_loader(dypc_model m, dypc_structure_type str, unsigned levels, dypc_size leaf_cap, dypc_size dmin, float damount, dypc_downsampling_mode dmode, dypc_tree_structure_loader_type ltype) {
+dypc_loader dypc_create_tree_structure_loader(dypc_model m, dypc_structure_type str, unsigned levels, dypc_size leaf_cap, dypc_size dmin, float damount, dypc_downsampling_mode dmode, dypc_tree_structure_loader_type ltype, dypc_bool additive) {
 	DYPC_INTERFACE_BEGIN;
 	dypc::model* mod = (dypc::model*)m;
 	dypc::tree_structure_loader* ld = dypc::create_tree_structure_memory_loader(
@@ -77,7 +120,8 @@ dypc_loader dypc_create_tree_structure_loader(dypc_model m, dypc_structure_type
 		damount,
 		(dypc::downsampling_mode)(dmode),
 		*mod,
-		(dypc::tree_structure_loader_type)(ltype)
+		(dypc::tree_structure_loader_type)(ltype),
+		additive
 	);
 	DYPC_INTERFACE_END_RETURN((dypc_loader)ld, nullptr);
 }
@@ -91,6 +135,7 @@ dypc_loader_type dypc_loader_loader_type(dypc_loader l) {
 void dypc_write_cubes_structure_to_file(const char* filename, dypc_model m, float side) {
 	DYPC_INTERFACE_BEGIN;
 	dypc::model* mod = (dypc::model*)m;
+	dypc::build_report report("write_cubes_structure", filename);
 	dypc::cubes_structure s(side, *mod);
 	auto ext = dypc::file_path_extension(filename);
 
@@ -107,6 +152,7 @@ void dypc_write_cubes_structure_to_file(const char* filename, dypc_model m, floa
 void dypc_write_mipmap_cubes_structure_to_file(const char* filename, dypc_model m, float side, unsigned levels, dypc_size dmin, float damount, dypc_downsampling_mode dmode) {
 	DYPC_INTERFACE_BEGIN;
 	dypc::model* mod = (dypc::model*)m;
+	dypc::build_report report("write_mipmap_cubes_structure", filename);
 	dypc::cubes_mipmap_structure s(side, levels, dmin, damount, (dypc::downsampling_mode)(dmode), *mod);
 	auto ext = dypc::file_path_extension(filename);
 	if(ext == "hdf") {
@@ -116,7 +162,19 @@ void dypc_write_mipmap_cubes_structure_to_file(const char* filename, dypc_model
 	DYPC_INTERFACE_END;
 }
 
-void dypc_write_tree_structure_to_file(const char* filename, dypc_model m, dypc_structure_type str, unsigned levels, dypc_size leaf_cap, dypc_size dmin, float damount, dypc_downsampling_mode dmode, dypc_size piece_cap, unsigned threads) {
+static dypc::tree_structure_hdf_file_options hdf_file_options_(const dypc_hdf_file_options* options) {
+	dypc::tree_structure_hdf_file_options opt;
+	if(options) {
+		opt.chunk_size = options->chunk_size;
+		opt.shuffle = options->shuffle;
+		opt.compression = (dypc::hdf_compression)(options->compression);
+		opt.compression_level = options->compression_level;
+		opt.chunk_cache_size = options->chunk_cache_size;
+	}
+	return opt;
+}
+
+void dypc_write_tree_structure_to_file(const char* filename, dypc_model m, dypc_structure_type str, unsigned levels, dypc_size leaf_cap, dypc_size dmin, float damount, dypc_downsampling_mode dmode, dypc_size piece_cap, unsigned threads, dypc_bool additive, const dypc_hdf_file_options* options) {
 	DYPC_INTERFACE_BEGIN;
 	dypc::model* mod = (dypc::model*)m;
 	dypc::write_tree_structure_file(
@@ -129,11 +187,51 @@ void dypc_write_tree_structure_to_file(const char* filename, dypc_model m, dypc_
 		(dypc::downsampling_mode)(dmode),
 		piece_cap,
 		*mod,
-		threads
+		threads,
+		additive,
+		hdf_file_options_(options)
 	);
 	DYPC_INTERFACE_END;
 }
 
+void dypc_write_octree_structure_to_file_external(const char* filename, dypc_model m, unsigned levels, dypc_size leaf_cap, dypc_size dmin, float damount, dypc_downsampling_mode dmode, const char* scratch_dir, dypc_size memory_cap, dypc_bool additive, const dypc_hdf_file_options* options) {
+	DYPC_INTERFACE_BEGIN;
+	dypc::model* mod = (dypc::model*)m;
+	dypc::write_octree_structure_file_external(
+		filename,
+		levels,
+		leaf_cap,
+		dmin,
+		damount,
+		(dypc::downsampling_mode)(dmode),
+		*mod,
+		scratch_dir,
+		memory_cap,
+		additive,
+		hdf_file_options_(options)
+	);
+	DYPC_INTERFACE_END;
+}
+
+void dypc_set_build_report_file(const char* filename) {
+	DYPC_INTERFACE_BEGIN;
+	dypc::set_build_report_file(filename ? filename : "");
+	DYPC_INTERFACE_END;
+}
+
+void dypc_insert_into_tree_structure_file(const char* filename, dypc_model m, dypc_size leaf_cap, dypc_downsampling_mode dmode) {
+	DYPC_INTERFACE_BEGIN;
+	dypc::model* mod = (dypc::model*)m;
+	dypc::insert_into_tree_structure_file(filename, *mod, leaf_cap, (dypc::downsampling_mode)(dmode));
+	DYPC_INTERFACE_END;
+}
+
+void dypc_repack_tree_structure_file(const char* filename, const char* output_filename, const dypc_hdf_file_options* options) {
+	DYPC_INTERFACE_BEGIN;
+	dypc::repack_tree_structure_file(filename, output_filename, hdf_file_options_(options));
+	DYPC_INTERFACE_END;
+}
+
 
 const char* dypc_loader_name(dypc_loader l) {
 	DYPC_INTERFACE_BEGIN;
@@ -162,11 +260,29 @@ void dypc_loader_compute_points(dypc_loader l, const dypc_loader_request* reques
 	dypc::loader* ld = (dypc::loader*)l;
 	std::size_t capacity = *count_ptr;
 	std::size_t count = 0;
-	ld->compute_points(convert_loader_request_(*request), (dypc::point*)buffer, count, capacity);
+	ld->compute_points_in_output_layout(convert_loader_request_(*request), buffer, count, capacity);
 	*count_ptr = count;
 	DYPC_INTERFACE_END;
 }
 
+void dypc_loader_set_output_layout(dypc_loader l, dypc_output_layout layout) {
+	DYPC_INTERFACE_BEGIN;
+	dypc::loader* ld = (dypc::loader*)l;
+	ld->set_output_layout((dypc::output_layout)layout);
+	DYPC_INTERFACE_END;
+}
+
+dypc_output_layout dypc_loader_output_layout(dypc_loader l) {
+	DYPC_INTERFACE_BEGIN;
+	dypc::loader* ld = (dypc::loader*)l;
+	DYPC_INTERFACE_END_RETURN((dypc_output_layout)ld->get_output_layout(), dypc_point_output_layout);
+}
+
+dypc_size dypc_output_layout_point_size(dypc_output_layout layout) {
+	DYPC_INTERFACE_BEGIN;
+	DYPC_INTERFACE_END_RETURN(dypc::output_layout_point_size((dypc::output_layout)layout), 0);
+}
+
 dypc_bool dypc_loader_should_compute_points(dypc_loader l, const dypc_loader_request* request, const dypc_loader_request* previous_request, dypc_milliseconds dtime) {
 	DYPC_INTERFACE_BEGIN;
 	dypc::loader* ld = (dypc::loader*)l;
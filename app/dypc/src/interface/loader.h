@@ -9,15 +9,25 @@ extern "C" {
 
 dypc_loader dypc_create_direct_model_loader(dypc_model) DYPC_INTERFACE_DEC;
 dypc_loader dypc_create_file_structure_loader(const char* filename, dypc_tree_structure_loader_type ltype) DYPC_INTERFACE_DEC;
+dypc_loader dypc_create_paged_file_structure_loader(const char* filename, dypc_tree_structure_loader_type ltype, dypc_size node_memory_budget) DYPC_INTERFACE_DEC;
+dypc_loader dypc_create_tiered_file_structure_loader(const char* filename, dypc_tree_structure_loader_type ltype, dypc_size node_memory_budget, dypc_size point_memory_budget) DYPC_INTERFACE_DEC;
+dypc_loader dypc_create_scene_loader(const char* manifest, dypc_tree_structure_loader_type ltype, dypc_size maximal_open_tiles, dypc_size memory_budget) DYPC_INTERFACE_DEC;
+dypc_loader dypc_create_loader_session(dypc_loader) DYPC_INTERFACE_DEC;
+dypc_loader dypc_create_remote_structure_loader(const char* address, dypc_tree_structure_loader_type ltype) DYPC_INTERFACE_DEC;
+void dypc_serve_structure_file(const char* filename, dypc_tree_structure_loader_type ltype, dypc_size point_memory_budget, const char* address) DYPC_INTERFACE_DEC;
 void dypc_delete_loader(dypc_loader) DYPC_INTERFACE_DEC;
 
 dypc_loader dypc_create_cubes_structure_loader(dypc_model mod, float side) DYPC_INTERFACE_DEC;
 dypc_loader dypc_create_mipmap_cubes_structure_loader(dypc_model mod, float side, unsigned levels, dypc_size dmin, float damount, dypc_downsampling_mode dmode) DYPC_INTERFACE_DEC;
-dypc_loader dypc_create_tree_structure_loader(dypc_model mod, dypc_structure_type str, unsigned levels, dypc_size leaf_cap, dypc_size dmin, float damount, dypc_downsampling_mode dmode, dypc_tree_structure_loader_type ltype) DYPC_INTERFACE_DEC;
+dypc_loader dypc_create_tree_structure_loader(dypc_model mod, dypc_structure_type str, unsigned levels, dypc_size leaf_cap, dypc_size dmin, float damount, dypc_downsampling_mode dmode, dypc_tree_structure_loader_type ltype, dypc_bool additive) DYPC_INTERFACE_DEC;
 
 void dypc_write_cubes_structure_to_file(const char* filename, dypc_model mod, float side) DYPC_INTERFACE_DEC;
 void dypc_write_mipmap_cubes_structure_to_file(const char* filename, dypc_model mod, float side, unsigned levels, dypc_size dmin, float damount, dypc_downsampling_mode dmode) DYPC_INTERFACE_DEC;
-void dypc_write_tree_structure_to_file(const char* filename, dypc_model mod, dypc_structure_type str, unsigned levels, dypc_size leaf_cap, dypc_size dmin, float damount, dypc_downsampling_mode dmode, dypc_size piece_cap, unsigned threads) DYPC_INTERFACE_DEC;
+void dypc_write_tree_structure_to_file(const char* filename, dypc_model mod, dypc_structure_type str, unsigned levels, dypc_size leaf_cap, dypc_size dmin, float damount, dypc_downsampling_mode dmode, dypc_size piece_cap, unsigned threads, dypc_bool additive, const dypc_hdf_file_options* options) DYPC_INTERFACE_DEC;
+void dypc_write_octree_structure_to_file_external(const char* filename, dypc_model mod, unsigned levels, dypc_size leaf_cap, dypc_size dmin, float damount, dypc_downsampling_mode dmode, const char* scratch_dir, dypc_size memory_cap, dypc_bool additive, const dypc_hdf_file_options* options) DYPC_INTERFACE_DEC;
+void dypc_set_build_report_file(const char* filename) DYPC_INTERFACE_DEC;
+void dypc_insert_into_tree_structure_file(const char* filename, dypc_model mod, dypc_size leaf_cap, dypc_downsampling_mode dmode) DYPC_INTERFACE_DEC;
+void dypc_repack_tree_structure_file(const char* filename, const char* output_filename, const dypc_hdf_file_options* options) DYPC_INTERFACE_DEC;
 
 dypc_loader_type dypc_loader_loader_type(dypc_loader) DYPC_INTERFACE_DEC;
 const char* dypc_loader_name(dypc_loader) DYPC_INTERFACE_DEC;
@@ -26,6 +36,9 @@ void dypc_loader_set_setting(dypc_loader, const char* key, double value) DYPC_IN
 double dypc_loader_get_setting(dypc_loader, const char* key) DYPC_INTERFACE_DEC;
 
 void dypc_loader_compute_points(dypc_loader, const dypc_loader_request* request, dypc_points_buffer buffer, dypc_size* count) DYPC_INTERFACE_DEC;
+void dypc_loader_set_output_layout(dypc_loader, dypc_output_layout layout) DYPC_INTERFACE_DEC;
+dypc_output_layout dypc_loader_output_layout(dypc_loader) DYPC_INTERFACE_DEC;
+dypc_size dypc_output_layout_point_size(dypc_output_layout layout) DYPC_INTERFACE_DEC;
 dypc_bool dypc_loader_should_compute_points(dypc_loader, const dypc_loader_request* request, const dypc_loader_request* previous_request, dypc_milliseconds dtime) DYPC_INTERFACE_DEC;
 
 dypc_size dypc_loader_memory_size(dypc_loader) DYPC_INTERFACE_DEC;
@@ -8,6 +8,12 @@ downsampling_loader::downsampling_loader() {
 	downsampling_controller_.reset(new pid_downsampling_controller());
 }
 
+void downsampling_loader::init_session_(downsampling_loader& session) const {
+	loader::init_session_(session);
+	session.adaptive_ = adaptive_;
+	session.downsampling_setting_ = downsampling_setting_;
+}
+
 double downsampling_loader::get_setting(const std::string& setting) const {
 	if(setting == "adaptive") return adaptive_ ? 1.0 : 0.0;
 	else if(setting == "downsampling_setting") return downsampling_setting_;
@@ -30,6 +30,12 @@ protected:
 	
 	virtual std::size_t compute_downsampled_points_(point_buffer_t points, std::size_t capacity, const loader::request_t& req) = 0;
 	
+	/**
+	 * Copy settings into new session of this loader.
+	 * The session gets its own downsampling controller, starting from the current downsampling setting.
+	 */
+	void init_session_(downsampling_loader& session) const;
+	
 public:
 	downsampling_loader();
 
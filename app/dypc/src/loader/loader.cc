@@ -1,4 +1,5 @@
 #include "loader.h"
+#include "output_layout.h"
 
 namespace dypc {
 
@@ -8,6 +9,21 @@ bool loader::should_compute_points(const request_t& request, const request_t& pr
 		request.orientation != previous.orientation;
 }
 
+void loader::compute_points_in_output_layout(const request_t& request, void* buffer, std::size_t& count, std::size_t capacity) {
+	point_buffer_t points = static_cast<point_buffer_t>(buffer);
+	if(output_layout_ == output_layout::point) compute_points(request, points, count, capacity);
+	else compute_points_in_layout_(request, points, count, capacity, output_layout_, output_layout_scratch_);
+}
+
+void loader::compute_points_in_layout_(const request_t& request, point_buffer_t points, std::size_t& count, std::size_t capacity, output_layout layout, std::vector<std::uint8_t>& scratch) {
+	compute_points(request, points, count, capacity);
+	convert_points_to_output_layout(points, count, capacity, layout, request.position, scratch);
+}
+
+loader* loader::create_session() const {
+	throw std::logic_error("Loader does not support sessions");
+}
+
 std::string loader::loader_name() const {
 	return "Unnamed loader";
 }
@@ -13,6 +13,8 @@
 #include <string>
 #include <chrono>
 #include <stdexcept>
+#include <vector>
+#include <cstdint>
 
 namespace dypc {
 
@@ -24,6 +26,16 @@ namespace dypc {
 class loader {
 private:
 	static constexpr float minimal_update_distance_ = 1.0;
+	
+	output_layout output_layout_ = output_layout::point; ///< Layout of points written by compute_points_in_output_layout.
+	std::vector<std::uint8_t> output_layout_scratch_; ///< Memory reused by layout conversion.
+
+protected:
+	/**
+	 * Copy settings into new session of this loader.
+	 * Subclasses that support sessions extend this with their own settings and shared data.
+	 */
+	void init_session_(loader& session) const { session.output_layout_ = output_layout_; }
 
 public:
 	/**
@@ -37,14 +49,15 @@ public:
 		 * Generate request with given values.
 		 * Sets the data members. The view frustum is deduced from the matrix.
 		 */
-		request_t(const glm::vec3& pos, const glm::vec3& vel, const glm::quat& ori, const glm::mat4& mat) :
-			position(pos), velocity(vel), orientation(ori), view_projection_matrix(mat), view_frustum(mat) { }
+		request_t(const glm::vec3& pos, const glm::vec3& vel, const glm::quat& ori, const glm::mat4& mat, float vp_height = 0) :
+			position(pos), velocity(vel), orientation(ori), view_projection_matrix(mat), viewport_height(vp_height), view_frustum(mat) { }
 		
 		
 		glm::vec3 position; ///< Position of the camera in the point cloud.
 		glm::vec3 velocity; ///< Velocity at which the camera is currently moving through the point cloud.
 		glm::quat orientation; ///< Direction the camera is looking at, expressed as quaternion.
 		glm::mat4 view_projection_matrix; ///< Current View-projection matrix.
+		float viewport_height = 0; ///< Height of viewport in pixels. 0 when unknown.
 		
 		/**
 		 * Current view frustum.
@@ -65,6 +78,48 @@ public:
 	 */
 	virtual void compute_points(const request_t& request, point_buffer_t points, std::size_t& count, std::size_t capacity) = 0;
 	
+protected:
+	/**
+	 * Load points into a buffer, in given layout.
+	 * Called by compute_points_in_output_layout. By default calls compute_points, and then converts all points in the
+	 * buffer. Loaders that can convert points while they extract them override this, to avoid the second pass.
+	 * @param request The request.
+	 * @param points Buffer to write points into.
+	 * @param count On output, number of points written into buffer.
+	 * @param capacity Maximal number of points that may be loaded and written to buffer.
+	 * @param layout The output layout.
+	 * @param scratch Memory reused by the layout conversion.
+	 */
+	virtual void compute_points_in_layout_(const request_t& request, point_buffer_t points, std::size_t& count, std::size_t capacity, output_layout layout, std::vector<std::uint8_t>& scratch);
+	
+public:
+	/**
+	 * Create session of this loader.
+	 * A session is a loader of the same type that shares the loaded data with this one, such as the structure or
+	 * the source it reads from, but has its own copy of the settings and its own state across requests. Different
+	 * clients or viewports can each use one session, and call compute_points concurrently on different threads.
+	 * The data stays alive as long as any session that shares it. Must not be called while compute_points of this
+	 * loader is running.
+	 * Throws std::logic_error when the loader does not support sessions.
+	 * @return Pointer to the new session. Must be deleted by the caller.
+	 */
+	virtual loader* create_session() const;
+	
+	/**
+	 * Load points into a buffer, in the output layout of the loader.
+	 * The points are converted in place in the buffer, by the loader while it extracts them, or else after
+	 * compute_points. So the consumer gets them in the layout it uses, without needing to repack them into another
+	 * buffer. @see output_layout_writer
+	 * @param request The request_t object based on which to select point set.
+	 * @param buffer Buffer to write points into. Must have space for \a capacity objects of type point.
+	 * @param count On output, number of points written into buffer.
+	 * @param capacity Maximal number of points that may be loaded and written to buffer.
+	 */
+	void compute_points_in_output_layout(const request_t& request, void* buffer, std::size_t& count, std::size_t capacity);
+	
+	output_layout get_output_layout() const { return output_layout_; } ///< Get layout of points outputted by compute_points_in_output_layout.
+	void set_output_layout(output_layout layout) { output_layout_ = layout; } ///< Set layout of points outputted by compute_points_in_output_layout.
+	
 	/**
 	 * Asks the loader whether a new point set should be loaded.
 	 * For instance when the camera position or orientation has changed. Loading can always be forced by calling compute_points.
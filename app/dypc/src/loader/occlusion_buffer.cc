@@ -0,0 +1,78 @@
+#include "occlusion_buffer.h"
+#include "../util.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace dypc {
+
+occlusion_buffer::occlusion_buffer(std::size_t w, std::size_t h, std::size_t min_coverage) :
+width_(w), height_(h), minimal_coverage_(min_coverage), view_projection_matrix_(1.0), depth_(w * h, 0), coverage_(w * h, 0) { }
+
+
+void occlusion_buffer::resize(std::size_t w, std::size_t h) {
+	width_ = w;
+	height_ = h;
+	depth_.assign(w * h, 0);
+	coverage_.assign(w * h, 0);
+}
+
+
+void occlusion_buffer::clear(const glm::mat4& mat) {
+	view_projection_matrix_ = mat;
+	std::fill(depth_.begin(), depth_.end(), 0);
+	std::fill(coverage_.begin(), coverage_.end(), 0);
+}
+
+
+void occlusion_buffer::add_points(const point* points, std::size_t n) {
+	const glm::mat4& m = view_projection_matrix_;
+	for(const point* p = points; p != points + n; ++p) {
+		float w = m[0][3]*p->x + m[1][3]*p->y + m[2][3]*p->z + m[3][3];
+		if(w <= float_comparison_epsilon) continue;
+		float x = (m[0][0]*p->x + m[1][0]*p->y + m[2][0]*p->z + m[3][0]) / w;
+		float y = (m[0][1]*p->x + m[1][1]*p->y + m[2][1]*p->z + m[3][1]) / w;
+		if(x < -1.0 || x >= 1.0 || y < -1.0 || y >= 1.0) continue;
+
+		std::size_t i = (x + 1.0) * 0.5 * width_;
+		std::size_t j = (y + 1.0) * 0.5 * height_;
+		std::size_t idx = std::min(j, height_ - 1) * width_ + std::min(i, width_ - 1);
+		if(w > depth_[idx]) depth_[idx] = w;
+		++coverage_[idx];
+	}
+}
+
+
+bool occlusion_buffer::cuboid_occluded(const cuboid& cub) const {
+	const glm::mat4& m = view_projection_matrix_;
+
+	float min_x = std::numeric_limits<float>::max(), max_x = -min_x;
+	float min_y = min_x, max_y = -min_x;
+	float nearest = min_x; // Depth is linear on the cuboid, so its nearest point is one of the corners
+	for(const glm::vec3& c : cub.corners()) {
+		float w = m[0][3]*c.x + m[1][3]*c.y + m[2][3]*c.z + m[3][3];
+		if(w <= float_comparison_epsilon) return false;
+		float x = (m[0][0]*c.x + m[1][0]*c.y + m[2][0]*c.z + m[3][0]) / w;
+		float y = (m[0][1]*c.x + m[1][1]*c.y + m[2][1]*c.z + m[3][1]) / w;
+		min_x = std::min(min_x, x); max_x = std::max(max_x, x);
+		min_y = std::min(min_y, y); max_y = std::max(max_y, y);
+		nearest = std::min(nearest, w);
+	}
+
+	min_x = std::max(min_x, -1.0f); max_x = std::min(max_x, 1.0f);
+	min_y = std::max(min_y, -1.0f); max_y = std::min(max_y, 1.0f);
+	if(min_x >= max_x || min_y >= max_y) return false;
+
+	std::ptrdiff_t i0 = std::floor((min_x + 1.0) * 0.5 * width_), i1 = std::ceil((max_x + 1.0) * 0.5 * width_);
+	std::ptrdiff_t j0 = std::floor((min_y + 1.0) * 0.5 * height_), j1 = std::ceil((max_y + 1.0) * 0.5 * height_);
+	i1 = std::min<std::ptrdiff_t>(i1, width_);
+	j1 = std::min<std::ptrdiff_t>(j1, height_);
+
+	for(std::ptrdiff_t j = j0; j < j1; ++j) for(std::ptrdiff_t i = i0; i < i1; ++i) {
+		std::size_t idx = j * width_ + i;
+		if(coverage_[idx] < minimal_coverage_ || depth_[idx] >= nearest) return false;
+	}
+	return true;
+}
+
+}
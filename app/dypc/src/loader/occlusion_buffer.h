@@ -0,0 +1,67 @@
+#ifndef DYPC_OCCLUSION_BUFFER_H_
+#define DYPC_OCCLUSION_BUFFER_H_
+
+#include "../point.h"
+#include "../geometry/cuboid.h"
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+namespace dypc {
+
+/**
+ * Low resolution software depth buffer for conservative occlusion culling.
+ * Points that were already outputted are rasterized into it as single-pixel splats, in normalized device coordinates.
+ * A pixel becomes an occluder only once it was covered by a minimal number of points, and its depth is then the
+ * \e farthest depth of these points. A cuboid is occluded when all pixels covered by its screen-space bounding
+ * rectangle are occluders that are nearer than the nearest corner of the cuboid.
+ * Depth is the clip space \e w coordinate, i.e. distance along viewing direction.
+ */
+class occlusion_buffer {
+private:
+	std::size_t width_;
+	std::size_t height_;
+	std::size_t minimal_coverage_; ///< Number of points that need to fall into pixel for it to occlude.
+	glm::mat4 view_projection_matrix_;
+	std::vector<float> depth_; ///< Farthest depth of points in each pixel.
+	std::vector<std::uint32_t> coverage_; ///< Number of points in each pixel.
+
+public:
+	/**
+	 * Create occlusion buffer.
+	 * @param w Width in pixels.
+	 * @param h Height in pixels.
+	 * @param min_coverage Number of points that need to fall into pixel for it to occlude.
+	 */
+	occlusion_buffer(std::size_t w = 64, std::size_t h = 64, std::size_t min_coverage = 4);
+
+	std::size_t width() const { return width_; }
+	std::size_t height() const { return height_; }
+	std::size_t minimal_coverage() const { return minimal_coverage_; }
+
+	void resize(std::size_t w, std::size_t h);
+	void set_minimal_coverage(std::size_t n) { minimal_coverage_ = n; }
+
+	/**
+	 * Clear the buffer and set projection for new frame.
+	 * @param mat View-projection matrix.
+	 */
+	void clear(const glm::mat4& mat);
+
+	/**
+	 * Rasterize points into the buffer.
+	 * @param points Buffer of points.
+	 * @param n Number of points.
+	 */
+	void add_points(const point* points, std::size_t n);
+
+	/**
+	 * Test whether a cuboid is completely hidden behind the occluders.
+	 * Returns false for cuboids that cross the plane of the camera.
+	 */
+	bool cuboid_occluded(const cuboid& cub) const;
+};
+
+}
+
+#endif
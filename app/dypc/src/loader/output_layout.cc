@@ -0,0 +1,120 @@
+#include "output_layout.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace dypc {
+
+static constexpr std::size_t block_size_ = 256;
+static constexpr std::size_t split_position_size_ = 3 * sizeof(float);
+static constexpr std::size_t split_color_size_ = 4;
+
+static_assert(sizeof(dypc_intensity_point) == sizeof(point), "dypc_intensity_point must have same size as point");
+static_assert(sizeof(dypc_relative_half_point) <= sizeof(point), "dypc_relative_half_point must not be larger than point");
+static_assert(split_position_size_ + split_color_size_ <= sizeof(point), "split layout must not be larger than point");
+
+
+static std::uint8_t intensity_(std::uint8_t r, std::uint8_t g, std::uint8_t b) {
+	return (77 * r + 150 * g + 29 * b) >> 8;
+}
+
+
+static void convert_to_intensity_(point_buffer_t points, std::size_t start, std::size_t count) {
+	// Only the padding byte is written, points stay in place
+	dypc_intensity_point* out = reinterpret_cast<dypc_intensity_point*>(points);
+	for(std::size_t i = start; i < start + count; ++i) out[i].intensity = intensity_(points[i].r, points[i].g, points[i].b);
+}
+
+
+static void convert_to_split_(point_buffer_t points, std::size_t start, std::size_t count, std::vector<std::uint8_t>& colors) {
+	// Colors array would overlap points not yet read or written, so colors are collected separately
+	std::uint8_t* bytes = reinterpret_cast<std::uint8_t*>(points);
+	if(colors.size() < split_color_size_ * (start + count)) colors.resize(split_color_size_ * (start + count));
+
+	point block[block_size_];
+	float positions[3 * block_size_];
+	for(std::size_t block_start = start; block_start < start + count; block_start += block_size_) {
+		std::size_t n = std::min(block_size_, start + count - block_start);
+		std::memcpy(block, points + block_start, n * sizeof(point));
+		std::uint8_t* block_colors = colors.data() + split_color_size_*block_start;
+		for(std::size_t i = 0; i < n; ++i) {
+			positions[3*i] = block[i].x;
+			positions[3*i + 1] = block[i].y;
+			positions[3*i + 2] = block[i].z;
+			block_colors[4*i] = block[i].r;
+			block_colors[4*i + 1] = block[i].g;
+			block_colors[4*i + 2] = block[i].b;
+			block_colors[4*i + 3] = 255;
+		}
+		std::memcpy(bytes + split_position_size_*block_start, positions, split_position_size_*n);
+	}
+}
+
+
+static void convert_to_relative_half_(point_buffer_t points, std::size_t start, std::size_t count, const glm::vec3& origin) {
+	std::uint8_t* bytes = reinterpret_cast<std::uint8_t*>(points);
+	const std::uint16_t one = float_to_half(1.0);
+
+	point block[block_size_];
+	dypc_relative_half_point out[block_size_];
+	for(std::size_t block_start = start; block_start < start + count; block_start += block_size_) {
+		std::size_t n = std::min(block_size_, start + count - block_start);
+		std::memcpy(block, points + block_start, n * sizeof(point));
+		for(std::size_t i = 0; i < n; ++i) {
+			out[i].x = float_to_half(block[i].x - origin.x);
+			out[i].y = float_to_half(block[i].y - origin.y);
+			out[i].z = float_to_half(block[i].z - origin.z);
+			out[i].w = one;
+			out[i].r = block[i].r;
+			out[i].g = block[i].g;
+			out[i].b = block[i].b;
+			out[i].a = 255;
+		}
+		std::memcpy(bytes + sizeof(dypc_relative_half_point)*block_start, out, sizeof(dypc_relative_half_point)*n);
+	}
+}
+
+
+std::size_t output_layout_point_size(output_layout layout) {
+	switch(layout) {
+		case output_layout::point: return sizeof(point);
+		case output_layout::intensity: return sizeof(dypc_intensity_point);
+		case output_layout::split: return split_position_size_ + split_color_size_;
+		case output_layout::relative_half: return sizeof(dypc_relative_half_point);
+		default: throw std::invalid_argument("Invalid output layout");
+	}
+}
+
+
+output_layout_writer::output_layout_writer(point_buffer_t buffer, std::size_t capacity, output_layout layout, const glm::vec3& origin, std::vector<std::uint8_t>& scratch) :
+buffer_(buffer), capacity_(capacity), layout_(layout), origin_(origin), scratch_(scratch) {
+	output_layout_point_size(layout); // Throws if layout is invalid
+	scratch_.clear();
+}
+
+
+void output_layout_writer::convert(std::size_t start, std::size_t count) {
+	switch(layout_) {
+		case output_layout::point: break;
+		case output_layout::intensity: convert_to_intensity_(buffer_, start, count); break;
+		case output_layout::split: convert_to_split_(buffer_, start, count, scratch_); break;
+		case output_layout::relative_half: convert_to_relative_half_(buffer_, start, count, origin_); break;
+		default: throw std::invalid_argument("Invalid output layout");
+	}
+}
+
+
+void output_layout_writer::finish(std::size_t count) {
+	if(layout_ == output_layout::split && count > 0) {
+		std::uint8_t* bytes = reinterpret_cast<std::uint8_t*>(buffer_);
+		std::memcpy(bytes + split_position_size_*capacity_, scratch_.data(), split_color_size_*count);
+	}
+}
+
+
+void convert_points_to_output_layout(point_buffer_t points, std::size_t count, std::size_t capacity, output_layout layout, const glm::vec3& origin, std::vector<std::uint8_t>& scratch) {
+	output_layout_writer writer(points, capacity, layout, origin, scratch);
+	writer.convert(0, count);
+	writer.finish(count);
+}
+
+}
@@ -0,0 +1,96 @@
+#ifndef DYPC_OUTPUT_LAYOUT_H_
+#define DYPC_OUTPUT_LAYOUT_H_
+
+#include "../point.h"
+#include "../enums.h"
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+namespace dypc {
+
+/**
+ * Number of bytes per point used by output layout.
+ * For output_layout::split, the colors array starts after \a capacity positions, so the buffer needs this size per
+ * point of capacity. All layouts take at most sizeof(point) bytes per point.
+ */
+std::size_t output_layout_point_size(output_layout layout);
+
+/**
+ * Convert points into given output layout, in place.
+ * The buffer must have capacity for \a capacity points. Points are processed in small blocks that get copied out
+ * first, so that the conversion loops do not alias and can be vectorized.
+ * @param points Buffer containing points. Gets overwritten with the points in the new layout.
+ * @param count Number of points in the buffer.
+ * @param capacity Capacity of the buffer, in points.
+ * @param layout Layout to convert into. Nothing is done for output_layout::point.
+ * @param origin Camera position, subtracted from positions for output_layout::relative_half.
+ * @param scratch Memory reused between calls, for output_layout::split.
+ */
+void convert_points_to_output_layout(point_buffer_t points, std::size_t count, std::size_t capacity, output_layout layout, const glm::vec3& origin, std::vector<std::uint8_t>& scratch);
+
+
+/**
+ * Converts points into given output layout in place, range by range while they are being written into the buffer.
+ * Each range is first written in point layout, at the indices the points get in the output, and then converted. No
+ * layout takes more than sizeof(point) bytes per point, so the converted points never overlap points written later,
+ * as long as ranges are converted in increasing order and are not written again afterwards.
+ */
+class output_layout_writer {
+private:
+	point_buffer_t buffer_;
+	std::size_t capacity_;
+	output_layout layout_;
+	glm::vec3 origin_;
+	std::vector<std::uint8_t>& scratch_; ///< Colors of output_layout::split, copied behind the positions by finish.
+
+public:
+	/**
+	 * Create writer into buffer.
+	 * @param buffer Buffer for \a capacity points.
+	 * @param capacity Capacity of the buffer, in points.
+	 * @param layout Layout to convert into. Nothing is done for output_layout::point.
+	 * @param origin Camera position, subtracted from positions for output_layout::relative_half.
+	 * @param scratch Memory reused between calls.
+	 */
+	output_layout_writer(point_buffer_t buffer, std::size_t capacity, output_layout layout, const glm::vec3& origin, std::vector<std::uint8_t>& scratch);
+
+	point_buffer_t buffer() const { return buffer_; } ///< Get the buffer.
+	output_layout layout() const { return layout_; } ///< Get the output layout.
+
+	/**
+	 * Convert range of points, which are in the buffer in point layout at their output indices.
+	 * @param start Index of first point.
+	 * @param count Number of points.
+	 */
+	void convert(std::size_t start, std::size_t count);
+
+	/**
+	 * Complete output, after the first \a count points have been converted.
+	 * For output_layout::split, copies the colors array behind the positions.
+	 */
+	void finish(std::size_t count);
+};
+
+
+/**
+ * Convert float to IEEE 754 half precision float.
+ * Rounds to nearest even. Values too small for normalized half floats become zero, and too large values become infinity.
+ */
+inline std::uint16_t float_to_half(float f) {
+	std::uint32_t x;
+	std::memcpy(&x, &f, sizeof(float));
+	std::uint32_t sign = (x >> 16) & 0x8000;
+	std::int32_t exponent = (std::int32_t)((x >> 23) & 0xFF) - 127 + 15;
+	std::uint32_t mantissa = x & 0x7FFFFF;
+	std::uint32_t rounded_mantissa = mantissa + 0xFFF + ((mantissa >> 13) & 1); // Round half to even, may carry into exponent
+	std::uint32_t h = ((std::uint32_t)exponent << 10) + (rounded_mantissa >> 13);
+	h = (exponent <= 0 ? 0 : h);
+	h = (exponent >= 31 || h >= 0x7C00 ? 0x7C00 : h);
+	return sign | h;
+}
+
+}
+
+#endif
@@ -0,0 +1,381 @@
+#include "scene_loader.h"
+#include "../structure/structure_loader_factory.h"
+#include "../structure/tree/tree_structure_loader.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace dypc {
+
+constexpr std::size_t scene_loader::bvh_leaf_tiles_;
+constexpr float scene_loader::capacity_weight_smoothing_;
+constexpr std::size_t scene_loader::maximal_coarse_points_;
+constexpr std::size_t scene_loader::maximal_coarse_reads_per_frame_;
+
+
+/**
+ * Extract part of the points of tree node at given level, spread over the node.
+ * Level is stored depth-first, so a prefix would cover only part of the node. Instead the share is divided among the
+ * children in proportion to their points at the level, down to nodes whose level fits into their share, or leaves.
+ * @see tree_structure_prioritized_loader::extract_node_share_
+ */
+static std::size_t extract_node_share_(const tree_structure_source& source, const tree_structure_source::node& nd, point_buffer_t points, std::size_t share, std::ptrdiff_t lvl) {
+	const std::size_t level_number_of_points = nd.number_of_points(lvl);
+	if(share >= level_number_of_points || nd.is_leaf()) return nd.extract_points(points, share, lvl);
+
+	std::size_t c = 0;
+	std::size_t children_number_of_points = 0;
+	std::size_t assigned = 0;
+	for(std::ptrdiff_t i = 0; i < source.number_of_node_children(); ++i) if(nd.has_child(i)) {
+		const tree_structure_source::node& child = nd.child(i);
+		children_number_of_points += child.number_of_points(lvl);
+		std::size_t child_share = std::min<std::size_t>((double)share * children_number_of_points / level_number_of_points, share) - assigned;
+		assigned += child_share;
+		if(child_share > 0) c += extract_node_share_(source, child, points + c, child_share, lvl);
+	}
+	return c;
+}
+
+
+std::vector<scene_loader::tile> scene_loader::read_manifest(const std::string& filename) {
+	std::ifstream file(filename);
+	if(! file) throw std::runtime_error("Could not open scene manifest " + filename);
+
+	std::string directory;
+	auto slash = filename.rfind('/');
+	if(slash != std::string::npos) directory = filename.substr(0, slash + 1);
+
+	std::vector<tile> tiles;
+	std::string line;
+	std::size_t line_number = 0;
+	while(std::getline(file, line)) {
+		++line_number;
+		if(line.find_first_not_of(" \t\r") == std::string::npos || line[line.find_first_not_of(" \t")] == '#') continue;
+
+		std::istringstream str(line);
+		tile t;
+		glm::vec3 origin, extremity;
+		str >> t.filename >> origin[0] >> origin[1] >> origin[2] >> extremity[0] >> extremity[1] >> extremity[2] >> t.number_of_points;
+		if(! str) throw std::runtime_error("Invalid scene manifest line " + std::to_string(line_number));
+
+		if(t.filename[0] != '/') t.filename = directory + t.filename;
+		t.bounds = make_cuboid(origin, extremity);
+		tiles.push_back(t);
+	}
+	return tiles;
+}
+
+
+scene_loader::scene_loader(const std::vector<tile>& tiles, tree_structure_loader_type ltype, std::size_t maximal_open_tiles, std::size_t memory_budget) :
+tiles_(tiles), tree_loader_type_(ltype), maximal_open_tiles_(maximal_open_tiles), memory_budget_(memory_budget), open_tiles_(tiles.size()) {
+	if(maximal_open_tiles_ == 0) throw std::invalid_argument("Scene loader needs at least one open tile");
+	for(const tile& t : tiles_) number_of_points_ += t.number_of_points;
+
+	bvh_tiles_.resize(tiles_.size());
+	for(std::size_t i = 0; i < tiles_.size(); ++i) bvh_tiles_[i] = i;
+	if(! tiles_.empty()) build_bvh_(0, tiles_.size());
+}
+
+
+std::ptrdiff_t scene_loader::build_bvh_(std::ptrdiff_t first, std::ptrdiff_t count) {
+	std::ptrdiff_t index = bvh_nodes_.size();
+	bvh_nodes_.push_back(bvh_node());
+
+	auto tiles_begin = bvh_tiles_.begin() + first, tiles_end = tiles_begin + count;
+	glm::vec3 origin = tiles_[*tiles_begin].bounds.origin, extremity = tiles_[*tiles_begin].bounds.extremity;
+	glm::vec3 centers_origin = tiles_[*tiles_begin].bounds.center(), centers_extremity = centers_origin;
+	for(auto it = tiles_begin; it != tiles_end; ++it) {
+		const cuboid& bounds = tiles_[*it].bounds;
+		origin = glm::min(origin, bounds.origin);
+		extremity = glm::max(extremity, bounds.extremity);
+		centers_origin = glm::min(centers_origin, bounds.center());
+		centers_extremity = glm::max(centers_extremity, bounds.center());
+	}
+
+	bvh_node nd;
+	nd.bounds = make_cuboid(origin, extremity);
+	nd.children[0] = nd.children[1] = -1;
+	nd.first_tile = first;
+	nd.number_of_tiles = count;
+
+	if(count > std::ptrdiff_t(bvh_leaf_tiles_)) {
+		// Split at median of tile centers, along axis where they are most spread out
+		glm::vec3 spread = centers_extremity - centers_origin;
+		std::ptrdiff_t axis = 0;
+		if(spread[1] > spread[axis]) axis = 1;
+		if(spread[2] > spread[axis]) axis = 2;
+		std::ptrdiff_t half = count / 2;
+		std::nth_element(tiles_begin, tiles_begin + half, tiles_end, [&](std::ptrdiff_t a, std::ptrdiff_t b) {
+			return tiles_[a].bounds.center()[axis] < tiles_[b].bounds.center()[axis];
+		});
+		nd.children[0] = build_bvh_(first, half);
+		nd.children[1] = build_bvh_(first + half, count - half);
+	}
+
+	bvh_nodes_[index] = nd;
+	return index;
+}
+
+
+void scene_loader::collect_visible_tiles_(const request_t& req, std::vector<std::ptrdiff_t>& visible) const {
+	if(bvh_nodes_.empty()) return;
+	std::vector<std::ptrdiff_t> stack { 0 };
+	while(! stack.empty()) {
+		const bvh_node& nd = bvh_nodes_[stack.back()];
+		stack.pop_back();
+
+		auto intersection = req.view_frustum.contains_cuboid(nd.bounds);
+		if(intersection == frustum::outside_frustum) continue;
+
+		if(nd.children[0] != -1) {
+			stack.push_back(nd.children[0]);
+			stack.push_back(nd.children[1]);
+		} else {
+			for(std::ptrdiff_t i = nd.first_tile; i < nd.first_tile + nd.number_of_tiles; ++i) {
+				std::ptrdiff_t t = bvh_tiles_[i];
+				if(intersection == frustum::inside_frustum || req.view_frustum.contains_cuboid(tiles_[t].bounds) != frustum::outside_frustum)
+					visible.push_back(t);
+			}
+		}
+	}
+}
+
+
+float scene_loader::tile_importance_(const tile& t, const request_t& req) {
+	// Approximates projected area of the tile. Bounded when the camera is close to or inside the tile.
+	float diagonal = glm::length(t.bounds.side_lengths());
+	float distance = t.bounds.minimal_distance(req.position);
+	return sq(diagonal / (distance + 0.5f*diagonal + float_comparison_epsilon));
+}
+
+
+loader& scene_loader::open_tile_(std::ptrdiff_t index) {
+	open_tile& ot = open_tiles_[index];
+	if(! ot.tile_loader) {
+		ot.tile_loader.reset(create_structure_file_loader(tiles_[index].filename, tree_loader_type_));
+		++number_of_open_tiles_;
+		for(const auto& setting : tile_settings_) {
+			try {
+				ot.tile_loader->set_setting(setting.first, setting.second);
+			} catch(const std::invalid_argument&) {
+				// Setting does not apply to this type of loader
+			}
+		}
+		if(! ot.coarse_points_read) read_coarse_points_(index, *ot.tile_loader);
+	}
+	ot.last_used_frame = frame_;
+	return *ot.tile_loader;
+}
+
+
+void scene_loader::read_coarse_points_(std::ptrdiff_t index, loader& tile_loader) {
+	open_tile& ot = open_tiles_[index];
+	ot.coarse_points_read = true;
+
+	// Only trees have a coarsest level that covers the whole tile
+	tree_structure_loader* tree_loader = dynamic_cast<tree_structure_loader*>(&tile_loader);
+	if(! tree_loader) return;
+	std::shared_ptr<const tree_structure_source> source = tree_loader->get_source();
+	std::ptrdiff_t coarsest_level = source->levels() - 1;
+
+	std::vector<point> coarse_points(maximal_coarse_points_);
+	source->begin_traversal();
+	try {
+		const tree_structure_source::node& root = source->root_node();
+		coarse_points.resize(extract_node_share_(*source, root, coarse_points.data(), maximal_coarse_points_, coarsest_level));
+	} catch(...) {
+		source->end_traversal();
+		throw;
+	}
+	source->end_traversal();
+	ot.coarse_points.assign(coarse_points.begin(), coarse_points.end());
+	coarse_points_memory_ += ot.coarse_points.capacity() * sizeof(point);
+}
+
+
+void scene_loader::drop_coarse_points_(std::ptrdiff_t index) {
+	open_tile& ot = open_tiles_[index];
+	coarse_points_memory_ -= ot.coarse_points.capacity() * sizeof(point);
+	std::vector<point>().swap(ot.coarse_points);
+	ot.coarse_points_read = false;
+}
+
+
+std::size_t scene_loader::extract_coarse_points_(std::ptrdiff_t index, point_buffer_t points, std::size_t capacity, std::size_t& file_reads) {
+	open_tile& ot = open_tiles_[index];
+	if(! ot.coarse_points_read) {
+		if(ot.tile_loader) {
+			read_coarse_points_(index, *ot.tile_loader);
+		} else if(file_reads < maximal_coarse_reads_per_frame_) {
+			// Opened only for reading, so that the number of open tiles stays within the limit
+			std::unique_ptr<loader> tile_loader(create_structure_file_loader(tiles_[index].filename, tree_loader_type_));
+			read_coarse_points_(index, *tile_loader);
+			++file_reads;
+		} else {
+			coarse_points_pending_ = true;
+			return 0;
+		}
+	}
+
+	std::size_t n = ot.coarse_points.size();
+	std::size_t m = std::min(n, capacity);
+	for(std::size_t i = 0; i < m; ++i) points[i] = ot.coarse_points[i * n / m];
+	return m;
+}
+
+
+void scene_loader::update_capacity_weights_(const std::vector<std::pair<float, std::ptrdiff_t>>& importances) {
+	double total_importance = 0.0;
+	for(const auto& entry : importances) total_importance += entry.first;
+	if(total_importance <= 0.0) return;
+
+	for(const auto& entry : importances) {
+		open_tile& ot = open_tiles_[entry.second];
+		float target = entry.first / total_importance;
+		// Tiles that just became visible start at their importance
+		if(ot.visible_frame + 1 == frame_) ot.capacity_weight += capacity_weight_smoothing_ * (target - ot.capacity_weight);
+		else ot.capacity_weight = target;
+		ot.visible_frame = frame_;
+	}
+}
+
+
+std::size_t scene_loader::open_tiles_memory_size_() const {
+	std::size_t total = 0;
+	for(const open_tile& ot : open_tiles_) if(ot.tile_loader) total += ot.tile_loader->memory_size();
+	return total;
+}
+
+
+void scene_loader::close_unused_tiles_() {
+	std::size_t memory = (memory_budget_ ? open_tiles_memory_size_() + coarse_points_memory_ : 0);
+	while(number_of_open_tiles_ > maximal_open_tiles_ || memory > memory_budget_) {
+		// Least recently used tile, not used for current request
+		std::ptrdiff_t lru = -1;
+		for(std::size_t i = 0; i < open_tiles_.size(); ++i) {
+			const open_tile& ot = open_tiles_[i];
+			if(! ot.tile_loader || ot.last_used_frame == frame_) continue;
+			if(lru == -1 || ot.last_used_frame < open_tiles_[lru].last_used_frame) lru = i;
+		}
+		if(lru == -1) break;
+
+		if(memory_budget_) memory -= open_tiles_[lru].tile_loader->memory_size();
+		open_tiles_[lru].tile_loader.reset();
+		--number_of_open_tiles_;
+	}
+
+	// Then coarse points of tiles least recently visible, not visible for current request
+	while(memory > memory_budget_) {
+		std::ptrdiff_t lru = -1;
+		for(std::size_t i = 0; i < open_tiles_.size(); ++i) {
+			const open_tile& ot = open_tiles_[i];
+			if(ot.coarse_points.empty() || ot.visible_frame == frame_) continue;
+			if(lru == -1 || ot.visible_frame < open_tiles_[lru].visible_frame) lru = i;
+		}
+		if(lru == -1) break;
+
+		memory -= open_tiles_[lru].coarse_points.capacity() * sizeof(point);
+		drop_coarse_points_(lru);
+	}
+}
+
+
+void scene_loader::compute_points(const request_t& req, point_buffer_t points, std::size_t& count, std::size_t capacity) {
+	++frame_;
+	coarse_points_pending_ = false;
+	std::size_t coarse_file_reads = 0;
+
+	std::vector<std::ptrdiff_t> visible;
+	collect_visible_tiles_(req, visible);
+
+	using importance_entry = std::pair<float, std::ptrdiff_t>;
+	std::vector<importance_entry> importances;
+	importances.reserve(visible.size());
+	for(std::ptrdiff_t t : visible) importances.emplace_back(tile_importance_(tiles_[t], req), t);
+	std::sort(importances.begin(), importances.end(), [](const importance_entry& a, const importance_entry& b) { return a.first > b.first; });
+	update_capacity_weights_(importances);
+
+	double remaining_weight = 0.0;
+	for(const importance_entry& entry : importances) remaining_weight += open_tiles_[entry.second].capacity_weight;
+
+	std::size_t total = 0;
+	for(std::size_t rank = 0; rank < importances.size(); ++rank) {
+		std::ptrdiff_t t = importances[rank].second;
+		float weight = open_tiles_[t].capacity_weight;
+		std::size_t remaining_capacity = capacity - total;
+		if(remaining_capacity == 0) break;
+
+		std::size_t share = remaining_capacity;
+		if(remaining_weight > weight) share = remaining_capacity * (weight / remaining_weight);
+		remaining_weight -= weight;
+		if(share == 0) continue;
+
+		if(rank < maximal_open_tiles_) {
+			std::size_t tile_count = 0;
+			open_tile_(t).compute_points(req, points + total, tile_count, share);
+			total += tile_count;
+		} else {
+			total += extract_coarse_points_(t, points + total, share, coarse_file_reads);
+		}
+	}
+	count = total;
+
+	close_unused_tiles_();
+}
+
+
+bool scene_loader::should_compute_points(const request_t& request, const request_t& previous, std::chrono::milliseconds dtime) {
+	if(loader::should_compute_points(request, previous, dtime)) return true;
+	if(coarse_points_pending_) return true;
+
+	// Tile loaders used for the last request may want to recompute even if the camera did not move
+	for(const open_tile& ot : open_tiles_) {
+		if(ot.tile_loader && ot.last_used_frame == frame_ && ot.tile_loader->should_compute_points(request, previous, dtime)) return true;
+	}
+	return false;
+}
+
+
+double scene_loader::get_setting(const std::string& setting) const {
+	if(setting == "maximal_open_tiles") return maximal_open_tiles_;
+	else if(setting == "memory_budget") return memory_budget_;
+
+	auto it = tile_settings_.find(setting);
+	if(it != tile_settings_.end()) return it->second;
+	for(const open_tile& ot : open_tiles_) if(ot.tile_loader) return ot.tile_loader->get_setting(setting);
+	return loader::get_setting(setting);
+}
+
+
+void scene_loader::set_setting(const std::string& setting, double value) {
+	if(setting == "maximal_open_tiles") {
+		if(value < 1.0) throw std::invalid_argument("Scene loader needs at least one open tile");
+		maximal_open_tiles_ = value;
+	} else if(setting == "memory_budget") {
+		memory_budget_ = value;
+	} else {
+		tile_settings_[setting] = value;
+		for(open_tile& ot : open_tiles_) {
+			if(! ot.tile_loader) continue;
+			try {
+				ot.tile_loader->set_setting(setting, value);
+			} catch(const std::invalid_argument&) { }
+		}
+	}
+}
+
+
+std::size_t scene_loader::memory_size() const {
+	return open_tiles_memory_size_() + coarse_points_memory_ + bvh_nodes_.size()*sizeof(bvh_node) + tiles_.size()*(sizeof(tile) + sizeof(open_tile));
+}
+
+
+std::size_t scene_loader::rom_size() const {
+	std::size_t total = 0;
+	for(const open_tile& ot : open_tiles_) if(ot.tile_loader) total += ot.tile_loader->rom_size();
+	return total;
+}
+
+}
@@ -0,0 +1,129 @@
+#ifndef DYPC_SCENE_LOADER_H_
+#define DYPC_SCENE_LOADER_H_
+
+#include "loader.h"
+#include "../geometry/cuboid.h"
+#include "../enums.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <utility>
+#include <cstdint>
+
+namespace dypc {
+
+/**
+ * Loader for a scene composed of many separately built structure files, called tiles.
+ * Keeps a bounding volume hierarchy over the tile cuboids, and only opens loaders (@see create_structure_file_loader)
+ * for tiles that are visible. The capacity is split among visible tiles by projected importance: tiles are processed
+ * from most to least important, and each gets its share of the capacity that remains, so that capacity left unused by
+ * a tile goes to the following ones. The shares follow the importances smoothly from frame to frame, so that the
+ * point density of a tile does not jump when other tiles enter or leave the view.
+ * At most maximal_open_tiles tile loaders are kept open, and if a memory budget is set, the memory of open tile loaders
+ * and of kept coarse points is kept below it. Tiles that were least recently visible get closed first, and their coarse
+ * points dropped after that. Visible tiles beyond the maximal_open_tiles most important ones get points from the
+ * coarsest level of their tree, which is kept in memory once read. Reading them opens the tile file, so only a few
+ * tiles get read per request, and the others get their coarse points in the following requests.
+ * Settings other than those of the scene loader are passed on to all tile loaders.
+ */
+class scene_loader : public loader {
+public:
+	/**
+	 * Tile of the scene.
+	 */
+	struct tile {
+		std::string filename; ///< Path of structure file.
+		cuboid bounds; ///< Cuboid enclosing the points of the tile.
+		std::size_t number_of_points; ///< Number of points in tile.
+	};
+
+private:
+	struct bvh_node {
+		cuboid bounds;
+		std::ptrdiff_t children[2]; ///< Child nodes, or -1 for leaf.
+		std::ptrdiff_t first_tile; ///< For leaf, offset of its tiles in bvh_tiles_.
+		std::ptrdiff_t number_of_tiles;
+	};
+
+	struct open_tile {
+		std::unique_ptr<loader> tile_loader;
+		std::uint64_t last_used_frame = 0;
+		std::uint64_t visible_frame = 0; ///< Last frame in which tile was visible.
+		float capacity_weight = 0.0; ///< Smoothed fraction of capacity given to tile.
+		bool coarse_points_read = false;
+		std::vector<point> coarse_points; ///< Points spread over coarsest level, kept when tile loader is closed.
+	};
+
+	static constexpr std::size_t bvh_leaf_tiles_ = 4; ///< Maximal number of tiles in BVH leaf.
+	static constexpr float capacity_weight_smoothing_ = 0.3; ///< Fraction by which capacity weight of visible tile moves towards its importance each frame.
+	static constexpr std::size_t maximal_coarse_points_ = 1024; ///< Maximal number of coarse points kept per tile.
+	static constexpr std::size_t maximal_coarse_reads_per_frame_ = 4; ///< Maximal number of closed tiles opened per request to read their coarse points.
+
+	const std::vector<tile> tiles_;
+	const tree_structure_loader_type tree_loader_type_;
+	std::size_t maximal_open_tiles_;
+	std::size_t memory_budget_;
+
+	std::vector<bvh_node> bvh_nodes_; ///< BVH nodes, root first.
+	std::vector<std::ptrdiff_t> bvh_tiles_; ///< Tile indices, ordered by BVH leaves.
+
+	std::vector<open_tile> open_tiles_; ///< For each tile. Loader is null when tile is not open.
+	std::size_t number_of_open_tiles_ = 0;
+	std::size_t coarse_points_memory_ = 0; ///< Memory of coarse points kept for all tiles, in bytes.
+	bool coarse_points_pending_ = false; ///< Whether visible tiles were left without coarse points in the last request.
+	std::uint64_t frame_ = 0; ///< Incremented on each compute_points call.
+	std::map<std::string, double> tile_settings_; ///< Settings passed on to tile loaders.
+	std::size_t number_of_points_ = 0;
+
+	std::ptrdiff_t build_bvh_(std::ptrdiff_t first, std::ptrdiff_t count);
+	void collect_visible_tiles_(const request_t&, std::vector<std::ptrdiff_t>& visible) const;
+	static float tile_importance_(const tile&, const request_t&);
+	loader& open_tile_(std::ptrdiff_t index);
+	void read_coarse_points_(std::ptrdiff_t index, loader& tile_loader);
+	void drop_coarse_points_(std::ptrdiff_t index);
+	std::size_t extract_coarse_points_(std::ptrdiff_t index, point_buffer_t points, std::size_t capacity, std::size_t& file_reads);
+	void update_capacity_weights_(const std::vector<std::pair<float, std::ptrdiff_t>>& importances);
+	void close_unused_tiles_();
+	std::size_t open_tiles_memory_size_() const;
+
+public:
+	/**
+	 * Read scene manifest file.
+	 * Each line describes one tile: path of the structure file, relative to the manifest, followed by the origin and
+	 * extremity of its bounding cuboid, and its number of points, separated by spaces. Empty lines, and lines
+	 * starting with #, are ignored. Paths cannot contain spaces.
+	 * @param filename Path of manifest file.
+	 */
+	static std::vector<tile> read_manifest(const std::string& filename);
+
+	/**
+	 * Create scene loader.
+	 * Tile files are only opened when they become visible.
+	 * @param tiles The tiles.
+	 * @param ltype Loader type used for tiles with tree structures.
+	 * @param maximal_open_tiles Maximal number of tile loaders kept open. At most this many tiles are loaded per request, further visible tiles only get coarse points.
+	 * @param memory_budget Memory of open tile loaders and coarse points in bytes, beyond which unused tiles get closed. 0 for no limit.
+	 */
+	explicit scene_loader(const std::vector<tile>& tiles, tree_structure_loader_type ltype = tree_structure_loader_type::ordered, std::size_t maximal_open_tiles = 64, std::size_t memory_budget = 0);
+
+	void compute_points(const request_t& request, point_buffer_t points, std::size_t& count, std::size_t capacity) override;
+	bool should_compute_points(const request_t& request, const request_t& previous, std::chrono::milliseconds dtime) override;
+
+	std::string loader_name() const override { return "Scene Loader"; }
+	loader_type get_loader_type() const override { return loader_type::scene; }
+
+	double get_setting(const std::string&) const override;
+	void set_setting(const std::string&, double) override;
+
+	std::size_t memory_size() const override;
+	std::size_t rom_size() const override;
+	std::size_t number_of_points() const override { return number_of_points_; }
+
+	std::size_t number_of_tiles() const { return tiles_.size(); }
+	std::size_t number_of_open_tiles() const { return number_of_open_tiles_; }
+};
+
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include "model.h"
 #include "../progress.h"
 #include <cstring>
+#include <algorithm>
 
 namespace dypc {
 
@@ -14,22 +15,34 @@ cuboid model::bounding_cuboid(float ep) {
 }
 
 void model::find_bounds_() {
-	auto it = begin();
-	auto it_end = end();
+	// Reads the handle chunk-wise instead of going through iterator, so that the inner loop has no per-point overhead.
+	constexpr std::size_t chunk_size = 1 << 16;
+	std::unique_ptr<handle> hd = make_handle_();
+	std::unique_ptr<point[]> buffer(new point[chunk_size]);
+	bool first = true;
+	float min_x = 0, min_y = 0, min_z = 0, max_x = 0, max_y = 0, max_z = 0;
 	
-	// Use first point's coordinates as initial min/max
-	minimum_ = maximum_ = *it;
-	
-	progress_foreach(it, it_end, number_of_points(), "Finding bounds of model", [&](const point& pt) {
-		if(pt.x < minimum_[0]) minimum_[0] = pt.x;
-		else if(pt.x > maximum_[0]) maximum_[0] = pt.x;
-		
-		if(pt.y < minimum_[1]) minimum_[1] = pt.y;
-		else if(pt.y > maximum_[1]) maximum_[1] = pt.y;
-
-		if(pt.z < minimum_[2]) minimum_[2] = pt.z;
-		else if(pt.z > maximum_[2]) maximum_[2] = pt.z;
+	shared_progress pr(number_of_points(), "Finding bounds of model", "points", sizeof(point));
+	pr.run(1, [&](shared_progress::counter& scanned) {
+		while(! hd->eof()) {
+			std::size_t n = hd->read(buffer.get(), chunk_size);
+			if(n == 0) continue;
+			if(first) {
+				min_x = max_x = buffer[0].x; min_y = max_y = buffer[0].y; min_z = max_z = buffer[0].z;
+				first = false;
+			}
+			for(std::size_t i = 0; i < n; ++i) {
+				const point& pt = buffer[i];
+				min_x = std::min(min_x, pt.x); max_x = std::max(max_x, pt.x);
+				min_y = std::min(min_y, pt.y); max_y = std::max(max_y, pt.y);
+				min_z = std::min(min_z, pt.z); max_z = std::max(max_z, pt.z);
+			}
+			scanned.add(n);
+		}
 	});
+	
+	minimum_ = glm::vec3(min_x, min_y, min_z);
+	maximum_ = glm::vec3(max_x, max_y, max_z);
 }
 
 
@@ -0,0 +1,203 @@
+#ifndef DYPC_POINT_SOA_CONTAINER_H_
+#define DYPC_POINT_SOA_CONTAINER_H_
+
+#include "point.h"
+#include <vector>
+#include <iterator>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <memory>
+
+namespace dypc {
+
+/**
+ * Allocator that aligns memory blocks.
+ * @tparam T Element type.
+ * @tparam Alignment Alignment in bytes, must be a power of two multiple of sizeof(void*).
+ */
+template<class T, std::size_t Alignment>
+class aligned_allocator {
+public:
+	using value_type = T;
+	template<class U> struct rebind { using other = aligned_allocator<U, Alignment>; };
+
+	aligned_allocator() = default;
+	template<class U> aligned_allocator(const aligned_allocator<U, Alignment>&) { }
+
+	T* allocate(std::size_t n) {
+		void* ptr = nullptr;
+		if(posix_memalign(&ptr, Alignment, n * sizeof(T)) != 0) throw std::bad_alloc();
+		return static_cast<T*>(ptr);
+	}
+
+	void deallocate(T* ptr, std::size_t n) {
+		std::free(ptr);
+	}
+
+	template<class U> bool operator==(const aligned_allocator<U, Alignment>&) const { return true; }
+	template<class U> bool operator!=(const aligned_allocator<U, Alignment>&) const { return false; }
+};
+
+
+/**
+ * Container of points, stored as structure of arrays.
+ * Coordinates and colors are kept in separate aligned arrays, so that kernels which only read coordinates can be
+ * vectorized by the compiler. In an array of point, each coordinate recurs with a 16 byte stride (three floats and
+ * three color bytes, padded), so vector loads would have to gather it. Can be used as PointsContainer
+ * of tree_structure. The iterators give points by value, so the points are converted back into point only when they
+ * are read out. Points cannot be modified in place.
+ * Like with std::vector, iterators remain valid when the container is moved or swapped, because the arrays are held
+ * on the heap and iterators refer to them.
+ */
+class point_soa_container {
+public:
+	static constexpr std::size_t alignment = 32; ///< Alignment of the arrays, in bytes.
+
+	class const_iterator;
+	using iterator = const_iterator;
+	using value_type = point;
+	using size_type = std::size_t;
+	using difference_type = std::ptrdiff_t;
+
+private:
+	template<class T> using array_t = std::vector<T, aligned_allocator<T, alignment>>;
+
+	struct arrays {
+		array_t<float> x, y, z;
+		array_t<std::uint8_t> r, g, b;
+
+		point operator[](std::size_t i) const { return point(x[i], y[i], z[i], r[i], g[i], b[i]); }
+	};
+
+	std::unique_ptr<arrays> arrays_; ///< Never null, also not after move.
+
+public:
+	point_soa_container() : arrays_(new arrays) { }
+	point_soa_container(const point_soa_container& c) : arrays_(new arrays(*c.arrays_)) { }
+	point_soa_container(point_soa_container&& c) : arrays_(new arrays) { arrays_.swap(c.arrays_); }
+
+	point_soa_container& operator=(const point_soa_container& c) { *arrays_ = *c.arrays_; return *this; }
+	point_soa_container& operator=(point_soa_container&& c) { arrays_.swap(c.arrays_); return *this; }
+
+	std::size_t size() const { return arrays_->x.size(); }
+	bool empty() const { return arrays_->x.empty(); }
+
+	const float* x() const { return arrays_->x.data(); } ///< Array of X coordinates.
+	const float* y() const { return arrays_->y.data(); } ///< Array of Y coordinates.
+	const float* z() const { return arrays_->z.data(); } ///< Array of Z coordinates.
+
+	point operator[](std::size_t i) const { return (*arrays_)[i]; }
+
+	const_iterator begin() const;
+	const_iterator end() const;
+	const_iterator cbegin() const;
+	const_iterator cend() const;
+
+	void push_back(const point& pt) {
+		arrays& a = *arrays_;
+		a.x.push_back(pt.x); a.y.push_back(pt.y); a.z.push_back(pt.z);
+		a.r.push_back(pt.r); a.g.push_back(pt.g); a.b.push_back(pt.b);
+	}
+
+	const_iterator insert(const_iterator pos, const point& pt);
+
+	void reserve(std::size_t n) {
+		arrays& a = *arrays_;
+		a.x.reserve(n); a.y.reserve(n); a.z.reserve(n);
+		a.r.reserve(n); a.g.reserve(n); a.b.reserve(n);
+	}
+
+	void clear() {
+		arrays& a = *arrays_;
+		a.x.clear(); a.y.clear(); a.z.clear();
+		a.r.clear(); a.g.clear(); a.b.clear();
+	}
+
+	void shrink_to_fit() {
+		arrays& a = *arrays_;
+		a.x.shrink_to_fit(); a.y.shrink_to_fit(); a.z.shrink_to_fit();
+		a.r.shrink_to_fit(); a.g.shrink_to_fit(); a.b.shrink_to_fit();
+	}
+
+	void swap(point_soa_container& other) {
+		arrays_.swap(other.arrays_);
+	}
+};
+
+
+/**
+ * Random access iterator for point_soa_container.
+ * Dereferencing yields point by value. Remains trivially copyable, so that it can be stored in a union.
+ */
+class point_soa_container::const_iterator {
+public:
+	/// Holds point for operator->.
+	class arrow_proxy {
+	private:
+		point pt_;
+	public:
+		explicit arrow_proxy(const point& pt) : pt_(pt) { }
+		const point* operator->() const { return &pt_; }
+	};
+
+	using iterator_category = std::random_access_iterator_tag;
+	using value_type = point;
+	using difference_type = std::ptrdiff_t;
+	using pointer = arrow_proxy;
+	using reference = point;
+
+private:
+	const arrays* arrays_;
+	std::ptrdiff_t index_;
+
+public:
+	const_iterator() = default;
+	const_iterator(const arrays* a, std::ptrdiff_t i) : arrays_(a), index_(i) { }
+
+	std::ptrdiff_t index() const { return index_; }
+
+	const float* x() const { return arrays_->x.data() + index_; } ///< X coordinates, starting at this point.
+	const float* y() const { return arrays_->y.data() + index_; } ///< Y coordinates, starting at this point.
+	const float* z() const { return arrays_->z.data() + index_; } ///< Z coordinates, starting at this point.
+
+	point operator*() const { return (*arrays_)[index_]; }
+	arrow_proxy operator->() const { return arrow_proxy(**this); }
+	point operator[](std::ptrdiff_t n) const { return (*arrays_)[index_ + n]; }
+
+	const_iterator& operator++() { ++index_; return *this; }
+	const_iterator& operator--() { --index_; return *this; }
+	const_iterator operator++(int) { const_iterator it = *this; ++index_; return it; }
+	const_iterator operator--(int) { const_iterator it = *this; --index_; return it; }
+	const_iterator& operator+=(std::ptrdiff_t n) { index_ += n; return *this; }
+	const_iterator& operator-=(std::ptrdiff_t n) { index_ -= n; return *this; }
+	const_iterator operator+(std::ptrdiff_t n) const { return const_iterator(arrays_, index_ + n); }
+	const_iterator operator-(std::ptrdiff_t n) const { return const_iterator(arrays_, index_ - n); }
+	std::ptrdiff_t operator-(const const_iterator& it) const { return index_ - it.index_; }
+
+	bool operator==(const const_iterator& it) const { return index_ == it.index_; }
+	bool operator!=(const const_iterator& it) const { return index_ != it.index_; }
+	bool operator<(const const_iterator& it) const { return index_ < it.index_; }
+	bool operator>(const const_iterator& it) const { return index_ > it.index_; }
+	bool operator<=(const const_iterator& it) const { return index_ <= it.index_; }
+	bool operator>=(const const_iterator& it) const { return index_ >= it.index_; }
+};
+
+
+inline point_soa_container::const_iterator point_soa_container::begin() const { return const_iterator(arrays_.get(), 0); }
+inline point_soa_container::const_iterator point_soa_container::end() const { return const_iterator(arrays_.get(), size()); }
+inline point_soa_container::const_iterator point_soa_container::cbegin() const { return begin(); }
+inline point_soa_container::const_iterator point_soa_container::cend() const { return end(); }
+
+
+inline point_soa_container::const_iterator point_soa_container::insert(const_iterator pos, const point& pt) {
+	std::ptrdiff_t i = pos.index();
+	arrays& a = *arrays_;
+	a.x.insert(a.x.begin() + i, pt.x); a.y.insert(a.y.begin() + i, pt.y); a.z.insert(a.z.begin() + i, pt.z);
+	a.r.insert(a.r.begin() + i, pt.r); a.g.insert(a.g.begin() + i, pt.g); a.b.insert(a.b.begin() + i, pt.b);
+	return const_iterator(arrays_.get(), i);
+}
+
+}
+
+#endif
@@ -0,0 +1,64 @@
+#include "progress.h"
+#include "util.h"
+
+namespace dypc {
+
+constexpr std::size_t shared_progress::maximum_;
+constexpr std::chrono::milliseconds shared_progress::report_interval_;
+constexpr std::chrono::seconds shared_progress::message_interval_;
+constexpr std::size_t shared_progress::counter::chunk_;
+
+
+shared_progress::shared_progress(std::size_t total, const std::string& label, const std::string& unit, std::size_t bytes_per_unit) :
+stage_(label), value_(0), total_(total), unit_(unit), bytes_per_unit_(bytes_per_unit), progress_(nullptr) {
+	dypc_progress& current = current_progress_();
+	previous_ = current;
+	if(! progress_muted_()) {
+		progress_ = dypc_current_progress_callbacks.open(label.c_str(), maximum_, current);
+		current = progress_;
+	}
+	start_time_ = last_message_time_ = clock::now();
+}
+
+
+shared_progress::~shared_progress() {
+	if(! progress_) return;
+	double seconds = std::chrono::duration<double>(clock::now() - start_time_).count();
+	std::string msg = std::to_string(value()) + " " + unit_ + " in " + float_to_string(seconds, 1) + " s";
+	if(seconds > 0) msg += " (" + throughput_message_(seconds) + ")";
+	dypc_current_progress_callbacks.message(progress_, msg.c_str());
+	dypc_current_progress_callbacks.close(progress_);
+	current_progress_() = previous_;
+}
+
+
+std::string shared_progress::throughput_message_(double seconds) const {
+	double rate = value() / seconds;
+	std::string msg = float_to_string(rate, 0) + " " + unit_ + "/s";
+	if(bytes_per_unit_) msg += ", " + float_to_string(rate * bytes_per_unit_ / (1024.0 * 1024.0), 1) + " MB/s";
+	return msg;
+}
+
+
+void shared_progress::report_() {
+	if(! progress_) return;
+
+	std::size_t val = value();
+	if(val > total_) val = total_;
+	if(total_) dypc_current_progress_callbacks.set(progress_, (unsigned)(maximum_ * val / total_));
+	else dypc_current_progress_callbacks.pulse(progress_);
+
+	clock::time_point now = clock::now();
+	if(now - last_message_time_ < message_interval_ || val == 0) return;
+	last_message_time_ = now;
+
+	double seconds = std::chrono::duration<double>(now - start_time_).count();
+	std::string msg = throughput_message_(seconds);
+	if(total_) {
+		double remaining = seconds * (total_ - val) / val;
+		msg += ", about " + time_to_string(std::chrono::milliseconds((long long)(remaining * 1000.0))) + " remaining";
+	}
+	dypc_current_progress_callbacks.message(progress_, msg.c_str());
+}
+
+}
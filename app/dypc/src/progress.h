@@ -4,7 +4,15 @@
 #include <functional>
 #include <string>
 #include <type_traits>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <exception>
+#include <algorithm>
 #include "interface/progress.h"
+#include "build_report.h"
 
 namespace dypc {
 
@@ -14,10 +22,10 @@ namespace dypc {
  */
 class progress_handle {
 private:
-	dypc_progress progress_; ///< Progress handle from interface.
-	unsigned value_; ///< Current progress value.
+	dypc_progress progress_ = nullptr; ///< Progress handle from interface. Null for stub handle.
+	unsigned value_ = 0; ///< Current progress value.
 public:
-	progress_handle() = default; ///< Create stub progress handle.
+	progress_handle() = default; ///< Create stub progress handle, which does not call the interface.
 	explicit progress_handle(dypc_progress p) : progress_(p), value_(0) { } ///< Create progress handle bound to a dypc_progress.
 	
 	/**
@@ -27,7 +35,7 @@ public:
 	 */
 	void set(unsigned v) {
 		value_ = v;
-		dypc_current_progress_callbacks.set(progress_, value_);
+		if(progress_) dypc_current_progress_callbacks.set(progress_, value_);
 	}
 	
 	/**
@@ -44,7 +52,7 @@ public:
 	 * Calls interface callback. Makes the progress indicator move to show there is some progress.
 	 */
 	void pulse() {
-		dypc_current_progress_callbacks.pulse(progress_);
+		if(progress_) dypc_current_progress_callbacks.pulse(progress_);
 	}
 	
 	/**
@@ -53,14 +61,35 @@ public:
 	 * @param msg Message to display.
 	 */
 	void message(const std::string& msg) {
-		dypc_current_progress_callbacks.message(progress_, msg.c_str());
+		if(progress_) dypc_current_progress_callbacks.message(progress_, msg.c_str());
 	}
 };
 
 
+/**
+ * Current progress of this thread.
+ * Parent for newly opened progress indicators.
+ */
+inline dypc_progress& current_progress_() {
+	static thread_local dypc_progress current = nullptr;
+	return current;
+}
+
+
+/**
+ * Whether progress reporting is muted in this thread.
+ * Set for worker threads of a shared_progress, which accounts their work instead. So that the interface callbacks
+ * never get called from multiple threads simultaneously.
+ */
+inline bool& progress_muted_() {
+	static thread_local bool muted = false;
+	return muted;
+}
+
+
 /**
  * Execute given function, and show progress bar.
- * Progress bar is handled by process_callbacks set by library user.
+ * Progress bar is handled by process_callbacks set by library user. Also gets measured as a stage of the build report. @see build_stage
  * @see dypc_set_progress_callbacks
  * @param total Maximal value for progress bar.
  * @param label Label for progress bar.
@@ -68,8 +97,15 @@ public:
  */
 template<class Function>
 void progress(std::size_t total, const std::string& label, Function func) {
-	static thread_local dypc_progress current = nullptr; ///< Current progress, for this thread
+	build_stage stage(label);
+	
+	if(progress_muted_()) {
+		progress_handle handle;
+		func(handle);
+		return;
+	}
 
+	dypc_progress& current = current_progress_();
 	dypc_progress previous = current;
 	dypc_progress progress = dypc_current_progress_callbacks.open(label.c_str(), total, current);
 	current = progress;
@@ -113,14 +149,12 @@ inline void progress(const std::string& label, Function func) {
 template<class Iterator, class Function>
 void progress_foreach(Iterator begin, Iterator end, std::size_t total, const std::string& label, Function func) {
 	progress(100, label, [&](progress_handle& pr) {
-		std::size_t update_step = total/100;
-		std::size_t counter = 0;
-		for(Iterator it = begin; it != end; ++it, ++counter) {
-			func(*it);
-			if(counter == update_step) {
-				pr.increment();
-				counter = 0;
-			}
+		// Inner loop runs one percent of the elements without touching the progress state
+		std::size_t update_step = std::max<std::size_t>(total/100, 1);
+		Iterator it = begin;
+		while(it != end) {
+			for(std::size_t i = 0; i < update_step && it != end; ++i, ++it) func(*it);
+			pr.increment();
 		}
 	});
 }
@@ -139,14 +173,11 @@ void progress_foreach(Iterator begin, Iterator end, std::size_t total, const std
 template<class Iterator, class Function>
 void progress_foreach_break(Iterator begin, Iterator end, std::size_t total, const std::string& label, Function func) {
 	progress(100, label, [&](progress_handle& pr) {
-		std::size_t update_step = total/100;
-		std::size_t counter = 0;
-		for(Iterator it = begin; it != end; ++it, ++counter) {
-			if(! func(*it)) break;
-			if(counter == update_step) {
-				pr.increment();
-				counter = 0;
-			}
+		std::size_t update_step = std::max<std::size_t>(total/100, 1);
+		Iterator it = begin;
+		while(it != end) {
+			for(std::size_t i = 0; i < update_step && it != end; ++i, ++it) if(! func(*it)) return;
+			pr.increment();
 		}
 	});
 }
@@ -204,6 +235,141 @@ void progress_for(std::ptrdiff_t begin, std::ptrdiff_t end, const std::string& l
 	progress_foreach(counter_iterator(begin), counter_iterator(end), end - begin, label, func);
 }
 
+
+
+/**
+ * Progress indicator shared by multiple worker threads.
+ * Workers add to an atomic counter through local counter objects, which only touch the shared counter once per
+ * chunk. The interface callbacks are called only by the thread that owns the shared_progress, at a limited rate, while
+ * it waits for the workers. It also periodically reports throughput and estimated remaining time, and a summary
+ * when closed.
+ */
+class shared_progress {
+public:
+	class counter;
+
+private:
+	static constexpr std::size_t maximum_ = 1000; ///< Maximal value of progress bar.
+	static constexpr std::chrono::milliseconds report_interval_ = std::chrono::milliseconds(200);
+	static constexpr std::chrono::seconds message_interval_ = std::chrono::seconds(30);
+
+	using clock = std::chrono::steady_clock;
+
+	build_stage stage_; ///< Stage in build report, which contains the stages opened by the workers.
+	std::atomic<std::size_t> value_;
+	std::size_t total_;
+	std::string unit_;
+	std::size_t bytes_per_unit_;
+	dypc_progress progress_;
+	dypc_progress previous_;
+	clock::time_point start_time_;
+	clock::time_point last_message_time_;
+	
+	void report_();
+	std::string throughput_message_(double seconds) const;
+
+public:
+	/**
+	 * Open shared progress indicator.
+	 * @param total Total amount of work, in units.
+	 * @param label Label for progress bar.
+	 * @param unit Name of unit, used in throughput messages.
+	 * @param bytes_per_unit Size of one unit in bytes, to also report MB/s. 0 if not applicable.
+	 */
+	shared_progress(std::size_t total, const std::string& label, const std::string& unit = "points", std::size_t bytes_per_unit = 0);
+	shared_progress(const shared_progress&) = delete;
+	~shared_progress(); ///< Close progress indicator, and report total throughput.
+	
+	std::size_t value() const { return value_.load(); }
+	std::size_t total() const { return total_; }
+	
+	/**
+	 * Run function in multiple threads, and report progress from this thread until all are finished.
+	 * Nested progress indicators opened by the workers are muted. If a worker throws an exception, it is rethrown here after
+	 * all threads have ended.
+	 * @param number_of_threads Number of worker threads.
+	 * @param func Function executed by each worker. Takes one shared_progress::counter attribute, by non-const reference.
+	 */
+	template<class Function>
+	void run(std::size_t number_of_threads, Function func);
+};
+
+
+/**
+ * Per-thread counter for shared progress.
+ * Accumulates locally and adds to the shared atomic counter in chunks.
+ */
+class shared_progress::counter {
+private:
+	static constexpr std::size_t chunk_ = 4096;
+
+	shared_progress& progress_;
+	std::size_t local_ = 0;
+
+public:
+	explicit counter(shared_progress& pr) : progress_(pr) { }
+	counter(const counter&) = delete;
+	~counter() { flush(); }
+	
+	void add(std::size_t n = 1) {
+		local_ += n;
+		if(local_ >= chunk_) flush();
+	}
+	
+	void flush() {
+		if(local_) progress_.value_.fetch_add(local_, std::memory_order_relaxed);
+		local_ = 0;
+	}
+};
+
+
+template<class Function>
+void shared_progress::run(std::size_t number_of_threads, Function func) {
+	std::atomic<std::size_t> running(0);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+
+	build_stage_record* stage = current_build_stage_();
+
+	std::vector<std::thread> threads;
+	try {
+		for(std::size_t i = 0; i < number_of_threads; ++i) {
+			++running;
+			try {
+				threads.emplace_back([&]() {
+					progress_muted_() = true;
+					current_build_stage_() = stage;
+					counter cnt(*this);
+					try {
+						func(cnt);
+					} catch(...) {
+						std::lock_guard<std::mutex> lock(error_mutex);
+						if(! error) error = std::current_exception();
+					}
+					cnt.flush();
+					--running;
+				});
+			} catch(...) {
+				--running;
+				throw;
+			}
+		}
+	} catch(...) {
+		// Thread could not be started: let those already running finish, since they refer to this frame
+		for(std::thread& thr : threads) thr.join();
+		throw;
+	}
+	
+	while(running.load() > 0) {
+		std::this_thread::sleep_for(report_interval_);
+		report_();
+	}
+	for(std::thread& thr : threads) thr.join();
+	report_();
+	
+	if(error) std::rethrow_exception(error);
+}
+
 }
 
 #endif
@@ -0,0 +1,200 @@
+#include "remote_client.h"
+#include "remote_socket.h"
+#include <stdexcept>
+#include <exception>
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+
+namespace dypc {
+
+using namespace remote_protocol;
+
+constexpr std::size_t remote_client::nodes_per_request_;
+
+
+remote_client::remote_client(const std::string& address) : fd_(connect_remote_socket(address)) {
+	try {
+		std::uint32_t seq = send_request_(info_message, nullptr, 0);
+		std::uint64_t size = receive_response_(info_message, seq);
+		if(size < sizeof(info_)) throw std::runtime_error("Invalid info response");
+		receive_(&info_, sizeof(info_));
+		skip_(size - sizeof(info_));
+		if(info_.version != version) throw std::runtime_error("Server uses different protocol version");
+	} catch(...) {
+		close(fd_);
+		throw;
+	}
+}
+
+
+remote_client::~remote_client() {
+	close(fd_);
+}
+
+
+template<class Exchange>
+void remote_client::exchange_(Exchange exchange) {
+	if(broken_) throw std::runtime_error("Connection to server is broken");
+	try {
+		exchange();
+	} catch(const response_error_&) {
+		throw;
+	} catch(...) {
+		broken_ = true;
+		throw;
+	}
+}
+
+
+std::uint32_t remote_client::send_request_(message_type type, const void* payload, std::size_t size, const void* extra, std::size_t extra_size) {
+	message_header header { type, ++sequence_, size + extra_size };
+	std::vector<std::uint8_t> message(sizeof(header) + size + extra_size);
+	std::memcpy(message.data(), &header, sizeof(header));
+	if(size) std::memcpy(message.data() + sizeof(header), payload, size);
+	if(extra_size) std::memcpy(message.data() + sizeof(header) + size, extra, extra_size);
+	send_to_socket(fd_, message.data(), message.size());
+	return header.sequence;
+}
+
+
+std::uint64_t remote_client::receive_response_(message_type type, std::uint32_t sequence) {
+	message_header header;
+	receive_(&header, sizeof(header));
+	if(header.sequence != sequence) throw std::runtime_error("Response out of sequence");
+
+	if(header.type == error_message) {
+		std::string text(header.size, '\0');
+		if(header.size) receive_(&text[0], header.size);
+		text.resize(std::strlen(text.c_str()));
+		throw response_error_("Server error: " + text);
+	} else if(header.type != type) {
+		skip_(header.size);
+		throw response_error_("Unexpected response type");
+	}
+	return header.size;
+}
+
+
+void remote_client::receive_(void* data, std::size_t size) {
+	if(! receive_from_socket(fd_, data, size)) throw std::runtime_error("Connection closed by server");
+}
+
+
+void remote_client::skip_(std::uint64_t size) {
+	char discard[256];
+	while(size) {
+		std::size_t n = std::min<std::uint64_t>(size, sizeof(discard));
+		receive_(discard, n);
+		size -= n;
+	}
+}
+
+
+std::uint64_t remote_client::receive_points_(point_buffer_t buffer, std::uint64_t capacity, std::uint64_t& remaining) {
+	std::uint64_t count;
+	if(remaining < sizeof(count)) throw std::runtime_error("Invalid points response");
+	receive_(&count, sizeof(count));
+	remaining -= sizeof(count);
+	if(count > capacity || count*sizeof(point) > remaining) throw std::runtime_error("Invalid points response");
+	if(count) receive_(buffer, count*sizeof(point));
+	remaining -= count*sizeof(point);
+	return count;
+}
+
+
+void remote_client::read_nodes(std::size_t first, std::size_t count, std::uint8_t* records) {
+	if(first + count > info_.number_of_nodes) throw std::out_of_range("Nodes out of range");
+	const std::size_t record_size = node_record_size(info_.levels, info_.number_of_children);
+	std::lock_guard<std::mutex> lock(mutex_);
+	exchange_([&]() {
+		// Send all requests before reading the responses, so that the server can answer them in a row
+		std::vector<std::uint32_t> sequences;
+		for(std::size_t i = 0; i < count; i += nodes_per_request_) {
+			nodes_request req { first + i, std::min(nodes_per_request_, count - i) };
+			sequences.push_back(send_request_(nodes_message, &req, sizeof(req)));
+		}
+
+		// Remaining responses still get read after an error, as long as the connection stays in sequence
+		std::exception_ptr error;
+		for(std::size_t j = 0; j < sequences.size(); ++j) {
+			std::size_t n = std::min(nodes_per_request_, count - j*nodes_per_request_);
+			try {
+				std::uint64_t size = receive_response_(nodes_message, sequences[j]);
+				if(size < n*record_size) {
+					skip_(size);
+					throw response_error_("Invalid nodes response");
+				}
+				receive_(records + j*nodes_per_request_*record_size, n*record_size);
+				skip_(size - n*record_size);
+			} catch(const response_error_&) {
+				if(! error) error = std::current_exception();
+			}
+		}
+		if(error) std::rethrow_exception(error);
+	});
+}
+
+
+std::size_t remote_client::read_blocks(const std::vector<block_request>& blocks, point_buffer_t buffer, std::vector<std::size_t>& counts) {
+	points_request req { blocks.size() };
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::size_t total = 0;
+	exchange_([&]() {
+		std::uint32_t seq = send_request_(points_message, &req, sizeof(req), blocks.data(), blocks.size()*sizeof(block_request));
+		std::uint64_t remaining = receive_response_(points_message, seq);
+
+		counts.clear();
+		for(const block_request& block : blocks) {
+			std::size_t n = receive_points_(buffer + total, block.capacity, remaining);
+			counts.push_back(n);
+			total += n;
+		}
+		skip_(remaining);
+	});
+	return total;
+}
+
+
+std::size_t remote_client::read_block(std::uint32_t node, std::uint32_t level, point_buffer_t buffer, std::size_t capacity) {
+	std::vector<block_request> blocks { block_request { node, level, capacity } };
+	std::vector<std::size_t> counts;
+	return read_blocks(blocks, buffer, counts);
+}
+
+
+std::size_t remote_client::compute_points(const loader::request_t& request, point_buffer_t buffer, std::size_t capacity) {
+	load_request req;
+	std::memset(&req, 0, sizeof(req));
+	std::memcpy(req.position, &request.position[0], sizeof(req.position));
+	std::memcpy(req.velocity, &request.velocity[0], sizeof(req.velocity));
+	req.orientation[0] = request.orientation.w;
+	req.orientation[1] = request.orientation.x;
+	req.orientation[2] = request.orientation.y;
+	req.orientation[3] = request.orientation.z;
+	std::memcpy(req.view_projection_matrix, &request.view_projection_matrix[0][0], sizeof(req.view_projection_matrix));
+	req.viewport_height = request.viewport_height;
+	req.capacity = capacity;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::size_t count = 0;
+	exchange_([&]() {
+		std::uint32_t seq = send_request_(load_message, &req, sizeof(req));
+		std::uint64_t remaining = receive_response_(load_message, seq);
+		count = receive_points_(buffer, capacity, remaining);
+		skip_(remaining);
+	});
+	return count;
+}
+
+
+void remote_client::set_setting(const std::string& name, double value) {
+	setting_request req { value, name.size() };
+	std::lock_guard<std::mutex> lock(mutex_);
+	exchange_([&]() {
+		std::uint32_t seq = send_request_(setting_message, &req, sizeof(req), name.data(), name.size());
+		skip_(receive_response_(setting_message, seq));
+	});
+}
+
+}
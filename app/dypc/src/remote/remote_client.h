@@ -0,0 +1,105 @@
+#ifndef DYPC_REMOTE_CLIENT_H_
+#define DYPC_REMOTE_CLIENT_H_
+
+#include "remote_protocol.h"
+#include "../loader/loader.h"
+#include "../point.h"
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stdexcept>
+#include <cstdint>
+
+namespace dypc {
+
+/**
+ * Connection to a structure_server.
+ * Each call sends its request(s) and waits for the response(s). Calls from several threads get serialized.
+ * Errors reported by the server are thrown as std::runtime_error, after which the connection remains usable.
+ * Other failures, such as responses out of sequence or with invalid contents, can leave responses unread. Then the
+ * connection is marked broken, and further calls throw.
+ */
+class remote_client {
+private:
+	static constexpr std::size_t nodes_per_request_ = 1 << 14; ///< Number of nodes requested per message when reading node table.
+
+	int fd_;
+	std::uint32_t sequence_ = 0;
+	remote_protocol::info info_;
+	std::mutex mutex_; ///< Held during each exchange.
+	bool broken_ = false; ///< Whether an exchange failed with responses left unread, so that the connection is out of sequence.
+
+	/**
+	 * Error after which the connection remains in sequence: error response of the server, or response whose payload
+	 * was skipped.
+	 */
+	struct response_error_ : std::runtime_error {
+		explicit response_error_(const std::string& what) : std::runtime_error(what) { }
+	};
+
+	/**
+	 * Run exchange of requests and responses with the server.
+	 * Throws if the connection is broken, and marks it broken if the exchange fails other than with response_error_.
+	 * @param exchange Function that sends the requests and receives the responses.
+	 */
+	template<class Exchange> void exchange_(Exchange exchange);
+
+	std::uint32_t send_request_(remote_protocol::message_type type, const void* payload, std::size_t size, const void* extra = nullptr, std::size_t extra_size = 0);
+	std::uint64_t receive_response_(remote_protocol::message_type type, std::uint32_t sequence);
+	void receive_(void* data, std::size_t size); ///< Receive exactly \a size bytes. Throws when the connection got closed.
+	void skip_(std::uint64_t size);
+	std::uint64_t receive_points_(point_buffer_t buffer, std::uint64_t capacity, std::uint64_t& remaining);
+
+public:
+	/**
+	 * Connect to server.
+	 * @param address Socket address of the server. @see listen_remote_socket
+	 */
+	explicit remote_client(const std::string& address);
+	~remote_client();
+
+	remote_client(const remote_client&) = delete;
+	remote_client& operator=(const remote_client&) = delete;
+
+	const remote_protocol::info& get_info() const { return info_; }
+
+	/**
+	 * Read node records of the tree structure.
+	 * The requests for all nodes are sent at once, and the responses read afterwards.
+	 * @param first Index of first node.
+	 * @param count Number of nodes.
+	 * @param records Output buffer, needs to hold \a count node records. @see remote_protocol::node_record_size
+	 */
+	void read_nodes(std::size_t first, std::size_t count, std::uint8_t* records);
+
+	/**
+	 * Read points of several blocks in one request.
+	 * The points of the blocks are written one after the other into \a buffer.
+	 * @param blocks Requested blocks. Capacity of the buffer must be at least the sum of their capacities.
+	 * @param counts On output, number of points read for each block.
+	 * @return Total number of points read.
+	 */
+	std::size_t read_blocks(const std::vector<remote_protocol::block_request>& blocks, point_buffer_t buffer, std::vector<std::size_t>& counts);
+
+	/**
+	 * Read points of one node at one level.
+	 * @return Number of points read.
+	 */
+	std::size_t read_block(std::uint32_t node, std::uint32_t level, point_buffer_t buffer, std::size_t capacity);
+
+	/**
+	 * Let the server's loader compute points for a request.
+	 * Evaluated by the loader session of this connection.
+	 * @return Number of points written into \a buffer.
+	 */
+	std::size_t compute_points(const loader::request_t& request, point_buffer_t buffer, std::size_t capacity);
+
+	/**
+	 * Change setting of the server's loader session for this connection.
+	 */
+	void set_setting(const std::string& name, double value);
+};
+
+}
+
+#endif
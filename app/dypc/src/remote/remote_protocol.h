@@ -0,0 +1,94 @@
+#ifndef DYPC_REMOTE_PROTOCOL_H_
+#define DYPC_REMOTE_PROTOCOL_H_
+
+#include <cstdint>
+#include <cstddef>
+
+namespace dypc {
+
+/**
+ * Messages exchanged between structure_server and its clients.
+ * Every message is a message_header followed by \a size bytes of payload. The client may send several requests
+ * without waiting for the responses. The server answers them in order, with the sequence number of the request, and
+ * the same type, or error_message with the error text as payload. Response payloads are padded with zeroes to a
+ * multiple of 8 bytes, so that the server can write points in place into its output buffer.
+ * Values are in native byte order, and points are sent as dypc::point objects, so both sides must run on the same
+ * kind of machine. This is meant for local TCP or Unix sockets.
+ */
+namespace remote_protocol {
+
+constexpr std::uint32_t version = 1;
+
+enum message_type : std::uint32_t {
+	info_message = 1, ///< Request: no payload. Response: info.
+	nodes_message, ///< Request: nodes_request. Response: node records of the requested nodes.
+	points_message, ///< Request: points_request, followed by block requests. Response: for each block, uint64 count and the points.
+	load_message, ///< Request: load_request. Response: uint64 count and the points.
+	setting_message, ///< Request: setting_request, followed by the setting name. Response: no payload.
+	error_message = 0xFF ///< Response: error text.
+};
+
+struct message_header {
+	std::uint32_t type;
+	std::uint32_t sequence; ///< Chosen by client, and echoed in the response.
+	std::uint64_t size; ///< Payload size in bytes.
+};
+
+struct info {
+	std::uint32_t version;
+	std::uint32_t loader_type; ///< Type of the server's loader, as dypc_loader_type.
+	std::uint32_t levels; ///< Downsampling levels of tree structure, or 0 when not serving a tree structure.
+	std::uint32_t number_of_children;
+	std::uint32_t additive;
+	std::uint32_t padding;
+	std::uint64_t number_of_nodes; ///< Number of nodes of tree structure. Nodes are indexed in depth-first order, the root is 0.
+	std::uint64_t number_of_points;
+};
+
+/**
+ * Size of node record.
+ * A record consists of the origin and extremity of the node cuboid as 6 floats, its number of points at each level
+ * as uint64, and the indices of its children as uint32, which are 0 for children that do not exist.
+ */
+inline std::size_t node_record_size(std::size_t levels, std::size_t number_of_children) {
+	return 6*sizeof(float) + levels*sizeof(std::uint64_t) + number_of_children*sizeof(std::uint32_t);
+}
+
+struct nodes_request {
+	std::uint64_t first; ///< Index of first node.
+	std::uint64_t count;
+};
+
+struct points_request {
+	std::uint64_t number_of_blocks; ///< Number of block requests that follow.
+};
+
+/// Points of one node at one level, as the node's tree_structure_source::node::extract_points gives them.
+struct block_request {
+	std::uint32_t node;
+	std::uint32_t level;
+	std::uint64_t capacity;
+};
+
+/// Evaluation of a request by the server's loader. Each connection has its own session of the loader.
+struct load_request {
+	float position[3];
+	float velocity[3];
+	float orientation[4]; ///< Quaternion, w first.
+	float view_projection_matrix[16]; ///< Column-major.
+	float viewport_height;
+	std::uint32_t padding;
+	std::uint64_t capacity;
+};
+
+/// Change setting of the connection's loader session.
+struct setting_request {
+	double value;
+	std::uint64_t name_length; ///< Length of the setting name that follows.
+};
+
+}
+
+}
+
+#endif
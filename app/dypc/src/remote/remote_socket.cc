@@ -0,0 +1,164 @@
+#include "remote_socket.h"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+
+namespace dypc {
+
+static const std::string unix_prefix_ = "unix:";
+
+
+static std::runtime_error socket_error_(const std::string& what) {
+	return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+
+static bool is_unix_address_(const std::string& address) {
+	return (address.compare(0, unix_prefix_.size(), unix_prefix_) == 0);
+}
+
+
+static sockaddr_un unix_socket_address_(const std::string& address) {
+	std::string path = address.substr(unix_prefix_.size());
+	sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(path.empty() || path.size() >= sizeof(addr.sun_path)) throw std::invalid_argument("Invalid Unix socket path");
+	std::strcpy(addr.sun_path, path.c_str());
+	return addr;
+}
+
+
+static addrinfo* tcp_socket_addresses_(const std::string& address, bool passive) {
+	auto colon = address.rfind(':');
+	if(colon == std::string::npos) throw std::invalid_argument("Socket address needs to be unix:path or host:port");
+	std::string host = address.substr(0, colon), port = address.substr(colon + 1);
+
+	addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if(passive) hints.ai_flags = AI_PASSIVE;
+
+	addrinfo* result;
+	int err = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+	if(err != 0) throw std::runtime_error(std::string("Could not resolve socket address: ") + gai_strerror(err));
+	return result;
+}
+
+
+static void set_no_delay_(int fd) {
+	// Requests and responses are sent as whole messages, and the other side waits for them. Fails for Unix sockets.
+	int flag = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+
+int listen_remote_socket(const std::string& address) {
+	int fd;
+	if(is_unix_address_(address)) {
+		sockaddr_un addr = unix_socket_address_(address);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(fd == -1) throw socket_error_("Could not create socket");
+		unlink(addr.sun_path);
+		if(bind(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+			close(fd);
+			throw socket_error_("Could not bind socket");
+		}
+	} else {
+		addrinfo* addrs = tcp_socket_addresses_(address, true);
+		fd = -1;
+		for(addrinfo* a = addrs; a && fd == -1; a = a->ai_next) {
+			fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+			if(fd == -1) continue;
+			int flag = 1;
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+			if(bind(fd, a->ai_addr, a->ai_addrlen) != 0) { close(fd); fd = -1; }
+		}
+		freeaddrinfo(addrs);
+		if(fd == -1) throw socket_error_("Could not bind socket");
+	}
+
+	if(listen(fd, SOMAXCONN) != 0) {
+		close(fd);
+		throw socket_error_("Could not listen on socket");
+	}
+	return fd;
+}
+
+
+int accept_remote_socket(int listen_fd) {
+	int fd;
+	do fd = accept(listen_fd, nullptr, nullptr);
+	while(fd == -1 && errno == EINTR);
+	if(fd == -1) throw socket_error_("Could not accept connection");
+	set_no_delay_(fd);
+	return fd;
+}
+
+
+int connect_remote_socket(const std::string& address) {
+	int fd;
+	if(is_unix_address_(address)) {
+		sockaddr_un addr = unix_socket_address_(address);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(fd == -1) throw socket_error_("Could not create socket");
+		if(connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+			close(fd);
+			throw socket_error_("Could not connect to " + address);
+		}
+	} else {
+		addrinfo* addrs = tcp_socket_addresses_(address, false);
+		fd = -1;
+		for(addrinfo* a = addrs; a && fd == -1; a = a->ai_next) {
+			fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+			if(fd == -1) continue;
+			if(connect(fd, a->ai_addr, a->ai_addrlen) != 0) { close(fd); fd = -1; }
+		}
+		freeaddrinfo(addrs);
+		if(fd == -1) throw socket_error_("Could not connect to " + address);
+		set_no_delay_(fd);
+	}
+	return fd;
+}
+
+
+void send_to_socket(int fd, const void* data, std::size_t size) {
+	const char* ptr = static_cast<const char*>(data);
+	while(size) {
+		ssize_t n = send(fd, ptr, size, MSG_NOSIGNAL);
+		if(n == -1) {
+			if(errno == EINTR) continue;
+			throw socket_error_("Could not send to socket");
+		}
+		ptr += n;
+		size -= n;
+	}
+}
+
+
+bool receive_from_socket(int fd, void* data, std::size_t size) {
+	char* ptr = static_cast<char*>(data);
+	std::size_t received = 0;
+	while(received < size) {
+		ssize_t n = recv(fd, ptr + received, size - received, 0);
+		if(n == -1) {
+			if(errno == EINTR) continue;
+			throw socket_error_("Could not receive from socket");
+		} else if(n == 0) {
+			if(received == 0) return false;
+			else throw std::runtime_error("Connection closed during message");
+		}
+		received += n;
+	}
+	return true;
+}
+
+}
@@ -0,0 +1,46 @@
+#ifndef DYPC_REMOTE_SOCKET_H_
+#define DYPC_REMOTE_SOCKET_H_
+
+#include <string>
+#include <cstddef>
+
+namespace dypc {
+
+/**
+ * Open listening socket.
+ * Throws std::runtime_error on failure.
+ * @param address Either "unix:" followed by the path of a Unix socket, or "host:port" for TCP. An existing Unix socket file gets replaced.
+ * @return File descriptor of the socket.
+ */
+int listen_remote_socket(const std::string& address);
+
+/**
+ * Accept connection on listening socket.
+ * Throws std::runtime_error on failure, including when the listening socket was shut down.
+ * @return File descriptor of the connected socket.
+ */
+int accept_remote_socket(int listen_fd);
+
+/**
+ * Connect to listening socket.
+ * Throws std::runtime_error on failure.
+ * @param address Address in the format of listen_remote_socket.
+ * @return File descriptor of the socket.
+ */
+int connect_remote_socket(const std::string& address);
+
+/**
+ * Send the whole buffer. Throws std::runtime_error when the connection fails.
+ */
+void send_to_socket(int fd, const void* data, std::size_t size);
+
+/**
+ * Receive exactly \a size bytes.
+ * Throws std::runtime_error when the connection fails or gets closed in between.
+ * @return False if the connection was closed by the other side before any byte was received.
+ */
+bool receive_from_socket(int fd, void* data, std::size_t size);
+
+}
+
+#endif
@@ -0,0 +1,319 @@
+#include "structure_server.h"
+#include "remote_socket.h"
+#include "../structure/tree/tree_structure_loader.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace dypc {
+
+using namespace remote_protocol;
+
+constexpr std::size_t structure_server::maximal_pending_output_;
+constexpr std::size_t structure_server::maximal_message_size_;
+constexpr std::size_t structure_server::maximal_load_points_;
+
+
+/// Append response header and payload, padded to a multiple of 8 bytes.
+static void append_response_(std::vector<std::uint8_t>& output, std::uint32_t type, std::uint32_t sequence, const void* data, std::size_t size) {
+	std::size_t padded_size = (size + 7) & ~std::size_t(7);
+	message_header header { type, sequence, padded_size };
+	std::size_t offset = output.size();
+	output.resize(offset + sizeof(header) + padded_size, 0);
+	std::memcpy(output.data() + offset, &header, sizeof(header));
+	if(size) std::memcpy(output.data() + offset + sizeof(header), data, size);
+}
+
+
+structure_server::structure_server(loader* ld) : loader_(ld) {
+	std::memset(&info_, 0, sizeof(info_));
+	info_.version = version;
+	info_.loader_type = (std::uint32_t)loader_->get_loader_type();
+	info_.number_of_points = loader_->number_of_points();
+
+	tree_structure_loader* tree_loader = dynamic_cast<tree_structure_loader*>(ld);
+	if(tree_loader) source_ = tree_loader->get_source();
+	if(source_) {
+		// Indexed nodes must not be freed while the server uses them
+		source_->begin_traversal();
+		index_nodes_();
+	}
+}
+
+
+structure_server::~structure_server() {
+	stop();
+	std::lock_guard<std::mutex> lock(serve_mutex_);
+	if(source_) source_->end_traversal();
+}
+
+
+void structure_server::index_nodes_() {
+	const std::size_t levels = source_->levels();
+	const std::size_t number_of_children = source_->number_of_node_children();
+
+	// Depth-first traversal, which assigns indices in preorder
+	std::vector<std::uint32_t> children;
+	struct entry { const tree_structure_source::node* nd; std::ptrdiff_t parent; std::ptrdiff_t child_index; };
+	std::vector<entry> stack { entry { &source_->root_node(), -1, 0 } };
+	while(! stack.empty()) {
+		entry e = stack.back();
+		stack.pop_back();
+
+		std::uint32_t index = nodes_.size();
+		nodes_.push_back(e.nd);
+		children.resize(children.size() + number_of_children, 0);
+		if(e.parent != -1) children[e.parent*number_of_children + e.child_index] = index;
+
+		for(std::ptrdiff_t i = number_of_children - 1; i >= 0; --i)
+			if(! e.nd->is_leaf() && e.nd->has_child(i)) stack.push_back(entry { &e.nd->child(i), index, i });
+	}
+
+	node_record_size_ = node_record_size(levels, number_of_children);
+	node_records_.resize(nodes_.size() * node_record_size_);
+	std::uint8_t* out = node_records_.data();
+	for(std::size_t index = 0; index < nodes_.size(); ++index) {
+		const tree_structure_source::node& nd = *nodes_[index];
+		cuboid cub = nd.node_cuboid();
+		std::memcpy(out, &cub.origin[0], 3*sizeof(float));
+		std::memcpy(out + 3*sizeof(float), &cub.extremity[0], 3*sizeof(float));
+		out += 6*sizeof(float);
+		for(std::ptrdiff_t l = 0; l < levels; ++l) {
+			std::uint64_t n = nd.number_of_points(l);
+			std::memcpy(out, &n, sizeof(n));
+			out += sizeof(n);
+		}
+		std::memcpy(out, children.data() + index*number_of_children, number_of_children*sizeof(std::uint32_t));
+		out += number_of_children*sizeof(std::uint32_t);
+	}
+
+	info_.levels = levels;
+	info_.number_of_children = number_of_children;
+	info_.additive = source_->is_additive();
+	info_.number_of_nodes = nodes_.size();
+}
+
+
+void structure_server::serve(const std::string& address) {
+	std::lock_guard<std::mutex> serve_lock(serve_mutex_);
+	listen_fd_ = listen_remote_socket(address);
+	while(! stopped_) {
+		int fd;
+		try {
+			fd = accept_remote_socket(listen_fd_);
+		} catch(const std::runtime_error&) {
+			if(stopped_) break;
+			else throw;
+		}
+
+		std::lock_guard<std::mutex> lock(connections_mutex_);
+		finish_connections_(false);
+		connections_.emplace_back();
+		connection& con = connections_.back();
+		con.fd = fd;
+		con.thread = std::thread(&structure_server::serve_connection_, this, std::ref(con));
+	}
+
+	std::lock_guard<std::mutex> lock(connections_mutex_);
+	finish_connections_(true);
+	close(listen_fd_);
+	listen_fd_ = -1;
+}
+
+
+void structure_server::stop() {
+	stopped_ = true;
+	if(listen_fd_ != -1) shutdown(listen_fd_, SHUT_RDWR);
+}
+
+
+void structure_server::finish_connections_(bool all) {
+	for(auto it = connections_.begin(); it != connections_.end();) {
+		if(all && ! it->finished) shutdown(it->fd, SHUT_RDWR);
+		if(all || it->finished) {
+			it->thread.join();
+			close(it->fd);
+			it = connections_.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+
+void structure_server::serve_connection_(connection& con) {
+	connection_state state;
+	std::vector<std::uint8_t> payload, output;
+	try {
+		for(;;) {
+			message_header header;
+			if(! receive_from_socket(con.fd, &header, sizeof(header))) break;
+			if(header.size > maximal_message_size_) throw std::runtime_error("Request too large");
+			payload.resize(header.size);
+			if(header.size) receive_from_socket(con.fd, payload.data(), header.size);
+
+			try {
+				handle_message_(state, header, payload, output);
+			} catch(const std::exception& ex) {
+				append_response_(output, error_message, header.sequence, ex.what(), std::strlen(ex.what()) + 1);
+			}
+
+			// Send responses together while the client keeps sending requests
+			char next;
+			bool request_waiting = (recv(con.fd, &next, 1, MSG_PEEK | MSG_DONTWAIT) == 1);
+			if(! request_waiting || output.size() > maximal_pending_output_) {
+				send_to_socket(con.fd, output.data(), output.size());
+				output.clear();
+			}
+		}
+	} catch(const std::exception&) {
+		// Connection failed or was shut down by stop()
+	}
+	con.finished = true;
+}
+
+
+void structure_server::handle_message_(connection_state& state, const message_header& header, const std::vector<std::uint8_t>& payload, std::vector<std::uint8_t>& output) {
+	switch(header.type) {
+		case info_message:
+			append_response_(output, info_message, header.sequence, &info_, sizeof(info_));
+			break;
+
+		case nodes_message: {
+			if(payload.size() != sizeof(nodes_request)) throw std::invalid_argument("Invalid nodes request");
+			nodes_request req;
+			std::memcpy(&req, payload.data(), sizeof(req));
+			if(req.first > nodes_.size() || req.count > nodes_.size() - req.first) throw std::out_of_range("Nodes out of range");
+			append_response_(output, nodes_message, header.sequence, node_records_.data() + req.first*node_record_size_, req.count*node_record_size_);
+			break;
+		}
+
+		case points_message: {
+			std::size_t offset = output.size();
+			append_response_(output, points_message, header.sequence, nullptr, 0);
+			try {
+				handle_points_(payload, output);
+			} catch(...) {
+				output.resize(offset);
+				throw;
+			}
+			reinterpret_cast<message_header*>(output.data() + offset)->size = output.size() - offset - sizeof(message_header);
+			break;
+		}
+
+		case load_message: {
+			std::size_t offset = output.size();
+			append_response_(output, load_message, header.sequence, nullptr, 0);
+			try {
+				handle_load_(state, payload, output);
+			} catch(...) {
+				output.resize(offset);
+				throw;
+			}
+			reinterpret_cast<message_header*>(output.data() + offset)->size = output.size() - offset - sizeof(message_header);
+			break;
+		}
+
+		case setting_message:
+			handle_setting_(state, payload);
+			append_response_(output, setting_message, header.sequence, nullptr, 0);
+			break;
+
+		default:
+			throw std::invalid_argument("Unknown request type");
+	}
+}
+
+
+void structure_server::handle_points_(const std::vector<std::uint8_t>& payload, std::vector<std::uint8_t>& output) {
+	if(! source_) throw std::logic_error("Server does not have tree structure");
+	points_request req;
+	if(payload.size() < sizeof(req)) throw std::invalid_argument("Invalid points request");
+	std::memcpy(&req, payload.data(), sizeof(req));
+	// Compared by division, so that a large number_of_blocks cannot overflow the expected size
+	std::size_t blocks_size = payload.size() - sizeof(req);
+	if(blocks_size % sizeof(block_request) != 0 || req.number_of_blocks != blocks_size / sizeof(block_request)) throw std::invalid_argument("Invalid points request");
+
+	const block_request* blocks = reinterpret_cast<const block_request*>(payload.data() + sizeof(req));
+	for(std::size_t i = 0; i < req.number_of_blocks; ++i) {
+		const block_request& block = blocks[i];
+		if(block.node >= nodes_.size() || block.level >= source_->levels()) throw std::out_of_range("Block out of range");
+		const tree_structure_source::node& nd = *nodes_[block.node];
+
+		// Points get extracted directly into output buffer, which stays aligned because all payloads are padded
+		std::size_t capacity = std::min<std::size_t>(block.capacity, nd.number_of_points(block.level));
+		std::size_t offset = output.size();
+		output.resize(offset + sizeof(std::uint64_t) + capacity*sizeof(point));
+		point* points = reinterpret_cast<point*>(output.data() + offset + sizeof(std::uint64_t));
+		std::uint64_t count = nd.extract_points(points, capacity, block.level);
+		std::memcpy(output.data() + offset, &count, sizeof(count));
+		output.resize(offset + sizeof(std::uint64_t) + count*sizeof(point));
+	}
+}
+
+
+void structure_server::open_session_(connection_state& state) {
+	if(state.session_created) return;
+	std::lock_guard<std::mutex> lock(loader_mutex_);
+	try {
+		state.session.reset(loader_->create_session());
+	} catch(const std::logic_error&) {
+		// Loader gets used by one connection at a time instead
+	}
+	state.session_created = true;
+}
+
+
+void structure_server::handle_load_(connection_state& state, const std::vector<std::uint8_t>& payload, std::vector<std::uint8_t>& output) {
+	load_request req;
+	if(payload.size() != sizeof(req)) throw std::invalid_argument("Invalid load request");
+	std::memcpy(&req, payload.data(), sizeof(req));
+
+	loader::request_t request(
+		glm::make_vec3(req.position),
+		glm::make_vec3(req.velocity),
+		glm::quat(req.orientation[0], req.orientation[1], req.orientation[2], req.orientation[3]),
+		glm::make_mat4(req.view_projection_matrix),
+		req.viewport_height
+	);
+	std::size_t capacity = std::min<std::size_t>({ req.capacity, loader_->number_of_points(), maximal_load_points_ });
+
+	std::size_t offset = output.size();
+	output.resize(offset + sizeof(std::uint64_t) + capacity*sizeof(point));
+	point* points = reinterpret_cast<point*>(output.data() + offset + sizeof(std::uint64_t));
+	std::size_t count = 0;
+
+	open_session_(state);
+	if(state.session) {
+		state.session->compute_points(request, points, count, capacity);
+	} else {
+		std::lock_guard<std::mutex> lock(loader_mutex_);
+		loader_->compute_points(request, points, count, capacity);
+	}
+
+	std::uint64_t count_int = count;
+	std::memcpy(output.data() + offset, &count_int, sizeof(count_int));
+	output.resize(offset + sizeof(std::uint64_t) + count*sizeof(point));
+}
+
+
+void structure_server::handle_setting_(connection_state& state, const std::vector<std::uint8_t>& payload) {
+	setting_request req;
+	if(payload.size() < sizeof(req)) throw std::invalid_argument("Invalid setting request");
+	std::memcpy(&req, payload.data(), sizeof(req));
+	if(req.name_length != payload.size() - sizeof(req)) throw std::invalid_argument("Invalid setting request");
+	std::string name(reinterpret_cast<const char*>(payload.data() + sizeof(req)), req.name_length);
+
+	open_session_(state);
+	if(state.session) {
+		state.session->set_setting(name, req.value);
+	} else {
+		std::lock_guard<std::mutex> lock(loader_mutex_);
+		loader_->set_setting(name, req.value);
+	}
+}
+
+}
@@ -0,0 +1,95 @@
+#ifndef DYPC_STRUCTURE_SERVER_H_
+#define DYPC_STRUCTURE_SERVER_H_
+
+#include "remote_protocol.h"
+#include "../loader/loader.h"
+#include "../structure/tree/tree_structure_source.h"
+#include <memory>
+#include <vector>
+#include <list>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+namespace dypc {
+
+/**
+ * Server that makes a loader, and the tree structure source it reads from, available over a socket.
+ * Clients can read the nodes and point blocks of the tree structure, for example through tree_structure_remote_source,
+ * or let the server evaluate entire loader requests. @see remote_protocol
+ * Each connection is served by its own thread, with its own session of the loader. The responses to requests that
+ * the client sent in a row are collected, and sent together when no further request is waiting.
+ */
+class structure_server {
+private:
+	struct connection {
+		int fd;
+		std::thread thread;
+		std::atomic<bool> finished { false };
+	};
+
+	/// State of a connection, used by its thread only.
+	struct connection_state {
+		std::unique_ptr<loader> session; ///< Loader session of the connection, null if the loader does not support sessions.
+		bool session_created = false;
+	};
+
+	static constexpr std::size_t maximal_pending_output_ = 4 << 20; ///< Output bytes beyond which responses get sent without waiting for further requests.
+	static constexpr std::size_t maximal_message_size_ = 1 << 20; ///< Maximal size of request payload.
+	static constexpr std::size_t maximal_load_points_ = 16 << 20; ///< Maximal number of points of load response, whatever capacity the client requests.
+
+	std::unique_ptr<loader> loader_;
+	std::shared_ptr<const tree_structure_source> source_; ///< Source of tree structure loader. Null for other loaders.
+	std::mutex loader_mutex_; ///< Held while using loader_ itself, when it does not support sessions.
+
+	remote_protocol::info info_;
+	std::vector<const tree_structure_source::node*> nodes_; ///< Nodes in depth-first order.
+	std::vector<std::uint8_t> node_records_; ///< Node records for all nodes.
+	std::size_t node_record_size_ = 0;
+
+	std::mutex connections_mutex_;
+	std::list<connection> connections_;
+	std::atomic<int> listen_fd_ { -1 };
+	std::atomic<bool> stopped_ { false };
+	std::mutex serve_mutex_; ///< Held while serve() runs, so that the destructor can wait for it to return.
+
+	void index_nodes_();
+	void serve_connection_(connection&);
+	void open_session_(connection_state&);
+	void handle_message_(connection_state&, const remote_protocol::message_header&, const std::vector<std::uint8_t>& payload, std::vector<std::uint8_t>& output);
+	void handle_points_(const std::vector<std::uint8_t>& payload, std::vector<std::uint8_t>& output);
+	void handle_load_(connection_state&, const std::vector<std::uint8_t>& payload, std::vector<std::uint8_t>& output);
+	void handle_setting_(connection_state&, const std::vector<std::uint8_t>& payload);
+	void finish_connections_(bool all);
+
+public:
+	/**
+	 * Create server for loader.
+	 * For tree structure loaders, the nodes of its source get indexed. The server keeps a traversal of the source open
+	 * until it is destroyed, so a paged HDF source keeps all its nodes loaded. @see tree_structure_source::begin_traversal
+	 * @param ld The loader. Server takes ownership.
+	 */
+	explicit structure_server(loader* ld);
+	~structure_server();
+
+	/**
+	 * Accept and serve connections, until stop() gets called.
+	 * Can run on another thread than the one that destroys the server, whose destructor stops it and waits for it.
+	 * @param address Socket address. @see listen_remote_socket
+	 */
+	void serve(const std::string& address);
+
+	/**
+	 * Stop the server. Can be called from any thread. Open connections get closed.
+	 */
+	void stop();
+
+	const loader& get_loader() const { return *loader_; }
+	std::size_t number_of_nodes() const { return nodes_.size(); }
+};
+
+}
+
+#endif
@@ -7,6 +7,7 @@
 #include <iterator>
 #include <vector>
 #include <type_traits>
+#include <cstdint>
 
 #include <sqlite3.h>
 
@@ -35,6 +36,11 @@ public:
 			else return "";
 		}
 		
+		std::vector<std::uint8_t> blob_value() const {
+			const auto* data = static_cast<const std::uint8_t*>(sqlite3_column_blob(stmt_, col_));
+			return std::vector<std::uint8_t>(data, data + sqlite3_column_bytes(stmt_, col_));
+		}
+		
 		bool is_null() const { return (sqlite3_column_text(stmt_, col_) == nullptr); }
 	};
 
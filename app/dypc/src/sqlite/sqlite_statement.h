@@ -4,6 +4,8 @@
 #include <string>
 #include <utility>
 #include <type_traits>
+#include <vector>
+#include <cstdint>
 #include <sqlite3.h>
 
 #include "sqlite_error.h"
@@ -35,6 +37,8 @@ public:
 		parameter& operator=(std::nullptr_t) { check_(sqlite3_bind_null(stmt_, index_)); return *this; }
 		
 		parameter& operator=(const std::string& str) { check_(sqlite3_bind_text(stmt_, index_, str.c_str(), str.size(), SQLITE_TRANSIENT)); return *this; }
+
+		parameter& operator=(const std::vector<std::uint8_t>& blob) { check_(sqlite3_bind_blob(stmt_, index_, blob.data(), blob.size(), SQLITE_TRANSIENT)); return *this; }
 	};
 
 protected:
@@ -4,6 +4,7 @@
 #include "cubes_structure_memory_loader.h"
 #include "cubes_structure_sqlite_loader.h"
 #include "cubes_structure_hdf_loader.h"
+#include "../cubes_binning.h"
 
 #include <stdexcept>
 #include <cassert>
@@ -12,6 +13,7 @@
 #include <cmath>
 #include <functional>
 #include <iostream>
+#include <random>
 
 namespace dypc {
 
@@ -21,17 +23,35 @@ void cubes_structure::add_point_(const point& pt) {
 }
 
 
-cubes_structure::cubes_structure(float side, model& mod) : structure(mod), side_length_(side) {
+cubes_structure::cubes_structure(float side, model& mod, std::size_t threads) : structure(mod), side_length_(side) {
 	using namespace std::placeholders;
 	
-	progress_foreach(
-		mod.begin(), mod.end(), mod.number_of_points(), "Creating Cubes Structure...",
-		std::bind(&cubes_structure::add_point_, this, _1)
+	if(threads <= 1) {
+		progress_foreach(
+			mod.begin(), mod.end(), mod.number_of_points(), "Creating Cubes Structure...",
+			std::bind(&cubes_structure::add_point_, this, _1)
+		);
+		
+		random_generator_t random_generator;
+		progress_foreach(
+			cubes_, "Finalizing Cubes Structure...",
+			[&](cubes_t::value_type& c) { c.second.assign_random_weights(random_generator); }
+		);
+		return;
+	}
+	
+	cube_bins_t bins = bin_points_into_cubes_parallel(
+		mod, [this](const point& pt) { return cube_index_for_coordinates(pt); }, threads, "Creating Cubes Structure..."
 	);
+	for(auto& entry : bins) {
+		cubes_[entry.first].add_points(entry.second);
+		std::vector<point>().swap(entry.second);
+	}
+	bins.clear();
 	
-	progress_foreach(
-		cubes_, "Finalizing Cubes Structure...",
-		[&](cubes_t::value_type& c) { c.second.assign_random_weights(); }
+	process_cubes_parallel(
+		cubes_, threads, "Finalizing Cubes Structure...",
+		[](cubes_t::value_type& c, random_generator_t& random_generator) { c.second.assign_random_weights(random_generator); }
 	);
 }
 
@@ -68,8 +88,14 @@ void cubes_structure::cube::add_point(const point& pt) {
 	points_.emplace_back(pt);
 }
 
-void cubes_structure::cube::assign_random_weights() {
-	for(auto& p : points_) p.weight = (float)std::rand() / RAND_MAX;
+void cubes_structure::cube::add_points(const std::vector<point>& pts) {
+	points_.reserve(points_.size() + pts.size());
+	for(const point& pt : pts) points_.emplace_back(pt);
+}
+
+void cubes_structure::cube::assign_random_weights(random_generator_t& random_generator) {
+	std::uniform_real_distribution<float> distribution(0.0, 1.0);
+	for(auto& p : points_) p.weight = distribution(random_generator);
 
 	std::sort(points_.begin(), points_.end(), [](const weighted_point& a, const weighted_point& b) -> bool {
 		return a.weight > b.weight;
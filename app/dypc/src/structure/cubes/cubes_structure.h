@@ -4,9 +4,11 @@
 #include <map>
 #include <cmath>
 #include <vector>
+#include <thread>
 #include "../../point.h"
 #include "../../weighted_point.h"
 #include "../../geometry/cuboid.h"
+#include "../../util.h"
 #include "../../loader/loader.h"
 #include "../structure.h"
 
@@ -36,7 +38,13 @@ private:
 	void add_point_(const point& pt);
 
 public:
-	cubes_structure(float side, model& mod);
+	/**
+	 * Create cubes structure.
+	 * @param side Side length of cubes.
+	 * @param mod The model.
+	 * @param threads Number of threads used to bin points and assign weights.
+	 */
+	cubes_structure(float side, model& mod, std::size_t threads = std::thread::hardware_concurrency());
 	
 	float get_side_length() const { return side_length_; }
 	
@@ -57,8 +65,9 @@ public:
 	
 	std::size_t number_of_points() const { return points_.size(); }
 	void add_point(const point& pt);
+	void add_points(const std::vector<point>& pts);
 	
-	void assign_random_weights();
+	void assign_random_weights(random_generator_t& random_generator);
 	
 	std::size_t extract_points_with_minimal_weight(point_buffer_t points, std::size_t capacity, float min_weight) const;
 };
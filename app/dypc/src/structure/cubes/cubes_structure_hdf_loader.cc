@@ -2,8 +2,11 @@
 #include "cubes_structure.h"
 #include "../../progress.h"
 #include "../../downsampling.h"
+#include "../../write_behind_queue.h"
+#include "../hdf_library_mutex.h"
 #include <utility>
 #include <memory>
+#include <mutex>
 
 namespace dypc {
 
@@ -34,17 +37,22 @@ H5::CompType cubes_structure_hdf_loader::initialize_cube_type_() {
 
 
 void cubes_structure_hdf_loader::write(const std::string& filename, const cubes_structure& s) {
-	H5::H5File file(filename, H5F_ACC_TRUNC);
+	// HDF library mutex is released while the cubes get enqueued, and held by the writer thread for each write
+	std::unique_lock<std::mutex> lock(hdf_library_mutex());
+	
+	// Align data sets so that the cube index can be memory-mapped in place when the file is opened
+	H5::FileAccPropList access_properties;
+	access_properties.setAlignment(1, alignof(std::uint64_t));
+	H5::H5File file(filename, H5F_ACC_TRUNC, H5::FileCreatPropList::DEFAULT, access_properties);
 			
-	std::vector<weighted_point> points_data;
 	std::vector<hdf_cube> cubes_data;
+	std::vector<cubes_structure_index::cube> index_cubes;
 	hsize_t cube_start = 0;
 
 	for(const auto& p : s.cubes()) {
 		auto idx = p.first;
 		const cubes_structure::cube& c = p.second;
 		
-		points_data.insert(points_data.end(), c.weighted_points().begin(), c.weighted_points().end());
 		auto len = c.number_of_points();
 		
 		hdf_cube hc;
@@ -54,6 +62,7 @@ void cubes_structure_hdf_loader::write(const std::string& filename, const cubes_
 		hc.data_start = cube_start;
 		hc.data_length = len;
 		cubes_data.push_back(hc);
+		index_cubes.push_back(cubes_structure_index::cube { hc.x, hc.y, hc.z, hc.data_length, cube_start });
 				
 		cube_start += len;
 	}
@@ -63,42 +72,61 @@ void cubes_structure_hdf_loader::write(const std::string& filename, const cubes_
 	H5::DataSet cubes_set = file.createDataSet("cubes", cube_type_, cubes_space);
 	cubes_set.write(cubes_data.data(), cube_type_);
 
-	hsize_t points_dims[] = { points_data.size() };
+	hsize_t points_dims[] = { cube_start };
 	H5::DataSpace points_space(1, points_dims);
 	H5::DataSet points_set = file.createDataSet("points", point_type_, points_space);
-	points_set.write(points_data.data(), point_type_);
+	
+	// Points of each cube are written at their offset by writer thread, instead of first concatenating all of them.
+	// Adjacent small cubes get merged into larger writes.
+	lock.unlock();
+	try {
+		write_behind_queue<weighted_point> write_queue([&](std::ptrdiff_t, std::size_t offset, const weighted_point* begin, const weighted_point* end) {
+			std::lock_guard<std::mutex> write_lock(hdf_library_mutex());
+			hsize_t n = end - begin;
+			hsize_t start = offset;
+			H5::DataSpace mem_space(1, &n);
+			H5::DataSpace data_space = points_set.getSpace();
+			data_space.selectHyperslab(H5S_SELECT_SET, &n, &start);
+			points_set.write((const void*)begin, point_type_, mem_space, data_space);
+		}, write_queue_capacity_);
+		auto cube_data = cubes_data.begin();
+		for(const auto& p : s.cubes()) {
+			const auto& pts = p.second.weighted_points();
+			write_queue.enqueue(0, (cube_data++)->data_start, pts.begin(), pts.end());
+		}
+		write_queue.finish();
+	} catch(...) {
+		lock.lock();
+		throw;
+	}
+	lock.lock();
 	
 	H5::Attribute side_attr = cubes_set.createAttribute("side_length", H5::PredType::NATIVE_FLOAT, H5::DataSpace(H5S_SCALAR));
 	float side_length = s.get_side_length();
 	side_attr.write(H5::PredType::NATIVE_FLOAT, (const void*)&side_length);
+	
+	std::vector<std::uint8_t> index_data = cubes_structure_index::build(side_length, std::move(index_cubes));
+	hsize_t index_dims[] = { index_data.size() };
+	H5::DataSet index_set = file.createDataSet("cube_index", H5::PredType::NATIVE_UINT8, H5::DataSpace(1, index_dims));
+	index_set.write(index_data.data(), H5::PredType::NATIVE_UINT8);
 }
 
 
 
-cubes_structure_hdf_loader::cubes_structure_hdf_loader(const std::string& filename) : file_(filename, 0) {	
-	auto cubes_set = file_.openDataSet("cubes");
-	
-	float side_length;
-	auto side_attr = cubes_set.openAttribute("side_length");
-	side_attr.read(H5::PredType::NATIVE_FLOAT, (void*)&side_length);
-	
-	auto cubes_space = cubes_set.getSpace();
-	hsize_t cubes_count = cubes_space.getSimpleExtentNpoints();
-	hdf_cube* cubes_data = new hdf_cube [cubes_count];
-	const hdf_cube* cubes_data_end = cubes_data + cubes_count;
-	cubes_set.read((void*)cubes_data, cube_type_);
-	for(hdf_cube* cub = cubes_data; cub < cubes_data_end; ++cub) {
-		cube_entries_.emplace_back(
-			cub->data_start,
-			cub->data_length,
-			cube_from_index_(std::make_tuple(cub->x, cub->y, cub->z), side_length)
-		);
-	}
-	delete[] cubes_data;
-		
+cubes_structure_hdf_loader::cubes_structure_hdf_loader(const std::string& filename) {
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
+	file_.openFile(filename, H5F_ACC_RDONLY);
+	index_.load_hdf(filename, file_);
 	points_data_set_ = file_.openDataSet("points");
 	points_data_space_ = points_data_set_.getSpace();
-	number_of_points_ = points_data_space_.getSimpleExtentNpoints();
+}
+
+
+cubes_structure_hdf_loader::~cubes_structure_hdf_loader() {
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
+	points_data_space_.close();
+	points_data_set_.close();
+	file_.close();
 }
 
 
@@ -107,33 +135,42 @@ std::size_t cubes_structure_hdf_loader::compute_downsampled_points_(point_buffer
 	std::size_t total = 0;
 	point_buffer_t buf = points;	
 	
-	for(const auto& entry : cube_entries_) {
-		const cuboid& cube = entry.cube;
-		if(entry.data_length > remaining) break;
+	for(auto block = index_.blocks_begin(); block != index_.blocks_end(); ++block) {
+		// Skip block outside frustum, unless one of its cubes would end the traversal
+		if(frustum_culling_ && block->maximal_cube_points <= remaining && !req.view_frustum.contains_cuboid(index_.block_cuboid(*block))) continue;
 		
-		if(frustum_culling_ && !req.view_frustum.contains_cuboid(cube)) continue;
-		
-		float distance = std::abs(glm::distance(req.position, cube.center()));
-		float min_weight = 1.0 - downsampling_ratio_(distance, capacity, number_of_points_);
-
-		points_data_space_.selectHyperslab(H5S_SELECT_SET, &entry.data_length, &entry.data_start);
-		
-		hsize_t dims[] = { entry.data_length };
-		H5::DataSpace mem_space(1, dims);
-		
-		weighted_point* mem_buf = new weighted_point[entry.data_length];
-		weighted_point* mem_buf_end = mem_buf + entry.data_length;
-		points_data_set_.read(mem_buf, point_type_, mem_space, points_data_space_);
-		
-		for(weighted_point* it = mem_buf; it != mem_buf_end; ++it) {
-			if(it->weight < min_weight) break;
+		for(auto entry = index_.block_cubes_begin(*block); entry != index_.block_cubes_end(*block); ++entry) {
+			hsize_t data_start = entry->data_start;
+			hsize_t data_length = entry->number_of_points;
+			if(data_length > remaining) return total;
+			
+			cuboid cube = cube_from_index_(std::make_tuple(entry->x, entry->y, entry->z), index_.side_length());
+			if(frustum_culling_ && !req.view_frustum.contains_cuboid(cube)) continue;
 			
-			*(buf++) = *it;
-			--remaining;
-			++total;
+			float distance = std::abs(glm::distance(req.position, cube.center()));
+			float min_weight = 1.0 - downsampling_ratio_(distance, capacity, index_.number_of_points());
+
+			weighted_point* mem_buf = new weighted_point[data_length];
+			weighted_point* mem_buf_end = mem_buf + data_length;
+			{
+				std::lock_guard<std::mutex> lock(hdf_library_mutex());
+				points_data_space_.selectHyperslab(H5S_SELECT_SET, &data_length, &data_start);
+				
+				hsize_t dims[] = { data_length };
+				H5::DataSpace mem_space(1, dims);
+				points_data_set_.read(mem_buf, point_type_, mem_space, points_data_space_);
+			}
+			
+			for(weighted_point* it = mem_buf; it != mem_buf_end; ++it) {
+				if(it->weight < min_weight) break;
+				
+				*(buf++) = *it;
+				--remaining;
+				++total;
+			}
+			
+			delete[] mem_buf;
 		}
-		
-		delete[] mem_buf;
 	}
 	
 	return total;
@@ -141,15 +178,16 @@ std::size_t cubes_structure_hdf_loader::compute_downsampled_points_(point_buffer
 
 	
 std::size_t cubes_structure_hdf_loader::memory_size() const {
-	return cube_entries_.size() * sizeof(cube_entry);
+	return index_.memory_size();
 }
 
 std::size_t cubes_structure_hdf_loader::rom_size() const {
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
 	return file_.getFileSize();
 }
 
 std::size_t cubes_structure_hdf_loader::number_of_points() const {
-	return number_of_points_;;
+	return index_.number_of_points();
 }
 
 
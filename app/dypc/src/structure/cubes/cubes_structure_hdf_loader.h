@@ -7,6 +7,7 @@
 #include <cstdint>
 #include <H5Cpp.h>
 #include "cubes_structure_loader.h"
+#include "cubes_structure_index.h"
 #include "../../point.h"
 #include "../../geometry/cuboid.h"
 #include "../../loader/loader.h"
@@ -17,16 +18,6 @@ class cubes_structure;
 
 class cubes_structure_hdf_loader : public cubes_structure_loader {	
 private:
-	class cube_entry {
-	public:
-		hsize_t data_start;
-		hsize_t data_length;
-		cuboid cube;
-		
-		cube_entry(hsize_t start, hsize_t len, const cuboid& c) :
-			data_start(start), data_length(len), cube(c) { }
-	};
-	
 	struct hdf_cube {
 		std::int32_t x;
 		std::int32_t y;
@@ -38,14 +29,15 @@ private:
 	static H5::CompType point_type_;
 	static H5::CompType cube_type_;
 	
+	static constexpr std::size_t write_queue_capacity_ = 1 << 22; ///< Points queued for writing before write() waits.
+	
 	static H5::CompType initialize_point_type_();
 	static H5::CompType initialize_cube_type_();	
 
-	std::vector<cube_entry> cube_entries_;
+	cubes_structure_index index_;
 	H5::H5File file_;
 	H5::DataSpace points_data_space_;
 	H5::DataSet points_data_set_;
-	std::size_t number_of_points_;
 		
 protected:
 	std::size_t compute_downsampled_points_(point_buffer_t points, std::size_t capacity, const loader::request_t&);
@@ -54,6 +46,7 @@ public:
 	static void write(const std::string& file, const cubes_structure&);
 	
 	explicit cubes_structure_hdf_loader(const std::string& file);
+	~cubes_structure_hdf_loader() override;
 
 	std::string loader_name() const override { return "Cubes Structure HDF Loader"; }
 
@@ -0,0 +1,217 @@
+#include "cubes_structure_index.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace dypc {
+
+constexpr std::size_t cubes_structure_index::cubes_per_block;
+constexpr std::uint32_t cubes_structure_index::version_;
+
+static const char index_magic_[8] = { 'D', 'Y', 'P', 'C', 'C', 'I', 'D', 'X' };
+
+
+/**
+ * Entry of the cubes table in HDF files.
+ */
+struct hdf_cube_ {
+	std::int32_t x;
+	std::int32_t y;
+	std::int32_t z;
+	std::uint32_t data_start;
+	std::uint32_t data_length;
+};
+
+/**
+ * HDF type of the cubes table. Member names as written by the HDF loaders.
+ */
+static H5::CompType hdf_cube_type_() {
+	H5::CompType t(sizeof(hdf_cube_));
+	t.insertMember("x", HOFFSET(hdf_cube_, x), H5::PredType::NATIVE_INT32);
+	t.insertMember("z", HOFFSET(hdf_cube_, y), H5::PredType::NATIVE_INT32);
+	t.insertMember("y", HOFFSET(hdf_cube_, z), H5::PredType::NATIVE_INT32);
+	t.insertMember("data_start", HOFFSET(hdf_cube_, data_start), H5::PredType::NATIVE_UINT32);
+	t.insertMember("data_length", HOFFSET(hdf_cube_, data_length), H5::PredType::NATIVE_UINT32);
+	return t;
+}
+
+
+/**
+ * Compare cubes by Morton order of their cube indices, without computing the interleaved key.
+ * The axis on which the indices differ in the highest bit decides. Sign bits are flipped so that negative indices
+ * come first.
+ */
+static bool morton_less_(const cubes_structure_index::cube& a, const cubes_structure_index::cube& b) {
+	const std::uint32_t sign = 0x80000000u;
+	const std::uint32_t ia[3] = { std::uint32_t(a.x) ^ sign, std::uint32_t(a.y) ^ sign, std::uint32_t(a.z) ^ sign };
+	const std::uint32_t ib[3] = { std::uint32_t(b.x) ^ sign, std::uint32_t(b.y) ^ sign, std::uint32_t(b.z) ^ sign };
+	std::ptrdiff_t axis = 0;
+	std::uint32_t axis_difference = ia[0] ^ ib[0];
+	for(std::ptrdiff_t j = 1; j < 3; ++j) {
+		std::uint32_t difference = ia[j] ^ ib[j];
+		// Highest set bit of difference is above that of axis_difference
+		if(axis_difference < difference && axis_difference < (axis_difference ^ difference)) {
+			axis = j;
+			axis_difference = difference;
+		}
+	}
+	return ia[axis] < ib[axis];
+}
+
+
+std::vector<std::uint8_t> cubes_structure_index::build(float side_length, std::vector<cube> cubes) {
+	// Morton order keeps the cubes of each block within a compact region, so that block cuboids are tight
+	std::sort(cubes.begin(), cubes.end(), &morton_less_);
+
+	std::vector<block> blocks;
+	std::uint64_t number_of_points = 0;
+	for(std::size_t first = 0; first < cubes.size(); first += cubes_per_block) {
+		std::size_t last = first + cubes_per_block;
+		if(last > cubes.size()) last = cubes.size();
+
+		block b;
+		std::memset(&b, 0, sizeof(block));
+		b.first_cube = first;
+		b.number_of_cubes = last - first;
+		b.index_min[0] = b.index_max[0] = cubes[first].x;
+		b.index_min[1] = b.index_max[1] = cubes[first].y;
+		b.index_min[2] = b.index_max[2] = cubes[first].z;
+		for(std::size_t i = first; i < last; ++i) {
+			const cube& c = cubes[i];
+			const std::int32_t idx[3] = { c.x, c.y, c.z };
+			for(std::ptrdiff_t j = 0; j < 3; ++j) {
+				if(idx[j] < b.index_min[j]) b.index_min[j] = idx[j];
+				if(idx[j] > b.index_max[j]) b.index_max[j] = idx[j];
+			}
+			b.number_of_points += c.number_of_points;
+			if(c.number_of_points > b.maximal_cube_points) b.maximal_cube_points = c.number_of_points;
+		}
+		number_of_points += b.number_of_points;
+		blocks.push_back(b);
+	}
+
+	header h;
+	std::memset(&h, 0, sizeof(header));
+	std::memcpy(h.magic, index_magic_, sizeof(h.magic));
+	h.version = version_;
+	h.side_length = side_length;
+	h.number_of_points = number_of_points;
+	h.number_of_cubes = cubes.size();
+	h.number_of_blocks = blocks.size();
+
+	std::vector<std::uint8_t> data(sizeof(header) + blocks.size()*sizeof(block) + cubes.size()*sizeof(cube));
+	std::uint8_t* out = data.data();
+	std::memcpy(out, &h, sizeof(header));
+	out += sizeof(header);
+	if(! blocks.empty()) std::memcpy(out, blocks.data(), blocks.size()*sizeof(block));
+	out += blocks.size()*sizeof(block);
+	if(! cubes.empty()) std::memcpy(out, cubes.data(), cubes.size()*sizeof(cube));
+	return data;
+}
+
+
+void cubes_structure_index::release_() {
+	if(mapping_) munmap(mapping_, mapping_length_);
+	mapping_ = nullptr;
+	mapping_length_ = 0;
+	data_.clear();
+	header_ = nullptr;
+	blocks_ = nullptr;
+	cubes_ = nullptr;
+}
+
+
+void cubes_structure_index::set_data_(const std::uint8_t* data, std::size_t size) {
+	if(size < sizeof(header)) throw std::runtime_error("Cube index is truncated");
+	const header* h = reinterpret_cast<const header*>(data);
+	if(std::memcmp(h->magic, index_magic_, sizeof(h->magic)) != 0 || h->version != version_)
+		throw std::runtime_error("Invalid cube index");
+	if(size != sizeof(header) + h->number_of_blocks*sizeof(block) + h->number_of_cubes*sizeof(cube))
+		throw std::runtime_error("Cube index is truncated");
+
+	header_ = h;
+	blocks_ = reinterpret_cast<const block*>(data + sizeof(header));
+	cubes_ = reinterpret_cast<const cube*>(data + sizeof(header) + h->number_of_blocks*sizeof(block));
+}
+
+
+bool cubes_structure_index::map(const std::string& filename, std::size_t offset, std::size_t size) {
+	release_();
+
+	// Record fields get accessed in place, so the mapped address must be aligned for them
+	if(offset % alignof(std::uint64_t) != 0 || size == 0) return false;
+
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd == -1) return false;
+	std::size_t page_size = sysconf(_SC_PAGESIZE);
+	std::size_t page_offset = offset % page_size;
+	std::size_t length = page_offset + size;
+	void* mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, offset - page_offset);
+	close(fd);
+	if(mapping == MAP_FAILED) return false;
+
+	mapping_ = mapping;
+	mapping_length_ = length;
+	try {
+		set_data_(static_cast<const std::uint8_t*>(mapping) + page_offset, size);
+	} catch(...) {
+		release_();
+		throw;
+	}
+	return true;
+}
+
+
+void cubes_structure_index::assign(std::vector<std::uint8_t>&& data) {
+	release_();
+	data_ = std::move(data);
+	try {
+		set_data_(data_.data(), data_.size());
+	} catch(...) {
+		release_();
+		throw;
+	}
+}
+
+
+void cubes_structure_index::load_hdf(const std::string& filename, const H5::H5File& file) {
+	if(H5Lexists(file.getId(), "cube_index", H5P_DEFAULT) > 0) {
+		auto index_set = file.openDataSet("cube_index");
+		std::size_t size = index_set.getSpace().getSimpleExtentNpoints();
+		haddr_t offset = index_set.getOffset(); // Undefined unless data set is contiguous and allocated
+		if(offset != HADDR_UNDEF && map(filename, offset, size)) return;
+		
+		std::vector<std::uint8_t> index_data(size);
+		index_set.read(index_data.data(), H5::PredType::NATIVE_UINT8);
+		assign(std::move(index_data));
+		
+	} else {
+		// File written without index: build it from the cubes table
+		auto cubes_set = file.openDataSet("cubes");
+		
+		float side_length;
+		auto side_attr = cubes_set.openAttribute("side_length");
+		side_attr.read(H5::PredType::NATIVE_FLOAT, (void*)&side_length);
+		
+		std::vector<hdf_cube_> cubes_data(cubes_set.getSpace().getSimpleExtentNpoints());
+		cubes_set.read((void*)cubes_data.data(), hdf_cube_type_());
+		std::vector<cube> index_cubes;
+		index_cubes.reserve(cubes_data.size());
+		for(const hdf_cube_& cub : cubes_data)
+			index_cubes.push_back(cube { cub.x, cub.y, cub.z, cub.data_length, cub.data_start });
+		assign(build(side_length, std::move(index_cubes)));
+	}
+}
+
+
+cuboid cubes_structure_index::block_cuboid(const block& b) const {
+	float side = header_->side_length;
+	glm::vec3 origin(b.index_min[0] * side, b.index_min[1] * side, b.index_min[2] * side);
+	glm::vec3 extremity((b.index_max[0] + 1) * side, (b.index_max[1] + 1) * side, (b.index_max[2] + 1) * side);
+	return cuboid(origin, extremity - origin);
+}
+
+}
@@ -0,0 +1,126 @@
+#ifndef DYPC_CUBES_STRUCTURE_INDEX_H_
+#define DYPC_CUBES_STRUCTURE_INDEX_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <H5Cpp.h>
+#include "../../geometry/cuboid.h"
+
+namespace dypc {
+
+/**
+ * Precomputed spatial index of the cubes in a cubes structure file.
+ * Gets serialized into one contiguous block of bytes when the file is written, so that opening the file only needs to
+ * map or read that block, instead of scanning the cubes and points tables. Contains the totals, the cube entries
+ * in Morton order of their cube index, and one entry per block of consecutive cubes, which holds their bounding box.
+ * Loaders can then cull entire blocks against the view frustum.
+ * The byte layout is native, so index files are not portable across endianness.
+ */
+class cubes_structure_index {
+public:
+	struct header {
+		char magic[8];
+		std::uint32_t version;
+		float side_length;
+		std::uint64_t number_of_points;
+		std::uint64_t number_of_cubes;
+		std::uint64_t number_of_blocks;
+	};
+
+	struct cube {
+		std::int32_t x;
+		std::int32_t y;
+		std::int32_t z;
+		std::uint32_t number_of_points;
+		std::uint64_t data_start; ///< Offset of points in HDF file, or cube id in SQLite file.
+	};
+
+	struct block {
+		std::int32_t index_min[3]; ///< Minimal cube index of cubes in block, on each axis.
+		std::int32_t index_max[3]; ///< Maximal cube index of cubes in block, on each axis.
+		std::uint32_t first_cube;
+		std::uint32_t number_of_cubes;
+		std::uint64_t number_of_points;
+		std::uint32_t maximal_cube_points; ///< Number of points of the largest cube in block.
+		std::uint32_t padding;
+	};
+
+	static constexpr std::size_t cubes_per_block = 64;
+
+private:
+	static constexpr std::uint32_t version_ = 1;
+
+	std::vector<std::uint8_t> data_; ///< Index data, when read into memory.
+	void* mapping_ = nullptr; ///< Start of memory mapping, when index is mapped from file.
+	std::size_t mapping_length_ = 0;
+
+	const header* header_ = nullptr;
+	const block* blocks_ = nullptr;
+	const cube* cubes_ = nullptr;
+
+	void release_();
+	void set_data_(const std::uint8_t* data, std::size_t size);
+
+public:
+	/**
+	 * Serialize index for given cubes.
+	 * @param side_length Side length of cubes.
+	 * @param cubes The cube entries. Get sorted in Morton order of cube index.
+	 */
+	static std::vector<std::uint8_t> build(float side_length, std::vector<cube> cubes);
+
+	cubes_structure_index() = default;
+	cubes_structure_index(const cubes_structure_index&) = delete;
+	cubes_structure_index& operator=(const cubes_structure_index&) = delete;
+	~cubes_structure_index() { release_(); }
+
+	/**
+	 * Memory-map index from region of file.
+	 * Returns false if the region cannot be mapped, for example when it is not suitably aligned. Then the index needs
+	 * to be read and passed to assign(). Throws if the mapped data is not a valid index.
+	 * @param filename Path of file.
+	 * @param offset Byte offset of the serialized index in file.
+	 * @param size Byte size of the serialized index.
+	 */
+	bool map(const std::string& filename, std::size_t offset, std::size_t size);
+
+	/**
+	 * Take serialized index that was read into memory. Throws if it is not a valid index.
+	 */
+	void assign(std::vector<std::uint8_t>&& data);
+
+	/**
+	 * Load index of cubes structure HDF file, as written by the cubes and cubes mipmap HDF loaders.
+	 * Maps or reads the serialized index. Files written without it get their index built from the cubes table.
+	 * Must be called while holding hdf_library_mutex().
+	 * @param filename Path of file.
+	 * @param file The opened file.
+	 */
+	void load_hdf(const std::string& filename, const H5::H5File& file);
+
+	float side_length() const { return header_->side_length; }
+	std::size_t number_of_points() const { return header_->number_of_points; }
+	std::size_t number_of_cubes() const { return header_->number_of_cubes; }
+	std::size_t number_of_blocks() const { return header_->number_of_blocks; }
+
+	const block* blocks_begin() const { return blocks_; }
+	const block* blocks_end() const { return blocks_ + header_->number_of_blocks; }
+	const cube* block_cubes_begin(const block& b) const { return cubes_ + b.first_cube; }
+	const cube* block_cubes_end(const block& b) const { return cubes_ + b.first_cube + b.number_of_cubes; }
+
+	/**
+	 * Cuboid that covers all cubes of block.
+	 */
+	cuboid block_cuboid(const block&) const;
+
+	/**
+	 * Bytes of index held in process memory. Mapped indices are not counted.
+	 */
+	std::size_t memory_size() const { return data_.size(); }
+};
+
+}
+
+#endif
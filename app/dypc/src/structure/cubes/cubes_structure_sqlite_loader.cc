@@ -16,46 +16,61 @@ void cubes_structure_sqlite_loader::write(const std::string& filename, const cub
 	auto insert_cube = database.prepare("INSERT INTO cubes (index_x, index_y, index_z, number_of_points) VALUES (?, ?, ?, ?)");
 	auto insert_point = database.prepare("INSERT INTO points (cube_id, x, y, z, r, g, b, weight) VALUES (?, ?, ?, ?, ?, ?, ?, ?)");
 	auto insert_config = database.prepare("INSERT INTO config (side_length) VALUES (?)");
+	auto insert_index = database.prepare("INSERT INTO cube_index (data) VALUES (?)");
 	
 	insert_config(s.get_side_length());
 	
+	std::vector<cubes_structure_index::cube> index_cubes;
 	database.transaction([&]() -> bool {
 		progress_foreach(s.cubes(), "Writing Cubes Structure to SQLite...", [&](const cubes_structure::cubes_t::value_type& p) {
 			const auto& idx = p.first;
 			const cubes_structure::cube& cube = p.second;
 			insert_cube(std::get<0>(idx), std::get<1>(idx), std::get<2>(idx), cube.number_of_points());
 			auto cube_id = database.last_insert_id();
+			index_cubes.push_back(cubes_structure_index::cube {
+				(std::int32_t)std::get<0>(idx), (std::int32_t)std::get<1>(idx), (std::int32_t)std::get<2>(idx),
+				(std::uint32_t)cube.number_of_points(), (std::uint64_t)cube_id
+			});
 			
 			for(const auto& pt : cube.weighted_points()) {					
 				insert_point(cube_id, pt.x, pt.y, pt.z, pt.r, pt.g, pt.b, pt.weight);
 			}
 		});
+		insert_index(cubes_structure_index::build(s.get_side_length(), std::move(index_cubes)));
 		return true;
 	});
 }
 	
 cubes_structure_sqlite_loader::cubes_structure_sqlite_loader(const std::string& filename) : database_(filename) {
+	auto select_index_table = database_.select("SELECT COUNT(*) FROM sqlite_master WHERE type='table' AND name='cube_index'");
+	select_index_table.next();
+	bool has_index = (select_index_table.current_row()[0].int_value() != 0);
+	
+	if(has_index) {
+		// Single row read, instead of a scan of cubes and points tables
+		auto select_index = database_.select("SELECT data FROM cube_index LIMIT 1");
+		if(! select_index.next()) throw std::runtime_error("Cube index is missing");
+		index_.assign(select_index.current_row()[0].blob_value());
+	} else {
+		build_index_();
+	}
+}
+
+
+void cubes_structure_sqlite_loader::build_index_() {
 	auto select_config = database_.select("SELECT side_length FROM config LIMIT 1");
 	select_config.next();
 	float side_length = select_config.current_row()[0].float_value();
 	
-	auto select_number = const_cast<sqlite_database&>(database_).select("SELECT COUNT(*) FROM points");
-	select_number.next();
-	number_of_points_ = select_number.current_row()[0].int_value();
-	
+	std::vector<cubes_structure_index::cube> index_cubes;
 	auto select_cubes = database_.select("SELECT id, index_x, index_y, index_z, number_of_points FROM cubes");
 	for(auto r : select_cubes) {
-		sqlite_database::id_t id = r[0].id_value();
-		std::ptrdiff_t index_x = r[1].int_value();
-		std::ptrdiff_t index_y = r[2].int_value();
-		std::ptrdiff_t index_z = r[3].int_value();
-		std::size_t number_of_points = r[4].int_value();
-		cube_entries_.emplace_back(
-			id,
-			number_of_points,
-			cube_from_index_(std::make_tuple(index_x, index_y, index_z), side_length)
-		);
+		index_cubes.push_back(cubes_structure_index::cube {
+			r[1].int_value(), r[2].int_value(), r[3].int_value(),
+			(std::uint32_t)r[4].int_value(), (std::uint64_t)r[0].id_value()
+		});
 	}
+	index_.assign(cubes_structure_index::build(side_length, std::move(index_cubes)));
 }
 
 	
@@ -63,6 +78,7 @@ void cubes_structure_sqlite_loader::create_tables_(sqlite_database& database) {
 	database.execute("DROP TABLE IF EXISTS cubes");
 	database.execute("DROP TABLE IF EXISTS points");
 	database.execute("DROP TABLE IF EXISTS config");
+	database.execute("DROP TABLE IF EXISTS cube_index");
 	
 	database.execute(
 		"CREATE TABLE cubes ("
@@ -93,6 +109,12 @@ void cubes_structure_sqlite_loader::create_tables_(sqlite_database& database) {
 		")"
 	);
 	
+	database.execute(
+		"CREATE TABLE cube_index ("
+			"data BLOB NOT NULL"
+		")"
+	);
+	
 	database.execute(
 		"CREATE INDEX points_cube_index ON points (cube_id)"
 	);
@@ -105,30 +127,35 @@ std::size_t cubes_structure_sqlite_loader::compute_downsampled_points_(point_buf
 
 	auto select_cube_points = database_.select("SELECT x, y, z, r, g, b FROM points WHERE cube_id=? AND weight>=?");
 	
-	for(const auto& entry : cube_entries_) {
-		const cuboid& cube = entry.cube;
-		if(entry.number_of_points > remaining) break;
-		
-		if(frustum_culling_ && !req.view_frustum.contains_cuboid(cube)) continue;
-
-		float distance = std::abs(glm::distance(req.position, cube.center()));
-		float min_weight = 1.0 - downsampling_ratio_(distance, capacity, number_of_points_);
-
-
-		select_cube_points.reset();
-		select_cube_points[0] = entry.id;
-		select_cube_points[1] = min_weight;
-		for(auto r : select_cube_points) {
-			buf->x = r[0].float_value();
-			buf->y = r[1].float_value();
-			buf->z = r[2].float_value();
-			buf->r = r[3].int_value();
-			buf->g = r[4].int_value();
-			buf->b = r[5].int_value();
+	for(auto block = index_.blocks_begin(); block != index_.blocks_end(); ++block) {
+		// Skip block outside frustum, unless one of its cubes would end the traversal
+		if(frustum_culling_ && block->maximal_cube_points <= remaining && !req.view_frustum.contains_cuboid(index_.block_cuboid(*block))) continue;
+
+		for(auto entry = index_.block_cubes_begin(*block); entry != index_.block_cubes_end(*block); ++entry) {
+			if(entry->number_of_points > remaining) return total;
 			
-			++buf;
-			--remaining;
-			++total;
+			cuboid cube = cube_from_index_(std::make_tuple(entry->x, entry->y, entry->z), index_.side_length());
+			if(frustum_culling_ && !req.view_frustum.contains_cuboid(cube)) continue;
+
+			float distance = std::abs(glm::distance(req.position, cube.center()));
+			float min_weight = 1.0 - downsampling_ratio_(distance, capacity, index_.number_of_points());
+
+
+			select_cube_points.reset();
+			select_cube_points[0] = (sqlite_database::id_t)entry->data_start;
+			select_cube_points[1] = min_weight;
+			for(auto r : select_cube_points) {
+				buf->x = r[0].float_value();
+				buf->y = r[1].float_value();
+				buf->z = r[2].float_value();
+				buf->r = r[3].int_value();
+				buf->g = r[4].int_value();
+				buf->b = r[5].int_value();
+				
+				++buf;
+				--remaining;
+				++total;
+			}
 		}
 	}
 
@@ -137,7 +164,7 @@ std::size_t cubes_structure_sqlite_loader::compute_downsampled_points_(point_buf
 
 
 std::size_t cubes_structure_sqlite_loader::memory_size() const {
-	return cube_entries_.size() * sizeof(cube_entry);
+	return index_.memory_size();
 }
 
 std::size_t cubes_structure_sqlite_loader::rom_size() const {
@@ -145,7 +172,7 @@ std::size_t cubes_structure_sqlite_loader::rom_size() const {
 }
 
 std::size_t cubes_structure_sqlite_loader::number_of_points() const {
-	return number_of_points_;
+	return index_.number_of_points();
 }
 
 }
@@ -5,6 +5,7 @@
 #include <vector>
 #include <utility>
 #include "cubes_structure_loader.h"
+#include "cubes_structure_index.h"
 #include "../../sqlite/sqlite_database.h"
 #include "../../point.h"
 #include "../../geometry/cuboid.h"
@@ -16,21 +17,11 @@ class cubes_structure;
 
 class cubes_structure_sqlite_loader : public cubes_structure_loader {	
 private:
-	class cube_entry {
-	public:
-		sqlite_database::id_t id;
-		std::size_t number_of_points;
-		cuboid cube;
-		
-		cube_entry(id_t nid, std::size_t npts, const cuboid& c) :
-			id(nid), number_of_points(npts), cube(c) { }
-	};
-
 	sqlite_database database_;
-	std::vector<cube_entry> cube_entries_;
-	std::size_t number_of_points_;
+	cubes_structure_index index_;
 
 	static void create_tables_(sqlite_database&);
+	void build_index_();
 	
 public:
 	static void write(const std::string& file, const cubes_structure&);
@@ -0,0 +1,117 @@
+#ifndef DYPC_CUBES_BINNING_H_
+#define DYPC_CUBES_BINNING_H_
+
+#include "../point.h"
+#include "../util.h"
+#include "../progress.h"
+#include "../model/model.h"
+#include <tuple>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <atomic>
+#include <mutex>
+
+namespace dypc {
+
+using cube_bin_index_t = std::tuple<std::ptrdiff_t, std::ptrdiff_t, std::ptrdiff_t>;
+
+struct cube_bin_index_hash {
+	std::size_t operator()(const cube_bin_index_t& idx) const {
+		std::hash<std::ptrdiff_t> hash;
+		return (hash(std::get<0>(idx)) * 73856093) ^ (hash(std::get<1>(idx)) * 19349663) ^ (hash(std::get<2>(idx)) * 83492791);
+	}
+};
+
+using cube_bins_t = std::unordered_map<cube_bin_index_t, std::vector<point>, cube_bin_index_hash>;
+
+
+/**
+ * Distribute the points of a model into cubes, using multiple threads.
+ * Threads take turns reading chunks from a shared model iterator, and put the points into their own hash tables.
+ * The tables are merged at the end. Order of points inside a cube is not deterministic.
+ * @param mod The model.
+ * @param index_for_point Function that returns cube index for a point.
+ * @param number_of_threads Number of threads.
+ * @param label Label for progress bar.
+ */
+template<class IndexFunction>
+cube_bins_t bin_points_into_cubes_parallel(model& mod, IndexFunction index_for_point, std::size_t number_of_threads, const std::string& label) {
+	const std::size_t chunk_size = 1 << 16;
+
+	model::iterator it = mod.begin(), end = mod.end();
+	std::mutex read_mutex;
+	std::vector<cube_bins_t> thread_bins(number_of_threads);
+	std::atomic<std::size_t> next_thread_bins(0);
+
+	shared_progress pr(mod.number_of_points(), label);
+	pr.run(number_of_threads, [&](shared_progress::counter& binned) {
+		cube_bins_t& bins = thread_bins[next_thread_bins++];
+		std::vector<point> chunk;
+		chunk.reserve(chunk_size);
+		for(;;) {
+			chunk.clear();
+			{
+				std::lock_guard<std::mutex> lock(read_mutex);
+				for(; it != end && chunk.size() < chunk_size; ++it) chunk.push_back(*it);
+			}
+			if(chunk.empty()) break;
+			for(const point& pt : chunk) bins[index_for_point(pt)].push_back(pt);
+			binned.add(chunk.size());
+		}
+	});
+
+	// Merge into the largest table, so that the least cubes need to be moved
+	auto largest = std::max_element(thread_bins.begin(), thread_bins.end(), [](const cube_bins_t& a, const cube_bins_t& b) {
+		return a.size() < b.size();
+	});
+	cube_bins_t result;
+	result.swap(*largest);
+	for(cube_bins_t& bins : thread_bins) {
+		for(auto& entry : bins) {
+			std::vector<point>& pts = result[entry.first];
+			if(pts.empty()) pts.swap(entry.second);
+			else pts.insert(pts.end(), entry.second.begin(), entry.second.end());
+		}
+		bins.clear();
+	}
+	return result;
+}
+
+
+/**
+ * Call function for each cube, using multiple threads.
+ * Cubes get handed out to the threads one at a time. Each thread has its own random generator, so that the function
+ * does not need to share one.
+ * @param cubes Container of cubes, such as the map of a cubes structure.
+ * @param number_of_threads Number of threads.
+ * @param label Label for progress bar.
+ * @param func Function called with element of \a cubes and random generator, both by non-const reference.
+ */
+template<class Container, class Function>
+void process_cubes_parallel(Container& cubes, std::size_t number_of_threads, const std::string& label, Function func) {
+	std::vector<typename Container::value_type*> entries;
+	entries.reserve(cubes.size());
+	for(auto& entry : cubes) entries.push_back(&entry);
+
+	std::random_device random_device;
+	std::vector<random_generator_t::result_type> seeds;
+	for(std::size_t i = 0; i < number_of_threads; ++i) seeds.push_back(random_device());
+	std::atomic<std::size_t> next_seed(0), next_entry(0);
+
+	shared_progress pr(entries.size(), label, "cubes");
+	pr.run(number_of_threads, [&](shared_progress::counter& processed) {
+		random_generator_t random_generator(seeds[next_seed++]);
+		for(std::size_t i = next_entry++; i < entries.size(); i = next_entry++) {
+			func(*entries[i], random_generator);
+			processed.add();
+		}
+	});
+}
+
+}
+
+#endif
@@ -2,6 +2,7 @@
 #include "../../model/model.h"
 #include "../../progress.h"
 #include "../../downsampling.h"
+#include "../cubes_binning.h"
 
 #include <stdexcept>
 #include <cassert>
@@ -12,30 +13,52 @@
 
 namespace dypc {
 
-void cubes_mipmap_structure::add_point_(const point& pt) {
-	auto idx = cube_index_for_coordinates(pt);
+cubes_mipmap_structure::cube& cubes_mipmap_structure::cube_at_index_(cube_index_t idx) {
 	auto it = cubes_.find(idx);
 	if(it == cubes_.end()) {
 		auto p = cubes_.emplace(std::piecewise_construct, std::forward_as_tuple(idx), std::forward_as_tuple(*this));
 		if(p.second) it = p.first;
 		else throw std::runtime_error("Point insertion failed");
 	}
-	it->second.add_point(pt);
+	return it->second;
+}
+
+
+void cubes_mipmap_structure::add_point_(const point& pt) {
+	cube_at_index_(cube_index_for_coordinates(pt)).add_point(pt);
 }
 
 
-cubes_mipmap_structure::cubes_mipmap_structure(float side, std::size_t dlevels, std::size_t dmin, float damount, downsampling_mode dmode, model& mod) :
-mipmap_structure(dlevels, dmin, damount, dmode, false, mod), side_length_(side) {
+cubes_mipmap_structure::cubes_mipmap_structure(float side, std::size_t dlevels, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, std::size_t threads) :
+mipmap_structure(dlevels, dmin, damount, dmode, false, false, mod), side_length_(side) {
 	using namespace std::placeholders;
 	
-	progress_foreach(
-		mod.begin(), mod.end(), mod.number_of_points(), "Creating Cubes Structure...",
-		std::bind(&cubes_mipmap_structure::add_point_, this, _1)
+	if(threads <= 1) {
+		progress_foreach(
+			mod.begin(), mod.end(), mod.number_of_points(), "Creating Cubes Structure...",
+			std::bind(&cubes_mipmap_structure::add_point_, this, _1)
+		);
+		
+		progress_foreach(
+			cubes_, "Downsampling...",
+			[&](cubes_t::value_type& c) { c.second.generate_downsampling(c.first); }
+		);
+		return;
+	}
+	
+	cube_bins_t bins = bin_points_into_cubes_parallel(
+		mod, [this](const point& pt) { return cube_index_for_coordinates(pt); }, threads, "Creating Cubes Structure..."
 	);
+	for(auto& entry : bins) {
+		cube_at_index_(entry.first).add_points(entry.second);
+		std::vector<point>().swap(entry.second);
+	}
+	bins.clear();
 	
-	progress_foreach(
-		cubes_, "Downsampling...",
-		[&](cubes_t::value_type& c) { c.second.generate_downsampling(c.first); }
+	// Cubes are independent, and downsampling only reads the structure's settings
+	process_cubes_parallel(
+		cubes_, threads, "Downsampling...",
+		[](cubes_t::value_type& c, random_generator_t&) { c.second.generate_downsampling(c.first); }
 	);
 }
 
@@ -5,6 +5,7 @@
 #include <cmath>
 #include <vector>
 #include <cassert>
+#include <thread>
 #include "../../enums.h"
 #include "../../point.h"
 #include "../../geometry/cuboid.h"
@@ -36,10 +37,21 @@ private:
 	const float side_length_;
 	cubes_t cubes_;
 
+	cube& cube_at_index_(cube_index_t idx);
 	void add_point_(const point& pt);
 
 public:
-	cubes_mipmap_structure(float side, std::size_t dlevels, std::size_t dmin, float damount, downsampling_mode dmode, model& mod);	
+	/**
+	 * Create cubes mipmap structure.
+	 * @param side Side length of cubes.
+	 * @param dlevels Number of downsampling levels.
+	 * @param dmin Minimal number of points in downsampled point sets.
+	 * @param damount Downsampling amount.
+	 * @param dmode Downsampling mode.
+	 * @param mod The model.
+	 * @param threads Number of threads used to bin points and downsample cubes.
+	 */
+	cubes_mipmap_structure(float side, std::size_t dlevels, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, std::size_t threads = std::thread::hardware_concurrency());
 	float get_side_length() const { return side_length_; }
 	
 	std::size_t total_number_of_points() const;
@@ -76,6 +88,10 @@ public:
 		point_sets_[0].push_back(pt);
 	}
 	
+	void add_points(const point_set_t& pts) {
+		point_sets_[0].insert(point_sets_[0].end(), pts.begin(), pts.end());
+	}
+	
 	void generate_downsampling(cube_index_t idx);
 		
 	std::size_t extract_points_at_level(point_buffer_t points, std::size_t capacity, std::ptrdiff_t lvl) const;
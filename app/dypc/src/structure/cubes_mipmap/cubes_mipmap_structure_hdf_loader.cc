@@ -1,5 +1,7 @@
 #include "cubes_mipmap_structure_hdf_loader.h"
 #include "cubes_mipmap_structure.h"
+#include "../hdf_library_mutex.h"
+#include <mutex>
 
 namespace dypc {
 	
@@ -29,11 +31,17 @@ H5::CompType cubes_mipmap_structure_hdf_loader::initialize_cube_type_() {
 
 
 void cubes_mipmap_structure_hdf_loader::write(const std::string& filename, const cubes_mipmap_structure& s) {
-	H5::H5File file(filename, H5F_ACC_TRUNC);
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
+	
+	// Aligned like in cubes_structure_hdf_loader, so that the cube index can be memory-mapped
+	H5::FileAccPropList access_properties;
+	access_properties.setAlignment(1, alignof(std::uint64_t));
+	H5::H5File file(filename, H5F_ACC_TRUNC, H5::FileCreatPropList::DEFAULT, access_properties);
 	
 	std::uint32_t mipmap_levels = s.get_downsampling_levels();
 	
 	std::vector<hdf_cube> cubes_data;
+	std::vector<cubes_structure_index::cube> index_cubes;
 	hsize_t cube_start = 0;
 
 	hsize_t points_dims[] = { s.total_number_of_points(), mipmap_levels };
@@ -66,6 +74,7 @@ void cubes_mipmap_structure_hdf_loader::write(const std::string& filename, const
 		hc.data_start = cube_start;
 		hc.data_length = cube_number_of_points;
 		cubes_data.push_back(hc);
+		index_cubes.push_back(cubes_structure_index::cube { hc.x, hc.y, hc.z, hc.data_length, cube_start });
 				
 		cube_start += cube_number_of_points;
 	}
@@ -81,29 +90,18 @@ void cubes_mipmap_structure_hdf_loader::write(const std::string& filename, const
 	
 	H5::Attribute levels_attr = points_set.createAttribute("mipmap_levels", H5::PredType::NATIVE_UINT32, H5::DataSpace(H5S_SCALAR));
 	levels_attr.write(H5::PredType::NATIVE_UINT32, (const void*)&mipmap_levels);
+	
+	std::vector<std::uint8_t> index_data = cubes_structure_index::build(side_length, std::move(index_cubes));
+	hsize_t index_dims[] = { index_data.size() };
+	H5::DataSet index_set = file.createDataSet("cube_index", H5::PredType::NATIVE_UINT8, H5::DataSpace(1, index_dims));
+	index_set.write(index_data.data(), H5::PredType::NATIVE_UINT8);
 }
 
 
-cubes_mipmap_structure_hdf_loader::cubes_mipmap_structure_hdf_loader(const std::string& filename) : file_(filename, 0) {	
-	auto cubes_set = file_.openDataSet("cubes");
-	
-	float side_length;
-	auto side_attr = cubes_set.openAttribute("side_length");
-	side_attr.read(H5::PredType::NATIVE_FLOAT, (void*)&side_length);
-	
-	auto cubes_space = cubes_set.getSpace();
-	hsize_t cubes_count = cubes_space.getSimpleExtentNpoints();
-	hdf_cube* cubes_data = new hdf_cube [cubes_count];
-	const hdf_cube* cubes_data_end = cubes_data + cubes_count;
-	cubes_set.read((void*)cubes_data, cube_type_);
-	for(hdf_cube* cub = cubes_data; cub < cubes_data_end; ++cub) {
-		cube_entries_.emplace_back(
-			cub->data_start,
-			cub->data_length,
-			cube_from_index_(std::make_tuple(cub->x, cub->y, cub->z), side_length)
-		);
-	}
-	delete[] cubes_data;
+cubes_mipmap_structure_hdf_loader::cubes_mipmap_structure_hdf_loader(const std::string& filename) {
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
+	file_.openFile(filename, H5F_ACC_RDONLY);
+	index_.load_hdf(filename, file_);
 	
 	points_data_set_ = file_.openDataSet("points");
 	points_data_space_ = points_data_set_.getSpace();
@@ -113,40 +111,55 @@ cubes_mipmap_structure_hdf_loader::cubes_mipmap_structure_hdf_loader(const std::
 }
 
 
+cubes_mipmap_structure_hdf_loader::~cubes_mipmap_structure_hdf_loader() {
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
+	points_data_space_.close();
+	points_data_set_.close();
+	file_.close();
+}
+
+
 std::size_t cubes_mipmap_structure_hdf_loader::compute_downsampled_points_(point_buffer_t points, std::size_t capacity, const loader::request_t& req) {
 	std::size_t remaining = capacity;
 	std::size_t total = 0;
 	point_buffer_t buf = points;	
 	
-	for(const auto& entry : cube_entries_) {
-		const cuboid& cube = entry.cube;
-		if(entry.data_length > remaining) break;
+	for(auto block = index_.blocks_begin(); block != index_.blocks_end(); ++block) {
+		if(frustum_culling_ && block->maximal_cube_points <= remaining && !req.view_frustum.contains_cuboid(index_.block_cuboid(*block))) continue;
 		
-		if(frustum_culling_ && !req.view_frustum.contains_cuboid(cube)) continue;
-		
-		float distance = std::abs(glm::distance(req.position, cube.center()));
-		std::size_t lvl = choose_downsampling_level(mipmap_levels_, distance, downsampling_setting_);
-
-		hsize_t count[] = { entry.data_length, 1 };
-		hsize_t start[] = { entry.data_start, lvl };
-		points_data_space_.selectHyperslab(H5S_SELECT_SET, count, start);
-		
-		hsize_t dims[] = { entry.data_length };
-		H5::DataSpace mem_space(1, dims);
-		
-		point* mem_buf = new point[entry.data_length];
-		point* mem_buf_end = mem_buf + entry.data_length;
-		points_data_set_.read(mem_buf, point_type_, mem_space, points_data_space_);
-		
-		for(point* it = mem_buf; it != mem_buf_end; ++it) {
-			if(! *it) break;
+		for(auto entry = index_.block_cubes_begin(*block); entry != index_.block_cubes_end(*block); ++entry) {
+			hsize_t data_length = entry->number_of_points;
+			if(data_length > remaining) return total;
 			
-			*(buf++) = *it;
-			--remaining;
-			++total;
+			cuboid cube = cube_from_index_(std::make_tuple(entry->x, entry->y, entry->z), index_.side_length());
+			if(frustum_culling_ && !req.view_frustum.contains_cuboid(cube)) continue;
+			
+			float distance = std::abs(glm::distance(req.position, cube.center()));
+			std::size_t lvl = choose_downsampling_level(mipmap_levels_, distance, downsampling_setting_);
+
+			point* mem_buf = new point[data_length];
+			point* mem_buf_end = mem_buf + data_length;
+			{
+				std::lock_guard<std::mutex> lock(hdf_library_mutex());
+				hsize_t count[] = { data_length, 1 };
+				hsize_t start[] = { entry->data_start, lvl };
+				points_data_space_.selectHyperslab(H5S_SELECT_SET, count, start);
+				
+				hsize_t dims[] = { data_length };
+				H5::DataSpace mem_space(1, dims);
+				points_data_set_.read(mem_buf, point_type_, mem_space, points_data_space_);
+			}
+			
+			for(point* it = mem_buf; it != mem_buf_end; ++it) {
+				if(! *it) break;
+				
+				*(buf++) = *it;
+				--remaining;
+				++total;
+			}
+			
+			delete[] mem_buf;
 		}
-		
-		delete[] mem_buf;
 	}
 	
 	return total;
@@ -154,16 +167,18 @@ std::size_t cubes_mipmap_structure_hdf_loader::compute_downsampled_points_(point
 
 
 std::size_t cubes_mipmap_structure_hdf_loader::memory_size() const {
-	return cube_entries_.size() * sizeof(cube_entry);
+	return index_.memory_size();
 }
 
 
 std::size_t cubes_mipmap_structure_hdf_loader::rom_size() const {
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
 	return file_.getFileSize();
 }
 
 
 std::size_t cubes_mipmap_structure_hdf_loader::number_of_points() const {
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
 	hsize_t dims[2];
 	points_data_set_.getSpace().getSimpleExtentDims(dims);
 	return dims[0];
@@ -7,6 +7,7 @@
 #include <cstdint>
 #include <H5Cpp.h>
 #include "cubes_mipmap_structure_loader.h"
+#include "../cubes/cubes_structure_index.h"
 #include "../../point.h"
 #include "../../geometry/cuboid.h"
 
@@ -18,16 +19,6 @@ class cubes_mipmap_structure;
 
 class cubes_mipmap_structure_hdf_loader : public cubes_mipmap_structure_loader {	
 private:
-	class cube_entry {
-	public:
-		hsize_t data_start;
-		hsize_t data_length;
-		cuboid cube;
-		
-		cube_entry(hsize_t start, hsize_t len, const cuboid& c) :
-			data_start(start), data_length(len), cube(c) { }
-	};
-	
 	struct hdf_cube {
 		std::int32_t x;
 		std::int32_t y;
@@ -42,7 +33,7 @@ private:
 	static H5::CompType initialize_point_type_();
 	static H5::CompType initialize_cube_type_();	
 
-	std::vector<cube_entry> cube_entries_;
+	cubes_structure_index index_;
 	H5::H5File file_;
 	H5::DataSpace points_data_space_;
 	H5::DataSet points_data_set_;
@@ -56,6 +47,7 @@ public:
 	static void write(const std::string& file, const cubes_mipmap_structure&);
 	
 	explicit cubes_mipmap_structure_hdf_loader(const std::string& file);
+	~cubes_mipmap_structure_hdf_loader() override;
 	
 	std::string loader_name() const override { return "Cubes Mipmap Structure HDF Loader"; }
 
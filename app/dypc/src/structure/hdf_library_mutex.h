@@ -0,0 +1,20 @@
+#ifndef DYPC_HDF_LIBRARY_MUTEX_H_
+#define DYPC_HDF_LIBRARY_MUTEX_H_
+
+#include <mutex>
+
+namespace dypc {
+
+/**
+ * Mutex held during calls into the HDF library, including the destruction of HDF objects.
+ * The HDF library is not built thread-safe, so loader sessions that read on different threads, even from different
+ * files, the writer threads of structure files, and loaders opening files take turns.
+ */
+inline std::mutex& hdf_library_mutex() {
+	static std::mutex mutex;
+	return mutex;
+}
+
+}
+
+#endif
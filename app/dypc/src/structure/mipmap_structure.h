@@ -7,6 +7,7 @@
 #include "../geometry/cuboid.h"
 #include <stdexcept>
 #include <iterator>
+#include <vector>
 
 namespace dypc {
 
@@ -21,6 +22,9 @@ protected:
 	const float downsampling_amount_; ///< Downsampling amount used in downsampling_ratios_.
 	const downsampling_ratios_t downsampling_ratios_; ///< Downsampling ratios for the different levels.
 	const bool exact_downsampling_; ///< Whether downsampling point set sizes must be predictable.
+	const bool additive_downsampling_; ///< Whether each downsampled point set is a subset of the previous level, stored as difference.
+	
+	static constexpr std::size_t parallel_random_downsampling_minimum_ = 1 << 22; ///< Input size from which random downsampling is split over threads.
 
 	/**
 	 * Create mipmap structure.
@@ -31,10 +35,11 @@ protected:
 	 * @param damount Downsampling amount.
 	 * @param dmode Downsampling mode.
 	 * @param dexact If true, generate predictable number of downsampled points.
+	 * @param dadditive If true, generate nested downsampled point sets for additive storage.
 	 * @param mod The model.
 	 */
-	mipmap_structure(std::size_t dlevels, std::size_t dmin, float damount, downsampling_mode dmode, bool dexact, model& mod) :
-	structure(mod), downsampling_mode_(dmode), downsampling_minimum_(dmin), downsampling_amount_(damount), downsampling_ratios_(determine_downsampling_ratios(dlevels, mod.number_of_points(), dmin, damount)), exact_downsampling_(dexact) { } 
+	mipmap_structure(std::size_t dlevels, std::size_t dmin, float damount, downsampling_mode dmode, bool dexact, bool dadditive, model& mod) :
+	structure(mod), downsampling_mode_(dmode), downsampling_minimum_(dmin), downsampling_amount_(damount), downsampling_ratios_(determine_downsampling_ratios(dlevels, mod.number_of_points(), dmin, damount)), exact_downsampling_(dexact), additive_downsampling_(dadditive) { } 
 	
 	/**
 	 * Generate downsampled point set for given level.
@@ -44,9 +49,27 @@ protected:
 	 * @param bouding_area Area of the region of the points that are to be downsampled.
 	 * @param output Output array to receive downsampled points.
 	 * @param previous_results Previous results data to use during downsampling.
+	 * @param number_of_threads Threads that random downsampling of large point sets may use.
 	 */
 	template<class Iterator, class OutputContainer>
-	void downsample_points_(Iterator pt_begin, Iterator pt_end, std::ptrdiff_t lvl, const cuboid& bounding_cuboid, OutputContainer& output, uniform_downsampling_previous_results_t& previous_results) const;
+	void downsample_points_(Iterator pt_begin, Iterator pt_end, std::ptrdiff_t lvl, const cuboid& bounding_cuboid, OutputContainer& output, uniform_downsampling_previous_results_t& previous_results, std::size_t number_of_threads = 1) const {
+		downsample_points_to_(pt_begin, pt_end, downsampling_expected_number_of_points_(pt_end - pt_begin, lvl), bounding_cuboid, output, previous_results, number_of_threads);
+	}
+	
+	/**
+	 * Generate downsampled point set with given number of points.
+	 * Like downsample_points_, but the expected number of output points is given instead of derived from the level ratio.
+	 * Used when a level gets downsampled in parts, and the parts must together have the size of the whole.
+	 * @param pt_begin Start iterator to original point set.
+	 * @param pt_end End iterator to original point set.
+	 * @param expected Expected number of output points.
+	 * @param bouding_area Area of the region of the points that are to be downsampled.
+	 * @param output Output array to receive downsampled points.
+	 * @param previous_results Previous results data to use during downsampling.
+	 * @param number_of_threads Threads that random downsampling of large point sets may use.
+	 */
+	template<class Iterator, class OutputContainer>
+	void downsample_points_to_(Iterator pt_begin, Iterator pt_end, std::size_t expected, const cuboid& bounding_cuboid, OutputContainer& output, uniform_downsampling_previous_results_t& previous_results, std::size_t number_of_threads = 1) const;
 	
 	/**
 	 * Get expected number of output points for downsampling level.
@@ -74,10 +97,35 @@ protected:
 		downsample_points_(pt_begin, pt_end, lvl, bounding_cuboid, output, previous_results);
 	}
 	
+	/**
+	 * Generate all downsampled point sets as nested subsets, for additive storage.
+	 * Level \a lvl + 1 is chosen among the points of level \a lvl, and no new points are generated. \a level_points[lvl]
+	 * receives the points of level \a lvl that are not also in level \a lvl + 1, and the last entry receives the coarsest level.
+	 * So the full point set of level \a lvl is the union of \a level_points[lvl] up to the last entry, and refining from
+	 * level \a lvl + 1 to \a lvl only requires the points in \a level_points[lvl].
+	 * @param points Full point set. Is cleared during the process.
+	 * @param bounding_cuboid Area of the region of the points.
+	 * @param level_points Array of get_downsampling_levels() empty containers, to receive the point sets.
+	 */
+	template<class Container>
+	void additive_downsample_points_(Container& points, const cuboid& bounding_cuboid, Container* level_points) const;
+	
+	/**
+	 * Generate all downsampled point sets as nested subsets, with given sizes.
+	 * Like additive_downsample_points_, but the expected size of the full point set of each level is given.
+	 * @param points Full point set. Is cleared during the process.
+	 * @param bounding_cuboid Area of the region of the points.
+	 * @param level_points Array of get_downsampling_levels() empty containers, to receive the point sets.
+	 * @param expected_sizes Array of get_downsampling_levels() expected sizes. Entry 0 is not used.
+	 */
+	template<class Container>
+	void additive_downsample_points_to_(Container& points, const cuboid& bounding_cuboid, Container* level_points, const std::size_t* expected_sizes) const;
+	
 public:
 	downsampling_mode get_downsampling_mode() const { return downsampling_mode_; } ///< Get downsampling mode.
 	float get_downsampling_amount() const { return downsampling_amount_; } ///< Get downsampling amount.
 	std::size_t get_downsampling_levels() const { return downsampling_ratios_.size(); } ///< Get number of downsampling levels.
+	bool is_additive() const { return additive_downsampling_; } ///< Check whether downsampled point sets are stored additively.
 
 	/**
 	 * Get downsampling ratio for given level.
@@ -107,21 +155,34 @@ public:
 		if(exact_downsampling_) return downsampling_expected_number_of_points_(input_number_of_points, i);
 		else throw std::logic_error("Exact downsampling not enabled for mipmap structure.");
 	}
+	
+	/**
+	 * Get exact number of points stored for given level.
+	 * Same as downsampling_number_of_points_exact, except with additive downsampling, where only the points of level \a i
+	 * that are not in level \a i + 1 are stored.
+	 * @param input_number_of_points Number of input point set.
+	 * @param i Downsampling level.
+	 */
+	std::size_t downsampling_stored_number_of_points_exact(std::size_t input_number_of_points, std::ptrdiff_t i) const {
+		std::size_t n = downsampling_number_of_points_exact(input_number_of_points, i);
+		if(additive_downsampling_ && i + 1 < get_downsampling_levels()) n -= downsampling_number_of_points_exact(input_number_of_points, i + 1);
+		return n;
+	}
 };
 
 
 template<class Iterator, class OutputContainer>
-void mipmap_structure::downsample_points_(Iterator pt_begin, Iterator pt_end, std::ptrdiff_t lvl, const cuboid& bounding_cuboid, OutputContainer& output, uniform_downsampling_previous_results_t& previous_results) const {
+void mipmap_structure::downsample_points_to_(Iterator pt_begin, Iterator pt_end, std::size_t expected, const cuboid& bounding_cuboid, OutputContainer& output, uniform_downsampling_previous_results_t& previous_results, std::size_t number_of_threads) const {
 	std::size_t n = pt_end - pt_begin;
-	if(n == 0) return;
-	std::size_t expected = downsampling_expected_number_of_points_(n, lvl);
+	if(n == 0 || expected == 0) return;
 	if(expected >= n) {
 		for(Iterator pt = pt_begin; pt != pt_end; ++pt) output.push_back(*pt);
 	} else if(downsampling_mode_ == downsampling_mode::random) {
-		random_downsampling(pt_begin, pt_end, expected, std::inserter(output, output.begin()));
+		if(n >= parallel_random_downsampling_minimum_ && number_of_threads > 1) random_downsampling_parallel(pt_begin, pt_end, expected, std::inserter(output, output.begin()), number_of_threads);
+		else random_downsampling(pt_begin, pt_end, expected, std::inserter(output, output.begin()));
 	} else if(downsampling_mode_ == downsampling_mode::uniform) {
-		uniform_downsampling(pt_begin, pt_end, expected, bounding_cuboid, std::inserter(output, output.begin()), previous_results);
-		if(exact_downsampling_) fill_with_duplicates(output, expected);
+		if(exact_downsampling_) uniform_downsampling_exact(pt_begin, pt_end, expected, bounding_cuboid, std::inserter(output, output.begin()), previous_results);
+		else uniform_downsampling(pt_begin, pt_end, expected, bounding_cuboid, std::inserter(output, output.begin()), previous_results);
 	} else {
 		throw std::logic_error("Invalid downsampling mode");
 	}
@@ -129,6 +190,50 @@ void mipmap_structure::downsample_points_(Iterator pt_begin, Iterator pt_end, st
 	else assert(output.size() <= expected);
 }
 
+
+template<class Container>
+void mipmap_structure::additive_downsample_points_(Container& points, const cuboid& bounding_cuboid, Container* level_points) const {
+	std::vector<std::size_t> expected(get_downsampling_levels());
+	for(std::ptrdiff_t lvl = 1; lvl < expected.size(); ++lvl) expected[lvl] = downsampling_expected_number_of_points_(points.size(), lvl);
+	additive_downsample_points_to_(points, bounding_cuboid, level_points, expected.data());
+}
+
+
+template<class Container>
+void mipmap_structure::additive_downsample_points_to_(Container& points, const cuboid& bounding_cuboid, Container* level_points, const std::size_t* expected_sizes) const {
+	const std::size_t levels = get_downsampling_levels();
+	
+	Container current; // Full point set of the level being processed
+	current.swap(points);
+	
+	for(std::ptrdiff_t lvl = 1; lvl < levels; ++lvl) {
+		std::size_t expected = expected_sizes[lvl];
+		if(expected >= current.size()) continue; // Level lvl - 1 has no points of its own
+
+		Container selected;
+		Container& rest = level_points[lvl - 1];
+		if(downsampling_mode_ == downsampling_mode::random) {
+			random_downsampling_partition(current.begin(), current.end(), expected, std::back_inserter(selected), std::back_inserter(rest));
+		} else if(downsampling_mode_ == downsampling_mode::uniform) {
+			uniform_downsampling_partition(current.begin(), current.end(), expected, bounding_cuboid, std::back_inserter(selected), std::back_inserter(rest));
+			if(exact_downsampling_ && selected.size() < expected) {
+				// Duplicates cannot be used here, so fill up with points from the remainder instead
+				Container remainder;
+				remainder.swap(rest);
+				random_downsampling_partition(remainder.begin(), remainder.end(), expected - selected.size(), std::back_inserter(selected), std::back_inserter(rest));
+			}
+		} else {
+			throw std::logic_error("Invalid downsampling mode");
+		}
+		if(exact_downsampling_) assert(selected.size() == expected);
+		else assert(selected.size() <= expected);
+		
+		current.swap(selected);
+	}
+	
+	level_points[levels - 1].swap(current);
+}
+
 }
 
 #endif
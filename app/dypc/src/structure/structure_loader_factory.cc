@@ -1,9 +1,12 @@
 #include "structure_loader_factory.h"
 #include "../sqlite/sqlite_database.h"
+#include "../build_report.h"
+#include "hdf_library_mutex.h"
 #include <H5Cpp.h>
 #include <cstdint>
 #include <utility>
 #include <memory>
+#include <mutex>
 
 #include "cubes/cubes_structure.h"
 #include "cubes/cubes_structure_hdf_loader.h"
@@ -16,15 +19,21 @@
 
 #include "tree/tree_structure_simple_loader.h"
 #include "tree/tree_structure_ordered_loader.h"
+#include "tree/tree_structure_prioritized_loader.h"
 #include "tree/tree_structure_memory_source.h"
 #include "tree/tree_structure_piecewise.h"
 #include "tree/hdf/tree_structure_hdf_source.h"
 #include "tree/hdf/tree_structure_piecewise_hdf_write_parallel.h"
+#include "tree/hdf/tree_structure_hdf_insert.h"
+#include "tree/remote/tree_structure_remote_source.h"
 
 #include "tree/octree/octree_structure.h"
+#include "tree/octree/octree_structure_external_builder.h"
 #include "tree/kdtree/kdtree_structure.h"
 #include "tree/kdtree_half/kdtree_half_structure.h"
 
+#include "../loader/scene_loader.h"
+
 namespace dypc {
 
 
@@ -55,13 +64,13 @@ struct create_tree_structure_ {
 	using result_t = structure*;
 	
 	template<class Structure>
-	result_t call(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod) const {
-		return new Structure(leaf_cap, dmin, damount, dmode, mod);
+	result_t call(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, bool additive) const {
+		return new Structure(leaf_cap, dmin, damount, dmode, mod, additive);
 	}
 
 	template<class Structure>
-	result_t call(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, std::size_t piece_size) const {
-		return new Structure(leaf_cap, dmin, damount, dmode, mod, piece_size);
+	result_t call(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, std::size_t piece_size, bool additive) const {
+		return new Structure(leaf_cap, dmin, damount, dmode, mod, piece_size, additive);
 	}
 };
 
@@ -69,15 +78,73 @@ class write_tree_structure_to_hdf_ {
 private:
 	std::string filename_;
 	unsigned threads_;
+	tree_structure_hdf_file_options options_;
 
 public:
-	write_tree_structure_to_hdf_(const std::string& filename, unsigned threads) : filename_(filename), threads_(threads) { }
+	write_tree_structure_to_hdf_(const std::string& filename, unsigned threads, const tree_structure_hdf_file_options& opt) : filename_(filename), threads_(threads), options_(opt) { }
 
 	using result_t = void;
 
 	template<class Structure>
 	result_t call(structure& s) const {
-		write_to_hdf_parallel(filename_, dynamic_cast<Structure&>(s), threads_);
+		write_to_hdf_parallel(filename_, dynamic_cast<Structure&>(s), threads_, options_);
+	}
+};
+
+
+class write_octree_structure_external_ {
+private:
+	std::string filename_;
+	std::string scratch_dir_;
+	std::size_t memory_cap_;
+	tree_structure_hdf_file_options options_;
+
+public:
+	write_octree_structure_external_(const std::string& filename, const std::string& scratch_dir, std::size_t memory_cap, const tree_structure_hdf_file_options& opt) :
+		filename_(filename), scratch_dir_(scratch_dir), memory_cap_(memory_cap), options_(opt) { }
+
+	using result_t = void;
+
+	template<class Builder>
+	result_t call(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, bool additive) const {
+		Builder builder(leaf_cap, dmin, damount, dmode, mod, scratch_dir_, memory_cap_, additive);
+		builder.write(filename_, options_);
+	}
+};
+
+
+class insert_into_tree_structure_hdf_ {
+private:
+	std::string filename_;
+
+public:
+	insert_into_tree_structure_hdf_(const std::string& filename) : filename_(filename) { }
+
+	using result_t = void;
+
+	template<class Structure>
+	result_t call(std::size_t leaf_cap, downsampling_mode dmode, model& mod) const {
+		tree_structure_hdf_inserter<typename Structure::splitter, Structure::levels> inserter(filename_, leaf_cap, dmode);
+		inserter.insert(mod);
+	}
+};
+
+
+class repack_tree_structure_hdf_ {
+private:
+	std::string filename_;
+	std::string output_filename_;
+	tree_structure_hdf_file_options options_;
+
+public:
+	repack_tree_structure_hdf_(const std::string& filename, const std::string& output_filename, const tree_structure_hdf_file_options& opt) :
+		filename_(filename), output_filename_(output_filename), options_(opt) { }
+
+	using result_t = void;
+
+	template<class Structure>
+	result_t call() const {
+		repack_tree_structure_hdf<Structure::levels, Structure::splitter::number_of_node_children>(filename_, output_filename_, options_);
 	}
 };
 
@@ -97,15 +164,18 @@ public:
 class create_tree_structure_hdf_source_ {
 private:
 	std::string filename_;
+	std::size_t node_memory_budget_;
+	std::size_t point_memory_budget_;
 
 public:
-	create_tree_structure_hdf_source_(const std::string& filename) : filename_(filename) { }
+	create_tree_structure_hdf_source_(const std::string& filename, std::size_t node_memory_budget, std::size_t point_memory_budget) :
+		filename_(filename), node_memory_budget_(node_memory_budget), point_memory_budget_(point_memory_budget) { }
 	
 	using result_t = tree_structure_source*;
 	
 	template<class Structure>
 	result_t call() const {
-		return new tree_structure_hdf_source<Structure::levels, Structure::number_of_node_children>(filename_);
+		return new tree_structure_hdf_source<Structure::levels, Structure::number_of_node_children>(filename_, node_memory_budget_, point_memory_budget_);
 	}
 };
 
@@ -113,12 +183,14 @@ static tree_structure_loader* create_tree_structure_loader_(tree_structure_loade
 	switch(ltype) {
 		case tree_structure_loader_type::simple: return new tree_structure_simple_loader;
 		case tree_structure_loader_type::ordered: return new tree_structure_ordered_loader;
+		case tree_structure_loader_type::prioritized: return new tree_structure_prioritized_loader;
 	}
 	throw std::invalid_argument("Invalid tree structure loader");
 }
 
 
 std::pair<structure_type, std::size_t> read_hdf_structure_file_type(const std::string& filename) {
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
 	H5::H5File file;
 	file.openFile(filename.c_str(), H5F_ACC_RDONLY);
 	
@@ -135,6 +207,7 @@ std::pair<structure_type, std::size_t> read_hdf_structure_file_type(const std::s
 
 
 void write_hdf_structure_file_type(const std::string& filename, structure_type type, std::size_t levels) {
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
 	H5::H5File file;
 	file.openFile(filename.c_str(), H5F_ACC_RDWR);
 
@@ -175,8 +248,8 @@ void write_sqlite_structure_file_type(const std::string& filename, structure_typ
 
 
 
-tree_structure_loader* create_tree_structure_memory_loader(structure_type type, unsigned levels, std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, tree_structure_loader_type ltype) {	
-	structure* s = call_(create_tree_structure_(), type, levels, leaf_cap, dmin, damount, dmode, mod);
+tree_structure_loader* create_tree_structure_memory_loader(structure_type type, unsigned levels, std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, tree_structure_loader_type ltype, bool additive) {	
+	structure* s = call_(create_tree_structure_(), type, levels, leaf_cap, dmin, damount, dmode, mod, additive);
 	
 	auto ld = create_tree_structure_loader_(ltype);
 	auto source = call_(create_tree_structure_memory_source_(), type, levels, s);
@@ -187,7 +260,7 @@ tree_structure_loader* create_tree_structure_memory_loader(structure_type type,
 
 
 
-loader* create_structure_file_loader(const std::string& filename, tree_structure_loader_type ltype) {
+loader* create_structure_file_loader(const std::string& filename, tree_structure_loader_type ltype, std::size_t node_memory_budget, std::size_t point_memory_budget) {
 	loader* ld = nullptr;
 		
 	auto ext = file_path_extension(filename);
@@ -200,7 +273,7 @@ loader* create_structure_file_loader(const std::string& filename, tree_structure
 		} else {
 			tree_structure_loader* tld;
 			ld = tld = create_tree_structure_loader_(ltype);
-			auto source = call_(create_tree_structure_hdf_source_(filename), type.first, type.second);
+			auto source = call_(create_tree_structure_hdf_source_(filename, node_memory_budget, point_memory_budget), type.first, type.second);
 			tld->take_source(source);
 		}
 	} else if(ext == "db") {
@@ -208,6 +281,8 @@ loader* create_structure_file_loader(const std::string& filename, tree_structure
 		if(type.first == structure_type::cubes) {
 			ld = new cubes_structure_sqlite_loader(filename);
 		}
+	} else if(ext == "scene") {
+		ld = new scene_loader(scene_loader::read_manifest(filename), ltype);
 	}
 	
 	if(ld) return ld;
@@ -215,12 +290,20 @@ loader* create_structure_file_loader(const std::string& filename, tree_structure
 }
 
 
-void write_tree_structure_file(const std::string& filename, structure_type type, unsigned levels, std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, std::size_t piece_cap, model& mod, std::size_t threads) {	
+loader* create_remote_structure_loader(const std::string& address, tree_structure_loader_type ltype) {
+	std::unique_ptr<tree_structure_loader> ld(create_tree_structure_loader_(ltype));
+	ld->take_source(new tree_structure_remote_source(address));
+	return ld.release();
+}
+
+
+void write_tree_structure_file(const std::string& filename, structure_type type, unsigned levels, std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, std::size_t piece_cap, model& mod, std::size_t threads, bool additive, const tree_structure_hdf_file_options& opt) {	
+	build_report report("write_tree_structure_file", filename);
 	auto ext = file_path_extension(filename);
-	std::unique_ptr<structure> s( call_(create_tree_structure_(), type, levels, leaf_cap, dmin, damount, dmode, mod, piece_cap) );
+	std::unique_ptr<structure> s( call_(create_tree_structure_(), type, levels, leaf_cap, dmin, damount, dmode, mod, piece_cap, additive) );
 
 	if(ext == "hdf") {
-		write_tree_structure_to_hdf_ f(filename, threads);
+		write_tree_structure_to_hdf_ f(filename, threads, opt);
 		call_(f, type, levels, *s);
 		write_hdf_structure_file_type(filename, type, levels);
 	} else {
@@ -228,4 +311,39 @@ void write_tree_structure_file(const std::string& filename, structure_type type,
 	}
 }
 
+
+void write_octree_structure_file_external(const std::string& filename, unsigned levels, std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, const std::string& scratch_dir, std::size_t memory_cap, bool additive, const tree_structure_hdf_file_options& opt) {
+	build_report report("write_octree_structure_file_external", filename);
+	if(file_path_extension(filename) != "hdf") throw std::invalid_argument("Invalid file format");
+	
+	write_octree_structure_external_ f(filename, scratch_dir, memory_cap, opt);
+	call_levels_<write_octree_structure_external_, octree_structure_external_builder>(f, levels, leaf_cap, dmin, damount, dmode, mod, additive);
+	write_hdf_structure_file_type(filename, structure_type::octree, levels);
+}
+
+
+void insert_into_tree_structure_file(const std::string& filename, model& mod, std::size_t leaf_cap, downsampling_mode dmode) {
+	build_report report("insert_into_tree_structure_file", filename);
+	if(file_path_extension(filename) != "hdf") throw std::invalid_argument("Invalid file format");
+	
+	auto type = read_hdf_structure_file_type(filename);
+	if(type.first != structure_type::octree && type.first != structure_type::kdtree && type.first != structure_type::kdtree_half)
+		throw std::invalid_argument("Insertion requires tree structure file");
+	call_(insert_into_tree_structure_hdf_(filename), type.first, type.second, leaf_cap, dmode, mod);
+}
+
+
+
+void repack_tree_structure_file(const std::string& filename, const std::string& output_filename, const tree_structure_hdf_file_options& opt) {
+	build_report report("repack_tree_structure_file", output_filename);
+	if(file_path_extension(filename) != "hdf" || file_path_extension(output_filename) != "hdf") throw std::invalid_argument("Invalid file format");
+	if(filename == output_filename) throw std::invalid_argument("Repacked file must be written to different path");
+
+	auto type = read_hdf_structure_file_type(filename);
+	if(type.first != structure_type::octree && type.first != structure_type::kdtree && type.first != structure_type::kdtree_half)
+		throw std::invalid_argument("Repacking requires tree structure file");
+	call_(repack_tree_structure_hdf_(filename, output_filename, opt), type.first, type.second);
+	write_hdf_structure_file_type(output_filename, type.first, type.second);
+}
+
 }
@@ -6,6 +6,7 @@
 #include "../enums.h"
 #include "../util.h"
 #include "../downsampling.h"
+#include "tree/hdf/tree_structure_hdf_file_options.h"
 
 
 namespace dypc {
@@ -54,18 +55,30 @@ void write_sqlite_structure_file_type(const std::string& filename, structure_typ
  * @param damount Downsampling amount.
  * @param mod The model. Must exist for lifetime of returned loader.
  * @param ltype Tree structure loader type.
+ * @param additive Store downsampled levels additively.
  * @return Pointer to a new memory loader for the tree structure. Must be deleted by the caller.
  */
-tree_structure_loader* create_tree_structure_memory_loader(structure_type type, unsigned levels, std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, tree_structure_loader_type ltype);
+tree_structure_loader* create_tree_structure_memory_loader(structure_type type, unsigned levels, std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, tree_structure_loader_type ltype, bool additive = false);
 
 /**
  * Create loader from a structure file.
  * The file type is determined from the file name extension, and the structure type information is read from the file.
+ * A scene manifest (extension .scene) gives a scene loader over its tiles. @see scene_loader
  * @param filename Full path to file. Needs to have correct extension.
  * @param ltype Tree structure loader type. Ignored for non-tree structures.
+ * @param node_memory_budget For tree structure HDF files, memory for nodes in bytes. If non-zero, the nodes table gets paged in on demand. @see tree_structure_hdf_source
+ * @param point_memory_budget For tree structure HDF files, memory in bytes for points of the top of the tree, which are kept in memory.
  * @return Pointer to a new file loader for the file. Must be deleted by the caller.
  */
-loader* create_structure_file_loader(const std::string& filename, tree_structure_loader_type ltype = tree_structure_loader_type::ordered);
+loader* create_structure_file_loader(const std::string& filename, tree_structure_loader_type ltype = tree_structure_loader_type::ordered, std::size_t node_memory_budget = 0, std::size_t point_memory_budget = 0);
+
+/**
+ * Create tree structure loader that reads from a structure server.
+ * @param address Socket address of the server. @see structure_server
+ * @param ltype Tree structure loader type.
+ * @return Pointer to a new loader. Must be deleted by the caller.
+ */
+loader* create_remote_structure_loader(const std::string& address, tree_structure_loader_type ltype = tree_structure_loader_type::ordered);
 
 
 /**
@@ -79,8 +92,46 @@ loader* create_structure_file_loader(const std::string& filename, tree_structure
  * @param damount Downsampling amount.
  * @param piece_cap Maximal number of points per piece. @see tree_structure_piecewise
  * @param mod The model. Must exist for lifetime of returned loader.
+ * @param threads Number of threads used to write pieces.
+ * @param additive Store downsampled levels additively.
+ * @param opt Chunking and compression of the point sets.
+ */
+void write_tree_structure_file(const std::string& filename, structure_type type, unsigned levels, std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, std::size_t piece_cap, model& mod, std::size_t threads, bool additive = false, const tree_structure_hdf_file_options& opt = tree_structure_hdf_file_options());
+
+/**
+ * Create octree structure using external memory, and store it in HDF file.
+ * Memory usage is bounded by \a memory_cap instead of depending on model size. @see octree_structure_external_builder
+ * @param filename Output file path, with extension.
+ * @param levels Downsampling levels, must be 1, 4, 8 or 16.
+ * @param leaf_cap Leaf capacity of the tree structure.
+ * @param dmin Minimal downsampling output.
+ * @param damount Downsampling amount.
+ * @param mod The model.
+ * @param scratch_dir Directory for temporary files.
+ * @param memory_cap Maximal number of points held in memory.
+ * @param additive Store downsampled levels additively.
+ * @param opt Chunking and compression of the point sets.
+ */
+void write_octree_structure_file_external(const std::string& filename, unsigned levels, std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, const std::string& scratch_dir, std::size_t memory_cap, bool additive = false, const tree_structure_hdf_file_options& opt = tree_structure_hdf_file_options());
+
+/**
+ * Insert points of model into existing tree structure HDF file.
+ * Only the leaves that receive points, and their ancestors, get rewritten. @see tree_structure_hdf_inserter
+ * @param filename Path of HDF file.
+ * @param mod The model. Its points must lie inside the existing nodes.
+ * @param leaf_cap Leaf capacity for leaves that receive points.
+ * @param dmode Downsampling mode for the new points.
+ */
+void insert_into_tree_structure_file(const std::string& filename, model& mod, std::size_t leaf_cap, downsampling_mode dmode);
+
+/**
+ * Write compact copy of tree structure HDF file, dropping the unused space left behind by insertions.
+ * @see repack_tree_structure_hdf
+ * @param filename Path of existing HDF file.
+ * @param output_filename Path of new HDF file.
+ * @param opt Chunking and compression of the new point sets.
  */
-void write_tree_structure_file(const std::string& filename, structure_type type, unsigned levels, std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, std::size_t piece_cap, model& mod, std::size_t threads);
+void repack_tree_structure_file(const std::string& filename, const std::string& output_filename, const tree_structure_hdf_file_options& opt = tree_structure_hdf_file_options());
 
 }
 
@@ -2,20 +2,28 @@
 #define DYPC_TREE_STRUCTURE_HDF_FILE_H_
 
 #include <H5Cpp.h>
+#include "tree_structure_hdf_file_options.h"
+#include "../../hdf_library_mutex.h"
+#include "../../../write_behind_queue.h"
 #include "../../../geometry/cuboid.h"
 #include <string>
+#include <stdexcept>
 #include <cstring>
 #include <memory>
 #include <cstdint>
 #include <vector>
+#include <mutex>
 
 namespace dypc {
 
 /**
  * HDF file storing tree structure.
- * Can read existing file, or write into new file.
+ * Can read existing file, write into new file, or open existing file for update.
  * When writing, full nodes array must be written in one go, while points can be written
- * in multiple chunks with given offset. But maximal number of points must be indicated upon construction.
+ * in multiple chunks with given offset. Point sets are extendible, so points can later be appended to them.
+ * Point sets are stored in HDF chunks, optionally compressed. The chunk size should be a multiple of the leaf
+ * capacity, so that the points of one node at one level lie in at most two chunks.
+ * All calls into the HDF library hold hdf_library_mutex(), so that a writer thread can use the file while sessions read.
  * @tparam Levels Number of downsampling levels.
  * @tparam NumberOfChildren Number of children that nodes in tree structure have.
  */
@@ -31,6 +39,10 @@ public:
 		
 		static constexpr std::ptrdiff_t no_child_index = -1;
 		
+		/// Value of data_start when the node's points at that level are not contiguous, and must be gathered from its children.
+		static constexpr std::uint32_t fragmented_data_start = 0xFFFFFFFF;
+		
+		bool is_fragmented(std::ptrdiff_t lvl) const { return (data_start[lvl] == fragmented_data_start); }
 		bool is_leaf() const {
 			for(auto child : children) if(child) return false;
 			return true;
@@ -43,7 +55,11 @@ public:
 	};
 	
 	~tree_structure_hdf_file() {
+		std::lock_guard<std::mutex> lock(hdf_library_mutex());
 		file_.flush(H5F_SCOPE_GLOBAL);
+		for(auto& set : points_data_set_) set.close();
+		nodes_data_set_.close();
+		file_.close();
 	}
 	
 
@@ -52,6 +68,8 @@ private:
 		return std::string("points") + std::to_string(lvl);
 	}
 	
+	static constexpr const char* additive_attribute_name_ = "additive";
+	
 	H5::H5File file_;
 	H5::DataSet points_data_set_[Levels];
 	H5::DataSet nodes_data_set_;
@@ -60,7 +78,20 @@ private:
 	static const H5::CompType node_type_;
 
 	static constexpr std::size_t maximal_chunk_size_ = 4800;
-	static constexpr hsize_t points_data_set_chunk_size_ = 1000000;
+	static constexpr hsize_t maximal_points_data_set_chunk_size_ = 1000000;
+	static constexpr hsize_t minimal_points_data_set_chunk_size_ = 4096; ///< Avoids chunk index overhead for small leaves.
+	static constexpr std::size_t minimal_chunk_cache_size_ = 1024 * 1024;
+	static constexpr std::size_t maximal_chunk_cache_size_ = 32 * 1024 * 1024;
+	static constexpr std::size_t cached_chunks_ = 4;
+	static constexpr std::size_t chunk_cache_slots_ = 10007; ///< Prime, as recommended by HDF.
+	
+	static constexpr H5Z_filter_t lz4_filter_ = 32004;
+	static constexpr H5Z_filter_t zstd_filter_ = 32015;
+	
+	static hsize_t points_chunk_size_(const tree_structure_hdf_file_options&, hsize_t max_points, std::size_t leaf_cap);
+	static void set_points_filters_(H5::DSetCreatPropList&, const tree_structure_hdf_file_options&);
+	static H5::DSetAccPropList points_access_properties_(hsize_t chunk_size, const tree_structure_hdf_file_options&);
+	void open_points_data_sets_(const tree_structure_hdf_file_options&);
 	
 	template<class Iterator> void write_(Iterator el_begin, Iterator el_end, const H5::DataType& typ, const H5::DataSet&, hsize_t offset);
 	template<class Inserter> void read_insert_(Inserter ins, hsize_t n, const H5::DataType& typ, const H5::DataSet&, hsize_t offset = 0) const;
@@ -73,30 +104,125 @@ private:
 public:
 	static H5::CompType initialize_point_type();
 	static H5::CompType initialize_node_type();
+	
+	struct update_t { }; ///< Tag to open existing file for update.
+	
+	using points_write_queue = write_behind_queue<point>; ///< Queue for writing points on separate thread. Sets are levels.
+	static constexpr std::size_t default_write_queue_capacity = 1 << 24; ///< Points queued before producers have to wait.
+
+	/**
+	 * Open existing file for reading.
+	 * @param filename Path of the file.
+	 * @param opt Options. Only the chunk cache size is used.
+	 */
+	explicit tree_structure_hdf_file(const std::string& filename, const tree_structure_hdf_file_options& opt = tree_structure_hdf_file_options());
+	
+	/**
+	 * Open existing file for reading and writing.
+	 * @param filename Path of the file.
+	 * @param opt Options. Only the chunk cache size is used.
+	 */
+	tree_structure_hdf_file(const std::string& filename, update_t, const tree_structure_hdf_file_options& opt = tree_structure_hdf_file_options());
+	
+	/**
+	 * Create new file.
+	 * @param filename Path of the file. Overwritten if it exists.
+	 * @param max_points Expected maximal number of points per level. Used to limit the chunk size of small files.
+	 * @param opt Chunk size, filters and chunk cache size for the point sets.
+	 * @param leaf_cap Leaf capacity of the tree structure. If non-zero and no chunk size is given, the chunk size becomes a multiple of it.
+	 */
+	tree_structure_hdf_file(const std::string& filename, hsize_t max_points, const tree_structure_hdf_file_options& opt = tree_structure_hdf_file_options(), std::size_t leaf_cap = 0);
+	
+	/**
+	 * Get number of points per chunk of the point sets.
+	 */
+	hsize_t get_points_chunk_size() const {
+		std::lock_guard<std::mutex> lock(hdf_library_mutex());
+		hsize_t chunk_size = 0;
+		H5::DSetCreatPropList prop = points_data_set_[0].getCreatePlist();
+		if(prop.getLayout() == H5D_CHUNKED) prop.getChunk(1, &chunk_size);
+		return chunk_size;
+	}
 
-	tree_structure_hdf_file(const std::string& filename);
-	tree_structure_hdf_file(const std::string& filename, hsize_t max_points);
-
-	std::size_t get_file_size() const { return file_.getFileSize(); }
+	std::size_t get_file_size() const {
+		std::lock_guard<std::mutex> lock(hdf_library_mutex());
+		return file_.getFileSize();
+	}
+	
+	/**
+	 * Check whether downsampled levels are stored additively.
+	 * Then data of a node at level \a lvl consists of its segments in levels \a lvl up to Levels - 1.
+	 * Files without the attribute are not additive.
+	 */
+	bool is_additive() const {
+		std::lock_guard<std::mutex> lock(hdf_library_mutex());
+		if(! file_.attrExists(additive_attribute_name_)) return false;
+		std::uint32_t additive_int;
+		file_.openAttribute(additive_attribute_name_).read(H5::PredType::NATIVE_UINT32, (void*)&additive_int);
+		return additive_int;
+	}
+	
+	/**
+	 * Mark downsampled levels as stored additively.
+	 * Can be called only once, on new file.
+	 */
+	void set_additive(bool additive) {
+		std::lock_guard<std::mutex> lock(hdf_library_mutex());
+		std::uint32_t additive_int = additive;
+		H5::Attribute attr = file_.createAttribute(additive_attribute_name_, H5::PredType::NATIVE_UINT32, H5::DataSpace(H5S_SCALAR));
+		attr.write(H5::PredType::NATIVE_UINT32, (const void*)&additive_int);
+	}
 
 	hsize_t get_number_of_points(std::ptrdiff_t lvl = 0) const {
+		std::lock_guard<std::mutex> lock(hdf_library_mutex());
 		hsize_t dims, maxdims;
 		points_data_set_[lvl].getSpace().getSimpleExtentDims(&dims, &maxdims);
 		return dims;
 	}
 	
 	void set_number_of_points(hsize_t n, std::ptrdiff_t lvl = 0) {
+		std::lock_guard<std::mutex> lock(hdf_library_mutex());
 		points_data_set_[lvl].extend(&n);
 	}
 	
+	/**
+	 * Get write function for points_write_queue, which writes points into this file.
+	 * The point sets must not be accessed by other threads while the queue is not finished.
+	 */
+	points_write_queue::write_function points_writer() {
+		return [this](std::ptrdiff_t lvl, std::size_t offset, const point* begin, const point* end) {
+			write_points(begin, end, lvl, offset);
+		};
+	}
+	
+	/**
+	 * Check whether points can be appended beyond the size given when the file was created.
+	 * Not the case for files written before point sets were made extendible.
+	 */
+	bool points_extendible() const {
+		std::lock_guard<std::mutex> lock(hdf_library_mutex());
+		for(const auto& set : points_data_set_) {
+			hsize_t dims, maxdims;
+			set.getSpace().getSimpleExtentDims(&dims, &maxdims);
+			if(maxdims != H5S_UNLIMITED) return false;
+		}
+		return true;
+	}
+	
 	hsize_t get_number_of_nodes() const {
+		std::lock_guard<std::mutex> lock(hdf_library_mutex());
 		hsize_t dims, maxdims;
 		nodes_data_set_.getSpace().getSimpleExtentDims(&dims, &maxdims);
 		return dims;
 	}
 	
+	/**
+	 * Write points into point set of given level.
+	 * The set is extended if needed, but never shrunk, so segments can be written in any order.
+	 */
 	template<class Iterator> void write_points(Iterator pt_begin, Iterator pt_end, std::ptrdiff_t lvl, hsize_t offset = 0) {
-		set_number_of_points(offset + (pt_end - pt_begin), lvl);
+		hsize_t end_offset = offset + (pt_end - pt_begin);
+		if(end_offset > get_number_of_points(lvl)) set_number_of_points(end_offset, lvl);
 		write_(pt_begin, pt_end, point_type_, points_data_set_[lvl], offset);
 	}
 	void write_points(typename std::vector<point>::const_iterator pt_begin, typename std::vector<point>::const_iterator pt_end, std::ptrdiff_t lvl, hsize_t offset = 0) {
@@ -122,6 +248,18 @@ public:
 	void write_nodes(typename std::vector<hdf_node>::iterator pt_begin, typename std::vector<hdf_node>::iterator pt_end) {
 		write_nodes(&(*pt_begin), &(*pt_end));
 	}
+	
+	/**
+	 * Replace nodes array of existing file.
+	 * The node count may differ from the previous one.
+	 */
+	void rewrite_nodes(const std::vector<hdf_node>& nodes) {
+		{
+			std::lock_guard<std::mutex> lock(hdf_library_mutex());
+			file_.unlink("nodes");
+		}
+		write_nodes(nodes.begin(), nodes.end());
+	}
 	template<class Inserter> void read_nodes(Inserter ins, hsize_t n, hsize_t offset = 0) const {
 		read_<Inserter>(ins, n, node_type_, nodes_data_set_, offset);
 	}
@@ -185,31 +323,118 @@ H5::CompType tree_structure_hdf_file<Levels, NumberOfChildren>::initialize_node_
 
 
 template<std::size_t Levels, std::size_t NumberOfChildren>
-tree_structure_hdf_file<Levels, NumberOfChildren>::tree_structure_hdf_file(const std::string& filename) {
+hsize_t tree_structure_hdf_file<Levels, NumberOfChildren>::points_chunk_size_(const tree_structure_hdf_file_options& opt, hsize_t max_points, std::size_t leaf_cap) {
+	hsize_t chunk_size = maximal_points_data_set_chunk_size_;
+	if(opt.chunk_size) {
+		chunk_size = opt.chunk_size;
+	} else if(leaf_cap && leaf_cap < maximal_points_data_set_chunk_size_) {
+		hsize_t leaves_per_chunk = (minimal_points_data_set_chunk_size_ + leaf_cap - 1) / leaf_cap;
+		if(leaves_per_chunk * leaf_cap < chunk_size) chunk_size = leaves_per_chunk * leaf_cap;
+	}
+	if(max_points && max_points < chunk_size) chunk_size = max_points;
+	return chunk_size;
+}
+
+
+template<std::size_t Levels, std::size_t NumberOfChildren>
+void tree_structure_hdf_file<Levels, NumberOfChildren>::set_points_filters_(H5::DSetCreatPropList& prop, const tree_structure_hdf_file_options& opt) {
+	H5Z_filter_t filter = H5Z_FILTER_NONE;
+	switch(opt.compression) {
+		case hdf_compression::none: break;
+		case hdf_compression::deflate: filter = H5Z_FILTER_DEFLATE; break;
+		case hdf_compression::lz4: filter = lz4_filter_; break;
+		case hdf_compression::zstd: filter = zstd_filter_; break;
+		default: throw std::invalid_argument("Invalid HDF compression");
+	}
+	
+	if(filter != H5Z_FILTER_NONE && H5Zfilter_avail(filter) <= 0)
+		throw std::runtime_error("HDF compression filter " + std::to_string(filter) + " not available");
+	
+	if(opt.shuffle) prop.setShuffle();
+	
+	if(filter == H5Z_FILTER_DEFLATE) {
+		prop.setDeflate(opt.compression_level);
+	} else if(filter == lz4_filter_) {
+		prop.setFilter(filter, H5Z_FLAG_MANDATORY, 0, nullptr);
+	} else if(filter == zstd_filter_) {
+		unsigned int level = opt.compression_level;
+		prop.setFilter(filter, H5Z_FLAG_MANDATORY, 1, &level);
+	}
+}
+
+
+template<std::size_t Levels, std::size_t NumberOfChildren>
+H5::DSetAccPropList tree_structure_hdf_file<Levels, NumberOfChildren>::points_access_properties_(hsize_t chunk_size, const tree_structure_hdf_file_options& opt) {
+	// Cache must hold at least one whole chunk, otherwise each partial read of a compressed chunk decompresses it again
+	std::size_t cache_size = opt.chunk_cache_size;
+	if(! cache_size) {
+		std::size_t chunk_bytes = chunk_size * sizeof(point);
+		cache_size = cached_chunks_ * chunk_bytes;
+		if(cache_size > maximal_chunk_cache_size_) cache_size = (chunk_bytes > maximal_chunk_cache_size_ ? chunk_bytes : maximal_chunk_cache_size_);
+		if(cache_size < minimal_chunk_cache_size_) cache_size = minimal_chunk_cache_size_;
+	}
+	H5::DSetAccPropList prop;
+	prop.setChunkCache(chunk_cache_slots_, cache_size, H5D_CHUNK_CACHE_W0_DEFAULT);
+	return prop;
+}
+
+
+template<std::size_t Levels, std::size_t NumberOfChildren>
+void tree_structure_hdf_file<Levels, NumberOfChildren>::open_points_data_sets_(const tree_structure_hdf_file_options& opt) {
+	for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) {
+		std::string name = points_set_name_(lvl);
+		H5::DSetCreatPropList creation_prop = file_.openDataSet(name).getCreatePlist();
+		if(creation_prop.getLayout() == H5D_CHUNKED) {
+			hsize_t chunk_size;
+			creation_prop.getChunk(1, &chunk_size);
+			points_data_set_[lvl] = file_.openDataSet(name, points_access_properties_(chunk_size, opt));
+		} else {
+			points_data_set_[lvl] = file_.openDataSet(name);
+		}
+	}
+}
+
+
+template<std::size_t Levels, std::size_t NumberOfChildren>
+tree_structure_hdf_file<Levels, NumberOfChildren>::tree_structure_hdf_file(const std::string& filename, const tree_structure_hdf_file_options& opt) {
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
 	file_.openFile(filename, H5F_ACC_RDONLY);
 	nodes_data_set_ = file_.openDataSet("nodes");
-	for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) points_data_set_[lvl] = file_.openDataSet(points_set_name_(lvl));
+	open_points_data_sets_(opt);
+}
+
+
+template<std::size_t Levels, std::size_t NumberOfChildren>
+tree_structure_hdf_file<Levels, NumberOfChildren>::tree_structure_hdf_file(const std::string& filename, update_t, const tree_structure_hdf_file_options& opt) {
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
+	file_.openFile(filename, H5F_ACC_RDWR);
+	nodes_data_set_ = file_.openDataSet("nodes");
+	open_points_data_sets_(opt);
 }
 
 
 
 template<std::size_t Levels, std::size_t NumberOfChildren>
-tree_structure_hdf_file<Levels, NumberOfChildren>::tree_structure_hdf_file(const std::string& filename, hsize_t max_points) {
+tree_structure_hdf_file<Levels, NumberOfChildren>::tree_structure_hdf_file(const std::string& filename, hsize_t max_points, const tree_structure_hdf_file_options& opt, std::size_t leaf_cap) {
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
 	file_ = H5::H5File(filename, H5F_ACC_TRUNC);
+	hsize_t chunk_size = points_chunk_size_(opt, max_points, leaf_cap);
 	for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) {
 		auto& set = points_data_set_[lvl];
 
 		H5::DSetCreatPropList prop;
-		hsize_t zero = 0, chunk_size = points_data_set_chunk_size_;
+		hsize_t zero = 0, unlimited = H5S_UNLIMITED;
 		prop.setChunk(1, &chunk_size);
+		set_points_filters_(prop, opt);
 		
-		set = file_.createDataSet(points_set_name_(lvl), point_type_, H5::DataSpace(1, &zero, &max_points), prop);
+		set = file_.createDataSet(points_set_name_(lvl), point_type_, H5::DataSpace(1, &zero, &unlimited), prop, points_access_properties_(chunk_size, opt));
 	}
 }
 
 
 template<std::size_t Levels, std::size_t NumberOfChildren>
 void tree_structure_hdf_file<Levels, NumberOfChildren>::initialize_nodes_(hsize_t n) {
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
 	nodes_data_set_ = file_.createDataSet("nodes", node_type_, H5::DataSpace(1, &n));
 }
 
@@ -217,6 +442,7 @@ void tree_structure_hdf_file<Levels, NumberOfChildren>::initialize_nodes_(hsize_
 template<std::size_t Levels, std::size_t NumberOfChildren> template<class Iterator>
 void tree_structure_hdf_file<Levels, NumberOfChildren>::write_(Iterator begin, Iterator end, const H5::DataType& typ, const H5::DataSet& set, hsize_t offset) {
 	using element_t = typename Iterator::value_type;
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
 	
 	hsize_t total = end - begin;
 	hsize_t remaining = total;
@@ -248,6 +474,7 @@ void tree_structure_hdf_file<Levels, NumberOfChildren>::write_(Iterator begin, I
 template<std::size_t Levels, std::size_t NumberOfChildren> template<class Inserter>
 void tree_structure_hdf_file<Levels, NumberOfChildren>::read_insert_(Inserter ins, hsize_t n, const H5::DataType& typ, const H5::DataSet& set, hsize_t offset) const {	
 	using element_t = typename Inserter::value_type;
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
 	
 	hsize_t remaining = n;
 	
@@ -278,6 +505,7 @@ template<std::size_t Levels, std::size_t NumberOfChildren> template<class Elemen
 void tree_structure_hdf_file<Levels, NumberOfChildren>::write_(Element* el_begin, Element* el_end, const H5::DataType& typ, const H5::DataSet& set, hsize_t offset) {
 	hsize_t n = el_end - el_begin;
 	if(n == 0) return;
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
 	H5::DataSpace mem_space(1, &n);
 	H5::DataSpace data_space = set.getSpace();
 	data_space.selectHyperslab(H5S_SELECT_SET, &n, &offset);
@@ -288,6 +516,7 @@ void tree_structure_hdf_file<Levels, NumberOfChildren>::write_(Element* el_begin
 
 template<std::size_t Levels, std::size_t NumberOfChildren> template<class Element>
 void tree_structure_hdf_file<Levels, NumberOfChildren>::read_(Element* buf, hsize_t n, const H5::DataType& typ, const H5::DataSet& set, hsize_t offset) const {
+	std::lock_guard<std::mutex> lock(hdf_library_mutex());
 	H5::DataSpace mem_space(1, &n);
 	H5::DataSpace data_space = set.getSpace();
 	data_space.selectHyperslab(H5S_SELECT_SET, &n, &offset);
@@ -0,0 +1,24 @@
+#ifndef DYPC_TREE_STRUCTURE_HDF_FILE_OPTIONS_H_
+#define DYPC_TREE_STRUCTURE_HDF_FILE_OPTIONS_H_
+
+#include "../../../enums.h"
+#include <cstddef>
+
+namespace dypc {
+
+/**
+ * Storage options for point sets of tree structure HDF file.
+ * Chunk size and filters are fixed when the file is created, and are then used transparently when reading. The
+ * chunk cache size is applied each time the file is opened. @see tree_structure_hdf_file
+ */
+struct tree_structure_hdf_file_options {
+	std::size_t chunk_size = 0; ///< Number of points per chunk. 0 to derive it from leaf capacity.
+	bool shuffle = false; ///< Apply shuffle filter before compression, which groups bytes of same significance together.
+	hdf_compression compression = hdf_compression::none; ///< Compression codec.
+	unsigned compression_level = 1; ///< Compression level for deflate (1-9) and Zstandard (1-22). Ignored for LZ4.
+	std::size_t chunk_cache_size = 0; ///< Chunk cache size per point set, in bytes. 0 to derive it from chunk size.
+};
+
+}
+
+#endif
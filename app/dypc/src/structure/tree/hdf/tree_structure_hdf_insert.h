@@ -0,0 +1,403 @@
+#ifndef DYPC_TREE_STRUCTURE_HDF_INSERT_H_
+#define DYPC_TREE_STRUCTURE_HDF_INSERT_H_
+
+#include "tree_structure_hdf_file.h"
+#include "../../../model/model.h"
+#include "../../../downsampling.h"
+#include "../../../progress.h"
+#include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <set>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+
+namespace dypc {
+
+/**
+ * Inserts the points of a model into an existing tree structure HDF file.
+ * The new points are downsampled using the ratios of the existing file, and then routed through the existing nodes
+ * to the leaves that contain them. Only these leaves are rewritten: Their old and new points are appended at the end
+ * of the point sets, and leaves that exceed the leaf capacity are split. The ancestors of affected leaves get updated
+ * lengths. Their levels that hold at most leaf capacity points, which are the coarse levels that loaders read from
+ * inner nodes, are gathered and appended contiguously as well. Their finer levels would copy most of the subtree,
+ * and are instead marked fragmented, so that readers gather them from the children.
+ *
+ * Nothing is reclaimed: The old ranges of rewritten nodes remain in the point sets as unused space, and the replaced
+ * nodes array remains in the HDF file, so the file grows with each insertion. Use repack_tree_structure_hdf to write
+ * a compact copy. Because node ranges are stored as 32 bit offsets, insertion fails once a point set would grow past
+ * that range.
+ * The points must lie inside the existing nodes, so the root cuboid can not grow.
+ * @tparam Splitter Splitter that the file was created with.
+ * @tparam Levels Number of mipmap levels.
+ */
+template<class Splitter, std::size_t Levels>
+class tree_structure_hdf_inserter {
+private:
+	using file_t = tree_structure_hdf_file<Levels, Splitter::number_of_node_children>;
+	using hdf_node = typename file_t::hdf_node;
+	using points_container_t = std::vector<point>;
+	using level_points_t = std::array<points_container_t, Levels>; ///< Point set segment for each level.
+
+	struct affected_leaf {
+		unsigned depth = 0;
+		level_points_t new_points;
+	};
+
+	file_t file_;
+	const std::size_t leaf_capacity_;
+	const downsampling_mode downsampling_mode_;
+	const bool additive_;
+	std::vector<hdf_node> nodes_;
+	std::vector<std::ptrdiff_t> parents_; ///< Index of parent of each existing node, -1 for root.
+	std::array<float, Levels> downsampling_ratios_; ///< Ratios of the existing file, derived from root node.
+	std::array<hsize_t, Levels> points_end_; ///< Current end of each point set, where points get appended.
+
+	std::size_t full_number_of_points_(const level_points_t& pts) const {
+		if(! additive_) return pts[0].size();
+		std::size_t n = 0;
+		for(const auto& lvl_pts : pts) n += lvl_pts.size();
+		return n;
+	}
+
+	std::ptrdiff_t leaf_for_point_(const point& pt, unsigned& depth) const;
+	void downsample_points_(points_container_t& points, const cuboid& bounding_cuboid, level_points_t& output) const;
+	void read_leaf_points_(std::ptrdiff_t index, level_points_t& output) const;
+	void gather_level_points_(std::ptrdiff_t index, std::ptrdiff_t lvl, points_container_t& output) const;
+	hsize_t append_points_(const points_container_t& pts, std::ptrdiff_t lvl);
+	void write_branch_(std::ptrdiff_t index, const cuboid& cub, unsigned depth, level_points_t& pts);
+	void rewrite_ancestors_(const std::vector<std::ptrdiff_t>& indices);
+
+public:
+	/**
+	 * Open tree structure file for insertion.
+	 * @param filename Path of HDF file. Must have been created with extendible point sets.
+	 * @param leaf_cap Leaf capacity for nodes that receive points.
+	 * @param dmode Downsampling mode for the new points.
+	 */
+	tree_structure_hdf_inserter(const std::string& filename, std::size_t leaf_cap, downsampling_mode dmode);
+
+	/**
+	 * Insert all points of model into the file.
+	 * Nothing is written if one of the points lies outside of the existing nodes.
+	 */
+	void insert(model& mod);
+};
+
+
+template<class Splitter, std::size_t Levels>
+tree_structure_hdf_inserter<Splitter, Levels>::tree_structure_hdf_inserter(const std::string& filename, std::size_t leaf_cap, downsampling_mode dmode) :
+file_(filename, typename file_t::update_t()), leaf_capacity_(leaf_cap), downsampling_mode_(dmode), additive_(file_.is_additive()) {
+	if(! file_.points_extendible()) throw std::invalid_argument("Tree structure file does not allow insertion, point sets are not extendible");
+
+	nodes_.resize(file_.get_number_of_nodes());
+	file_.read_nodes(nodes_.data(), nodes_.size());
+
+	parents_.assign(nodes_.size(), -1);
+	for(std::ptrdiff_t i = 0; i < nodes_.size(); ++i)
+		for(std::uint32_t child : nodes_[i].children) if(child) parents_[child] = i;
+
+	// With additive storage, the full point set of a level also includes all coarser levels
+	const hdf_node& root = nodes_[0];
+	std::array<std::size_t, Levels> full_lengths;
+	std::size_t coarser = 0;
+	for(std::ptrdiff_t lvl = Levels - 1; lvl >= 0; --lvl) {
+		full_lengths[lvl] = root.data_length[lvl] + (additive_ ? coarser : 0);
+		coarser = full_lengths[lvl];
+	}
+	for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl)
+		downsampling_ratios_[lvl] = (full_lengths[0] ? (float)full_lengths[lvl] / full_lengths[0] : 1.0);
+
+	for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) points_end_[lvl] = file_.get_number_of_points(lvl);
+}
+
+
+template<class Splitter, std::size_t Levels>
+std::ptrdiff_t tree_structure_hdf_inserter<Splitter, Levels>::leaf_for_point_(const point& pt, unsigned& depth) const {
+	depth = 0;
+	if(! nodes_[0].node_cuboid().in_range(pt)) return -1;
+
+	std::ptrdiff_t index = 0;
+	while(! nodes_[index].is_leaf()) {
+		std::ptrdiff_t i = nodes_[index].child_index_for_point(nodes_.data(), pt);
+		if(i == hdf_node::no_child_index) return -1;
+		index = nodes_[index].children[i];
+		++depth;
+	}
+	return index;
+}
+
+
+template<class Splitter, std::size_t Levels>
+void tree_structure_hdf_inserter<Splitter, Levels>::downsample_points_(points_container_t& points, const cuboid& bounding_cuboid, level_points_t& output) const {
+	const std::size_t n = points.size();
+
+	if(! additive_) {
+		for(std::ptrdiff_t lvl = 1; lvl < Levels; ++lvl) {
+			std::size_t expected = downsampling_ratios_[lvl] * n;
+			auto ins = std::back_inserter(output[lvl]);
+			if(expected >= n) output[lvl] = points;
+			else if(downsampling_mode_ == downsampling_mode::random) random_downsampling(points.begin(), points.end(), expected, ins);
+			else if(downsampling_mode_ == downsampling_mode::uniform) uniform_downsampling(points.begin(), points.end(), expected, bounding_cuboid, ins);
+			else throw std::logic_error("Invalid downsampling mode");
+		}
+		output[0].swap(points);
+		return;
+	}
+
+	// Same nesting as mipmap_structure::additive_downsample_points_
+	points_container_t current;
+	current.swap(points);
+	for(std::ptrdiff_t lvl = 1; lvl < Levels; ++lvl) {
+		std::size_t expected = downsampling_ratios_[lvl] * n;
+		if(expected >= current.size()) continue;
+
+		points_container_t selected;
+		auto sel_ins = std::back_inserter(selected);
+		auto rest_ins = std::back_inserter(output[lvl - 1]);
+		if(downsampling_mode_ == downsampling_mode::random) random_downsampling_partition(current.begin(), current.end(), expected, sel_ins, rest_ins);
+		else if(downsampling_mode_ == downsampling_mode::uniform) uniform_downsampling_partition(current.begin(), current.end(), expected, bounding_cuboid, sel_ins, rest_ins);
+		else throw std::logic_error("Invalid downsampling mode");
+		current.swap(selected);
+	}
+	output[Levels - 1].swap(current);
+}
+
+
+template<class Splitter, std::size_t Levels>
+void tree_structure_hdf_inserter<Splitter, Levels>::read_leaf_points_(std::ptrdiff_t index, level_points_t& output) const {
+	const hdf_node& nd = nodes_[index];
+	for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) {
+		std::size_t n = nd.data_length[lvl];
+		output[lvl].resize(n);
+		if(n) file_.read_points(output[lvl].data(), n, lvl, nd.data_start[lvl]);
+	}
+}
+
+
+template<class Splitter, std::size_t Levels>
+void tree_structure_hdf_inserter<Splitter, Levels>::gather_level_points_(std::ptrdiff_t index, std::ptrdiff_t lvl, points_container_t& output) const {
+	const hdf_node& nd = nodes_[index];
+	std::size_t n = nd.data_length[lvl];
+	if(n == 0) return;
+	if(! nd.is_fragmented(lvl)) {
+		std::size_t offset = output.size();
+		output.resize(offset + n);
+		file_.read_points(output.data() + offset, n, lvl, nd.data_start[lvl]);
+		return;
+	}
+	for(std::uint32_t child : nd.children) if(child) gather_level_points_(child, lvl, output);
+}
+
+
+template<class Splitter, std::size_t Levels>
+hsize_t tree_structure_hdf_inserter<Splitter, Levels>::append_points_(const points_container_t& pts, std::ptrdiff_t lvl) {
+	// Node ranges are 32 bit, and the largest value marks fragmented ranges
+	hsize_t start = points_end_[lvl];
+	if(start + pts.size() >= hdf_node::fragmented_data_start)
+		throw std::overflow_error("Tree structure file point set exceeds range of node offsets");
+	if(! pts.empty()) file_.write_points(pts.begin(), pts.end(), lvl, start);
+	points_end_[lvl] += pts.size();
+	return start;
+}
+
+
+template<class Splitter, std::size_t Levels>
+void tree_structure_hdf_inserter<Splitter, Levels>::write_branch_(std::ptrdiff_t index, const cuboid& cub, unsigned depth, level_points_t& pts) {
+	constexpr std::size_t number_of_children = Splitter::number_of_node_children;
+	const std::array<hsize_t, Levels> start = points_end_;
+	const std::size_t n = full_number_of_points_(pts);
+
+	bool split = false;
+	if(n > leaf_capacity_) {
+		// Node points information is computed on the full level 0 point set, like in tree_structure_node
+		points_container_t all_points;
+		if(additive_) for(const auto& lvl_pts : pts) all_points.insert(all_points.end(), lvl_pts.begin(), lvl_pts.end());
+		const points_container_t& full_points = (additive_ ? all_points : pts[0]);
+		auto info = Splitter::compute_node_points_information(full_points.begin(), full_points.end(), cub, depth);
+
+		std::array<level_points_t, number_of_children> child_points;
+		for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl)
+			for(const point& pt : pts[lvl]) child_points[Splitter::node_child_for_point(pt, cub, info, depth)][lvl].push_back(pt);
+
+		// Points that the splitter cannot separate (e.g. all at same position) remain in an overfull leaf
+		split = true;
+		for(const auto& ch_pts : child_points) if(full_number_of_points_(ch_pts) == n) split = false;
+
+		if(split) {
+			for(auto& lvl_pts : pts) points_container_t().swap(lvl_pts);
+			std::ptrdiff_t first_child = nodes_.size();
+			nodes_.resize(first_child + number_of_children);
+			for(std::ptrdiff_t i = 0; i < number_of_children; ++i) {
+				nodes_[index].children[i] = first_child + i;
+				write_branch_(first_child + i, Splitter::node_child_cuboid(i, cub, info, depth), depth + 1, child_points[i]);
+			}
+		}
+	}
+
+	if(! split) {
+		for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) append_points_(pts[lvl], lvl);
+	}
+
+	// The branch was written contiguously, so this node's range is not fragmented
+	hdf_node& nd = nodes_[index];
+	nd.cuboid_origin = cub.origin;
+	nd.cuboid_extremity = cub.extremity;
+	for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) {
+		nd.data_start[lvl] = start[lvl];
+		nd.data_length[lvl] = points_end_[lvl] - start[lvl];
+	}
+}
+
+
+template<class Splitter, std::size_t Levels>
+void tree_structure_hdf_inserter<Splitter, Levels>::rewrite_ancestors_(const std::vector<std::ptrdiff_t>& indices) {
+	// Deepest first, so that gathering reads the children's new ranges instead of fragmenting again
+	std::vector<std::pair<unsigned, std::ptrdiff_t>> by_depth;
+	for(std::ptrdiff_t index : indices) {
+		unsigned depth = 0;
+		for(std::ptrdiff_t parent = parents_[index]; parent != -1; parent = parents_[parent]) ++depth;
+		by_depth.emplace_back(depth, index);
+	}
+	std::sort(by_depth.begin(), by_depth.end(), std::greater<std::pair<unsigned, std::ptrdiff_t>>());
+
+	points_container_t lvl_pts;
+	for(const auto& entry : by_depth) {
+		std::ptrdiff_t index = entry.second;
+		for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) {
+			if(nodes_[index].data_length[lvl] > leaf_capacity_) {
+				nodes_[index].data_start[lvl] = hdf_node::fragmented_data_start;
+				continue;
+			}
+			// Children's ranges are current, so gather from them and not from the node's own outdated range
+			lvl_pts.clear();
+			for(std::uint32_t child : nodes_[index].children) if(child) gather_level_points_(child, lvl, lvl_pts);
+			nodes_[index].data_start[lvl] = append_points_(lvl_pts, lvl);
+		}
+	}
+}
+
+
+template<class Splitter, std::size_t Levels>
+void tree_structure_hdf_inserter<Splitter, Levels>::insert(model& mod) {
+	const cuboid root_cuboid = nodes_[0].node_cuboid();
+
+	points_container_t new_points;
+	new_points.reserve(mod.number_of_points());
+	progress_foreach(mod, "Collecting points from model...", [&](const point& pt) {
+		new_points.push_back(pt);
+	});
+
+	level_points_t new_level_points;
+	downsample_points_(new_points, root_cuboid, new_level_points);
+
+	// Route all points before anything gets written, so that the file is unchanged on error
+	std::map<std::ptrdiff_t, affected_leaf> affected_leaves;
+	progress("Routing points to leaves...", [&](progress_handle& pr) {
+		for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) {
+			for(const point& pt : new_level_points[lvl]) {
+				unsigned depth;
+				std::ptrdiff_t index = leaf_for_point_(pt, depth);
+				if(index == -1) throw std::invalid_argument("Inserted point lies outside of tree structure nodes");
+				affected_leaf& leaf = affected_leaves[index];
+				leaf.depth = depth;
+				leaf.new_points[lvl].push_back(pt);
+			}
+			points_container_t().swap(new_level_points[lvl]);
+		}
+	});
+
+	std::set<std::ptrdiff_t> ancestors;
+	progress(affected_leaves.size(), "Rewriting affected leaves...", [&](progress_handle& pr) {
+		for(auto& entry : affected_leaves) {
+			std::ptrdiff_t index = entry.first;
+			affected_leaf& leaf = entry.second;
+
+			level_points_t pts;
+			read_leaf_points_(index, pts);
+			for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl)
+				pts[lvl].insert(pts[lvl].end(), leaf.new_points[lvl].begin(), leaf.new_points[lvl].end());
+
+			write_branch_(index, nodes_[index].node_cuboid(), leaf.depth, pts);
+
+			for(std::ptrdiff_t parent = parents_[index]; parent != -1; parent = parents_[parent]) {
+				hdf_node& nd = nodes_[parent];
+				for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) nd.data_length[lvl] += leaf.new_points[lvl].size();
+				ancestors.insert(parent);
+			}
+
+			for(auto& lvl_pts : leaf.new_points) points_container_t().swap(lvl_pts);
+			pr.increment();
+		}
+	});
+
+	progress("Rewriting ancestors...", [&](progress_handle& pr) {
+		rewrite_ancestors_(std::vector<std::ptrdiff_t>(ancestors.begin(), ancestors.end()));
+	});
+
+	file_.rewrite_nodes(nodes_);
+}
+
+
+/**
+ * Write compact copy of tree structure HDF file.
+ * Points are copied leaf by leaf in depth-first order, so that every node's range is contiguous again at all levels,
+ * and the unused space that insertions left behind is dropped. Node indices stay the same.
+ * @tparam Levels Number of mipmap levels.
+ * @tparam NumberOfChildren Number of children that nodes in tree structure have.
+ * @param filename Path of existing HDF file.
+ * @param output_filename Path of new HDF file. Overwritten if it exists. Must differ from filename.
+ * @param opt Chunking and compression of the new point sets. When no chunk size is given, that of the existing file is kept.
+ */
+template<std::size_t Levels, std::size_t NumberOfChildren>
+void repack_tree_structure_hdf(const std::string& filename, const std::string& output_filename, tree_structure_hdf_file_options opt) {
+	using file_t = tree_structure_hdf_file<Levels, NumberOfChildren>;
+	using hdf_node = typename file_t::hdf_node;
+
+	const file_t input(filename);
+	std::vector<hdf_node> nodes(input.get_number_of_nodes());
+	input.read_nodes(nodes.data(), nodes.size());
+	if(nodes.empty()) throw std::invalid_argument("Tree structure file has no nodes");
+
+	if(! opt.chunk_size) opt.chunk_size = input.get_points_chunk_size();
+	file_t output(output_filename, nodes[0].data_length[0], opt);
+	output.set_additive(input.is_additive());
+
+	std::array<hsize_t, Levels> end;
+	end.fill(0);
+	std::vector<point> pts;
+
+	std::function<void(std::ptrdiff_t)> copy_branch = [&](std::ptrdiff_t index) {
+		hdf_node& nd = nodes[index];
+		const std::array<hsize_t, Levels> start = end;
+		if(nd.is_leaf()) {
+			for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) {
+				std::size_t n = nd.data_length[lvl];
+				if(n == 0) continue;
+				pts.resize(n);
+				input.read_points(pts.data(), n, lvl, nd.data_start[lvl]);
+				output.write_points(pts.begin(), pts.end(), lvl, end[lvl]);
+				end[lvl] += n;
+			}
+		} else {
+			for(std::uint32_t child : nd.children) if(child) copy_branch(child);
+		}
+		for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) {
+			nd.data_start[lvl] = start[lvl];
+			nd.data_length[lvl] = end[lvl] - start[lvl];
+		}
+	};
+
+	progress("Repacking tree structure file...", [&](progress_handle& pr) {
+		copy_branch(0);
+	});
+	output.write_nodes(nodes.begin(), nodes.end());
+}
+
+}
+
+#endif
@@ -6,11 +6,29 @@
 #include <memory>
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <map>
+#include <list>
+#include <mutex>
+#include <cstdint>
 
 namespace dypc {
 
 /**
  * Tree structure source that reads HDF file.
+ * By default the whole nodes table is read when the file is opened. In paged mode, the nodes table is instead
+ * divided into pages of consecutive nodes, which are read when the traversal first reaches one of their nodes. The
+ * pages holding the top levels of the tree are read at open and stay in memory. When more pages than the memory
+ * budget allows are loaded, the ones least recently used get freed once no traversal is in progress. Unpinned pages
+ * are kept in a list in order of use, so that finding them does not require scanning all pages. Because nodes are
+ * stored in depth-first order, a page mostly contains nodes of the same subtree.
+ * Independently, a memory budget for points can be given. Then the point segments of the top of the tree, which
+ * almost every request reads, are read at open and kept in memory, and only the remaining finer segments get read
+ * from the file during traversals. Coarser levels get priority, and on each level the nodes are taken in
+ * breadth-first order. The traversal does not go below nodes whose segment got pinned, and when a segment does not fit
+ * in the remaining budget, the segments of the node's children are tried instead.
+ * Sessions of a loader can traverse the source concurrently. Then page loads are serialized, and pages are only
+ * freed when the last traversal in progress ends. @see tree_structure_source::begin_traversal
  */
 template<std::size_t Levels, std::size_t NumberOfChildren>
 class tree_structure_hdf_source : public tree_structure_source {
@@ -20,43 +38,127 @@ public:
 private:
 	using file_t = tree_structure_hdf_file<Levels, NumberOfChildren>;
 	using hdf_node = typename file_t::hdf_node;
+	
+	static constexpr std::size_t page_size_ = 1024; ///< Number of nodes per page.
+
+	/// Consecutive nodes from the nodes table, in paged mode.
+	struct page {
+		std::vector<node> nodes;
+		std::uint64_t last_used = 0; ///< Traversal in which page was last accessed.
+		bool pinned = false; ///< Page holds nodes of the top levels, and never gets freed.
+		std::list<std::size_t>::iterator lru_position; ///< Position in lru_pages_, when not pinned.
+	};
 
 	file_t file_;
-	std::vector<node> nodes_;
+	std::size_t number_of_nodes_;
+	std::vector<node> nodes_; ///< All nodes, when not in paged mode.
+	
+	const bool paged_;
+	std::size_t maximal_loaded_pages_ = 0;
+	mutable std::vector<std::unique_ptr<page>> pages_; ///< Pages by index, null when not loaded.
+	mutable std::size_t loaded_pages_ = 0;
+	mutable std::list<std::size_t> lru_pages_; ///< Indices of loaded unpinned pages, least recently used first.
+	mutable std::uint64_t traversal_ = 0;
+	mutable std::size_t active_traversals_ = 0; ///< Traversals in progress, during which no pages get freed.
+	mutable std::uint64_t release_epoch_ = 0; ///< Incremented whenever pages get freed.
+	mutable std::mutex pages_mutex_; ///< Held while accessing pages_, in paged mode.
+	
+	/// Range of a points set kept in memory.
+	struct pinned_range {
+		std::uint32_t length;
+		std::size_t offset; ///< Offset in pinned_points_.
+	};
+
+	std::vector<point> pinned_points_; ///< Point ranges kept in memory.
+	std::map<std::uint32_t, pinned_range> pinned_ranges_[Levels]; ///< For each level, disjoint pinned ranges by start in file.
+	
+	const node& node_at_(std::size_t index) const;
+	page& load_page_(std::size_t page_index) const;
+	bool release_unused_pages_() const;
+	void pin_top_levels_(unsigned pinned_levels);
+	void pin_points_(std::size_t point_memory_budget);
+	const point* pinned_points_at_(std::ptrdiff_t lvl, std::uint32_t start, std::size_t n) const;
 
 public:	
-	explicit tree_structure_hdf_source(const std::string& filepath);
+	/**
+	 * Open tree structure HDF file.
+	 * @param filepath Path of the HDF file.
+	 * @param node_memory_budget Memory for nodes in bytes. 0 to read the whole nodes table at once, otherwise enables paged mode.
+	 * @param point_memory_budget Memory for points of the top of the tree that are kept in memory, in bytes. 0 to read all points from file.
+	 * @param pinned_levels Number of top tree levels read at open and kept in memory, in paged mode.
+	 */
+	explicit tree_structure_hdf_source(const std::string& filepath, std::size_t node_memory_budget = 0, std::size_t point_memory_budget = 0, unsigned pinned_levels = 4);
 		
-	const node& root_node() const override { return nodes_[0]; }
-	std::size_t number_of_nodes() const override { return nodes_.size(); }
-	std::size_t memory_size() const override { return nodes_.size() * sizeof(node); }
+	const node& root_node() const override { return node_at_(0); }
+	std::size_t number_of_nodes() const override { return number_of_nodes_; }
+	std::size_t memory_size() const override;
 	std::size_t rom_size() const override { return file_.get_file_size(); }
+	
+	std::uint64_t begin_traversal() const override;
+	void end_traversal() const override;
+	
+	bool is_paged() const { return paged_; }
+	std::size_t number_of_loaded_pages() const { return loaded_pages_; }
+	std::size_t number_of_pinned_points() const { return pinned_points_.size(); }
 };
 
 
 template<std::size_t Levels, std::size_t NumberOfChildren>
 class tree_structure_hdf_source<Levels, NumberOfChildren>::node : public tree_structure_source::node {
+	friend class tree_structure_hdf_source;
+	
 private:
 	tree_structure_hdf_source& source_;
 	const hdf_node node_;
 
+	/**
+	 * Read the points of one level stored in this node.
+	 * After points were inserted into the file, the range of a non-leaf node may be fragmented, and is then
+	 * gathered from its children in depth-first order.
+	 */
+	std::size_t extract_level_points_(point_buffer_t buffer, std::size_t capacity, std::ptrdiff_t l) const {
+		std::size_t n = node_.data_length[l];
+		if(n > capacity) n = capacity;
+		if(n == 0) return 0;
+		if(! node_.is_fragmented(l)) {
+			const point* pinned = source_.pinned_points_at_(l, node_.data_start[l], n);
+			if(pinned) std::copy_n(pinned, n, buffer);
+			else source_.file_.read_points(buffer, n, l, node_.data_start[l]);
+			return n;
+		}
+		std::size_t total = 0;
+		for(std::ptrdiff_t i = 0; (i < NumberOfChildren) && (total < n); ++i)
+			if(has_child(i)) total += child(i).extract_level_points_(buffer + total, n - total, l);
+		return total;
+	}
+
 public:
 	node(tree_structure_hdf_source& src, const hdf_node& nd) : source_(src), node_(nd) { }
 
 	tree_structure_hdf_source& source() const { return source_; }
 
-	std::size_t number_of_points(std::ptrdiff_t lvl = 0) const override { return node_.data_length[lvl]; }
+	std::size_t number_of_points(std::ptrdiff_t lvl = 0) const override {
+		if(! source_.additive_) return node_.data_length[lvl];
+		std::size_t n = 0;
+		for(std::ptrdiff_t l = lvl; l < Levels; ++l) n += node_.data_length[l];
+		return n;
+	}
 	
 	std::size_t extract_points(point_buffer_t buffer, std::size_t capacity, std::ptrdiff_t lvl = 0) const override {
-		std::size_t n = number_of_points(lvl);
-		if(n > capacity) n = capacity;
-		source_.file_.read_points(buffer, n, lvl, node_.data_start[lvl]);
-		return n;
+		if(! source_.additive_) return extract_level_points_(buffer, capacity, lvl);
+		
+		// Read the segment of each level from the coarsest one, until the capacity is reached
+		std::size_t total = 0;
+		for(std::ptrdiff_t l = Levels - 1; (l >= lvl) && capacity; --l) {
+			std::size_t n = extract_level_points_(buffer, capacity, l);
+			buffer += n; capacity -= n; total += n;
+		}
+		return total;
 	}
 
 	bool is_leaf() const override { return node_.is_leaf(); }
 	bool has_child(std::ptrdiff_t i) const override { return node_.has_child(i); }
-	const node& child(std::ptrdiff_t i) const override { assert(has_child(i)); return source_.nodes_[node_.children[i]]; }
+	const node& child(std::ptrdiff_t i) const override { assert(has_child(i)); return source_.node_at_(node_.children[i]); }
 	
 	std::ptrdiff_t child_for_point(glm::vec3 pt) const override;
 	cuboid node_cuboid() const override { return node_.node_cuboid(); }
@@ -64,14 +166,177 @@ public:
 
 
 template<std::size_t Levels, std::size_t NumberOfChildren>
-tree_structure_hdf_source<Levels, NumberOfChildren>::tree_structure_hdf_source(const std::string& filepath) :
-tree_structure_source(Levels, NumberOfChildren), file_(filepath) {
-	std::size_t number_of_nodes = file_.get_number_of_nodes();
-	std::unique_ptr<hdf_node[]> hdf_nodes(new hdf_node [number_of_nodes]);
-	file_.read_nodes(hdf_nodes.get(), number_of_nodes);
-	
-	const hdf_node* end = hdf_nodes.get() + number_of_nodes;
-	for(const hdf_node* it = hdf_nodes.get(); it != end; ++it) nodes_.emplace_back(*this, *it);
+tree_structure_hdf_source<Levels, NumberOfChildren>::tree_structure_hdf_source(const std::string& filepath, std::size_t node_memory_budget, std::size_t point_memory_budget, unsigned pinned_levels) :
+tree_structure_source(Levels, NumberOfChildren), file_(filepath), number_of_nodes_(file_.get_number_of_nodes()), paged_(node_memory_budget != 0) {
+	additive_ = file_.is_additive();
+	
+	if(paged_) {
+		maximal_loaded_pages_ = std::max<std::size_t>(1, node_memory_budget / (page_size_ * sizeof(node)));
+		pages_.resize((number_of_nodes_ + page_size_ - 1) / page_size_);
+		pin_top_levels_(pinned_levels);
+	} else {
+		std::unique_ptr<hdf_node[]> hdf_nodes(new hdf_node [number_of_nodes_]);
+		file_.read_nodes(hdf_nodes.get(), number_of_nodes_);
+		
+		nodes_.reserve(number_of_nodes_);
+		const hdf_node* end = hdf_nodes.get() + number_of_nodes_;
+		for(const hdf_node* it = hdf_nodes.get(); it != end; ++it) nodes_.emplace_back(*this, *it);
+	}
+	
+	if(point_memory_budget) {
+		pin_points_(point_memory_budget);
+		// Pages that were only needed to select the pinned segments can go again
+		if(paged_) release_unused_pages_();
+	}
+}
+
+
+template<std::size_t Levels, std::size_t NumberOfChildren>
+auto tree_structure_hdf_source<Levels, NumberOfChildren>::node_at_(std::size_t index) const -> const node& {
+	if(! paged_) return nodes_[index];
+	
+	std::lock_guard<std::mutex> lock(pages_mutex_);
+	const std::unique_ptr<page>& pg = pages_[index / page_size_];
+	page& p = (pg ? *pg : load_page_(index / page_size_));
+	if(p.last_used != traversal_) {
+		// Move to back of LRU list on first access in this traversal
+		p.last_used = traversal_;
+		if(! p.pinned) lru_pages_.splice(lru_pages_.end(), lru_pages_, p.lru_position);
+	}
+	return p.nodes[index % page_size_];
+}
+
+
+template<std::size_t Levels, std::size_t NumberOfChildren>
+auto tree_structure_hdf_source<Levels, NumberOfChildren>::load_page_(std::size_t page_index) const -> page& {
+	std::size_t start = page_index * page_size_;
+	std::size_t n = std::min(page_size_, number_of_nodes_ - start);
+	
+	std::unique_ptr<hdf_node[]> hdf_nodes(new hdf_node [n]);
+	file_.read_nodes(hdf_nodes.get(), n, start);
+	
+	page* p = new page;
+	p->last_used = traversal_;
+	p->lru_position = lru_pages_.insert(lru_pages_.end(), page_index);
+	p->nodes.reserve(n);
+	tree_structure_hdf_source& src = const_cast<tree_structure_hdf_source&>(*this);
+	for(std::size_t i = 0; i < n; ++i) p->nodes.emplace_back(src, hdf_nodes[i]);
+	
+	pages_[page_index].reset(p);
+	++loaded_pages_;
+	return *p;
+}
+
+
+template<std::size_t Levels, std::size_t NumberOfChildren>
+void tree_structure_hdf_source<Levels, NumberOfChildren>::pin_top_levels_(unsigned pinned_levels) {
+	// Breadth-first traversal of top levels, which loads the pages holding their nodes
+	std::vector<std::size_t> level_nodes { 0 }, next_level_nodes;
+	for(unsigned depth = 0; depth < pinned_levels && ! level_nodes.empty(); ++depth) {
+		next_level_nodes.clear();
+		for(std::size_t index : level_nodes) {
+			const hdf_node& nd = node_at_(index).node_;
+			page& p = *pages_[index / page_size_];
+			if(! p.pinned) {
+				lru_pages_.erase(p.lru_position);
+				p.pinned = true;
+			}
+			for(std::ptrdiff_t i = 0; i < NumberOfChildren; ++i) if(nd.has_child(i)) next_level_nodes.push_back(nd.children[i]);
+		}
+		std::swap(level_nodes, next_level_nodes);
+	}
+}
+
+
+template<std::size_t Levels, std::size_t NumberOfChildren>
+void tree_structure_hdf_source<Levels, NumberOfChildren>::pin_points_(std::size_t point_memory_budget) {
+	std::size_t remaining = point_memory_budget / sizeof(point);
+	
+	// On each level, from the coarsest, take segments in breadth-first order. Below a pinned segment the traversal
+	// stops, so that it reaches deep nodes (and, in paged mode, loads their pages) only where nothing was pinned.
+	std::vector<std::size_t> level_nodes, next_level_nodes;
+	for(std::ptrdiff_t l = Levels - 1; (l >= 0) && remaining; --l) {
+		level_nodes.assign(1, 0);
+		while(! level_nodes.empty() && remaining) {
+			next_level_nodes.clear();
+			for(std::size_t index : level_nodes) {
+				const hdf_node& nd = node_at_(index).node_;
+				std::size_t n = nd.data_length[l];
+				if(n && ! nd.is_fragmented(l)) {
+					if(pinned_points_at_(l, nd.data_start[l], n)) continue;
+					if(n <= remaining) {
+						std::size_t offset = pinned_points_.size();
+						pinned_points_.resize(offset + n);
+						file_.read_points(pinned_points_.data() + offset, n, l, nd.data_start[l]);
+						pinned_ranges_[l][nd.data_start[l]] = pinned_range { std::uint32_t(n), offset };
+						remaining -= n;
+						continue;
+					}
+					// Segment does not fit, but the smaller segments of the children may
+				}
+				for(std::ptrdiff_t i = 0; i < NumberOfChildren; ++i) if(nd.has_child(i)) next_level_nodes.push_back(nd.children[i]);
+			}
+			std::swap(level_nodes, next_level_nodes);
+		}
+	}
+	pinned_points_.shrink_to_fit();
+}
+
+
+template<std::size_t Levels, std::size_t NumberOfChildren>
+const point* tree_structure_hdf_source<Levels, NumberOfChildren>::pinned_points_at_(std::ptrdiff_t lvl, std::uint32_t start, std::size_t n) const {
+	const auto& ranges = pinned_ranges_[lvl];
+	if(ranges.empty()) return nullptr;
+	
+	// Last range starting at or before start
+	auto it = ranges.upper_bound(start);
+	if(it == ranges.begin()) return nullptr;
+	--it;
+	if(std::size_t(start) + n > std::size_t(it->first) + it->second.length) return nullptr;
+	else return pinned_points_.data() + it->second.offset + (start - it->first);
+}
+
+
+template<std::size_t Levels, std::size_t NumberOfChildren>
+std::uint64_t tree_structure_hdf_source<Levels, NumberOfChildren>::begin_traversal() const {
+	if(! paged_) return 0;
+	std::lock_guard<std::mutex> lock(pages_mutex_);
+	++traversal_;
+	++active_traversals_;
+	return release_epoch_;
+}
+
+
+template<std::size_t Levels, std::size_t NumberOfChildren>
+void tree_structure_hdf_source<Levels, NumberOfChildren>::end_traversal() const {
+	if(! paged_) return;
+	std::lock_guard<std::mutex> lock(pages_mutex_);
+	assert(active_traversals_ > 0);
+	// Only when no other traversal holds references to nodes
+	if(--active_traversals_ == 0 && release_unused_pages_()) ++release_epoch_;
+}
+
+
+template<std::size_t Levels, std::size_t NumberOfChildren>
+bool tree_structure_hdf_source<Levels, NumberOfChildren>::release_unused_pages_() const {
+	bool released = false;
+	while(loaded_pages_ > maximal_loaded_pages_ && ! lru_pages_.empty()) {
+		pages_[lru_pages_.front()].reset();
+		lru_pages_.pop_front();
+		--loaded_pages_;
+		released = true;
+	}
+	return released;
+}
+
+
+template<std::size_t Levels, std::size_t NumberOfChildren>
+std::size_t tree_structure_hdf_source<Levels, NumberOfChildren>::memory_size() const {
+	std::size_t pinned_size = pinned_points_.size() * sizeof(point);
+	for(const auto& ranges : pinned_ranges_) pinned_size += ranges.size() * (sizeof(std::uint32_t) + sizeof(pinned_range));
+	
+	if(paged_) return pinned_size + pages_.size() * sizeof(std::unique_ptr<page>) + loaded_pages_ * (sizeof(page) + page_size_ * sizeof(node));
+	else return pinned_size + nodes_.size() * sizeof(node);
 }
 
 
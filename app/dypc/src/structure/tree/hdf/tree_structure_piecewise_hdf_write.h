@@ -3,6 +3,7 @@
 
 #include "../tree_structure_piecewise.h"
 #include "tree_structure_hdf_file.h"
+#include "../../../point_soa_container.h"
 #include "../../../progress.h"
 #include <string>
 #include <vector>
@@ -16,27 +17,32 @@ namespace dypc {
  * Uses piecewise tree structure: The entire structure (all pieces) will get written to HDF, but only
  * one piece is loaded into memory at a time. Limits memory usage, and allows for huge models to be
  * written into the file.
+ * Each piece is built with point_soa_container, whatever the container of \a s, since its points are only copied into the file.
  * @tparam Splitter Splitter that defined the tree structure.
  * @tparam Levels Number of mipmap levels.
  * @tparam PointsCountainer Container used to hold arrays (std::vector, std::deque)
  * @param filename Path of HDF file
  * @param s The piecewise tree structure.
+ * @param opt Storage options for the point sets. By default, chunk size is derived from the leaf capacity.
  */
 template<class Splitter, std::size_t Levels, class PointsContainer, class PiecesSplitter>
-void write_to_hdf(const std::string& filename, tree_structure_piecewise<Splitter, Levels, PointsContainer, PiecesSplitter>& s) {	
+void write_to_hdf(const std::string& filename, tree_structure_piecewise<Splitter, Levels, PointsContainer, PiecesSplitter>& s, const tree_structure_hdf_file_options& opt = tree_structure_hdf_file_options()) {	
 	// Some type definitions...
 	using Structure = tree_structure_piecewise<Splitter, Levels, PointsContainer, PiecesSplitter>;
-	using single_piece_structure_t = tree_structure<Splitter, Levels, PointsContainer>;
+	using single_piece_structure_t = tree_structure<Splitter, Levels, point_soa_container>;
 	
 	
 	using file_t = tree_structure_hdf_file<Levels, Splitter::number_of_node_children>;
 	using hdf_node = typename file_t::hdf_node;
-	using structure_node = typename tree_structure_piecewise<Splitter, Levels, PointsContainer>::node; // Node in tree inside a piece
+	using structure_node = typename single_piece_structure_t::node; // Node in tree inside a piece
 	using piece_node = typename tree_structure_piecewise<Splitter, Levels, PointsContainer>::piece_node; // Node in pieces tree
 	
 	using point_data_offsets_t = std::array<std::ptrdiff_t, Levels>; // Stores offsets in the L point sets
 				
-	file_t file(filename, s.total_number_of_points()); // The output file. Total number of points is known.
+	file_t file(filename, s.total_number_of_points(), opt, s.leaf_capacity()); // The output file. Total number of points is known.
+	
+	// Points are written by a separate writer thread, while the next levels and pieces get computed.
+	typename file_t::points_write_queue write_queue(file.points_writer(), file_t::default_write_queue_capacity);
 	
 	std::vector<hdf_node> all_hdf_nodes; // Will contain full nodes list for file. (Combined from pieces tree + trees in each piece)
 	
@@ -97,7 +103,7 @@ void write_to_hdf(const std::string& filename, tree_structure_piecewise<Splitter
 			scheduled_tasks.push_back(task);
 						
 			for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) points_offsets[lvl] += s.piece_number_of_points(nd, lvl);
-			
+			return 0; // Reference from parent gets set in postprocessing, once nodes of piece are known
 		} else {
 			// Pieces tree node is not a leaf. 
 			
@@ -139,22 +145,22 @@ void write_to_hdf(const std::string& filename, tree_structure_piecewise<Splitter
 	
 	// Load a piece, and add its nodes tree, points
 	// Function designed so that multiple instances can be run simulataneously. (used in parallel version)
-	// Loads piece into local variable, then only works on local variables. (except writing to output file --> add mutex in par)
+	// Loads piece into local variable, then only works on local variables. Points are copied into the write queue.
 	// Model class designed to allow multiple reading threads. (see model/model.h)
 	auto execute_add_piece_task =
-	[&file, &add_node](const Structure& piecewise_s, add_piece_task& task) {
+	[&write_queue, &add_node](const Structure& piecewise_s, add_piece_task& task) {
 	progress("Adding tree structure piece " + std::to_string(task.node.get_id()) + "...", [&](progress_handle& pr) {
-		single_piece_structure_t s = piecewise_s.load_and_export_piece(task.node);
+		single_piece_structure_t s = piecewise_s.template load_and_export_piece<point_soa_container>(task.node);
 		
-		// Write all points to the file...
+		// Queue all points to be written to the file...
 		const auto& pts = s.points_at_level(0);
-		file.write_points(pts.begin(), pts.end(), 0, task.point_data_offsets[0]);
+		write_queue.enqueue(0, task.point_data_offsets[0], pts.begin(), pts.end());
 		
 		uniform_downsampling_previous_results_t previous_results;		
 		for(std::ptrdiff_t lvl = 1; lvl < Levels; ++lvl) {
 			s.load_downsampled_points(lvl, previous_results);
 			const auto& pts = s.points_at_level(lvl);
-			file.write_points(pts.begin(), pts.end(), lvl, task.point_data_offsets[lvl]);
+			write_queue.enqueue(lvl, task.point_data_offsets[lvl], pts.begin(), pts.end());
 			s.unload_downsampled_points(lvl);
 		}
 
@@ -175,10 +181,11 @@ void write_to_hdf(const std::string& filename, tree_structure_piecewise<Splitter
 	add_piece_node_and_schedule(s.root_piece_node(), -1, -1, init_points_offsets);
 	
 	// Execute the scheduled tasks.
-	// Will write points directly to assigned location in file, and nodes in local array, with local offsets
+	// Will queue points for their assigned location in file, and write nodes in local array, with local offsets
 	for(add_piece_task& task : scheduled_tasks) {
 		execute_add_piece_task(s, task);
 	}
+	write_queue.finish(); // Wait for remaining points to be written
 	
 	// Postprocessong:
 	for(add_piece_task& task : scheduled_tasks) {
@@ -198,6 +205,7 @@ void write_to_hdf(const std::string& filename, tree_structure_piecewise<Splitter
 	
 	// Finally write the nodes
 	file.write_nodes(all_hdf_nodes.begin(), all_hdf_nodes.end());
+	file.set_additive(s.is_additive());
 }
 
 }
@@ -4,6 +4,7 @@
 #include "../tree_structure_piecewise.h"
 #include "tree_structure_piecewise_hdf_write.h"
 #include "tree_structure_hdf_file.h"
+#include "../../../point_soa_container.h"
 #include "../../../progress.h"
 #include <string>
 #include <vector>
@@ -12,6 +13,7 @@
 #include <mutex>
 #include <thread>
 #include <atomic>
+#include <algorithm>
 
 namespace dypc {
 
@@ -20,30 +22,36 @@ namespace dypc {
  * Uses piecewise tree structure: The entire structure (all pieces) will get written to HDF, but only
  * a few piece is loaded into memory at a time and processed simulteneously. Saves less memory than
  * the sequential version, but benefits from multiprocessing.
+ * Each piece is built with point_soa_container, whatever the container of \a s, since its points are only copied into the file.
  * @tparam Splitter Splitter that defined the tree structure.
  * @tparam Levels Number of mipmap levels.
  * @tparam PointsCountainer Container used to hold arrays (std::vector, std::deque)
  * @param filename Path of HDF file
  * @param s The piecewise tree structure.
  * @param number_of_threads Number of simultaneous threads.
+ * @param opt Storage options for the point sets. By default, chunk size is derived from the leaf capacity.
  */
 template<class Splitter, std::size_t Levels, class PointsContainer, class PiecesSplitter>
-void write_to_hdf_parallel(const std::string& filename, tree_structure_piecewise<Splitter, Levels, PointsContainer, PiecesSplitter>& s, std::size_t number_of_threads = std::thread::hardware_concurrency()) {
-	if(number_of_threads <= 1) return write_to_hdf(filename, s);
+void write_to_hdf_parallel(const std::string& filename, tree_structure_piecewise<Splitter, Levels, PointsContainer, PiecesSplitter>& s, std::size_t number_of_threads = std::thread::hardware_concurrency(), const tree_structure_hdf_file_options& opt = tree_structure_hdf_file_options()) {
+	if(number_of_threads <= 1) return write_to_hdf(filename, s, opt);
 	
 	// Some type definitions...
 	using Structure = tree_structure_piecewise<Splitter, Levels, PointsContainer, PiecesSplitter>;
-	using single_piece_structure_t = tree_structure<Splitter, Levels, PointsContainer>;
+	using single_piece_structure_t = tree_structure<Splitter, Levels, point_soa_container>;
 	
 	using file_t = tree_structure_hdf_file<Levels, Splitter::number_of_node_children>;
 	using hdf_node = typename file_t::hdf_node;
-	using structure_node = typename tree_structure_piecewise<Splitter, Levels, PointsContainer>::node; // Node in tree inside a piece
+	using structure_node = typename single_piece_structure_t::node; // Node in tree inside a piece
 	using piece_node = typename tree_structure_piecewise<Splitter, Levels, PointsContainer>::piece_node; // Node in pieces tree
 	
 	using point_data_offsets_t = std::array<std::ptrdiff_t, Levels>; // Stores offsets in the L point sets
 				
-	file_t file(filename, s.total_number_of_points()); // The output file. Total number of points is known.
-	std::mutex file_mutex; // Only one thread may write into file at a time.
+	file_t file(filename, s.total_number_of_points(), opt, s.leaf_capacity()); // The output file. Total number of points is known.
+	std::mutex load_mutex; // Only one thread may load a piece at a time.
+	
+	// Points are written by a separate writer thread, so that the threads computing pieces do not wait for the disk.
+	// It is the only thread accessing the file until it is finished.
+	typename file_t::points_write_queue write_queue(file.points_writer(), file_t::default_write_queue_capacity);
 	
 	std::vector<hdf_node> all_hdf_nodes; // Will contain full nodes list for file. (Combined from pieces tree + trees in each piece)
 	
@@ -111,7 +119,7 @@ void write_to_hdf_parallel(const std::string& filename, tree_structure_piecewise
 			scheduled_tasks.push_back(task);
 						
 			for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) points_offsets[lvl] += s.piece_number_of_points(nd, lvl);
-			
+			return 0; // Reference from parent gets set in postprocessing, once nodes of piece are known
 		} else {
 			// Pieces tree node is not a leaf. 
 			
@@ -153,26 +161,27 @@ void write_to_hdf_parallel(const std::string& filename, tree_structure_piecewise
 	
 	// Load a piece, and add its nodes tree, points
 	// Function designed so that multiple instances can be run simulataneously. (used in parallel version)
-	// Loads piece into local variable, then only works on local variables. (except writing to output file --> add mutex in par)
+	// Loads piece into local variable, then only works on local variables. Points are copied into the write queue.
 	// Model class designed to allow multiple reading threads. (see model/model.h)
+	// Progress of each task is accounted by number of queued points, through the shared counter
 	auto execute_add_piece_task =
-	[&file, &file_mutex, &add_node](const Structure& piecewise_s, add_piece_task& task) {
+	[&write_queue, &load_mutex, &add_node](const Structure& piecewise_s, add_piece_task& task, std::size_t downsampling_threads, shared_progress::counter& written) {
 	progress("Adding tree structure piece " + std::to_string(task.node.get_id()) + "...", [&](progress_handle& pr) {
-		file_mutex.lock();
-		single_piece_structure_t s = piecewise_s.load_and_export_piece(task.node);
-		file_mutex.unlock();
+		load_mutex.lock();
+		single_piece_structure_t s = piecewise_s.template load_and_export_piece<point_soa_container>(task.node);
+		load_mutex.unlock();
 		
-		// Write all points to the file...
+		// Queue all points to be written to the file...
 		const auto& pts = s.points_at_level(0);
-		file.write_points(pts.begin(), pts.end(), 0, task.point_data_offsets[0]);
+		write_queue.enqueue(0, task.point_data_offsets[0], pts.begin(), pts.end());
+		written.add(pts.size());
 		
 		uniform_downsampling_previous_results_t previous_results;
 		for(std::ptrdiff_t lvl = 1; lvl < Levels; ++lvl) {
-			s.load_downsampled_points(lvl, previous_results);
+			s.load_downsampled_points(lvl, previous_results, downsampling_threads);
 			const auto& pts = s.points_at_level(lvl);
-			file_mutex.lock();
-			file.write_points(pts.begin(), pts.end(), lvl, task.point_data_offsets[lvl]);
-			file_mutex.unlock();
+			write_queue.enqueue(lvl, task.point_data_offsets[lvl], pts.begin(), pts.end());
+			written.add(pts.size());
 			s.unload_downsampled_points(lvl);
 		}
 
@@ -193,10 +202,15 @@ void write_to_hdf_parallel(const std::string& filename, tree_structure_piecewise
 	add_piece_node_and_schedule(s.root_piece_node(), -1, -1, init_points_offsets);
 	
 	// Execute the scheduled tasks.
-	// Will write points directly to assigned location in file, and nodes in local array, with local offsets
+	// Will queue points for their assigned location in file, and write nodes in local array, with local offsets
 	// MAIN DIFFERENCE FROM SEQUENTIAL VERSION: spawn multiple threads
-	std::vector<std::thread> threads;
-	for(unsigned i = 0; i < number_of_threads; ++i) threads.emplace_back([&]() {
+	// Total number of points to write is now in init_points_offsets. This thread reports the progress while waiting.
+	std::size_t total_written_points = 0;
+	for(auto off : init_points_offsets) total_written_points += off;
+	// Pieces already run on all threads, so downsampling inside a piece only gets the threads left over when there are fewer pieces
+	std::size_t downsampling_threads = std::max<std::size_t>(1, number_of_threads / scheduled_tasks.size());
+	shared_progress pr(total_written_points, "Writing tree structure pieces...", "points", sizeof(point));
+	pr.run(number_of_threads, [&](shared_progress::counter& written) {
 		// Inside one of the threads.
 		// Choose a task that is still available
 		bool none_left = false;
@@ -207,7 +221,7 @@ void write_to_hdf_parallel(const std::string& filename, tree_structure_piecewise
 				if(task.taken.compare_exchange_strong(expected, true)) { // atomoic
 					// Was not taken, now taken by this thread.
 					// task if now marked as taken. execute it in this thread
-					execute_add_piece_task(s, task);
+					execute_add_piece_task(s, task, downsampling_threads, written);
 					none_left = false;
 				}
 			}
@@ -215,8 +229,9 @@ void write_to_hdf_parallel(const std::string& filename, tree_structure_piecewise
 			// other threads may still be working on a task, and will also exit afterwards
 		}
 	});
-	// wait until all threads have exited
-	for(std::thread& thr : threads) thr.join();
+	// run() returned: all threads have exited
+	
+	write_queue.finish(); // Wait for remaining points to be written
 	
 	for(const add_piece_task& task : scheduled_tasks) if(! task.taken.load()) throw std::runtime_error("Something went wrong");
 	
@@ -238,6 +253,7 @@ void write_to_hdf_parallel(const std::string& filename, tree_structure_piecewise
 	
 	// Finally write the nodes
 	file.write_nodes(all_hdf_nodes.begin(), all_hdf_nodes.end());
+	file.set_additive(s.is_additive());
 }
 
 }
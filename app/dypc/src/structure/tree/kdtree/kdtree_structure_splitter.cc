@@ -1,5 +1,6 @@
 #include "kdtree_structure_splitter.h"
 #include "../../../point.h"
+#include <algorithm>
 
 namespace dypc {
 
@@ -12,6 +13,35 @@ std::ptrdiff_t kdtree_structure_splitter::node_child_for_point(const point& pt,
 }
 
 
+void kdtree_structure_splitter::node_children_for_points(const float* x, const float* y, const float* z, std::size_t n, const cuboid& cub, const node_points_information& info, unsigned depth, std::uint8_t* children) {
+	unsigned dimension = depth % 3;
+	const float* coordinates = (dimension == 0 ? x : (dimension == 1 ? y : z));
+	const float split_plane = info.split_plane;
+	for(std::size_t i = 0; i < n; ++i) children[i] = !(coordinates[i] < split_plane);
+}
+
+
+kdtree_structure_splitter::node_points_information kdtree_structure_splitter::compute_node_points_information(point_soa_container::const_iterator pt_begin, point_soa_container::const_iterator pt_end, const cuboid& cub, unsigned depth) {
+	// The coordinates are already contiguous, so they get copied in one go
+	unsigned dimension = depth % 3;
+	const float* coordinates_begin = (dimension == 0 ? pt_begin.x() : (dimension == 1 ? pt_begin.y() : pt_begin.z()));
+	std::vector<float> coordinates(coordinates_begin, coordinates_begin + (pt_end - pt_begin));
+	return median_split_(coordinates);
+}
+
+
+kdtree_structure_splitter::node_points_information kdtree_structure_splitter::median_split_(std::vector<float>& coordinates) {
+	std::sort(coordinates.begin(), coordinates.end());
+	
+	std::size_t n = coordinates.size();
+	float split_plane;
+	if(n % 2) split_plane = (coordinates[(n-1)/2] + coordinates[n/2]) / 2.0;
+	else split_plane = coordinates[n/2];
+	
+	return { split_plane };
+}
+
+
 cuboid kdtree_structure_splitter::node_child_cuboid(const std::ptrdiff_t idx, const cuboid& cub, const node_points_information& info, unsigned depth) {
 	unsigned dimension = depth % 3;
 	if(idx) {
@@ -2,7 +2,8 @@
 #define DYPC_KDTREE_STRUCTURE_SPLITTER_H_
 
 #include "../tree_structure_splitter.h"
-#include <deque>
+#include "../../../point_soa_container.h"
+#include <vector>
 #include <algorithm>
 
 
@@ -15,33 +16,33 @@ public:
 	struct node_points_information {
 		float split_plane;
 	};
-	
+
+private:
+	static node_points_information median_split_(std::vector<float>& coordinates);
+
+public:
 	static std::ptrdiff_t node_child_for_point(const point& pt, const cuboid& cub, const node_points_information& info, unsigned depth);
 	static cuboid node_child_cuboid(const std::ptrdiff_t i, const cuboid& cub, const node_points_information& info, unsigned depth);
+	static void node_children_for_points(const float* x, const float* y, const float* z, std::size_t n, const cuboid& cub, const node_points_information& info, unsigned depth, std::uint8_t* children);
 	
 	template<class Iterator>
 	static node_points_information compute_node_points_information(Iterator pt_begin, Iterator pt_end, const cuboid& cub, unsigned depth);
+	static node_points_information compute_node_points_information(point_soa_container::const_iterator pt_begin, point_soa_container::const_iterator pt_end, const cuboid& cub, unsigned depth);
 };
 
 
 template<class Iterator>
 kdtree_structure_splitter::node_points_information kdtree_structure_splitter::compute_node_points_information(Iterator pt_begin, Iterator pt_end, const cuboid& cub, unsigned depth){
 	// Calculate median
-	std::deque<float> coordinates;
+	std::vector<float> coordinates;
+	coordinates.reserve(pt_end - pt_begin);
 	
 	unsigned dimension = depth % 3;
 	if(dimension == 0) for(Iterator it = pt_begin; it != pt_end; ++it) coordinates.push_back(it->x);
 	else if(dimension == 1) for(Iterator it = pt_begin; it != pt_end; ++it) coordinates.push_back(it->y);
 	else if(dimension == 2) for(Iterator it = pt_begin; it != pt_end; ++it) coordinates.push_back(it->z);
 	
-	std::sort(coordinates.begin(), coordinates.end());
-	
-	std::size_t n = coordinates.size();
-	float split_plane;
-	if(n % 2) split_plane = (coordinates[(n-1)/2] + coordinates[n/2]) / 2.0;
-	else split_plane = coordinates[n/2];
-	
-	return { split_plane };
+	return median_split_(coordinates);
 }
 
 
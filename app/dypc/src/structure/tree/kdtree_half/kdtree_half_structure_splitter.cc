@@ -14,6 +14,14 @@ std::ptrdiff_t kdtree_half_structure_splitter::node_child_for_point(const point&
 }
 
 
+void kdtree_half_structure_splitter::node_children_for_points(const float* x, const float* y, const float* z, std::size_t n, const cuboid& cub, const node_points_information& info, unsigned depth, std::uint8_t* children) {
+	unsigned dimension = depth % 3;
+	const float* coordinates = (dimension == 0 ? x : (dimension == 1 ? y : z));
+	const float c = cub.center()[dimension];
+	for(std::size_t i = 0; i < n; ++i) children[i] = !(coordinates[i] < c);
+}
+
+
 cuboid kdtree_half_structure_splitter::node_child_cuboid(const std::ptrdiff_t idx, const cuboid& cub, const node_points_information& info, unsigned depth) {
 	unsigned dimension = depth % 3;
 	float c = cub.center()[dimension];
@@ -0,0 +1,451 @@
+#ifndef DYPC_OCTREE_STRUCTURE_EXTERNAL_BUILDER_H_
+#define DYPC_OCTREE_STRUCTURE_EXTERNAL_BUILDER_H_
+
+#include "octree_structure_splitter.h"
+#include "../../mipmap_structure.h"
+#include "../hdf/tree_structure_hdf_file.h"
+#include "../../../progress.h"
+#include "../../../util.h"
+#include <string>
+#include <vector>
+#include <array>
+#include <fstream>
+#include <algorithm>
+#include <queue>
+#include <unordered_set>
+#include <functional>
+#include <memory>
+#include <cstdint>
+#include <stdexcept>
+
+namespace dypc {
+
+/**
+ * Builder that writes octree structure into HDF file, using bounded memory.
+ * Produces the same file format as write_to_hdf for octree_structure, readable by tree_structure_hdf_source. At most
+ * \a memory_cap points are held in memory at a time, regardless of model size, and no piece capacity needs to be chosen.
+ * Only a leaf at maximal depth, which cannot be split, can hold more than the leaf capacity and exceed this bound.
+ * Procedure:
+ * 1. Points are read from the model in runs. Each point gets the Morton key of its leaf at maximal depth, each run is
+ *    sorted by key and written into a scratch file.
+ * 2. The runs are merged into one sorted scratch file. During the merge, the number of points with each key prefix is
+ *    counted, to find out which nodes get split. When there are too many runs to give each one a read buffer, groups of
+ *    runs are merged first.
+ * 3. The sorted file is read once more. Now each node is a contiguous range of it, in the depth-first order of the file,
+ *    so the node table and the point sets are emitted in one streaming pass.
+ * Downsampled point sets are generated separately for each leaf, using the leaf cuboid as bounding area. The number of
+ * points each leaf contributes to a level is taken from the level size of all points read so far, so that the fractions
+ * carry over from leaf to leaf in key order, and each level gets the same size as when downsampling the whole model.
+ * @tparam Levels Number of downsampling levels.
+ */
+template<std::size_t Levels>
+class octree_structure_external_builder : public mipmap_structure {
+public:
+	using splitter = octree_structure_splitter;
+	using file_t = tree_structure_hdf_file<Levels, splitter::number_of_node_children>;
+	using hdf_node = typename file_t::hdf_node;
+
+	static constexpr std::size_t levels = Levels;
+
+private:
+	static constexpr unsigned maximal_depth_ = 21; ///< Maximal depth of tree. Morton key has 3 bits per depth.
+	static constexpr std::size_t minimal_buffer_size_ = 1024; ///< Minimal number of points in each read or output buffer.
+	static constexpr std::size_t maximal_output_buffer_size_ = 1 << 16; ///< Maximal number of points collected per level before writing to file.
+
+	/**
+	 * Point with Morton key, as stored in scratch files.
+	 */
+	struct morton_point {
+		std::uint64_t key;
+		point pt;
+	};
+
+	class run_reader;
+
+	const std::size_t leaf_capacity_;
+	const std::string scratch_directory_;
+	const std::size_t memory_capacity_;
+	cuboid root_cuboid_;
+
+	/**
+	 * Compute Morton key of point.
+	 * Obtained by descending the octree down to maximal depth using the splitter, so that key order and node membership
+	 * are always consistent with the node cuboids.
+	 */
+	std::uint64_t key_for_point_(const point& pt) const;
+
+	static std::uint64_t prefix_(std::uint64_t key, unsigned depth) { return key >> (3 * (maximal_depth_ - depth)); } ///< Key prefix of node at \a depth containing key.
+	static std::uint64_t node_id_(std::uint64_t prefix, unsigned depth) { return (std::uint64_t(1) << (3 * depth)) | prefix; } ///< Unique identifier of node, from its prefix and depth.
+
+	/// New scratch file with unique name, so that concurrent builds can share the scratch directory. Removed with the object.
+	temporary_file make_scratch_file_() const { return temporary_file(scratch_directory_, "dypc_octree"); }
+
+	/**
+	 * Smallest memory capacity that the builder uses.
+	 * Holds the points of a leaf with its downsampled point sets, and minimal buffers for emit_tree_. Also allows merges of
+	 * at least two runs.
+	 */
+	static std::size_t minimal_memory_capacity_(std::size_t leaf_cap) { return (Levels + 1) * leaf_cap + 4 * Levels * minimal_buffer_size_; }
+
+	/**
+	 * Merge sorted scratch files.
+	 * The memory capacity is divided among the read buffers of the inputs and the output buffer.
+	 * @param inputs Paths of the input files, at most memory_capacity_ / minimal_buffer_size_ - 1.
+	 * @param output Path of output file. If empty, the inputs are only read.
+	 * @param visit_key Function called with the key of each point, in sorted order.
+	 */
+	template<class Function>
+	void merge_files_(const std::vector<std::string>& inputs, const std::string& output, const Function& visit_key);
+
+	std::vector<temporary_file> write_sorted_runs_();
+	temporary_file merge_runs_(std::vector<temporary_file>& runs, std::unordered_set<std::uint64_t>& split_nodes);
+	void emit_tree_(const std::string& sorted, const std::unordered_set<std::uint64_t>& split_nodes, file_t& file);
+
+public:
+	/**
+	 * Create external memory octree builder.
+	 * @param leaf_cap Leaf capacity.
+	 * @param dmin Minimal number of points in downsampled point sets.
+	 * @param damount Downsampling amount.
+	 * @param dmode Downsampling mode.
+	 * @param mod The model.
+	 * @param scratch_dir Existing directory for temporary files. Needs space for about twice the model.
+	 * @param memory_cap Maximal number of points held in memory at a time. Raised if it is too small for \a leaf_cap.
+	 * @param additive Store downsampled levels additively.
+	 */
+	octree_structure_external_builder(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, const std::string& scratch_dir, std::size_t memory_cap, bool additive = false);
+
+	/**
+	 * Build the structure and write it into HDF file.
+	 * Scratch files are removed afterwards, also when the build fails.
+	 * @param filename Path of HDF file.
+	 * @param opt Storage options for the point sets.
+	 */
+	void write(const std::string& filename, const tree_structure_hdf_file_options& opt = tree_structure_hdf_file_options());
+};
+
+
+/**
+ * Buffered sequential reader of scratch file.
+ */
+template<std::size_t Levels>
+class octree_structure_external_builder<Levels>::run_reader {
+private:
+	std::ifstream file_;
+	std::vector<morton_point> buffer_;
+	std::size_t position_ = 0;
+	std::size_t size_ = 0;
+
+	void fill_() {
+		file_.read((char*)buffer_.data(), buffer_.size() * sizeof(morton_point));
+		size_ = file_.gcount() / sizeof(morton_point);
+		position_ = 0;
+	}
+
+public:
+	run_reader(const std::string& filename, std::size_t buffer_size) : file_(filename, std::ios::binary), buffer_(buffer_size) {
+		if(! file_) throw std::runtime_error("Could not open scratch file " + filename);
+		fill_();
+	}
+
+	bool empty() const { return (position_ == size_); }
+	const morton_point& front() const { return buffer_[position_]; }
+	void pop() { if(++position_ == size_) fill_(); }
+};
+
+
+template<std::size_t Levels>
+octree_structure_external_builder<Levels>::octree_structure_external_builder(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, const std::string& scratch_dir, std::size_t memory_cap, bool additive) :
+mipmap_structure(Levels, dmin, damount, dmode, false, additive, mod),
+leaf_capacity_(leaf_cap),
+scratch_directory_(scratch_dir),
+memory_capacity_(std::max(memory_cap, minimal_memory_capacity_(leaf_cap))),
+root_cuboid_(splitter::adjust_root_cuboid(mod.enclosing_cuboid())) { }
+
+
+template<std::size_t Levels>
+std::uint64_t octree_structure_external_builder<Levels>::key_for_point_(const point& pt) const {
+	splitter::node_points_information info;
+	cuboid cub = root_cuboid_;
+	std::uint64_t key = 0;
+	for(unsigned depth = 0; depth < maximal_depth_; ++depth) {
+		std::ptrdiff_t i = splitter::node_child_for_point(pt, cub, info, depth);
+		key = (key << 3) | i;
+		cub = splitter::node_child_cuboid(i, cub, info, depth);
+	}
+	return key;
+}
+
+
+template<std::size_t Levels>
+std::vector<temporary_file> octree_structure_external_builder<Levels>::write_sorted_runs_() {
+	std::vector<temporary_file> runs;
+	std::vector<morton_point> run;
+	run.reserve(memory_capacity_);
+
+	auto write_run = [&]() {
+		std::sort(run.begin(), run.end(), [](const morton_point& a, const morton_point& b) { return a.key < b.key; });
+		runs.push_back(make_scratch_file_());
+		const std::string& filename = runs.back().path();
+		std::ofstream file(filename, std::ios::binary);
+		file.write((const char*)run.data(), run.size() * sizeof(morton_point));
+		if(! file) throw std::runtime_error("Could not write scratch file " + filename);
+		run.clear();
+	};
+
+	progress_foreach(model_, "Sorting points by Morton key...", [&](const point& pt) {
+		run.push_back({ key_for_point_(pt), pt });
+		if(run.size() == memory_capacity_) write_run();
+	});
+	if(! run.empty() || runs.empty()) write_run();
+
+	return runs;
+}
+
+
+template<std::size_t Levels> template<class Function>
+void octree_structure_external_builder<Levels>::merge_files_(const std::vector<std::string>& inputs, const std::string& output_filename, const Function& visit_key) {
+	const bool write_output = ! output_filename.empty();
+	std::size_t buffer_size = std::max(memory_capacity_ / (inputs.size() + (write_output ? 1 : 0)), minimal_buffer_size_);
+
+	std::vector<std::unique_ptr<run_reader>> readers;
+	for(const std::string& input : inputs) readers.emplace_back(new run_reader(input, buffer_size));
+
+	using queue_entry = std::pair<std::uint64_t, std::size_t>;
+	std::priority_queue<queue_entry, std::vector<queue_entry>, std::greater<queue_entry>> queue;
+	for(std::size_t i = 0; i < readers.size(); ++i) if(! readers[i]->empty()) queue.emplace(readers[i]->front().key, i);
+
+	std::ofstream output;
+	std::vector<morton_point> output_buffer;
+	if(write_output) {
+		output.open(output_filename, std::ios::binary);
+		output_buffer.reserve(buffer_size);
+	}
+
+	while(! queue.empty()) {
+		std::size_t i = queue.top().second;
+		run_reader& reader = *readers[i];
+		queue.pop();
+
+		const morton_point& mpt = reader.front();
+		visit_key(mpt.key);
+		if(write_output) {
+			output_buffer.push_back(mpt);
+			if(output_buffer.size() == buffer_size) {
+				output.write((const char*)output_buffer.data(), output_buffer.size() * sizeof(morton_point));
+				output_buffer.clear();
+			}
+		}
+
+		reader.pop();
+		if(! reader.empty()) queue.emplace(reader.front().key, i);
+	}
+
+	if(write_output) {
+		output.write((const char*)output_buffer.data(), output_buffer.size() * sizeof(morton_point));
+		if(! output) throw std::runtime_error("Could not write scratch file " + output_filename);
+	}
+}
+
+
+template<std::size_t Levels>
+temporary_file octree_structure_external_builder<Levels>::merge_runs_(std::vector<temporary_file>& runs, std::unordered_set<std::uint64_t>& split_nodes) {
+	// Counters of points in the node at each depth along the path of the current key
+	std::array<std::size_t, maximal_depth_ + 1> counts;
+	counts.fill(0);
+	std::uint64_t previous_key = 0;
+
+	// Nodes deeper than depth are complete. Remember them if they need to be split. (Nodes at maximal depth cannot be split)
+	auto complete_nodes = [&](std::ptrdiff_t depth) {
+		for(std::ptrdiff_t d = maximal_depth_; d > depth; --d) {
+			if(d < maximal_depth_ && counts[d] > leaf_capacity_) split_nodes.insert(node_id_(prefix_(previous_key, d), d));
+			counts[d] = 0;
+		}
+	};
+	auto count_key = [&](std::uint64_t key) {
+		if(key != previous_key) {
+			std::ptrdiff_t common_depth = maximal_depth_;
+			while(prefix_(key, common_depth) != prefix_(previous_key, common_depth)) --common_depth;
+			complete_nodes(common_depth);
+		}
+		for(std::size_t& c : counts) ++c;
+		previous_key = key;
+	};
+
+	std::size_t total = total_number_of_points();
+
+	// Runs are merged in groups first, while there are too many to give each one a read buffer
+	const std::size_t maximal_inputs = memory_capacity_ / minimal_buffer_size_ - 1;
+	while(runs.size() > maximal_inputs) {
+		std::vector<temporary_file> merged_runs;
+		progress(100, "Merging groups of sorted runs...", [&](progress_handle& pr) {
+			for(std::size_t i = 0; i < runs.size(); i += maximal_inputs) {
+				std::size_t group_end = std::min(i + maximal_inputs, runs.size());
+				if(group_end - i == 1) {
+					merged_runs.push_back(std::move(runs[i]));
+				} else {
+					std::vector<std::string> group;
+					for(std::size_t j = i; j < group_end; ++j) group.push_back(runs[j].path());
+					merged_runs.push_back(make_scratch_file_());
+					merge_files_(group, merged_runs.back().path(), [](std::uint64_t) { });
+					for(std::size_t j = i; j < group_end; ++j) runs[j] = temporary_file(); // Remove merged runs early
+				}
+				pr.set(100 * group_end / runs.size());
+			}
+		});
+		runs = std::move(merged_runs);
+	}
+
+	temporary_file output_file = (runs.size() == 1 ? std::move(runs.front()) : make_scratch_file_());
+	const std::string& output_filename = output_file.path();
+
+	progress(100, "Merging sorted runs...", [&](progress_handle& pr) {
+		std::size_t count = 0;
+		auto visit_key = [&](std::uint64_t key) {
+			count_key(key);
+			if(++count % (1 << 20) == 0 && total) pr.set(100 * count / total);
+		};
+		if(runs.size() == 1) {
+			merge_files_({ output_filename }, std::string(), visit_key);
+		} else {
+			std::vector<std::string> inputs;
+			for(const temporary_file& run : runs) inputs.push_back(run.path());
+			merge_files_(inputs, output_filename, visit_key);
+		}
+	});
+	complete_nodes(-1);
+
+	runs.clear();
+
+	return output_file;
+}
+
+
+template<std::size_t Levels>
+void octree_structure_external_builder<Levels>::emit_tree_(const std::string& sorted, const std::unordered_set<std::uint64_t>& split_nodes, file_t& file) {
+	using points_container_t = std::vector<point>;
+
+	// Memory capacity is split into the points of the current leaf with its downsampled point sets, and shares for the
+	// read buffer, the output buffers of all levels, and the write queue. The queue gets two shares, because its writer
+	// thread may copy queued segments to merge them.
+	const std::size_t share = (memory_capacity_ - (Levels + 1) * leaf_capacity_) / 4;
+	const std::size_t output_buffer_size = std::min(share / Levels, maximal_output_buffer_size_);
+
+	run_reader input(sorted, share);
+	std::vector<hdf_node> nodes;
+
+	// Points of each level are collected in buffers and handed to the writer thread in larger segments,
+	// so that reading the sorted file and downsampling continues while they get written.
+	typename file_t::points_write_queue write_queue(file.points_writer(), share);
+	std::array<points_container_t, Levels> output_buffers;
+	std::array<hsize_t, Levels> output_offsets; // Offset in file of start of output buffer
+	output_offsets.fill(0);
+	auto output_size = [&](std::ptrdiff_t lvl) { return output_offsets[lvl] + output_buffers[lvl].size(); };
+	auto flush = [&](std::ptrdiff_t lvl) {
+		auto& buf = output_buffers[lvl];
+		if(buf.empty()) return;
+		std::size_t n = buf.size();
+		write_queue.enqueue(lvl, output_offsets[lvl], std::move(buf));
+		output_offsets[lvl] += n;
+		buf = points_container_t();
+	};
+	auto output = [&](const points_container_t& pts, std::ptrdiff_t lvl) {
+		auto& buf = output_buffers[lvl];
+		if(buf.size() + pts.size() > output_buffer_size) flush(lvl);
+		buf.insert(buf.end(), pts.begin(), pts.end());
+	};
+
+	// Number of points of level lvl that the current leaf must add, once count points have been read.
+	// Points stored at levels lvl and above all belong to level lvl when it is stored additively.
+	auto leaf_level_size = [&](std::size_t count, std::ptrdiff_t lvl)->std::size_t {
+		std::size_t expected = downsampling_expected_number_of_points_(count, lvl);
+		std::size_t level_size = output_size(lvl);
+		if(additive_downsampling_) for(std::ptrdiff_t l = lvl + 1; l < Levels; ++l) level_size += output_size(l);
+		return (expected > level_size ? expected - level_size : 0);
+	};
+
+	progress(100, "Writing tree structure nodes...", [&](progress_handle& pr) {
+		std::size_t total = total_number_of_points();
+		std::size_t count = 0;
+
+		std::function<std::ptrdiff_t(std::uint64_t, unsigned, const cuboid&)> emit_node =
+		[&](std::uint64_t prefix, unsigned depth, const cuboid& cub)->std::ptrdiff_t {
+			std::ptrdiff_t this_node_offset = nodes.size();
+			nodes.push_back(hdf_node());
+
+			std::array<hsize_t, Levels> start;
+			for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) start[lvl] = output_size(lvl);
+
+			std::array<std::ptrdiff_t, splitter::number_of_node_children> children;
+			children.fill(0);
+
+			if(split_nodes.count(node_id_(prefix, depth))) {
+				// Child nodes follow in depth-first order, like the points in the sorted file
+				splitter::node_points_information info;
+				for(std::ptrdiff_t i = 0; i < splitter::number_of_node_children; ++i) {
+					cuboid child_cub = splitter::node_child_cuboid(i, cub, info, depth);
+					children[i] = emit_node((prefix << 3) | i, depth + 1, child_cub);
+				}
+			} else {
+				// Leaf: Its points are the next ones in the sorted file with this prefix
+				points_container_t pts;
+				while(! input.empty() && prefix_(input.front().key, depth) == prefix) {
+					pts.push_back(input.front().pt);
+					input.pop();
+				}
+				count += pts.size();
+
+				if(additive_downsampling_) {
+					std::array<std::size_t, Levels> expected;
+					for(std::ptrdiff_t lvl = 1; lvl < Levels; ++lvl) expected[lvl] = leaf_level_size(count, lvl);
+					std::array<points_container_t, Levels> level_points;
+					additive_downsample_points_to_(pts, cub, level_points.data(), expected.data());
+					for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) output(level_points[lvl], lvl);
+				} else {
+					output(pts, 0);
+					uniform_downsampling_previous_results_t previous_results;
+					for(std::ptrdiff_t lvl = 1; lvl < Levels; ++lvl) {
+						points_container_t downsampled;
+						downsample_points_to_(pts.begin(), pts.end(), leaf_level_size(count, lvl), cub, downsampled, previous_results);
+						output(downsampled, lvl);
+					}
+				}
+				if(total) pr.set(100 * count / total);
+			}
+
+			hdf_node& hn = nodes[this_node_offset];
+			hn.cuboid_origin = cub.origin;
+			hn.cuboid_extremity = cub.extremity;
+			for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) {
+				hn.data_start[lvl] = start[lvl];
+				hn.data_length[lvl] = output_size(lvl) - start[lvl];
+			}
+			for(std::ptrdiff_t i = 0; i < splitter::number_of_node_children; ++i) hn.children[i] = children[i];
+
+			return this_node_offset;
+		};
+
+		emit_node(0, 0, root_cuboid_);
+	});
+
+	for(std::ptrdiff_t lvl = 0; lvl < Levels; ++lvl) flush(lvl);
+	write_queue.finish();
+	file.write_nodes(nodes.begin(), nodes.end());
+	file.set_additive(additive_downsampling_);
+}
+
+
+template<std::size_t Levels>
+void octree_structure_external_builder<Levels>::write(const std::string& filename, const tree_structure_hdf_file_options& opt) {
+	std::vector<temporary_file> runs = write_sorted_runs_();
+
+	std::unordered_set<std::uint64_t> split_nodes;
+	temporary_file sorted = merge_runs_(runs, split_nodes);
+
+	file_t file(filename, total_number_of_points(), opt, leaf_capacity_);
+	emit_tree_(sorted.path(), split_nodes, file);
+}
+
+}
+
+#endif
@@ -31,6 +31,13 @@ std::ptrdiff_t octree_structure_splitter::node_child_for_point(const point& pt,
 	return idx;
 }
 
+void octree_structure_splitter::node_children_for_points(const float* x, const float* y, const float* z, std::size_t n, const cuboid& cub, const node_points_information& info, unsigned depth, std::uint8_t* children) {
+	glm::vec3 c = cub.center();
+	const float cx = c[0], cy = c[1], cz = c[2];
+	for(std::size_t i = 0; i < n; ++i)
+		children[i] = (x[i] >= cx) | ((y[i] >= cy) << 1) | ((z[i] >= cz) << 2);
+}
+
 cuboid octree_structure_splitter::node_child_cuboid(const std::ptrdiff_t idx, const cuboid& cub, const node_points_information& info, unsigned depth) {
 	// Generate child cuboid/cube.
 	// Important: The cuboids are stored as origin+extremity vectors. This procedure does not change the origin, or does not change the extremity floating point value, and so no errors due to floating point imprecision can occur on the borders of the cube. That is, the cube will always contain the points when node_child_for_point says they do.
@@ -15,6 +15,7 @@ public:
 	static cuboid adjust_root_cuboid(const cuboid& cub);	
 	static std::ptrdiff_t node_child_for_point(const point& pt, const cuboid& cub, const node_points_information& info, unsigned depth);
 	static cuboid node_child_cuboid(const std::ptrdiff_t i, const cuboid& cub, const node_points_information& info, unsigned depth);
+	static void node_children_for_points(const float* x, const float* y, const float* z, std::size_t n, const cuboid& cub, const node_points_information& info, unsigned depth, std::uint8_t* children);
 	using tree_structure_splitter::compute_node_points_information;
 };
 
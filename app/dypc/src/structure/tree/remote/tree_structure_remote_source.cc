@@ -0,0 +1,95 @@
+#include "tree_structure_remote_source.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+namespace dypc {
+
+constexpr std::size_t tree_structure_remote_source::maximal_blocks_per_request_;
+
+
+tree_structure_remote_source::tree_structure_remote_source(const std::string& address) :
+	tree_structure_remote_source(new remote_client(address)) { }
+
+
+tree_structure_remote_source::tree_structure_remote_source(remote_client* client) :
+tree_structure_source(client->get_info().levels, client->get_info().number_of_children, client->get_info().additive), client_(client) {
+	if(levels() == 0 || number_of_node_children() == 0) throw std::invalid_argument("Server does not serve a tree structure");
+	read_nodes_();
+}
+
+
+void tree_structure_remote_source::read_nodes_() {
+	const std::size_t n = client_->get_info().number_of_nodes;
+	const std::size_t lvls = levels(), nchl = number_of_node_children();
+	const std::size_t record_size = remote_protocol::node_record_size(lvls, nchl);
+	
+	std::vector<std::uint8_t> records(n * record_size);
+	client_->read_nodes(0, n, records.data());
+	
+	nodes_.reserve(n);
+	number_of_points_.resize(n * lvls);
+	children_.resize(n * nchl);
+	const std::uint8_t* rec = records.data();
+	for(std::size_t index = 0; index < n; ++index) {
+		cuboid cub;
+		std::memcpy(&cub.origin[0], rec, 3*sizeof(float));
+		std::memcpy(&cub.extremity[0], rec + 3*sizeof(float), 3*sizeof(float));
+		rec += 6*sizeof(float);
+		std::memcpy(number_of_points_.data() + index*lvls, rec, lvls*sizeof(std::uint64_t));
+		rec += lvls*sizeof(std::uint64_t);
+		std::memcpy(children_.data() + index*nchl, rec, nchl*sizeof(std::uint32_t));
+		rec += nchl*sizeof(std::uint32_t);
+		
+		for(std::ptrdiff_t i = 0; i < nchl; ++i)
+			if(children_[index*nchl + i] >= n) throw std::runtime_error("Invalid node record from server");
+		nodes_.emplace_back(*this, index, cub);
+	}
+}
+
+
+std::size_t tree_structure_remote_source::memory_size() const {
+	return nodes_.size()*sizeof(node) + number_of_points_.size()*sizeof(std::uint64_t) + children_.size()*sizeof(std::uint32_t);
+}
+
+
+std::size_t tree_structure_remote_source::extract_blocks(const std::vector<block>& blocks, point_buffer_t buffer, std::vector<std::size_t>& counts) const {
+	counts.clear();
+	std::size_t total = 0;
+	std::vector<remote_protocol::block_request> requests;
+	std::vector<std::size_t> request_counts;
+	for(std::size_t first = 0; first < blocks.size(); first += maximal_blocks_per_request_) {
+		std::size_t last = std::min(first + maximal_blocks_per_request_, blocks.size());
+		requests.clear();
+		for(std::size_t i = first; i < last; ++i) {
+			const node& nd = static_cast<const node&>(*blocks[i].block_node);
+			requests.push_back(remote_protocol::block_request { nd.index_, std::uint32_t(blocks[i].level), std::min(blocks[i].capacity, nd.number_of_points(blocks[i].level)) });
+		}
+		total += client_->read_blocks(requests, buffer + total, request_counts);
+		counts.insert(counts.end(), request_counts.begin(), request_counts.end());
+	}
+	return total;
+}
+
+
+std::size_t tree_structure_remote_source::node::extract_points(point_buffer_t buffer, std::size_t capacity, std::ptrdiff_t lvl) const {
+	capacity = std::min(capacity, number_of_points(lvl));
+	if(capacity == 0) return 0;
+	return source_.client_->read_block(index_, lvl, buffer, capacity);
+}
+
+
+bool tree_structure_remote_source::node::is_leaf() const {
+	for(std::ptrdiff_t i = 0; i < source_.number_of_node_children(); ++i) if(has_child(i)) return false;
+	return true;
+}
+
+
+std::ptrdiff_t tree_structure_remote_source::node::child_for_point(glm::vec3 pt) const {
+	for(std::ptrdiff_t i = 0; i < source_.number_of_node_children(); ++i) {
+		if(has_child(i) && child(i).node_cuboid().in_range(pt)) return i;
+	}
+	return no_child_index;
+}
+
+}
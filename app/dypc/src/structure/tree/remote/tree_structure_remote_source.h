@@ -0,0 +1,77 @@
+#ifndef DYPC_TREE_STRUCTURE_REMOTE_SOURCE_H_
+#define DYPC_TREE_STRUCTURE_REMOTE_SOURCE_H_
+
+#include "../tree_structure_source.h"
+#include "../../../remote/remote_client.h"
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace dypc {
+
+/**
+ * Tree structure source that reads from a structure_server.
+ * The node records of the whole tree are read when connecting, so that loaders traverse the tree locally, and only
+ * the point blocks get requested from the server. Loaders collect the blocks of a traversal and read them through
+ * extract_blocks, which needs one request per maximal_blocks_per_request_ blocks, while each extract_points call is
+ * one request. The client connection serializes concurrent requests from loader sessions.
+ */
+class tree_structure_remote_source : public tree_structure_source {
+public:
+	class node : public tree_structure_source::node {
+		friend class tree_structure_remote_source;
+		
+	private:
+		const tree_structure_remote_source& source_;
+		std::uint32_t index_;
+		cuboid cuboid_;
+
+		std::uint32_t child_index_(std::ptrdiff_t i) const { return source_.children_[index_*source_.number_of_node_children() + i]; }
+
+	public:
+		node(const tree_structure_remote_source& src, std::uint32_t index, const cuboid& cub) : source_(src), index_(index), cuboid_(cub) { }
+
+		std::size_t number_of_points(std::ptrdiff_t lvl = 0) const override { return source_.number_of_points_[index_*source_.levels() + lvl]; }
+		std::size_t extract_points(point_buffer_t buffer, std::size_t capacity, std::ptrdiff_t lvl = 0) const override;
+
+		bool is_leaf() const override;
+		bool has_child(std::ptrdiff_t i) const override { return child_index_(i) != 0; }
+		const node& child(std::ptrdiff_t i) const override { return source_.nodes_[child_index_(i)]; }
+		
+		std::ptrdiff_t child_for_point(glm::vec3 pt) const override;
+		cuboid node_cuboid() const override { return cuboid_; }
+	};
+
+private:
+	static constexpr std::size_t maximal_blocks_per_request_ = 4096; ///< Keeps requests well below the server's maximal message size.
+	
+	std::unique_ptr<remote_client> client_;
+	std::vector<node> nodes_; ///< Nodes in the server's depth-first order.
+	std::vector<std::uint64_t> number_of_points_; ///< Number of points of each node at each level.
+	std::vector<std::uint32_t> children_; ///< Child indices of each node, 0 for none.
+	
+	explicit tree_structure_remote_source(remote_client* client);
+	void read_nodes_();
+
+public:
+	/**
+	 * Connect to server.
+	 * @param address Socket address of the server. @see listen_remote_socket
+	 */
+	explicit tree_structure_remote_source(const std::string& address);
+	
+	const node& root_node() const override { return nodes_.front(); }
+	std::size_t number_of_nodes() const override { return nodes_.size(); }
+	std::size_t memory_size() const override;
+	std::size_t rom_size() const override { return 0; }
+	
+	std::size_t extract_blocks(const std::vector<block>& blocks, point_buffer_t buffer, std::vector<std::size_t>& counts) const override;
+	bool batches_extraction() const override { return true; }
+	
+	remote_client& client() const { return *client_; }
+};
+
+}
+
+#endif
@@ -16,6 +16,7 @@
 #include <vector>
 #include <utility>
 #include <array>
+#include <thread>
 
 namespace dypc {
 
@@ -23,7 +24,7 @@ namespace dypc {
  * Tree structure where the model is recursively subdivided into cuboid regions.
  * @tparam Splitter Tree structure splitter which defines how space is subdivided into cuboids.
  * @tparam Levels Mipmap levels of downsampling to generate.
- * @tparam PointsContainer Container used to store arrays of points.
+ * @tparam PointsContainer Container used to store arrays of points. std::vector, std::deque, or point_soa_container.
  */
 template<class Splitter, std::size_t Levels, class PointsContainer = std::vector<point>>
 class tree_structure : public mipmap_structure {
@@ -52,9 +53,10 @@ protected:
 	 * @param dmode Downsampling mode.
 	 * @param mod The model, must exist during lifetime of tree structure.
 	 * @param exact_downsampling If true, generate predictable number of downsampled points.
+	 * @param additive_downsampling If true, store downsampled points additively.
 	 * @param no_load Marker.
 	 */
-	tree_structure(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, bool exact_downsampling, no_load_t no_load) : mipmap_structure(Levels, dmin, damount, dmode, exact_downsampling, mod), leaf_capacity_(leaf_cap) { }
+	tree_structure(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, bool exact_downsampling, bool additive_downsampling, no_load_t no_load) : mipmap_structure(Levels, dmin, damount, dmode, exact_downsampling, additive_downsampling, mod), leaf_capacity_(leaf_cap) { }
 	
 	/**
 	 * Unload model.
@@ -65,6 +67,7 @@ protected:
 	/**
 	 * Load model.
 	 * Load points from model and create tree nodes. Can be restricted to cuboid region of model (for piecewise tree @see tree_structure_piecewise).
+	 * With additive downsampling, also generates all downsampled levels.
 	 * @param cub Cuboid within which to load.
 	 */
 	void load_(const cuboid& cub);
@@ -81,8 +84,9 @@ public:
 	 * @param cub Cuboid defining portion of model to load.
 	 * @param load_all_downsampled If true, also load all levels of downsampled points.
 	 * @param exact_downsampling If true, generate predictable number of downsampled points.
+	 * @param additive_downsampling If true, store downsampled points additively. Then all levels are always loaded.
 	 */
-	tree_structure(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, const cuboid& cub, bool load_all_downsampled = true, bool exact_downsampling = false);
+	tree_structure(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, const cuboid& cub, bool load_all_downsampled = true, bool exact_downsampling = false, bool additive_downsampling = false);
 	
 	
 	/**
@@ -95,9 +99,10 @@ public:
 	 * @param mod The model, must exist during lifetime of tree structure.
 	 * @param load_all_downsampled If true, also load all levels of downsampled points.
 	 * @param exact_downsampling If true, generate predictable number of downsampled points.
+	 * @param additive_downsampling If true, store downsampled points additively. Then all levels are always loaded.
 	 */
-	tree_structure(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, bool load_all_downsampled = true, bool exact_downsampling = false) :
-	tree_structure(leaf_cap, dmin, damount, dmode, mod, mod.enclosing_cuboid(), load_all_downsampled, exact_downsampling) { }	
+	tree_structure(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, bool load_all_downsampled = true, bool exact_downsampling = false, bool additive_downsampling = false) :
+	tree_structure(leaf_cap, dmin, damount, dmode, mod, mod.enclosing_cuboid(), load_all_downsampled, exact_downsampling, additive_downsampling) { }	
 	
 	
 	/**
@@ -110,11 +115,16 @@ public:
 	
 	/**
 	 * Get number of points for given level.
-	 * Returns 0 when points at that level are not loader
+	 * Returns 0 when points at that level are not loader. With additive downsampling, only the points stored for that level are counted.
 	 * @param lvl Mipmap level, 0 for not downsampled.
 	 */
 	std::size_t number_of_points(std::ptrdiff_t lvl = 0) const { assert(lvl >= 0 && lvl < levels); return all_points_[lvl].size(); }
 	
+	/**
+	 * Get maximal number of points per node.
+	 */
+	std::size_t leaf_capacity() const { return leaf_capacity_; }
+	
 	/**
 	 * Get total number of nodes in tree.
 	 */
@@ -127,10 +137,12 @@ public:
 	
 	/**
 	 * Generate downsampled points for given level.
+	 * Does nothing with additive downsampling, where all levels are generated on load.
 	 * @param lvl Mipmap level, must be larger than 0.
 	 * @param previous_results Previous results information for use by downsampling algorithm.
+	 * @param number_of_threads Threads that downsampling may use. Callers that already run on several threads pass their share.
 	 */
-	void load_downsampled_points(std::ptrdiff_t lvl, uniform_downsampling_previous_results_t& previous_results);
+	void load_downsampled_points(std::ptrdiff_t lvl, uniform_downsampling_previous_results_t& previous_results, std::size_t number_of_threads = std::thread::hardware_concurrency());
 	
 	/**
 	 * Generate downsampled points for given level.
@@ -183,23 +195,25 @@ void tree_structure<Splitter, Levels, PointsContainer>::unload_() {
 
 
 template<class Splitter, std::size_t Levels, class PointsContainer>
-tree_structure<Splitter, Levels, PointsContainer>::tree_structure(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, const cuboid& cub, bool load_all_downsampled, bool exact_downsampling) :
-mipmap_structure(Levels, dmin, damount, dmode, exact_downsampling, mod), leaf_capacity_(leaf_cap) {
+tree_structure<Splitter, Levels, PointsContainer>::tree_structure(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, const cuboid& cub, bool load_all_downsampled, bool exact_downsampling, bool additive_downsampling) :
+mipmap_structure(Levels, dmin, damount, dmode, exact_downsampling, additive_downsampling, mod), leaf_capacity_(leaf_cap) {
 	load_(cub);
 	if(load_all_downsampled) for(std::ptrdiff_t lvl = 1; lvl < Levels; ++lvl) load_downsampled_points(lvl);
 }
 
 
 template<class Splitter, std::size_t Levels, class PointsContainer>
-void tree_structure<Splitter, Levels, PointsContainer>::load_downsampled_points(std::ptrdiff_t lvl, uniform_downsampling_previous_results_t& previous_results) {
+void tree_structure<Splitter, Levels, PointsContainer>::load_downsampled_points(std::ptrdiff_t lvl, uniform_downsampling_previous_results_t& previous_results, std::size_t number_of_threads) {
 	assert(lvl >= 1 && lvl < Levels);
+	if(additive_downsampling_) return; // Already generated by load_
+	build_stage stage("Generating downsampled level " + std::to_string(lvl) + "...");
 
 	PointsContainer downsampled; // Will hold unordered downsampled points
 	const auto& original_points = all_points_[0];
 	auto& level_points = all_points_[lvl]; // Will hold ordered downsampled points
 	
 	// Call downsampling algorithm
-	downsample_points_(original_points.begin(), original_points.end(), lvl, root_cuboid_, downsampled, previous_results);
+	downsample_points_(original_points.begin(), original_points.end(), lvl, root_cuboid_, downsampled, previous_results, number_of_threads);
 	
 	// Add points into root node
 	progress("Adding downsampled points, level " + std::to_string(lvl) + "...", [&](progress_handle& pr) {
@@ -235,6 +249,22 @@ void tree_structure<Splitter, Levels, PointsContainer>::load_(const cuboid& cub)
 	progress("Adding points and building tree...", [&](progress_handle& pr) {
 		root_.add_root_node_points(0, all_points_[0], all_points_unordered, root_cuboid_, leaf_capacity_);
 	});
+	
+	if(! additive_downsampling_) return;
+	
+	// Additive downsampling: The tree was built using all points, but level 0 stores only the points that are in no
+	// downsampled level. Nodes still reference the full point set until level 0 is replaced, but don't get accessed before that.
+	std::array<PointsContainer, Levels> level_points_unordered;
+	PointsContainer full_points;
+	full_points.swap(all_points_[0]);
+	additive_downsample_points_(full_points, root_cuboid_, level_points_unordered.data());
+	
+	progress("Adding additive downsampled points...", [&](progress_handle& pr) {
+		// Higher levels first, because add_root_node_points requires level 0 to be non-empty
+		for(std::ptrdiff_t lvl = 1; lvl < Levels; ++lvl)
+			root_.add_root_node_points(lvl, all_points_[lvl], level_points_unordered[lvl], root_cuboid_, leaf_capacity_);
+		root_.replace_root_node_points(0, all_points_[0], level_points_unordered[0], root_cuboid_, leaf_capacity_);
+	});
 }
 
 
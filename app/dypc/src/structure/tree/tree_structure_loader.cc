@@ -4,11 +4,17 @@
 
 namespace dypc {
 
-std::ptrdiff_t tree_structure_loader::action_for_node_(const cuboid& cub, std::size_t number_of_points, bool is_leaf, const loader::request_t& req, std::size_t levels) const {
-	auto intersection = req.view_frustum.contains_cuboid(cub);
+std::ptrdiff_t tree_structure_loader::action_for_node_(const tree_structure_source::node& nd, const loader::request_t& req, std::size_t levels, frustum::intersection_t& intersection) const {
+	const cuboid cub = nd.node_cuboid();
+	const std::size_t number_of_points = nd.number_of_points();
+	const bool is_leaf = nd.is_leaf();
+
+	intersection = req.view_frustum.contains_cuboid(cub);
 	
 	if(intersection == frustum::outside_frustum) {
 		return action_skip;
+	} else if(occlusion_culling_ && occlusion_buffer_.cuboid_occluded(cub)) {
+		return action_skip;
 	} else if(intersection == frustum::partially_inside_frustum && !is_leaf && number_of_points >= minimal_number_of_points_for_split_) {
 		return action_split;
 	} else if(levels <= 1) {
@@ -20,11 +26,113 @@ std::ptrdiff_t tree_structure_loader::action_for_node_(const cuboid& cub, std::s
 	
 	if(	! is_leaf && maximal_distance - minimal_distance > additional_split_distance_difference_) return action_split;
 	
+	if(lod_selection_ == lod_selection_mode::screen_space_error && req.viewport_height > 0)
+		return choose_screen_space_error_level_(nd, cub, req, levels);
+	
 	float distance = cuboid_distance_(req.position, cub, minimal_distance, maximal_distance, downsampling_node_distance_);
 	return choose_downsampling_level(levels, distance, downsampling_setting_);
 }
 
 
+void tree_structure_loader::begin_occlusion_culling_(const loader::request_t& req) const {
+	if(occlusion_culling_) occlusion_buffer_.clear(req.view_projection_matrix);
+}
+
+
+std::size_t tree_structure_loader::extract_node_level_points_(const tree_structure_source::node& nd, const loader::request_t& req, point_buffer_t points, std::size_t capacity, std::size_t lvl, frustum::intersection_t intersection) const {
+	if(collected_blocks_) {
+		std::size_t n = std::min(capacity, nd.number_of_points(lvl));
+		if(n) collected_blocks_->push_back(tree_structure_source::block { &nd, std::ptrdiff_t(lvl), n });
+		return n;
+	}
+	
+	std::size_t n = extract_source_points_(nd, points, capacity, lvl);
+	if(point_culling_ && intersection == frustum::partially_inside_frustum)
+		n = req.view_frustum.filter_points(points, n);
+	if(occlusion_culling_) occlusion_buffer_.add_points(points, n);
+	if(output_writer_) output_writer_->convert(points - output_writer_->buffer(), n);
+	return n;
+}
+
+
+void tree_structure_loader::compute_points_in_layout_(const request_t& request, point_buffer_t points, std::size_t& count, std::size_t capacity, output_layout layout, std::vector<std::uint8_t>& scratch) {
+	output_layout_writer writer(points, capacity, layout, request.position, scratch);
+	output_writer_ = &writer;
+	try {
+		compute_points(request, points, count, capacity);
+	} catch(...) {
+		output_writer_ = nullptr;
+		throw;
+	}
+	output_writer_ = nullptr;
+	writer.finish(count);
+}
+
+
+std::size_t tree_structure_loader::extract_source_points_(const tree_structure_source::node& nd, point_buffer_t points, std::size_t capacity, std::ptrdiff_t lvl) const {
+	if(! prefetched_blocks_.empty()) {
+		auto it = prefetched_blocks_.find(block_key_(&nd, lvl));
+		// Prefetched block may have been read with a smaller capacity
+		if(it != prefetched_blocks_.end() && std::min(capacity, nd.number_of_points(lvl)) <= it->second.second) {
+			std::size_t n = std::min(capacity, it->second.second);
+			std::copy_n(prefetched_points_.data() + it->second.first, n, points);
+			return n;
+		}
+	}
+	return nd.extract_points(points, capacity, lvl);
+}
+
+
+void tree_structure_loader::prefetch_blocks_(const std::vector<tree_structure_source::block>& blocks) const {
+	clear_prefetched_blocks_();
+	if(! source_->batches_extraction() || blocks.empty()) return;
+	
+	std::size_t total_capacity = 0;
+	for(const tree_structure_source::block& b : blocks) total_capacity += b.capacity;
+	prefetched_points_.resize(total_capacity);
+	std::vector<std::size_t> counts;
+	source_->extract_blocks(blocks, prefetched_points_.data(), counts);
+	
+	std::size_t offset = 0;
+	for(std::size_t i = 0; i < blocks.size(); ++i) {
+		prefetched_blocks_[block_key_(blocks[i].block_node, blocks[i].level)] = std::make_pair(offset, counts[i]);
+		offset += counts[i];
+	}
+}
+
+
+void tree_structure_loader::clear_prefetched_blocks_() const {
+	prefetched_blocks_.clear();
+	prefetched_points_.clear();
+}
+
+
+std::ptrdiff_t tree_structure_loader::choose_screen_space_error_level_(const tree_structure_source::node& nd, const cuboid& cub, const loader::request_t& req, std::size_t levels) const {
+	const glm::mat4& mat = req.view_projection_matrix;
+	
+	// Point of cuboid closest to camera, where the projected spacing is largest
+	glm::vec3 closest = glm::min(glm::max(req.position, cub.origin), cub.extremity);
+	
+	// Clip space w at that point (= depth in view space), and vertical scale factor of projection
+	float w = mat[0][3]*closest.x + mat[1][3]*closest.y + mat[2][3]*closest.z + mat[3][3];
+	if(w <= float_comparison_epsilon) return 0; // Camera is inside or at the node
+	float vertical_scale = glm::length(glm::vec3(mat[0][1], mat[1][1], mat[2][1]));
+	float pixels_per_unit = vertical_scale / w * req.viewport_height / 2.0;
+	
+	// Points are assumed to lie on a surface, whose area is estimated from the two largest cuboid side lengths
+	glm::vec3 sides = cub.side_lengths();
+	float surface_area = std::max({ sides.x*sides.y, sides.y*sides.z, sides.x*sides.z });
+	
+	for(std::ptrdiff_t lvl = levels - 1; lvl > 0; --lvl) {
+		std::size_t n = nd.number_of_points(lvl);
+		if(n == 0) continue;
+		float spacing = std::sqrt(surface_area / n);
+		if(spacing * pixels_per_unit <= screen_space_error_threshold_) return lvl;
+	}
+	return 0;
+}
+
+
 float tree_structure_loader::cuboid_distance_(glm::vec3 position, const cuboid& cub, float min_dist, float max_dist, cuboid_distance_mode type) const {
 	switch(type) {
 		case cuboid_distance_mode::minimal: return min_dist;
@@ -50,10 +158,38 @@ float tree_structure_loader::cuboid_distance_(glm::vec3 position, const cuboid&
 }
 
 
+tree_structure_loader::source_traversal_::source_traversal_(const tree_structure_loader& ld) : source_(*ld.source_) {
+	std::uint64_t epoch = source_.begin_traversal();
+	released_ = (epoch != ld.source_epoch_);
+	ld.source_epoch_ = epoch;
+}
+
+
+void tree_structure_loader::init_session_(tree_structure_loader& session) const {
+	downsampling_loader::init_session_(session);
+	session.minimal_number_of_points_for_split_ = minimal_number_of_points_for_split_;
+	session.downsampling_node_distance_ = downsampling_node_distance_;
+	session.additional_split_distance_difference_ = additional_split_distance_difference_;
+	session.lod_selection_ = lod_selection_;
+	session.screen_space_error_threshold_ = screen_space_error_threshold_;
+	session.occlusion_culling_ = occlusion_culling_;
+	session.point_culling_ = point_culling_;
+	session.occlusion_buffer_ = occlusion_buffer_;
+	session.source_ = source_;
+	session.updated_source_();
+}
+
+
 double tree_structure_loader::get_setting(const std::string& setting) const {
 	if(setting == "minimal_number_of_points_for_split") return minimal_number_of_points_for_split_;
 	else if(setting == "downsampling_node_distance") return (double)downsampling_node_distance_;
 	else if(setting == "additional_split_distance_difference") return additional_split_distance_difference_;
+	else if(setting == "lod_selection") return (double)lod_selection_;
+	else if(setting == "screen_space_error_threshold") return screen_space_error_threshold_;
+	else if(setting == "occlusion_culling") return occlusion_culling_ ? 1.0 : 0.0;
+	else if(setting == "occlusion_buffer_size") return occlusion_buffer_.width();
+	else if(setting == "occlusion_minimal_coverage") return occlusion_buffer_.minimal_coverage();
+	else if(setting == "point_culling") return point_culling_ ? 1.0 : 0.0;
 	else return downsampling_loader::get_setting(setting);
 }
 
@@ -61,6 +197,12 @@ void tree_structure_loader::set_setting(const std::string& setting, double value
 	if(setting == "minimal_number_of_points_for_split") minimal_number_of_points_for_split_ = value;
 	else if(setting == "downsampling_node_distance") downsampling_node_distance_ = (cuboid_distance_mode)value;
 	else if(setting == "additional_split_distance_difference") additional_split_distance_difference_ = value;
+	else if(setting == "lod_selection") lod_selection_ = (lod_selection_mode)value;
+	else if(setting == "screen_space_error_threshold") screen_space_error_threshold_ = value;
+	else if(setting == "occlusion_culling") occlusion_culling_ = (value != 0.0);
+	else if(setting == "occlusion_buffer_size") occlusion_buffer_.resize(value, value);
+	else if(setting == "occlusion_minimal_coverage") occlusion_buffer_.set_minimal_coverage(value);
+	else if(setting == "point_culling") point_culling_ = (value != 0.0);
 	else downsampling_loader::set_setting(setting, value);
 }
 
@@ -4,9 +4,14 @@
 #include "tree_structure.h"
 #include "tree_structure_source.h"
 #include "../../loader/downsampling_loader.h"
+#include "../../loader/occlusion_buffer.h"
+#include "../../loader/output_layout.h"
 #include "../../enums.h"
 #include <memory>
 #include <utility>
+#include <vector>
+#include <map>
+#include <cstdint>
 
 namespace dypc {
 
@@ -21,6 +26,28 @@ private:
 	std::size_t minimal_number_of_points_for_split_ = 1000; ///< Minimal number of points for node to be split.
 	cuboid_distance_mode downsampling_node_distance_ = cuboid_distance_mode::center; ///< Point-to-cuboid distance setting.
 	float additional_split_distance_difference_ = 25; ///< Minimal min-max distance difference to enforce additional split.
+	lod_selection_mode lod_selection_ = lod_selection_mode::distance; ///< How downsampling level of node is chosen.
+	float screen_space_error_threshold_ = 2.0; ///< Maximal projected point spacing in pixels, for screen space error LOD selection.
+	bool occlusion_culling_ = false; ///< Whether nodes hidden behind already outputted points are skipped.
+	bool point_culling_ = false; ///< Whether points of partially visible nodes are tested individually against the frustum.
+	
+	/**
+	 * Depth buffer for occlusion culling.
+	 * Mutable because it gets filled during the (const) traversal of the tree, and is reset for each request.
+	 */
+	mutable occlusion_buffer occlusion_buffer_;
+	
+	mutable std::uint64_t source_epoch_ = 0; ///< Release epoch of source at the last traversal. @see tree_structure_source::begin_traversal
+	
+	using block_key_ = std::pair<const tree_structure_source::node*, std::ptrdiff_t>; ///< Node and level of block.
+	
+	mutable std::vector<tree_structure_source::block>* collected_blocks_ = nullptr; ///< Receives blocks instead of extracting their points, during the collecting traversal of extract_with_prefetch_.
+	mutable std::vector<point> prefetched_points_; ///< Points of prefetched blocks.
+	mutable std::map<block_key_, std::pair<std::size_t, std::size_t>> prefetched_blocks_; ///< Offset in prefetched_points_ and number of points of each prefetched block.
+	
+	mutable output_layout_writer* output_writer_ = nullptr; ///< Converts extracted points into the output layout, during compute_points_in_layout_.
+	
+	std::size_t extract_source_points_(const tree_structure_source::node& nd, point_buffer_t points, std::size_t capacity, std::ptrdiff_t lvl) const;
 
 	/**
 	 * Compute a point-to-cuboid distance.
@@ -31,24 +58,97 @@ private:
 	 * @param type Distance type.
 	 */
 	float cuboid_distance_(glm::vec3 position, const cuboid& cub, float min_dist, float max_dist, cuboid_distance_mode type) const;
+	
+	/**
+	 * Choose downsampling level using screen space error.
+	 * The point spacing of the node at each level is estimated from its cuboid and its number of points at that level, as stored in
+	 * the structure. It is projected using the request's view-projection matrix at the point of the cuboid closest to the camera.
+	 * @param nd The node.
+	 * @param cub Cuboid of the node.
+	 * @param req The loader request. Must have viewport height set.
+	 * @param levels Available downsampling levels.
+	 * @return Coarsest level for which projected point spacing is below the threshold, or 0 if none.
+	 */
+	std::ptrdiff_t choose_screen_space_error_level_(const tree_structure_source::node& nd, const cuboid& cub, const loader::request_t& req, std::size_t levels) const;
 
 protected:
 	static constexpr std::ptrdiff_t action_skip = -2; ///< Instead of a downsampling level, this value means ignore node.
 	static constexpr std::ptrdiff_t action_split = -1; ///< Instead of a downsampling level, this value means descent into node's children.
 	
-	std::unique_ptr<const tree_structure_source> source_; ///< The tree structure source.
+	std::shared_ptr<const tree_structure_source> source_; ///< The tree structure source. Shared with sessions of the loader.
 	
 	/**
 	 * Action to take for given node.
 	 * Common behavoir for all tree structure loaders.
-	 * @param cub Cuboid of current node.
-	 * @param number_of_points Number of points in node.
-	 * @param is_leaf Whether node is a leaf.
+	 * @param nd Current node.
 	 * @param req The loader request with camera position etc.
 	 * @param levels Available downsampling levels.
+	 * @param intersection Receives how the node intersects the view frustum, to be passed on to extract_node_level_points_.
 	 * @return Either downsampling level at which the node should be outputted, or \a action_skip or \a action_split.
 	 */
-	std::ptrdiff_t action_for_node_(const cuboid&, std::size_t number_of_points, bool is_leaf, const loader::request_t& req, std::size_t levels = 1) const;
+	std::ptrdiff_t action_for_node_(const tree_structure_source::node& nd, const loader::request_t& req, std::size_t levels, frustum::intersection_t& intersection) const;
+	
+	/**
+	 * Prepare occlusion culling for new request.
+	 * Must be called by subclass before traversing the tree.
+	 */
+	void begin_occlusion_culling_(const loader::request_t& req) const;
+	
+	/**
+	 * Check whether node is hidden behind points outputted so far.
+	 * For loaders that output nodes after the traversal that chose them. Always false when occlusion culling is off.
+	 */
+	bool node_occluded_(const tree_structure_source::node& nd) const { return occlusion_culling_ && occlusion_buffer_.cuboid_occluded(nd.node_cuboid()); }
+	
+	/**
+	 * Extract points of node at given level.
+	 * When point culling is enabled and the node is only partially inside the view frustum, the points outside
+	 * of it are removed from the output. When occlusion culling is enabled, the extracted points are also added as occluders.
+	 * Points of prefetched blocks are taken from memory. When loading in an output layout, the points are converted
+	 * into it afterwards, so subclasses must extract into the output buffer in order, and not access the points again.
+	 * @param nd The node.
+	 * @param req The loader request.
+	 * @param points Buffer to write points into.
+	 * @param capacity Capacity of buffer.
+	 * @param lvl Downsampling level.
+	 * @param intersection Intersection of the node with the view frustum, as given by action_for_node_.
+	 * @return Number of points extracted.
+	 */
+	std::size_t extract_node_level_points_(const tree_structure_source::node& nd, const loader::request_t& req, point_buffer_t points, std::size_t capacity, std::size_t lvl, frustum::intersection_t intersection) const;
+	
+	/**
+	 * Read given blocks from the source together, so that extract_node_level_points_ takes them from memory.
+	 * Blocks prefetched before get discarded. Does nothing when the source does not batch extraction.
+	 */
+	void prefetch_blocks_(const std::vector<tree_structure_source::block>& blocks) const;
+	
+	void clear_prefetched_blocks_() const; ///< Discard prefetched blocks, once the traversal is done.
+	
+	/**
+	 * Run traversal that extracts points, reading the blocks it needs together when the source batches extraction.
+	 * The traversal then first runs without extracting, while extract_node_level_points_ only collects the blocks
+	 * and assumes that all their points get outputted. After these are prefetched, it runs again. Otherwise it just
+	 * runs once.
+	 * @param traversal Function that traverses the tree, and returns the number of points extracted.
+	 * @return Number of points extracted.
+	 */
+	template<class Traversal>
+	std::size_t extract_with_prefetch_(Traversal traversal) const {
+		if(! source_->batches_extraction()) return traversal();
+		std::vector<tree_structure_source::block> blocks;
+		collected_blocks_ = &blocks;
+		try {
+			traversal();
+		} catch(...) {
+			collected_blocks_ = nullptr;
+			throw;
+		}
+		collected_blocks_ = nullptr;
+		prefetch_blocks_(blocks);
+		std::size_t c = traversal();
+		clear_prefetched_blocks_();
+		return c;
+	}
 	
 	/**
 	 * Compute a point-to-cuboid distance.
@@ -66,18 +166,52 @@ protected:
 	 */
 	float cuboid_distance_(glm::vec3 position, const cuboid& cub) const;
 	
+	/**
+	 * Traversal of the source by the loader, for the lifetime of the object.
+	 * Subclass creates one before traversing the tree, so that the source does not free nodes while sessions sharing
+	 * it are traversing. @see tree_structure_source::begin_traversal
+	 */
+	class source_traversal_ {
+	private:
+		const tree_structure_source& source_;
+		bool released_;
+
+	public:
+		explicit source_traversal_(const tree_structure_loader& ld);
+		source_traversal_(const source_traversal_&) = delete;
+		source_traversal_& operator=(const source_traversal_&) = delete;
+		~source_traversal_() { source_.end_traversal(); }
+
+		bool released() const { return released_; } ///< Whether source freed nodes since previous traversal of loader, so that references to nodes held by loader became invalid.
+	};
+	
+	/**
+	 * Copy settings into new session of this loader, and share the source with it.
+	 */
+	void init_session_(tree_structure_loader& session) const;
+	
 	virtual void updated_source_() { } ///< Notified subclass that source was switched.
+	
+	/**
+	 * Load points in given layout, converting the points of each node as they are extracted.
+	 */
+	void compute_points_in_layout_(const request_t& request, point_buffer_t points, std::size_t& count, std::size_t capacity, output_layout layout, std::vector<std::uint8_t>& scratch) override;
 		
 public:
 	void set_minimal_number_of_points_for_split(std::size_t n) { minimal_number_of_points_for_split_ = n; }
 	void set_downsampling_node_distance(cuboid_distance_mode d) { downsampling_node_distance_ = d; }
 	void set_additional_split_distance_difference(float d) { additional_split_distance_difference_ = d; }
+	void set_lod_selection(lod_selection_mode m) { lod_selection_ = m; }
+	void set_screen_space_error_threshold(float px) { screen_space_error_threshold_ = px; }
+	void set_occlusion_culling(bool b) { occlusion_culling_ = b; }
+	void set_point_culling(bool b) { point_culling_ = b; }
 	
 	double get_setting(const std::string&) const override;
 	void set_setting(const std::string&, double) override;
 	
 	void take_source(const tree_structure_source* src) { source_.reset(src); updated_source_(); } ///< Assign source. Takes ownership of pointer.
-	void delete_source() { source_.release(); updated_source_(); } ///< Deletes source.
+	std::shared_ptr<const tree_structure_source> get_source() const { return source_; } ///< Get source, which stays alive while the returned pointer is held.
+	void delete_source() { source_.reset(); updated_source_(); } ///< Deletes source, unless sessions still share it.
 	
 	loader_type get_loader_type() const override { return loader_type::tree; }
 	
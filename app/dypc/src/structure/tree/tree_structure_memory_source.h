@@ -45,17 +45,26 @@ private:
 	const map_t& map_;
 	cuboid cuboid_;
 	unsigned depth_;
+	bool additive_;
+	
+	std::ptrdiff_t last_level_(std::ptrdiff_t lvl) const { return (additive_ ? Structure::levels - 1 : lvl); } ///< Coarsest level whose points are part of level \a lvl.
 
 public:
-	node(const map_t& mp, const structure_node& nd, const cuboid& cub, unsigned depth) : map_(mp), node_(nd), cuboid_(cub), depth_(depth) { }
+	node(const map_t& mp, const structure_node& nd, const cuboid& cub, unsigned depth, bool additive) : map_(mp), node_(nd), cuboid_(cub), depth_(depth), additive_(additive) { }
 
-	std::size_t number_of_points(std::ptrdiff_t lvl = 0) const override { return node_.number_of_points(); }
+	std::size_t number_of_points(std::ptrdiff_t lvl = 0) const override {
+		std::size_t n = 0;
+		for(std::ptrdiff_t l = last_level_(lvl); l >= lvl; --l) n += node_.number_of_points(l);
+		return n;
+	}
 	
 	std::size_t extract_points(point_buffer_t buffer, std::size_t capacity, std::ptrdiff_t lvl = 0) const override {
-		auto pt_begin = node_.points_begin(lvl);
-		auto pt_end = node_.points_end(lvl);
 		std::size_t n = 0;
-		for(auto it = pt_begin; (it != pt_end) && capacity; ++it, --capacity, ++n) *(buffer++) = *it;
+		for(std::ptrdiff_t l = last_level_(lvl); l >= lvl; --l) {
+			auto pt_begin = node_.points_begin(l);
+			auto pt_end = node_.points_end(l);
+			for(auto it = pt_begin; (it != pt_end) && capacity; ++it, --capacity, ++n) *(buffer++) = *it;
+		}
 		return n;
 	}
 
@@ -70,7 +79,7 @@ public:
 
 template<class Structure>
 tree_structure_memory_source<Structure>::tree_structure_memory_source(const Structure* str) :
-tree_structure_source(Structure::levels, Structure::number_of_node_children), structure_(str) {
+tree_structure_source(Structure::levels, Structure::number_of_node_children, str->is_additive()), structure_(str) {
 	auto& root_structure_node = str->root_node();
 	add_node_to_map_(root_structure_node, str->root_cuboid(), 0);
 	root_node_ = & map_.at(& root_structure_node);
@@ -79,7 +88,7 @@ tree_structure_source(Structure::levels, Structure::number_of_node_children), st
 
 template<class Structure>
 void tree_structure_memory_source<Structure>::add_node_to_map_(const structure_node& nd, const cuboid& cub, unsigned depth) {
-	map_.emplace(std::piecewise_construct, std::forward_as_tuple(&nd), std::forward_as_tuple(map_, nd, cub, depth));
+	map_.emplace(std::piecewise_construct, std::forward_as_tuple(&nd), std::forward_as_tuple(map_, nd, cub, depth, additive_));
 	if(! nd.is_leaf()) for(std::ptrdiff_t i = 0; i < Structure::number_of_node_children; ++i) {
 		cuboid child_cub = Structure::splitter::node_child_cuboid(i, cub, nd.get_points_information(), depth);
 		add_node_to_map_(nd.child(i), child_cub, depth + 1);
@@ -2,12 +2,15 @@
 #define DYPC_TREE_STRUCTURE_NODE_H_
 
 #include "../../point.h"
+#include "../../point_soa_container.h"
 #include <cassert>
 
 #include "../../debug.h"
 #include <array>
 #include <utility>
 #include <cstring>
+#include <cstdint>
+#include <vector>
 
 namespace dypc {
 
@@ -74,6 +77,34 @@ private:
 	
 	
 	
+	/**
+	 * Distribute points into point sets for the child nodes.
+	 * @param all_points Points of this node.
+	 * @param cub Cuboid of this node.
+	 * @param depth Depth of this node.
+	 * @param child_point_sets Array of empty point sets, one for each child.
+	 */
+	template<class Container>
+	void distribute_points_(const Container& all_points, const cuboid& cub, unsigned depth, Container* child_point_sets) const {
+		for(const point& pt : all_points) child_point_sets[Splitter::node_child_for_point(pt, cub, points_information_, depth)].push_back(pt);
+	}
+	
+	/**
+	 * Distribute points into point sets for the child nodes, for structure of arrays containers.
+	 * Computes the child indices first with the vectorized batch kernel of the splitter, and then reserves the child sets.
+	 */
+	void distribute_points_(const point_soa_container& all_points, const cuboid& cub, unsigned depth, point_soa_container* child_point_sets) const {
+		std::vector<std::uint8_t> child_indices(all_points.size());
+		Splitter::node_children_for_points(all_points.x(), all_points.y(), all_points.z(), all_points.size(), cub, points_information_, depth, child_indices.data());
+		
+		std::size_t counts[Splitter::number_of_node_children] = { 0 };
+		for(std::uint8_t i : child_indices) ++counts[i];
+		for(std::ptrdiff_t i = 0; i < Splitter::number_of_node_children; ++i) child_point_sets[i].reserve(counts[i]);
+		
+		auto child_index = child_indices.begin();
+		for(const point& pt : all_points) child_point_sets[*(child_index++)].push_back(pt);
+	}
+	
 	/**
 	 * Recursively add non-downsampled points to tree nodes and build tree.
 	 * Adds points into internal buffers.
@@ -93,7 +124,7 @@ private:
 	 * as downsampled point sets contain fewer points. However, it may occur that more points fall into one leaf than before
 	 * downsampling. Will enlarge leaf capacity by two-fold when necessary. (see report)
 	 * @see add_root_node_points
-	 * @param lvl Downsampling level, must be greater than 0.
+	 * @param lvl Downsampling level. Can be 0 only when called from replace_root_node_points.
 	 * @param pt Point to add.
 	 * @param cub Cuboid of this node.
 	 * @param depth Depth of this node.
@@ -117,6 +148,13 @@ private:
 	 * @param lvl Downsampling point set level.
 	 */
 	void finalize_move_out_(const PointsContainer& output_points, unsigned lvl);
+	
+	/**
+	 * Recursively remove point set of given level from node and its children.
+	 * Does not deallocate internal buffers, and must not be called while they are in use.
+	 * @param lvl Downsampling point set level.
+	 */
+	void reset_points_(unsigned lvl);
 
 	
 public:
@@ -162,6 +200,19 @@ public:
 	 * @param pr_tot Maximal value for progress.
 	 */
 	void add_root_node_points(std::ptrdiff_t lvl, PointsContainer& all_points, PointsContainer& output_points, const cuboid& cub, std::size_t leaf_capacity);
+	
+	/**
+	 * Replace points of given level in node.
+	 * Must be called only on root node of tree, after the tree has been built. The tree structure is not changed, and points
+	 * are distributed into the existing leaves like for downsampled levels. Used for level 0 with additive downsampling, where
+	 * the full point set is needed to build the tree, but only part of it gets stored at level 0.
+	 * @param lvl Downsampling level.
+	 * @param output_points Output array that will store the points in tree nodes order. Previous content is discarded.
+	 * @param all_points Unordered array of points to add to node. Is cleared during process.
+	 * @param cub Cuboid for this node.
+	 * @param leaf_capacity Leaf nodes capacity for the tree.
+	 */
+	void replace_root_node_points(std::ptrdiff_t lvl, PointsContainer& output_points, PointsContainer& all_points, const cuboid& cub, std::size_t leaf_capacity);
 		
 	/**
 	 * Get number of nodes in tree starting from this node.
@@ -224,9 +275,35 @@ void tree_structure_node<Splitter, Levels, PointsContainer>::add_root_node_point
 }
 
 
+template<class Splitter, std::size_t Levels, class PointsContainer>
+void tree_structure_node<Splitter, Levels, PointsContainer>::replace_root_node_points(std::ptrdiff_t lvl, PointsContainer& output_points, PointsContainer& all_points, const cuboid& cub, std::size_t leaf_capacity) {
+	assert(lvl >= 0 && lvl < Levels);
+	
+	// Previous points of this level are no longer referenced by the nodes after this
+	reset_points_(lvl);
+	output_points.clear();
+	
+	for(const point& pt : all_points) add_higher_level_point_(lvl, pt, cub, 0, leaf_capacity);
+	all_points.clear(); all_points.shrink_to_fit();
+	
+	// Same stages 2 and 3 as in add_root_node_points
+	move_out_points_(output_points, lvl);
+	finalize_move_out_(output_points, lvl);
+}
+
+
+template<class Splitter, std::size_t Levels, class PointsContainer>
+void tree_structure_node<Splitter, Levels, PointsContainer>::reset_points_(unsigned lvl) {
+	point_sets_[lvl] = point_set();
+	if(! is_leaf()) {
+		for(std::ptrdiff_t i = 0; i < Splitter::number_of_node_children; ++i) children_[i]->reset_points_(lvl);
+	}
+}
+
+
 template<class Splitter, std::size_t Levels, class PointsContainer>
 void tree_structure_node<Splitter, Levels, PointsContainer>::add_higher_level_point_(std::ptrdiff_t lvl, const point& pt, const cuboid& cub, unsigned depth, std::size_t leaf_capacity) {
-	assert(lvl > 0);
+	assert(lvl >= 0 && lvl < Levels);
 	
 	auto& set = point_sets_[lvl];
 	if(! is_leaf()) {
@@ -261,10 +338,7 @@ void tree_structure_node<Splitter, Levels, PointsContainer>::add_points_with_inf
 		
 		// Distribute points into subsets for the child nodes
 		PointsContainer child_point_sets[Splitter::number_of_node_children];
-		for(const point& pt : all_points) {
-			std::ptrdiff_t i = Splitter::node_child_for_point(pt, cub, points_information_, depth);
-			child_point_sets[i].push_back(pt);
-		}
+		distribute_points_(all_points, cub, depth, child_point_sets);
 		
 		// Recursively call with child node point sets
 		for(std::ptrdiff_t i = 0; i < Splitter::number_of_node_children; ++i) {
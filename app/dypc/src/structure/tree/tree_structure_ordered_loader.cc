@@ -13,7 +13,8 @@ std::size_t tree_structure_ordered_loader::extract_node_points_(point_buffer_t p
 	const std::size_t levels = source_->levels();
 	const std::size_t number_of_node_children = source_->number_of_node_children();
 	
-	auto action = action_for_node_(nd.node_cuboid(), nd.number_of_points(), nd.is_leaf(), req, levels);
+	frustum::intersection_t intersection;
+	auto action = action_for_node_(nd, req, levels, intersection);
 	
 	if(action == action_skip) {
 		return 0;
@@ -37,13 +38,17 @@ std::size_t tree_structure_ordered_loader::extract_node_points_(point_buffer_t p
 		std::ptrdiff_t lvl = action;
 		if(lvl >= levels) lvl = levels - 1;
 		
-		return nd.extract_points(points, capacity, lvl);
+		return extract_node_level_points_(nd, req, points, capacity, lvl, intersection);
 	}
 }
 
 	
 
 std::size_t tree_structure_ordered_loader::compute_downsampled_points_(point_buffer_t points, std::size_t capacity, const loader::request_t& req) {
+	// Path from previous request is lost when source freed its nodes
+	source_traversal_ traversal(*this);
+	if(traversal.released()) updated_source_();
+	
 	// First update position of camera
 	bool outside_root = false;
 	// Move back to parent node if no longer in same node
@@ -61,15 +66,18 @@ std::size_t tree_structure_ordered_loader::compute_downsampled_points_(point_buf
 		position_path_.push_back(& nd.child(i));
 	}
 	
-	std::size_t c = 0;
-	const source_node* previous = nullptr;
-	for(auto it = position_path_.rbegin(); c < capacity && it != position_path_.rend(); ++it) {
-		// First traverse subtree closer to camera
-		c += this->extract_node_points_(points + c, capacity - c, req, **it, previous);
-		previous = *it;
-	}
+	begin_occlusion_culling_(req);
 	
-	return c;
+	return extract_with_prefetch_([&]() -> std::size_t {
+		std::size_t c = 0;
+		const source_node* previous = nullptr;
+		for(auto it = position_path_.rbegin(); c < capacity && it != position_path_.rend(); ++it) {
+			// First traverse subtree closer to camera
+			c += this->extract_node_points_(points + c, capacity - c, req, **it, previous);
+			previous = *it;
+		}
+		return c;
+	});
 }
 
 }
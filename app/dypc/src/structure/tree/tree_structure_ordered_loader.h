@@ -18,6 +18,12 @@ private:
 	
 public:	
 	std::string loader_name() const override { return "Tree Structure Ordered Loader"; }
+	
+	loader* create_session() const override {
+		auto session = new tree_structure_ordered_loader;
+		init_session_(*session);
+		return session;
+	}
 
 protected:
 	virtual std::size_t extract_node_points_(point_buffer_t points, std::size_t capacity, const loader::request_t& req, const tree_structure_source::node& nd, const source_node* skip = nullptr) const;
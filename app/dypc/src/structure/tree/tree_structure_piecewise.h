@@ -39,16 +39,18 @@ public:
 	/**
 	 * Create tree structure in one single piece.
 	 * Loads all downsampled point sets.
+	 * @param additive If true, store downsampled points additively.
 	 */
-	tree_structure_piecewise(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod) : 
-	super(leaf_cap, dmin, damount, dmode, mod, true), root_piece_node_(cuboid(), 0) { }
+	tree_structure_piecewise(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, bool additive = false) : 
+	super(leaf_cap, dmin, damount, dmode, mod, true, false, additive), root_piece_node_(cuboid(), 0) { }
 	
 	/**
 	 * Create tree structure, split into pieces of at most \a maxnum points.
 	 * Initially no piece is loaded.
 	 * @param maxnum Maximal number of points per piece.
+	 * @param additive If true, store downsampled points additively.
 	 */
-	tree_structure_piecewise(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, std::ptrdiff_t maxnum);
+	tree_structure_piecewise(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, std::ptrdiff_t maxnum, bool additive);
 	
 	/**
 	 * Get root node of pieces tree.
@@ -68,19 +70,25 @@ public:
 	 */
 	void load_piece(const piece_node& nd);
 	
-	
-	tree_structure<Splitter, Levels, PointsContainer> load_and_export_piece(const piece_node& nd) const;
+	/**
+	 * Load given piece into separate tree structure.
+	 * @tparam PieceContainer Container used to store arrays of points in the piece. Can differ from the one of this structure.
+	 * @param nd The piece node to load.
+	 */
+	template<class PieceContainer = PointsContainer>
+	tree_structure<Splitter, Levels, PieceContainer> load_and_export_piece(const piece_node& nd) const;
 	
 	/**
 	 * Get total number of points in structure.
 	 * Sum of points in all pieces, for given downsampling level. Will give exact value, without loading pieces.
+	 * With additive downsampling, this is the number of points stored for that level.
 	 * @param lvl Downsampling level.
 	 */
 	std::size_t total_number_of_points(std::ptrdiff_t lvl = 0) const;
 	
 	/**
 	 * Get number of points in piece.
-	 * Will give exact value, without loading piece.
+	 * Will give exact value, without loading piece. With additive downsampling, this is the number of points stored for that level.
 	 * @param lvl Downsampling level.
 	 */
 	std::size_t piece_number_of_points(const piece_node& nd, std::ptrdiff_t lvl = 0) const;
@@ -175,8 +183,8 @@ public:
 
 
 template<class Splitter, std::size_t Levels, class PointsContainer, class PiecesSplitter>
-tree_structure_piecewise<Splitter, Levels, PointsContainer, PiecesSplitter>::tree_structure_piecewise(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, std::ptrdiff_t maxnum) :
-super(leaf_cap, dmin, damount, dmode, mod, true, super::no_load),
+tree_structure_piecewise<Splitter, Levels, PointsContainer, PiecesSplitter>::tree_structure_piecewise(std::size_t leaf_cap, std::size_t dmin, float damount, downsampling_mode dmode, model& mod, std::ptrdiff_t maxnum, bool additive) :
+super(leaf_cap, dmin, damount, dmode, mod, true, additive, super::no_load),
 root_piece_node_(mod.enclosing_cuboid(), 0) {	
 	std::size_t max_depth = expected_maximal_pieces_depth_;
 	bool repeat = true;
@@ -201,9 +209,9 @@ void tree_structure_piecewise<Splitter, Levels, PointsContainer, PiecesSplitter>
 }
 
 
-template<class Splitter, std::size_t Levels, class PointsContainer, class PiecesSplitter>
-tree_structure<Splitter, Levels, PointsContainer> tree_structure_piecewise<Splitter, Levels, PointsContainer, PiecesSplitter>::load_and_export_piece(const piece_node& nd) const {
-	return tree_structure<Splitter, Levels, PointsContainer>(
+template<class Splitter, std::size_t Levels, class PointsContainer, class PiecesSplitter> template<class PieceContainer>
+tree_structure<Splitter, Levels, PieceContainer> tree_structure_piecewise<Splitter, Levels, PointsContainer, PiecesSplitter>::load_and_export_piece(const piece_node& nd) const {
+	return tree_structure<Splitter, Levels, PieceContainer>(
 		super::leaf_capacity_,
 		super::downsampling_minimum_,
 		super::downsampling_amount_,
@@ -211,7 +219,8 @@ tree_structure<Splitter, Levels, PointsContainer> tree_structure_piecewise<Split
 		super::model_,
 		nd.get_cuboid(),
 		false,
-		true
+		true,
+		super::additive_downsampling_
 	);
 }
 
@@ -219,13 +228,13 @@ tree_structure<Splitter, Levels, PointsContainer> tree_structure_piecewise<Split
 template<class Splitter, std::size_t Levels, class PointsContainer, class PiecesSplitter>
 std::size_t tree_structure_piecewise<Splitter, Levels, PointsContainer, PiecesSplitter>::total_number_of_points(std::ptrdiff_t lvl) const {
 	std::size_t n = super::total_number_of_points();
-	return super::downsampling_number_of_points_exact(n, lvl);
+	return super::downsampling_stored_number_of_points_exact(n, lvl);
 }
 
 
 template<class Splitter, std::size_t Levels, class PointsContainer, class PiecesSplitter>
 std::size_t tree_structure_piecewise<Splitter, Levels, PointsContainer, PiecesSplitter>::piece_number_of_points(const piece_node& nd, std::ptrdiff_t lvl) const {
-	return super::downsampling_number_of_points_exact(nd.get_number_of_points(), lvl);
+	return super::downsampling_stored_number_of_points_exact(nd.get_number_of_points(), lvl);
 }
 
 
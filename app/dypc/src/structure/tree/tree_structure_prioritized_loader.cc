@@ -0,0 +1,161 @@
+#include "tree_structure_prioritized_loader.h"
+#include <queue>
+#include <vector>
+#include <utility>
+#include <limits>
+#include <algorithm>
+
+namespace dypc {
+
+float tree_structure_prioritized_loader::node_priority_(const source_node& nd, const loader::request_t& req) const {
+	const cuboid cub = nd.node_cuboid();
+	float distance = cub.minimal_distance(req.position);
+	if(distance <= float_comparison_epsilon) return std::numeric_limits<float>::infinity();
+	return glm::length(cub.side_lengths()) / distance;
+}
+
+
+void tree_structure_prioritized_loader::select_nodes_(std::vector<selected_node_>& selected, const loader::request_t& req, std::size_t capacity) const {
+	using queue_entry = std::pair<float, const source_node*>;
+	auto compare = [](const queue_entry& a, const queue_entry& b) { return a.first < b.first; };
+	std::priority_queue<queue_entry, std::vector<queue_entry>, decltype(compare)> queue(compare);
+
+	const std::size_t levels = source_->levels();
+	const std::size_t number_of_node_children = source_->number_of_node_children();
+
+	const source_node& root = source_->root_node();
+	queue.emplace(node_priority_(root, req), &root);
+
+	// Coarsest level points of the selected nodes and of the nodes in the queue
+	std::size_t frontier_number_of_points = root.number_of_points(levels - 1);
+
+	while(! queue.empty()) {
+		float priority = queue.top().first;
+		const source_node& nd = *queue.top().second;
+		queue.pop();
+
+		frustum::intersection_t intersection;
+		auto action = action_for_node_(nd, req, levels, intersection);
+
+		if(action == action_split) {
+			// Splitting replaces the node's coarsest level by those of its children, which together have more points.
+			// Once they no longer fit, the node is kept at its coarsest level instead.
+			std::size_t children_number_of_points = 0;
+			for(std::ptrdiff_t i = 0; i < number_of_node_children; ++i)
+				if(nd.has_child(i)) children_number_of_points += nd.child(i).number_of_points(levels - 1);
+			std::size_t split_number_of_points = frontier_number_of_points - nd.number_of_points(levels - 1) + children_number_of_points;
+			if(split_number_of_points > capacity) action = levels - 1;
+		}
+
+		if(action == action_skip) {
+			frontier_number_of_points -= nd.number_of_points(levels - 1);
+
+		} else if(action == action_split) {
+			frontier_number_of_points -= nd.number_of_points(levels - 1);
+			for(std::ptrdiff_t i = 0; i < number_of_node_children; ++i) if(nd.has_child(i)) {
+				const source_node& child = nd.child(i);
+				frontier_number_of_points += child.number_of_points(levels - 1);
+				queue.emplace(node_priority_(child, req), &child);
+			}
+
+		} else {
+			selected_node_ sel;
+			sel.node = &nd;
+			sel.priority = priority;
+			sel.intersection = intersection;
+			sel.target_level = std::min<std::ptrdiff_t>(action, levels - 1);
+			sel.level = levels - 1;
+			sel.number_of_points = nd.number_of_points(sel.level);
+			selected.push_back(sel);
+		}
+	}
+}
+
+
+std::size_t tree_structure_prioritized_loader::allocate_capacity_(std::vector<selected_node_>& selected, std::size_t capacity) const {
+	std::size_t total = 0;
+	for(const selected_node_& sel : selected) total += sel.number_of_points;
+
+	if(total > capacity) {
+		// Coarsest levels do not fit: every node gets a share proportional to its number of points, at least one point
+		// while capacity remains. Selection is in priority order, so the least important nodes lose out first.
+		std::size_t remaining = capacity;
+		for(selected_node_& sel : selected) {
+			std::size_t share = (double)capacity * sel.number_of_points / total;
+			if(share == 0 && sel.number_of_points > 0) share = 1;
+			share = std::min(share, remaining);
+			sel.number_of_points = share;
+			remaining -= share;
+		}
+		return capacity - remaining;
+	}
+
+	// Upgrade nodes one level at a time, most important first, as long as the finer level still fits
+	auto compare = [&selected](std::size_t a, std::size_t b) { return selected[a].priority < selected[b].priority; };
+	std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(compare)> queue(compare);
+	for(std::size_t i = 0; i < selected.size(); ++i) if(selected[i].level > selected[i].target_level) queue.push(i);
+
+	while(! queue.empty()) {
+		selected_node_& sel = selected[queue.top()];
+		std::size_t finer_number_of_points = sel.node->number_of_points(sel.level - 1);
+		if(total - sel.number_of_points + finer_number_of_points > capacity) {
+			queue.pop(); // Keeps current level; smaller nodes may still be upgraded
+			continue;
+		}
+		total = total - sel.number_of_points + finer_number_of_points;
+		sel.number_of_points = finer_number_of_points;
+		--sel.level;
+		if(sel.level == sel.target_level) queue.pop();
+	}
+
+	return total;
+}
+
+
+std::size_t tree_structure_prioritized_loader::extract_node_share_(const source_node& nd, const loader::request_t& req, point_buffer_t points, std::size_t share, std::ptrdiff_t lvl, frustum::intersection_t intersection) const {
+	const std::size_t level_number_of_points = nd.number_of_points(lvl);
+	if(share >= level_number_of_points || nd.is_leaf()) return extract_node_level_points_(nd, req, points, share, lvl, intersection);
+
+	// Level is stored depth-first, so a prefix would cover only part of the node. Instead the share is divided among
+	// the children in proportion to their points at the level, carrying the fractions over from child to child.
+	const std::size_t number_of_node_children = source_->number_of_node_children();
+	std::size_t c = 0;
+	std::size_t children_number_of_points = 0;
+	std::size_t assigned = 0;
+	for(std::ptrdiff_t i = 0; i < number_of_node_children; ++i) if(nd.has_child(i)) {
+		const source_node& child = nd.child(i);
+		children_number_of_points += child.number_of_points(lvl);
+		std::size_t child_share = std::min<std::size_t>((double)share * children_number_of_points / level_number_of_points, share) - assigned;
+		assigned += child_share;
+		if(child_share > 0) c += extract_node_share_(child, req, points + c, child_share, lvl, intersection);
+	}
+	return c;
+}
+
+
+std::size_t tree_structure_prioritized_loader::compute_downsampled_points_(point_buffer_t points, std::size_t capacity, const loader::request_t& req) {
+	source_traversal_ traversal(*this);
+	begin_occlusion_culling_(req);
+
+	std::vector<selected_node_> selected;
+	select_nodes_(selected, req, capacity);
+	allocate_capacity_(selected, capacity);
+
+	return extract_with_prefetch_([&]()->std::size_t {
+		std::size_t c = 0;
+		for(const selected_node_& sel : selected) {
+			if(sel.number_of_points == 0) continue;
+
+			// Selection traversal ran with an empty occlusion buffer; nodes behind points outputted so far are culled here
+			if(node_occluded_(*sel.node)) continue;
+
+			if(sel.number_of_points >= sel.node->number_of_points(sel.level))
+				c += extract_node_level_points_(*sel.node, req, points + c, capacity - c, sel.level, sel.intersection);
+			else
+				c += extract_node_share_(*sel.node, req, points + c, std::min(sel.number_of_points, capacity - c), sel.level, sel.intersection);
+		}
+		return c;
+	});
+}
+
+}
@@ -0,0 +1,76 @@
+#ifndef DYPC_TREE_STRUCTURE_PRIORITIZED_LOADER_H_
+#define DYPC_TREE_STRUCTURE_PRIORITIZED_LOADER_H_
+
+#include "tree_structure_loader.h"
+#include <vector>
+
+namespace dypc {
+
+/**
+ * Tree structure loader that refines nodes best-first.
+ * The tree is traversed in order of projected node size, and every visible node gets its coarsest level first. Then
+ * nodes are upgraded to finer levels one at a time, largest on screen first, as long as the capacity allows, up to the
+ * level chosen for their distance. So no visible node is left without points, and the loaded point set only gains
+ * detail as the capacity grows. Nodes are not split further once the coarsest levels of their children would not fit.
+ * When even the coarsest levels of the selected nodes do not fit, each node gets a share of the capacity, which is
+ * spread over its subtree.
+ */
+class tree_structure_prioritized_loader : public tree_structure_loader {
+private:
+	using source_node = tree_structure_source::node;
+
+	/**
+	 * Importance of node for given request.
+	 * Length of diagonal of node's cuboid, divided by its minimal distance to the camera.
+	 */
+	float node_priority_(const source_node& nd, const loader::request_t& req) const;
+
+	/**
+	 * Visible node to output, with the level it gets outputted at.
+	 */
+	struct selected_node_ {
+		const source_node* node;
+		float priority;
+		frustum::intersection_t intersection; ///< Intersection with view frustum, from the selection traversal.
+		std::ptrdiff_t target_level; ///< Level chosen for the node's distance.
+		std::ptrdiff_t level; ///< Level assigned so far, starting with the coarsest.
+		std::size_t number_of_points; ///< Number of points to output for node.
+	};
+
+	/**
+	 * Traverse tree and collect nodes to output, in order of decreasing priority.
+	 * Refinement is budgeted: A node is not split when the coarsest levels of all selected and queued nodes would then
+	 * exceed \a capacity, and is selected at its coarsest level instead.
+	 */
+	void select_nodes_(std::vector<selected_node_>& selected, const loader::request_t& req, std::size_t capacity) const;
+
+	/**
+	 * Assign levels and numbers of points to the selected nodes.
+	 * @return Total number of points to output.
+	 */
+	std::size_t allocate_capacity_(std::vector<selected_node_>& selected, std::size_t capacity) const;
+
+	/**
+	 * Extract part of the points of node at given level, spread over the node.
+	 * The share is divided among the children in proportion to their number of points at the level, down to nodes
+	 * whose level fits into their share, or leaves, so that no more than \a share points are read.
+	 * @param share Number of points to extract.
+	 */
+	std::size_t extract_node_share_(const source_node& nd, const loader::request_t& req, point_buffer_t points, std::size_t share, std::ptrdiff_t lvl, frustum::intersection_t intersection) const;
+
+public:
+	std::string loader_name() const override { return "Tree Structure Prioritized Loader"; }
+	
+	loader* create_session() const override {
+		auto session = new tree_structure_prioritized_loader;
+		init_session_(*session);
+		return session;
+	}
+
+protected:
+	std::size_t compute_downsampled_points_(point_buffer_t points, std::size_t capacity, const loader::request_t& req) override;
+};
+
+}
+
+#endif
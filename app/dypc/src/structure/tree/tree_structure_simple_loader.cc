@@ -6,7 +6,8 @@ std::size_t tree_structure_simple_loader::extract_node_points_(point_buffer_t po
 	const std::size_t levels = source_->levels();
 	const std::size_t number_of_node_children = source_->number_of_node_children();
 	
-	auto action = action_for_node_(nd.node_cuboid(), nd.number_of_points(), nd.is_leaf(), req, levels);
+	frustum::intersection_t intersection;
+	auto action = action_for_node_(nd, req, levels, intersection);
 	
 	if(action == action_skip) {
 		return 0;
@@ -20,7 +21,7 @@ std::size_t tree_structure_simple_loader::extract_node_points_(point_buffer_t po
 		std::ptrdiff_t lvl = action;
 		if(lvl >= levels) lvl = levels - 1;
 		
-		return nd.extract_points(points, capacity, lvl);
+		return extract_node_level_points_(nd, req, points, capacity, lvl, intersection);
 	}
 }
 
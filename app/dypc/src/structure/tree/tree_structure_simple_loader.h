@@ -11,13 +11,21 @@ namespace dypc {
 class tree_structure_simple_loader : public tree_structure_loader {
 public:		
 	std::string loader_name() const override { return "Tree Structure Simple Loader"; }
+	
+	loader* create_session() const override {
+		auto session = new tree_structure_simple_loader;
+		init_session_(*session);
+		return session;
+	}
 
 private:
 	std::size_t extract_node_points_(point_buffer_t points, std::size_t capacity, const loader::request_t& req, const tree_structure_source::node& nd) const;
 	
 protected:
 	std::size_t compute_downsampled_points_(point_buffer_t points, std::size_t capacity, const loader::request_t& req) override {
-		return extract_node_points_(points, capacity, req, source_->root_node());
+		source_traversal_ traversal(*this);
+		begin_occlusion_culling_(req);
+		return extract_with_prefetch_([&]() { return extract_node_points_(points, capacity, req, source_->root_node()); });
 	}
 };
 
@@ -3,6 +3,8 @@
 
 #include "../../geometry/cuboid.h"
 #include "../../point.h"
+#include <vector>
+#include <cstdint>
 
 namespace dypc {
 
@@ -16,9 +18,13 @@ private:
 	const std::size_t number_of_children_; ///< Number of children per node in the tree structure.
 
 protected:
-	tree_structure_source(std::size_t lvls, std::size_t nchl) : levels_(lvls), number_of_children_(nchl) { }
+	bool additive_; ///< Whether downsampled levels are stored additively. @see mipmap_structure::additive_downsample_points_
+
+	tree_structure_source(std::size_t lvls, std::size_t nchl, bool additive = false) : levels_(lvls), number_of_children_(nchl), additive_(additive) { }
 
 public:
+	virtual ~tree_structure_source() { }
+
 	/**
 	 * Virtual node in the tree structure.
 	 * Polymorphic object implemented in subclasses by which the loader traverses the tree.
@@ -31,7 +37,7 @@ public:
 		static constexpr std::ptrdiff_t no_child_index = -1; ///< Placeholder value.
 	
 		virtual std::size_t number_of_points(std::ptrdiff_t lvl = 0) const = 0; ///< Get number of points in the nude.
-		virtual std::size_t extract_points(point_buffer_t buffer, std::size_t capacity, std::ptrdiff_t lvl = 0) const = 0; ///< Extract points from node.
+		virtual std::size_t extract_points(point_buffer_t buffer, std::size_t capacity, std::ptrdiff_t lvl = 0) const = 0; ///< Extract points from node. With additive storage, points of coarser levels come first.
 		
 		virtual bool is_leaf() const = 0; ///< Check whether node is a leaf.
 		virtual bool has_child(std::ptrdiff_t i) const = 0; ///< Check whether node has given child.
@@ -41,13 +47,59 @@ public:
 		virtual cuboid node_cuboid() const = 0; ///< Get cuboid for this node.
 	};
 	
+	/**
+	 * Points of a node at one level, as read by extract_blocks.
+	 */
+	struct block {
+		const node* block_node;
+		std::ptrdiff_t level;
+		std::size_t capacity;
+	};
+	
 	std::size_t levels() const { return levels_; } ///< Get number of downsampling levels.
 	std::size_t number_of_node_children() const { return number_of_children_; } ///< Get number of children per node.
+	bool is_additive() const { return additive_; } ///< Check whether downsampled levels are stored additively.
 	
 	virtual const node& root_node() const = 0; ///< Get polymorphic root node object.
 	virtual std::size_t number_of_nodes() const = 0; ///< Get total number of nodes.
 	std::size_t number_of_points() const { return this->root_node().number_of_points(); } ///< Get total number of points.
 	
+	/**
+	 * Begin traversal of the tree by a loader.
+	 * Nodes stay valid until the matching end_traversal call. Sources that load nodes on demand may free nodes that
+	 * were not accessed recently while no traversal is in progress. Sources that hold all nodes in memory do nothing.
+	 * @return Release epoch, which changes whenever nodes get freed. If it differs from the one returned for an
+	 * earlier traversal, references to nodes obtained before are invalid.
+	 */
+	virtual std::uint64_t begin_traversal() const { return 0; }
+
+	virtual void end_traversal() const { } ///< End traversal started by begin_traversal.
+	
+	/**
+	 * Read points of several blocks, as extract_points of their nodes would.
+	 * The points of the blocks are written one after the other into \a buffer.
+	 * @param blocks The blocks.
+	 * @param buffer Output buffer. Must have space for the sum of the block capacities.
+	 * @param counts On output, number of points read for each block.
+	 * @return Total number of points read.
+	 */
+	virtual std::size_t extract_blocks(const std::vector<block>& blocks, point_buffer_t buffer, std::vector<std::size_t>& counts) const {
+		counts.clear();
+		std::size_t total = 0;
+		for(const block& b : blocks) {
+			std::size_t n = b.block_node->extract_points(buffer + total, b.capacity, b.level);
+			counts.push_back(n);
+			total += n;
+		}
+		return total;
+	}
+	
+	/**
+	 * Whether extract_blocks is faster than extracting the blocks one by one, for example because each read is a
+	 * round trip over the network. Then loaders collect the blocks of a traversal and read them together.
+	 */
+	virtual bool batches_extraction() const { return false; }
+	
 	virtual std::size_t memory_size() const = 0; ///< Get structure's size in RAM.
 	virtual std::size_t rom_size() const = 0; ///< Get structure's size in ROM. 0 if loading from memory source.
 };
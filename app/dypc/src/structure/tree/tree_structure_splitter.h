@@ -6,6 +6,7 @@
 #include "../../point.h"
 #include <vector>
 #include <stdexcept>
+#include <cstdint>
 
 namespace dypc {
 
@@ -50,6 +51,21 @@ public:
 	 */
 	static cuboid node_child_cuboid(const std::ptrdiff_t i, const cuboid& cub, const node_points_information& info, unsigned depth) { throw std::logic_error("Not implemented"); }
 	
+	/**
+	 * Get index of node child for a batch of points, given as coordinate arrays.
+	 * Used with point_soa_container. Must give the same result as node_child_for_point for each point, and should be
+	 * written without branches in the loop, so that it gets vectorized.
+	 * @param x X coordinates of the points.
+	 * @param y Y coordinates of the points.
+	 * @param z Z coordinates of the points.
+	 * @param n Number of points.
+	 * @param cub Cuboid of this node.
+	 * @param info Node points information for this node.
+	 * @param depth Depth of this node.
+	 * @param children Output array of \a n child indices.
+	 */
+	static void node_children_for_points(const float* x, const float* y, const float* z, std::size_t n, const cuboid& cub, const node_points_information& info, unsigned depth, std::uint8_t* children) { throw std::logic_error("Not implemented"); }
+	
 	
 	/**
 	 * Create node points information from point set.
@@ -2,6 +2,10 @@
 #include <cstdio>
 #include <string>
 #include <memory>
+#include <vector>
+#include <stdexcept>
+#include <cstdlib>
+#include <unistd.h>
 
 namespace dypc {
 
@@ -35,5 +39,32 @@ std::string float_to_string(double f, std::size_t decimal_digits) {
 	return std::string(decimal);
 }
 
+
+
+temporary_file::temporary_file(const std::string& directory, const std::string& prefix) {
+	std::string pattern = directory + "/" + prefix + "_XXXXXX";
+	std::vector<char> name(pattern.begin(), pattern.end());
+	name.push_back('\0');
+	int fd = mkstemp(name.data());
+	if(fd == -1) throw std::runtime_error("Could not create temporary file in " + directory);
+	close(fd);
+	path_ = name.data();
+}
+
+
+temporary_file& temporary_file::operator=(temporary_file&& tmp) {
+	if(&tmp != this) {
+		remove();
+		path_ = std::move(tmp.path_);
+		tmp.path_.clear();
+	}
+	return *this;
 }
 
+
+void temporary_file::remove() {
+	if(! path_.empty()) std::remove(path_.c_str());
+	path_.clear();
+}
+
+}
@@ -62,6 +62,36 @@ std::string time_to_string(std::chrono::milliseconds t);
 std::string float_to_string(double f, std::size_t decimal_digits = 2);
 
 
+/**
+ * Temporary file with a unique name, which gets removed when the object is destroyed.
+ * The file is created empty, so that concurrent users of the same directory never pick the same name.
+ */
+class temporary_file {
+private:
+	std::string path_;
+
+public:
+	temporary_file() = default; ///< Create object that holds no file.
+	
+	/**
+	 * Create temporary file.
+	 * @param directory Existing directory in which to create the file.
+	 * @param prefix Start of file name, followed by random characters.
+	 */
+	explicit temporary_file(const std::string& directory, const std::string& prefix = "dypc");
+	temporary_file(const temporary_file&) = delete;
+	temporary_file(temporary_file&& tmp) : path_(std::move(tmp.path_)) { tmp.path_.clear(); }
+	~temporary_file() { remove(); }
+
+	temporary_file& operator=(const temporary_file&) = delete;
+	temporary_file& operator=(temporary_file&& tmp);
+	
+	const std::string& path() const { return path_; } ///< Path of the file, or empty string if none.
+	void remove(); ///< Remove the file now.
+	void release() { path_.clear(); } ///< Keep the file, e.g. after it was renamed.
+};
+
+
 
 template<class Number> inline Number sq(Number n) { return n * n; } ///< Get square of number.
 
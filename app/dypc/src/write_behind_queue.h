@@ -0,0 +1,211 @@
+#ifndef DYPC_WRITE_BEHIND_QUEUE_H_
+#define DYPC_WRITE_BEHIND_QUEUE_H_
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <cstddef>
+
+namespace dypc {
+
+/**
+ * Writes blocks of elements into a file on a dedicated writer thread.
+ * Producer threads enqueue contiguous blocks together with their destination, and continue computing while the
+ * writer thread writes them through the given write function. The writer thread takes all queued blocks at once,
+ * sorts them by destination, and merges small blocks that are adjacent in the file into one write. Queued blocks are
+ * bounded by a capacity: when it is exceeded, enqueue() waits until enough blocks have been written. So producers
+ * only wait for the disk when they are faster than it overall.
+ * The write function is only ever called from the writer thread, so it does not need to be thread safe.
+ * @tparam Element Type of elements written.
+ */
+template<class Element>
+class write_behind_queue {
+public:
+	/**
+	 * Function that writes elements into file.
+	 * Receives destination set, offset in set, and range of elements.
+	 */
+	using write_function = std::function<void(std::ptrdiff_t set, std::size_t offset, const Element* begin, const Element* end)>;
+
+private:
+	struct block {
+		std::ptrdiff_t set;
+		std::size_t offset;
+		std::vector<Element> elements;
+
+		std::size_t end_offset() const { return offset + elements.size(); }
+		bool operator<(const block& b) const { return (set == b.set ? offset < b.offset : set < b.set); }
+	};
+
+	static constexpr std::size_t merge_size_ = 64 * 1024; ///< Blocks smaller than this get merged with adjacent blocks.
+
+	write_function write_;
+	const std::size_t capacity_;
+
+	std::mutex mutex_;
+	std::condition_variable queued_condition_; ///< Notified when blocks get queued, or when finishing.
+	std::condition_variable written_condition_; ///< Notified when blocks have been written.
+	std::deque<block> queue_;
+	std::size_t queued_elements_ = 0; ///< Elements in queue and being written.
+	bool finishing_ = false;
+	std::exception_ptr error_;
+
+	std::thread thread_;
+
+	void thread_main_();
+	void write_blocks_(std::vector<block>&, std::vector<Element>& merged);
+
+public:
+	/**
+	 * Create queue and start writer thread.
+	 * @param write Function that writes elements into the file.
+	 * @param capacity Maximal number of queued elements. A single larger block is still accepted when the queue is empty.
+	 */
+	write_behind_queue(const write_function& write, std::size_t capacity);
+
+	write_behind_queue(const write_behind_queue&) = delete;
+	write_behind_queue& operator=(const write_behind_queue&) = delete;
+
+	/**
+	 * Destruct queue. Writes remaining blocks, but errors are dropped. Call finish() to get them.
+	 */
+	~write_behind_queue();
+
+	/**
+	 * Enqueue block of elements. Can be called from multiple threads.
+	 * Waits while capacity is exceeded. Throws if the writer thread failed.
+	 * @param set Destination set, passed to write function.
+	 * @param offset Offset in destination set, passed to write function.
+	 * @param elements The elements. Are moved into the queue.
+	 */
+	void enqueue(std::ptrdiff_t set, std::size_t offset, std::vector<Element>&& elements);
+
+	/**
+	 * Enqueue copy of range of elements. @see enqueue
+	 */
+	template<class Iterator>
+	void enqueue(std::ptrdiff_t set, std::size_t offset, Iterator begin, Iterator end) {
+		enqueue(set, offset, std::vector<Element>(begin, end));
+	}
+
+	/**
+	 * Wait until all blocks have been written, and stop writer thread.
+	 * Rethrows the exception thrown by the write function, if any. No blocks can be enqueued afterwards.
+	 */
+	void finish();
+};
+
+
+template<class Element>
+write_behind_queue<Element>::write_behind_queue(const write_function& write, std::size_t capacity) :
+write_(write), capacity_(capacity) {
+	thread_ = std::thread(&write_behind_queue::thread_main_, this);
+}
+
+
+template<class Element>
+write_behind_queue<Element>::~write_behind_queue() {
+	try {
+		finish();
+	} catch(...) { }
+}
+
+
+template<class Element>
+void write_behind_queue<Element>::enqueue(std::ptrdiff_t set, std::size_t offset, std::vector<Element>&& elements) {
+	if(elements.empty()) return;
+	std::unique_lock<std::mutex> lock(mutex_);
+	written_condition_.wait(lock, [&]() {
+		return error_ || queued_elements_ == 0 || queued_elements_ + elements.size() <= capacity_;
+	});
+	if(error_) std::rethrow_exception(error_);
+	if(finishing_) throw std::logic_error("Write behind queue already finished");
+
+	queued_elements_ += elements.size();
+	queue_.push_back(block { set, offset, std::move(elements) });
+	lock.unlock();
+	queued_condition_.notify_one();
+}
+
+
+template<class Element>
+void write_behind_queue<Element>::finish() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		finishing_ = true;
+	}
+	queued_condition_.notify_one();
+	if(thread_.joinable()) thread_.join();
+	if(error_) std::rethrow_exception(error_);
+}
+
+
+template<class Element>
+void write_behind_queue<Element>::thread_main_() {
+	std::vector<block> blocks;
+	std::vector<Element> merged;
+	for(;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			queued_condition_.wait(lock, [&]() { return finishing_ || ! queue_.empty(); });
+			if(queue_.empty()) return; // finishing, and all written
+			blocks.assign(std::make_move_iterator(queue_.begin()), std::make_move_iterator(queue_.end()));
+			queue_.clear();
+		}
+
+		std::size_t written = 0;
+		for(const block& b : blocks) written += b.elements.size();
+		try {
+			write_blocks_(blocks, merged);
+		} catch(...) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			error_ = std::current_exception();
+			queue_.clear();
+			written_condition_.notify_all();
+			return;
+		}
+		blocks.clear();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			queued_elements_ -= written;
+		}
+		written_condition_.notify_all();
+	}
+}
+
+
+template<class Element>
+void write_behind_queue<Element>::write_blocks_(std::vector<block>& blocks, std::vector<Element>& merged) {
+	std::sort(blocks.begin(), blocks.end());
+
+	auto it = blocks.begin();
+	while(it != blocks.end()) {
+		// Find run of small blocks that are adjacent in file
+		auto run_end = it + 1;
+		if(it->elements.size() < merge_size_) {
+			while(run_end != blocks.end() && run_end->set == it->set && run_end->offset == (run_end - 1)->end_offset() && run_end->elements.size() < merge_size_) ++run_end;
+		}
+
+		if(run_end - it == 1) {
+			write_(it->set, it->offset, it->elements.data(), it->elements.data() + it->elements.size());
+		} else {
+			merged.clear();
+			for(auto b = it; b != run_end; ++b) merged.insert(merged.end(), b->elements.begin(), b->elements.end());
+			write_(it->set, it->offset, merged.data(), merged.data() + merged.size());
+		}
+
+		for(auto b = it; b != run_end; ++b) std::vector<Element>().swap(b->elements); // Release memory early
+		it = run_end;
+	}
+}
+
+}
+
+#endif
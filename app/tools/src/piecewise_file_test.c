@@ -14,7 +14,9 @@ int main() {
 		2.0,
 		dypc_random_downsampling_mode,
 		5000,
-		2
+		2,
+		0,
+		NULL
 	);
 	return 0;
 }
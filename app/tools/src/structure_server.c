@@ -0,0 +1,27 @@
+#include <dypc/dypc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, const char* argv[]) {
+	if(argc < 3) {
+		fprintf(stderr, "Usage: %s structure_file address [loader_type] [point_memory_budget]\n", argv[0]);
+		fprintf(stderr, "Address is unix:path or host:port. Loader type is simple, ordered or prioritized.\n");
+		return 1;
+	}
+	
+	dypc_tree_structure_loader_type ltype = dypc_ordered_tree_structure_loader_type;
+	if(argc > 3) {
+		const char* name = argv[3];
+		if(strcmp(name, "simple") == 0) ltype = dypc_simple_tree_structure_loader_type;
+		else if(strcmp(name, "prioritized") == 0) ltype = dypc_prioritized_tree_structure_loader_type;
+	}
+	dypc_size point_memory_budget = (argc > 4 ? strtoull(argv[4], NULL, 10) : 0);
+	
+	dypc_serve_structure_file(argv[1], ltype, point_memory_budget, argv[2]);
+	if(dypc_error) {
+		fprintf(stderr, "%s\n", dypc_error_message());
+		return 1;
+	}
+	return 0;
+}
@@ -37,50 +37,63 @@ renderer::renderer(float w, float h) : viewport_width_(w), viewport_height_(h) {
 
 renderer::~renderer() {
 	if(shaders_) delete shaders_;
-	if(renderer_point_buffer_) glDeleteBuffers(1, &renderer_point_buffer_);
-	if(loader_point_buffer_) glDeleteBuffers(1, &loader_point_buffer_);
+	if(point_buffers_[0]) glDeleteBuffers(3, point_buffers_);
 }
 
-void renderer::initialize_point_buffers_() {	
-	if(! renderer_point_buffer_) glGenBuffers(1, &renderer_point_buffer_);
-	glBindBuffer(GL_ARRAY_BUFFER, renderer_point_buffer_);
-	glBufferData(GL_ARRAY_BUFFER, point_buffer_capacity_*sizeof(dypc_point), nullptr, GL_STREAM_DRAW);
-
-	if(! loader_point_buffer_) glGenBuffers(1, &loader_point_buffer_);
-	glBindBuffer(GL_ARRAY_BUFFER, loader_point_buffer_);
-	glBufferData(GL_ARRAY_BUFFER, point_buffer_capacity_*sizeof(dypc_point), nullptr, GL_STREAM_DRAW);
+void renderer::initialize_point_buffers_() {
+	if(! point_buffers_[0]) glGenBuffers(3, point_buffers_);
 
+	// Buffer 0 is initially rendered, buffers 1 and 2 are handed to the updater mapped
+	dypc_points_buffer mapped_buffers[3] = { nullptr, nullptr, nullptr };
+	for(std::ptrdiff_t i = 0; i < 3; ++i) {
+		glBindBuffer(GL_ARRAY_BUFFER, point_buffers_[i]);
+		glBufferData(GL_ARRAY_BUFFER, point_buffer_capacity_*sizeof(dypc_point), nullptr, GL_STREAM_DRAW);
+		if(i != 0) mapped_buffers[i] = (dypc_points_buffer)glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+	}
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	renderer_point_buffer_ = point_buffers_[0];
+	renderer_point_buffer_size_ = 0;
+	updater_.reset(mapped_buffers, point_buffer_capacity_);
 }
 
-void renderer::update_request_() {
-	updater_.set_request(-position_, -velocity_, orientation_, projection_matrix_ * view_matrix_);
+void renderer::update_request_(float dtime) {
+	if(updater_.is_speculative() && dtime > 0.0) {
+		// Extrapolate camera motion of the last frame up to the next updater check
+		float steps = std::chrono::duration<float>(updater_.get_check_interval()).count() / dtime;
+		glm::vec3 predicted_position = position_ + (position_ - previous_position_) * steps;
+		glm::quat rotation = orientation_ * glm::inverse(previous_orientation_);
+		glm::quat predicted_orientation = glm::normalize(glm::slerp(glm::quat(1.0, 0.0, 0.0, 0.0), rotation, steps) * orientation_);
+		glm::mat4 predicted_view_matrix = view_matrix_for_(predicted_position, predicted_orientation);
+		updater_.set_predicted_request(-predicted_position, -velocity_, predicted_orientation, projection_matrix_ * predicted_view_matrix, viewport_height_);
+	}
+	updater_.set_request(-position_, -velocity_, orientation_, projection_matrix_ * view_matrix_, viewport_height_);
+
+	previous_position_ = position_;
+	previous_orientation_ = orientation_;
 }
 
 void renderer::check_updater_() {
-	if(! updater_.is_finished()) return;
+	if(! updater_.new_points_available()) return;
 
-	glBindBuffer(GL_ARRAY_BUFFER, loader_point_buffer_);
-	std::size_t sz;
-	if(updater_.new_points_available(sz)) {
-		auto valid = glUnmapBuffer(GL_ARRAY_BUFFER);
-		if(valid) {
-			std::swap(loader_point_buffer_, renderer_point_buffer_);
-			renderer_point_buffer_size_ = sz;
-		}
-		
-		if(callback_) callback_(just_changed_loader_);
-		just_changed_loader_ = false;
-	} else {
-		glUnmapBuffer(GL_ARRAY_BUFFER); // does nothing if buffer was not mapped
-		renderer_point_buffer_size_ = 0;
-	}
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	
-	glBindBuffer(GL_ARRAY_BUFFER, loader_point_buffer_);	
+	// Map the buffer rendered until now, so that the updater can fill it again later
+	glBindBuffer(GL_ARRAY_BUFFER, point_buffers_[updater_.rendered_buffer_index()]);
 	auto buf = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-	if(buf) updater_.reset((dypc_points_buffer)buf, point_buffer_capacity_);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	if(! buf) return;
+
+	std::size_t sz;
+	std::ptrdiff_t index = updater_.take_new_points((dypc_points_buffer)buf, sz);
+
+	glBindBuffer(GL_ARRAY_BUFFER, point_buffers_[index]);
+	auto valid = glUnmapBuffer(GL_ARRAY_BUFFER);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	renderer_point_buffer_ = point_buffers_[index];
+	renderer_point_buffer_size_ = (valid ? sz : 0);
+
+	if(callback_) callback_(just_changed_loader_);
+	just_changed_loader_ = false;
 }
 
 void renderer::compute_projection_matrix_() {
@@ -88,14 +101,18 @@ void renderer::compute_projection_matrix_() {
 	glUniformMatrix4fv(projection_matrix_uniform_, 1, GL_FALSE, &projection_matrix_[0][0]);
 }
 
+glm::mat4 renderer::view_matrix_for_(const glm::vec3& position, const glm::quat& orientation) const {
+	glm::mat4 scale_matrix = glm::scale(scale_, scale_, scale_);
+	glm::mat4 translation_matrix = glm::translate(position);
+	glm::mat4 rotation_matrix = glm::mat4_cast(orientation);
+	
+	return rotation_matrix * translation_matrix * scale_matrix;
+}
+
 void renderer::compute_view_matrix_() {
 	compute_projection_matrix_();
 	
-	glm::mat4 scale_matrix = glm::scale(scale_, scale_, scale_);
-	glm::mat4 translation_matrix = glm::translate(position_);
-	glm::mat4 rotation_matrix = glm::mat4_cast(orientation_);
-	
-	view_matrix_ = rotation_matrix * translation_matrix * scale_matrix;
+	view_matrix_ = view_matrix_for_(position_, orientation_);
 	
 	glUniformMatrix4fv(view_matrix_uniform_, 1, GL_FALSE, &view_matrix_[0][0]);
 }
@@ -133,7 +150,7 @@ void renderer::draw(float dtime) {
 
 	compute_motion_(dtime);
 	compute_view_matrix_();
-	update_request_();
+	update_request_(dtime);
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -198,6 +215,7 @@ void renderer::set_configuration(float fov, float scale, unsigned char bg_r, uns
 	fov_ = fov;
 	scale_ = scale;
 	compute_projection_matrix_();
+	updater_.set_speculation_tolerance(speculation_position_tolerance_ * scale_, speculation_orientation_tolerance_);
 	
 	background_color_[0] = (float)bg_r / 255.0;
 	background_color_[1] = (float)bg_g / 255.0;
@@ -28,7 +28,7 @@ class loader;
 
 /**
  * OpenGL renderer for point cloud.
- * Renders point sets outputted by loader. Operates using buffer swapping: There are two point buffers allocated (OpenGL buffer object), where one is used for rendering while the other one is periodically being filled by the loader with a new point set on a different thread. Upon completion, the buffers' roles are swapped.
+ * Renders point sets outputted by loader. Operates using triple buffering: There are three point buffers allocated (OpenGL buffer object). One is used for rendering, one is being filled by the loader on a different thread, and the third holds the latest completed point set until the renderer picks it up. The roles are rotated by the updater.
  * Contains the updater, which periodically takes input from a loader. @see updater
  * Also handles motion (using velocity vector, and simulated damping), and shaders.
  */
@@ -37,8 +37,8 @@ private:
 	updater updater_; ///< The updater.
 	
 	std::size_t point_buffer_capacity_ = 1000000; ///< Capacity for point buffers.
+	GLuint point_buffers_[3] = { 0, 0, 0 }; ///< OpenGL buffer objects, indexed like the output buffers of the updater.
 	GLuint renderer_point_buffer_ = 0; ///< OpenGL buffer object used for rendering.
-	GLuint loader_point_buffer_ = 0; ///< OpenGL buffer object used for filling by loader.
 	std::size_t renderer_point_buffer_size_ = 0; ///< Number of points in rendered buffer.
 		
 	const float viewport_width_; ///< Width of viewport.
@@ -62,21 +62,26 @@ private:
 	GLint maximal_shadow_distance_uniform_;
 		
 	float scale_ = 1.0;
+	static constexpr float speculation_position_tolerance_ = 0.05; ///< Position tolerance of speculative updates at scale 1. Camera positions are scaled along with the model.
+	static constexpr float speculation_orientation_tolerance_ = 0.01; ///< Orientation tolerance of speculative updates, in radiants.
 	glm::vec3 position_; ///< Current camera position.
 	glm::quat orientation_; ///< Current camera orientation as quaternion.
 	glm::vec3 velocity_; ///< Current camera velocity.
 	glm::vec3 view_target_velocity_;
+	glm::vec3 previous_position_; ///< Camera position at previous frame, used to predict motion.
+	glm::quat previous_orientation_; ///< Camera orientation at previous frame, used to predict motion.
 	
 	std::function<void(bool)> callback_;
 	bool just_changed_loader_ = false;
 
 	void compute_projection_matrix_();
 	void compute_view_matrix_();
+	glm::mat4 view_matrix_for_(const glm::vec3& position, const glm::quat& orientation) const;
 	void compute_motion_(float dtime);
 	void compute_fps_();
 	
 	void initialize_point_buffers_();
-	void update_request_();
+	void update_request_(float dtime);
 	void check_updater_();
 	
 	void initialize_gl_();
@@ -104,6 +109,8 @@ public:
 	void set_updater_check_interval(std::chrono::milliseconds i) { updater_.set_check_interval(i); }
 	bool get_updater_check_condition() const { return updater_.get_check_condition(); }
 	void set_updater_check_condition(bool c) { updater_.set_check_condition(c); }
+	bool get_updater_speculative() const { return updater_.is_speculative(); }
+	void set_updater_speculative(bool s) { updater_.set_speculative(s); }
 	
 	void set_loader_downsampling_setting(float setting);
 	float get_loader_downsampling_setting();
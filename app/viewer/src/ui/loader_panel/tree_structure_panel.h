@@ -20,12 +20,20 @@ private:
 			default: return dypc_minimal_cuboid_distance_mode;
 		}
 	}
+	
+	dypc_lod_selection_mode get_selected_lod_selection_() {
+		if(dist_choice->GetSelection() == 4) return dypc_screen_space_error_lod_selection_mode;
+		else return dypc_distance_lod_selection_mode;
+	}
 
 	void update_() {
 		updater_.set_loader_settings({
 			{ "minimal_number_of_points_for_split", (double)min_split_spin->GetValue() },
 			{ "downsampling_node_distance", (double)get_selected_distance_() },
+			{ "lod_selection", (double)get_selected_lod_selection_() },
 			{ "additional_split_distance_difference", (double)add_split_diff_spin->GetValue() },
+			{ "occlusion_culling", (occlusion_check->GetValue() ? 1.0 : 0.0) },
+			{ "point_culling", (point_culling_check->GetValue() ? 1.0 : 0.0) },
 		});
 	}
 	
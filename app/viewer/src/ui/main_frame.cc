@@ -72,6 +72,11 @@ void main_frame::updated_callback_(bool changed_loader) {
 	if(nval > 1000) loader_time->SetForegroundColour(color_red);
 	else if(nval > 300) loader_time->SetForegroundColour(color_yellow);
 	else loader_time->SetForegroundColour(color_green);
+	
+	const updater& upd = get_renderer_().get_updater();
+	std::string speculation_str;
+	if(upd.is_speculative()) speculation_str = std::to_string(upd.get_speculation_hits()) + " hits, " + std::to_string(upd.get_speculation_misses()) + " misses";
+	loader_speculation->SetLabel(wxString(speculation_str.c_str(), wxConvUTF8));
 }
 
 
@@ -191,9 +196,11 @@ void main_frame::on_loader_config_() {
 	bool paused = loader_paused->IsChecked();
 	std::chrono::milliseconds interval( loader_interval->GetValue() );
 	bool check_condition = loader_check_condition->IsChecked();
+	bool speculative = loader_speculative->IsChecked();
 	
 	rd.set_updater_paused(paused);
 	rd.set_updater_check_condition(check_condition);
+	rd.set_updater_speculative(speculative);
 	rd.set_updater_check_interval(interval);
 	
 	float setting = (float)downsampling_setting->GetValue();
@@ -20,16 +20,18 @@ dypc_loader tree_structure_create::create_memory_loader(dypc_model mod) const {
 	unsigned leaf_cap = capacity_spin->GetValue();
 	std::size_t dmin = dmin_spin->GetValue();
 	double damount; amount_text->GetLineText(0).ToDouble(&damount);
-	dypc_downsampling_mode dmode = (mode_choice->GetSelection() == 0 ? dypc_random_downsampling_mode : dypc_uniform_downsampling_mode);
+	dypc_downsampling_mode dmode = (mode_choice->GetSelection() % 2 == 0 ? dypc_random_downsampling_mode : dypc_uniform_downsampling_mode);
+	dypc_bool additive = (mode_choice->GetSelection() >= 2);
 
 	dypc_tree_structure_loader_type ltypes[] = {
 		dypc_simple_tree_structure_loader_type,
-		dypc_ordered_tree_structure_loader_type
+		dypc_ordered_tree_structure_loader_type,
+		dypc_prioritized_tree_structure_loader_type
 	};
-	std::vector<std::string> choices = { "Simple", "Ordered Nodes" };
+	std::vector<std::string> choices = { "Simple", "Ordered Nodes", "Prioritized Nodes" };
 	std::ptrdiff_t i = user_choice(choices, "Type of tree loader");
 	if(i >= 0 && i < 3) {
-		return dypc_create_tree_structure_loader(mod, structure_type_, selected_levels_(), leaf_cap, dmin, damount, dmode, ltypes[i]);
+		return dypc_create_tree_structure_loader(mod, structure_type_, selected_levels_(), leaf_cap, dmin, damount, dmode, ltypes[i], additive);
 	} else {
 		return nullptr;
 	}
@@ -39,11 +41,12 @@ void tree_structure_create::write_structure_file(dypc_model mod, const std::stri
 	unsigned leaf_cap = capacity_spin->GetValue();
 	std::size_t dmin = dmin_spin->GetValue();
 	double damount; amount_text->GetLineText(0).ToDouble(&damount);
-	dypc_downsampling_mode dmode = (mode_choice->GetSelection() == 0 ? dypc_random_downsampling_mode : dypc_uniform_downsampling_mode);
+	dypc_downsampling_mode dmode = (mode_choice->GetSelection() % 2 == 0 ? dypc_random_downsampling_mode : dypc_uniform_downsampling_mode);
+	dypc_bool additive = (mode_choice->GetSelection() >= 2);
 	unsigned piece_cap = piece_capacity_spin->GetValue();
 	unsigned threads = threads_spin->GetValue();
 
-	dypc_write_tree_structure_to_file(filename.c_str(), mod, structure_type_, selected_levels_(), leaf_cap, dmin, damount, dmode, piece_cap, threads);
+	dypc_write_tree_structure_to_file(filename.c_str(), mod, structure_type_, selected_levels_(), leaf_cap, dmin, damount, dmode, piece_cap, threads, additive, nullptr);
 }
 
 
@@ -0,0 +1,69 @@
+#ifndef DYPC_TRIPLE_BUFFER_H_
+#define DYPC_TRIPLE_BUFFER_H_
+
+#include <atomic>
+#include <cstddef>
+
+namespace dypc {
+
+/**
+ * Lock-free triple buffer, for handing values from one producer thread to one consumer thread.
+ * The producer writes into back() and calls publish(), which exchanges the back slot with the middle slot. The consumer
+ * calls consume(), which exchanges the front slot with the middle slot if it holds a newly published value, and then
+ * reads front(). Neither side ever waits for the other, and the consumer always gets the latest published value.
+ */
+template<class T>
+class triple_buffer {
+private:
+	static constexpr unsigned fresh_flag_ = 4; ///< Set on middle index when it was published and not yet consumed.
+
+	T slots_[3] {};
+	unsigned back_ = 1; ///< Index of back slot, only accessed by producer.
+	unsigned front_ = 0; ///< Index of front slot, only accessed by consumer.
+	std::atomic<unsigned> middle_; ///< Index of middle slot, with fresh flag.
+
+public:
+	triple_buffer() : middle_(2) { }
+	triple_buffer(const triple_buffer&) = delete;
+	triple_buffer& operator=(const triple_buffer&) = delete;
+
+	/// Set slot indices to initial state: front is 0, back is 1, middle is 2. Not thread safe.
+	void reset() {
+		front_ = 0;
+		back_ = 1;
+		middle_ = 2;
+	}
+
+	T& operator[](std::ptrdiff_t i) { return slots_[i]; } ///< Access slot by index. Not thread safe.
+
+	T& back() { return slots_[back_]; } ///< Slot the producer writes into.
+	std::ptrdiff_t back_index() const { return back_; }
+	T& front() { return slots_[front_]; } ///< Slot the consumer reads from.
+	const T& front() const { return slots_[front_]; }
+	std::ptrdiff_t front_index() const { return front_; }
+
+	/// Make back slot available to consumer. Called by producer.
+	void publish() {
+		back_ = middle_.exchange(back_ | fresh_flag_, std::memory_order_acq_rel) & ~fresh_flag_;
+	}
+
+	/// Check whether a value was published and not yet consumed. Called by consumer.
+	bool has_fresh() const {
+		return (middle_.load(std::memory_order_acquire) & fresh_flag_);
+	}
+
+	/**
+	 * Take latest published value into front slot. Called by consumer.
+	 * The previous front slot becomes the middle slot, and can later be reused as back slot by the producer.
+	 * @return Whether there was a new value. If not, front slot is unchanged.
+	 */
+	bool consume() {
+		if(! has_fresh()) return false;
+		front_ = middle_.exchange(front_, std::memory_order_acq_rel) & ~fresh_flag_;
+		return true;
+	}
+};
+
+}
+
+#endif
@@ -1,38 +1,61 @@
 #include "updater.h"
 
+#include <cmath>
+#include <algorithm>
+
 namespace dypc {
 
 updater::updater() :
-	loader_(nullptr), points_(nullptr), points_count_(0), points_capacity_(0),
-	finished_(false), stop_(true), force_update_(false) { }
+	loader_(nullptr), check_interval_(std::chrono::milliseconds(100)), check_condition_(true), output_capacity_(0),
+	request_sequence_(0), handled_request_sequence_(0), sleeping_(false),
+	stop_(true), force_update_(false), last_compute_duration_(std::chrono::milliseconds(0)),
+	speculative_(false), speculation_position_tolerance_(0.05), speculation_orientation_tolerance_(0.01),
+	speculation_hits_(0), speculation_misses_(0), speculation_ready_(false),
+	speculation_session_(nullptr), speculation_session_outdated_(true) { }
 
 
 updater::~updater() {
 	stop();
+	if(speculation_session_) dypc_delete_loader(speculation_session_);
 	if(loader_) dypc_delete_loader(loader_);
 }
 
 
 void updater::set_check_interval(std::chrono::milliseconds interval) {
-	configuration_mutex_.lock();
 	check_interval_ = interval;
-	configuration_mutex_.unlock();
 }
 
 
 void updater::set_check_condition(bool check) {
-	configuration_mutex_.lock();
 	check_condition_ = check;
-	configuration_mutex_.unlock();
+}
+
+
+void updater::set_speculative(bool speculative) {
+	if(speculative && ! speculative_) {
+		speculation_hits_ = 0;
+		speculation_misses_ = 0;
+	}
+	speculative_ = speculative;
+}
+
+
+void updater::set_speculation_tolerance(float position, float orientation) {
+	speculation_position_tolerance_ = position;
+	speculation_orientation_tolerance_ = orientation;
 }
 
 
 void updater::switch_loader(dypc_loader ld) {
 	configuration_mutex_.lock();
+	if(speculation_session_) dypc_delete_loader(speculation_session_);
+	speculation_session_ = nullptr;
+	speculation_session_outdated_ = true;
 	if(loader_) dypc_delete_loader(loader_);
 	loader_ = ld;
 	force_update_ = true;
 	configuration_mutex_.unlock();
+	wake_();
 }
 
 
@@ -45,6 +68,7 @@ void updater::access_loader(std::function<void(dypc_loader)> fct) {
 	configuration_mutex_.lock();
 	try {
 		fct(loader_);
+		speculation_session_outdated_ = true; // Session has its own copy of the settings
 		configuration_mutex_.unlock();
 	} catch(...) {
 		configuration_mutex_.unlock();
@@ -72,6 +96,7 @@ void updater::set_loader_settings(const std::map<std::string, double>& settings)
 void updater::stop() {
 	if(! is_running()) return;
 	stop_ = true;
+	wake_();
 	thread_.join();
 }
 
@@ -79,89 +104,197 @@ void updater::start() {
 	if(is_running()) return;
 	force_update_ = true;
 	stop_ = false;
-	finished_ = false;
+	speculation_ready_ = false;
 	thread_ = std::thread(&updater::thread_main_, this);
 }
 
 void updater::update_now() {
 	if(is_running()) {
 		force_update_ = true;
-	} else if(loader_) {
-		dypc_size count = points_capacity_;
-		dypc_loader_compute_points(loader_, &next_request_, points_, &count);
-		points_count_ = count;
-		finished_ = true;
+		wake_();
+	} else if(loader_ && output_.back().points) {
+		output_buffer& output = output_.back();
+		dypc_size count = output_capacity_;
+		dypc_loader_compute_points(loader_, &request_.request, output.points, &count);
+		output.count = count;
+		output_.publish();
 	}
 }
 
 
+void updater::wait_for_request_() {
+	std::unique_lock<std::mutex> lock(wake_mutex_);
+	sleeping_ = true;
+	wake_condition_.wait(lock, [&]() -> bool {
+		return stop_ || force_update_ || request_sequence_ != handled_request_sequence_;
+	});
+	sleeping_ = false;
+}
+
+
+void updater::wait_until_(clock::time_point deadline) {
+	std::unique_lock<std::mutex> lock(wake_mutex_);
+	sleeping_ = true;
+	wake_condition_.wait_until(lock, deadline, [&]() -> bool {
+		return stop_ || force_update_;
+	});
+	sleeping_ = false;
+}
+
+
+void updater::wake_() {
+	// sleeping_ gets set before the thread checks its wake condition, and the condition variable only gets notified
+	// while holding wake_mutex_. So the wakeup cannot get lost, and the caller does not need to lock when the thread is busy.
+	if(! sleeping_) return;
+	std::lock_guard<std::mutex> lock(wake_mutex_);
+	wake_condition_.notify_one();
+}
+
+
+bool updater::within_speculation_tolerance_(const dypc_loader_request& request, const dypc_loader_request& predicted_request) const {
+	glm::vec3 position(request.position[0], request.position[1], request.position[2]);
+	glm::vec3 predicted_position(predicted_request.position[0], predicted_request.position[1], predicted_request.position[2]);
+	if(glm::distance(position, predicted_position) > speculation_position_tolerance_) return false;
+
+	float dot = 0.0;
+	for(std::ptrdiff_t i = 0; i < 4; ++i) dot += request.orientation[i] * predicted_request.orientation[i];
+	float angle = 2.0 * std::acos(std::min(std::abs(dot), 1.0f));
+	if(angle > speculation_orientation_tolerance_) return false;
+
+	return (request.viewport_height == predicted_request.viewport_height);
+}
+
+
+bool updater::update_speculation_session_() {
+	if(speculation_session_outdated_) {
+		if(speculation_session_) dypc_delete_loader(speculation_session_);
+		speculation_session_ = (loader_ ? dypc_create_loader_session(loader_) : nullptr);
+		if(! speculation_session_) dypc_clear_error(); // Loader does not support sessions
+		speculation_session_outdated_ = false;
+	}
+	return (speculation_session_ != nullptr);
+}
+
+
+bool updater::speculate_(const request_entry& entry, const dypc_loader_request& request, clock::time_point deadline) {
+	if(! speculative_ || ! entry.has_prediction) return false;
+	if(! loader_ || ! output_.back().points) return false;
+	if(clock::now() + last_compute_duration_.load() > deadline) return false;
+	if(! update_speculation_session_()) return false;
+	
+	dypc_milliseconds dtime = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now()).count();
+	if(check_condition_ && ! dypc_loader_should_compute_points(speculation_session_, &entry.predicted_request, &request, dtime)) return false;
+
+	output_buffer& output = output_.back();
+	dypc_size count = output_capacity_;
+	dypc_loader_compute_points(speculation_session_, &entry.predicted_request, output.points, &count);
+	output.count = count;
+	speculated_request_ = entry.predicted_request;
+	return true;
+}
+
+
 void updater::thread_main_() {
-	auto previous_time = std::chrono::high_resolution_clock::now();
+	clock::time_point previous_time = clock::now();
 	dypc_loader_request previous_request;
-	while(! stop_) {		
+	while(! stop_) {
+		wait_for_request_();
+		if(stop_) break;
+
+		clock::time_point check_time = clock::now();
+		handled_request_sequence_ = request_sequence_;
+		requests_.consume();
+		const request_entry& entry = requests_.front();
+		const dypc_loader_request& request = entry.request;
+		bool force = force_update_.exchange(false);
+		clock::time_point next_check_time = check_time + check_interval_.load();
+
 		configuration_mutex_.lock();
-		
-		next_request_mutex_.lock();
-		dypc_loader_request request = next_request_;
-		next_request_mutex_.unlock();
-			
-		auto now = std::chrono::high_resolution_clock::now();	
-		std::chrono::milliseconds dtime = std::chrono::duration_cast<std::chrono::milliseconds>(now - previous_time);
-				
-		if(loader_ && (force_update_ || !check_condition_ || dypc_loader_should_compute_points(loader_, &request, &previous_request, dtime.count()))) {
-			using namespace std::chrono;
-
-			high_resolution_clock::time_point start_time = high_resolution_clock::now();
-			
-			dypc_size count = points_capacity_;
-			dypc_loader_compute_points(loader_, &request, points_, &count);
-			points_count_ = count;
-
-			high_resolution_clock::time_point end_time = high_resolution_clock::now();
-			last_compute_duration_ = duration_cast<std::chrono::milliseconds>(end_time - start_time);
-			
+
+		bool updated = false;
+		if(speculation_ready_) {
+			// Points for predicted request are in back buffer. Discarded when update is forced, because then loader changed
+			speculation_ready_ = false;
+			if(! force && within_speculation_tolerance_(request, speculated_request_)) {
+				output_.publish();
+				++speculation_hits_;
+				updated = true;
+			} else if(! force) {
+				++speculation_misses_;
+			}
+		}
+
+		std::chrono::milliseconds dtime = std::chrono::duration_cast<std::chrono::milliseconds>(check_time - previous_time);
+		output_buffer& output = output_.back();
+		if(! updated && loader_ && output.points && (force || !check_condition_ || dypc_loader_should_compute_points(loader_, &request, &previous_request, dtime.count()))) {
+			dypc_size count = output_capacity_;
+			dypc_loader_compute_points(loader_, &request, output.points, &count);
+			output.count = count;
+			last_compute_duration_ = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - check_time);
+			output_.publish();
+			updated = true;
+		}
+
+		if(updated) {
 			previous_request = request;
-			previous_time = now;
-			
-			finished_ = true;
-			force_update_ = false;
+			previous_time = check_time;
 		}
-			
+
+		speculation_ready_ = speculate_(entry, request, next_check_time);
+
 		configuration_mutex_.unlock();
-		
-		if(last_compute_duration_ < check_interval_) std::this_thread::sleep_for(check_interval_ - last_compute_duration_);
-		while(finished_ && !stop_) std::this_thread::sleep_for(check_interval_);
+
+		wait_until_(next_check_time);
 	}
 }
 
 
-void updater::set_request(const glm::vec3& position, const glm::vec3& velocity, const glm::quat& orientation, const glm::mat4& view_projection_matrix) {
-	next_request_mutex_.lock();
-	for(std::ptrdiff_t i = 0; i < 3; ++i) next_request_.position[i] = position[i];
-	for(std::ptrdiff_t i = 0; i < 3; ++i) next_request_.velocity[i] = velocity[i];
-	for(std::ptrdiff_t i = 0; i < 4; ++i) next_request_.orientation[i] = orientation[i];
-	for(std::ptrdiff_t i = 0; i < 16; ++i) next_request_.view_projection_matrix[i] = view_projection_matrix[i/4][i%4];
-	next_request_mutex_.unlock();
+void updater::fill_request_(dypc_loader_request& request, const glm::vec3& position, const glm::vec3& velocity, const glm::quat& orientation, const glm::mat4& view_projection_matrix, float viewport_height) {
+	for(std::ptrdiff_t i = 0; i < 3; ++i) request.position[i] = position[i];
+	for(std::ptrdiff_t i = 0; i < 3; ++i) request.velocity[i] = velocity[i];
+	for(std::ptrdiff_t i = 0; i < 4; ++i) request.orientation[i] = orientation[i];
+	for(std::ptrdiff_t i = 0; i < 16; ++i) request.view_projection_matrix[i] = view_projection_matrix[i/4][i%4];
+	request.viewport_height = viewport_height;
 }
-	
-	
-bool updater::new_points_available(std::size_t& count) const {
-	count = points_count_;
-	return finished_;
+
+
+void updater::set_request(const glm::vec3& position, const glm::vec3& velocity, const glm::quat& orientation, const glm::mat4& view_projection_matrix, float viewport_height) {
+	fill_request_(request_.request, position, velocity, orientation, view_projection_matrix, viewport_height);
+
+	requests_.back() = request_;
+	requests_.publish();
+	++request_sequence_;
+	wake_();
+
+	request_.has_prediction = false;
 }
 
-std::chrono::milliseconds updater::get_last_compute_duration() {
-	if(! finished_) throw std::logic_error("Cannot get last compute duration when it is not idle.");
-	return last_compute_duration_;
+
+void updater::set_predicted_request(const glm::vec3& position, const glm::vec3& velocity, const glm::quat& orientation, const glm::mat4& view_projection_matrix, float viewport_height) {
+	fill_request_(request_.predicted_request, position, velocity, orientation, view_projection_matrix, viewport_height);
+	request_.has_prediction = true;
 }
 
-void updater::reset(dypc_points_buffer buffer, std::size_t output_buffer_capacity_) {
-	if(! finished_) throw std::logic_error("Cannot reset loader when it is not idle.");
-	
-	points_ = buffer;
-	points_count_ = 0;
-	points_capacity_ = output_buffer_capacity_;
-	finished_ = false;
+
+std::ptrdiff_t updater::take_new_points(dypc_points_buffer released_buffer, std::size_t& count) {
+	output_.front().points = released_buffer;
+	output_.front().count = 0;
+	output_.consume();
+	count = output_.front().count;
+	return output_.front_index();
+}
+
+
+void updater::reset(const dypc_points_buffer buffers[3], std::size_t capacity) {
+	if(is_running()) throw std::logic_error("Cannot reset output buffers while updater is running.");
+
+	output_.reset();
+	speculation_ready_ = false;
+	for(std::ptrdiff_t i = 0; i < 3; ++i) {
+		output_[i].points = buffers[i];
+		output_[i].count = 0;
+	}
+	output_capacity_ = capacity;
 }
 
 
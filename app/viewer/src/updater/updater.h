@@ -3,9 +3,12 @@
 
 #include <dypc/dypc.h>
 
+#include "triple_buffer.h"
+
 #include <stdexcept>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
 #include <chrono>
 #include <string>
@@ -13,6 +16,7 @@
 #include <functional>
 #include <vector>
 #include <map>
+#include <cstdint>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
@@ -21,59 +25,144 @@
 
 namespace dypc {
 
+/**
+ * Runs loader on separate thread.
+ * Requests are passed from the renderer to the thread through a triple buffer, with a sequence number so that the
+ * thread knows when a new one arrived. Output goes into three point buffers, also rotated as a triple buffer: the
+ * renderer draws the front buffer, the loader fills the back buffer, and the middle one holds the latest finished
+ * point set. So the loader never needs to wait for the renderer to pick up its output. The thread sleeps on a
+ * condition variable, and gets woken up when a new request arrives, an update is forced, or it is stopped.
+ *
+ * In speculative mode, the caller also sets a request for the pose it predicts at the next check. When time remains
+ * before the next check, the thread computes points for the predicted request into the back buffer without
+ * publishing them. If the actual request then lies within tolerance of the prediction, these points are published
+ * without running the loader again. Speculation runs on a session of the loader, so that predicted requests do not
+ * change the state that the loader keeps across requests. Loaders that do not support sessions are not speculated on.
+ */
 class updater {
+public:
+	using clock = std::chrono::steady_clock;
+
+	/// Point buffer the loader writes into.
+	struct output_buffer {
+		dypc_points_buffer points = nullptr; ///< Mapped buffer, or null if unavailable.
+		std::size_t count = 0; ///< Number of points written.
+	};
+
 private:
 	dypc_loader loader_;
-	std::chrono::milliseconds check_interval_ = std::chrono::milliseconds(100);
-	bool check_condition_ = true;
+	std::atomic<std::chrono::milliseconds> check_interval_;
+	std::atomic_bool check_condition_;
 	std::mutex configuration_mutex_;
 
-	dypc_points_buffer points_;
-	std::size_t points_count_;
-	std::size_t points_capacity_;
+	triple_buffer<output_buffer> output_;
+	std::size_t output_capacity_;
+
+	/// Request and predicted request, passed to the thread together.
+	struct request_entry {
+		dypc_loader_request request;
+		dypc_loader_request predicted_request;
+		bool has_prediction = false;
+	};
+
+	request_entry request_; ///< Last request set, owned by caller of set_request().
+	triple_buffer<request_entry> requests_;
+	std::atomic<std::uint64_t> request_sequence_;
+	std::uint64_t handled_request_sequence_; ///< Sequence number of last request taken by thread.
+
+	std::mutex wake_mutex_;
+	std::condition_variable wake_condition_;
+	std::atomic_bool sleeping_;
 
-	dypc_loader_request next_request_;
-	std::mutex next_request_mutex_;
-	
-	std::atomic_bool finished_;
 	std::atomic_bool stop_;
 	std::atomic_bool force_update_;
 	std::thread thread_;
 
-	std::chrono::milliseconds last_compute_duration_ = std::chrono::milliseconds(0);
+	std::atomic<std::chrono::milliseconds> last_compute_duration_;
+
+	std::atomic_bool speculative_;
+	std::atomic<float> speculation_position_tolerance_;
+	std::atomic<float> speculation_orientation_tolerance_;
+	std::atomic<std::size_t> speculation_hits_;
+	std::atomic<std::size_t> speculation_misses_;
+	dypc_loader_request speculated_request_; ///< Request for which back output buffer holds points, if speculation_ready_.
+	bool speculation_ready_;
+	dypc_loader speculation_session_; ///< Session of loader used for speculation, or null.
+	bool speculation_session_outdated_; ///< Whether loader or its settings changed since session was created.
+
+	static void fill_request_(dypc_loader_request&, const glm::vec3& position, const glm::vec3& velocity, const glm::quat& orientation, const glm::mat4& view_projection_matrix, float viewport_height);
+	bool within_speculation_tolerance_(const dypc_loader_request& request, const dypc_loader_request& predicted_request) const;
+	
+	/**
+	 * Recreate speculation session if loader or its settings changed.
+	 * Must be called with configuration_mutex_ locked.
+	 * @return Whether a session is available.
+	 */
+	bool update_speculation_session_();
+	
+	/**
+	 * Compute points for predicted request into back output buffer, without publishing them.
+	 * Does nothing if there is no prediction, if the loader considers that the predicted pose would not need an update
+	 * from the current one, or if the computation would likely not finish before the next check. Must be called with
+	 * configuration_mutex_ locked.
+	 * @return Whether points were computed.
+	 */
+	bool speculate_(const request_entry&, const dypc_loader_request& request, clock::time_point deadline);
 
 	void thread_main_();
+	void wait_for_request_();
+	void wait_until_(clock::time_point);
+	void wake_();
 
 public:
 	updater();
 	~updater();
-	
+
 	void switch_loader(dypc_loader);
 	void delete_loader();
 	void access_loader(std::function<void(dypc_loader)>);
 	double get_loader_setting(const std::string&);
 	void set_loader_settings(const std::map<std::string, double>&);
 	void set_loader_setting(const std::string& setting, double value) { set_loader_settings({{setting, value}}); }
-	
+
 	void set_check_interval(std::chrono::milliseconds);
 	void set_check_condition(bool);
 	std::chrono::milliseconds get_check_interval() const { return check_interval_; }
 	bool get_check_condition() const { return check_condition_; }
 
-	void set_request(const glm::vec3& position, const glm::vec3& velocity, const glm::quat& orientation, const glm::mat4& view_projection_matrix);
-	const dypc_loader_request& get_request() const { return next_request_; }
+	void set_request(const glm::vec3& position, const glm::vec3& velocity, const glm::quat& orientation, const glm::mat4& view_projection_matrix, float viewport_height);
 	
-	bool new_points_available(std::size_t&) const;
-	bool is_finished() const { return finished_; }
-	std::chrono::milliseconds get_last_compute_duration();
-	void reset(dypc_points_buffer buffer, std::size_t output_buffer_capacity_);
+	/**
+	 * Set request for pose predicted at next check, for speculative mode.
+	 * Gets passed to the thread together with the next call to set_request().
+	 */
+	void set_predicted_request(const glm::vec3& position, const glm::vec3& velocity, const glm::quat& orientation, const glm::mat4& view_projection_matrix, float viewport_height);
+	const dypc_loader_request& get_request() const { return request_.request; }
+
+	void set_speculative(bool);
+	bool is_speculative() const { return speculative_; }
 	
+	/**
+	 * Set how far the actual request may be from the predicted one, for the speculative points to be used.
+	 * @param position Maximal distance between camera positions, in the units of the request positions.
+	 * @param orientation Maximal angle between camera orientations, in radiants.
+	 */
+	void set_speculation_tolerance(float position, float orientation);
+	std::size_t get_speculation_hits() const { return speculation_hits_; }
+	std::size_t get_speculation_misses() const { return speculation_misses_; }
+
+	bool new_points_available() const { return output_.has_fresh(); }
+	std::ptrdiff_t rendered_buffer_index() const { return output_.front_index(); } ///< Index of output buffer currently held by renderer.
+	std::ptrdiff_t take_new_points(dypc_points_buffer released_buffer, std::size_t& count);
+	std::chrono::milliseconds get_last_compute_duration() const { return last_compute_duration_; }
+	void reset(const dypc_points_buffer buffers[3], std::size_t capacity);
+
 	bool is_running() const { return thread_.joinable(); }
 	void stop();
 	void start();
 	void update_now();
 };
-	
+
 }
 
 #endif